@@ -3,6 +3,9 @@
  * - pthread.h: 스레드 생성/종료/동기화를 위한 POSIX 표준 라이브러리
  * - sys/time.h: 마이크로초(us) 단위의 정밀한 시간 측정을 위한 gettimeofday 함수 포함
  * - ctype.h: isalnum() 등 문자 판별 함수 포함
+ * - sys/mman.h, sys/stat.h, fcntl.h, unistd.h: mmap 모드 (파일을 복사하지 않고 주소 공간에 매핑)
+ * - dirent.h, errno.h, limits.h, sys/syscall.h, linux/futex.h: 트리 모드 (디렉터리 훑기, 일 없는 스레드 재우기)
+ * - wc_simd.h: 버퍼 안의 단어 수를 SIMD로 세는 커널 (CPU에 맞는 것을 실행 시 고름)
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,8 +13,19 @@
 #include <sys/time.h>
 #include <string.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
-#define MAX_THREADS 16 // 최대 스레드 개수 제한 (안전장치)
+#include "wc_simd.h"
+
+#define MMAP_WINDOW (8L * 1024 * 1024) // mmap 모드에서 한 번에 세고 매핑을 놓아주는 단위 (8MB)
 
 /* * [함수: 시간 차이 계산]
  * 시작 시간(start)과 끝 시간(end)을 받아서 밀리초(ms) 단위로 변환해 반환합니다.
@@ -31,12 +45,13 @@ typedef struct {
     char *buffer;   // [공유 데이터] 파일 내용 전체가 담긴 거대한 메모리 주소 (모든 스레드가 공유함)
     long start;     // [구역 설정] 이 스레드가 검사를 시작할 배열 인덱스
     long end;       // [구역 설정] 이 스레드가 검사를 멈출 배열 인덱스
-    int count;      // [결과 저장] 이 스레드가 찾은 단어 개수를 여기에 적어서 돌려줌
+    long count;     // [결과 저장] 이 스레드가 찾은 단어 개수를 여기에 적어서 돌려줌
+    int mapped;     // [입력 방식] buffer가 mmap한 파일이면 1 (다 센 부분의 페이지를 놓아줌)
 } ThreadArg;
 
-/* [함수: 단어 판별] 알파벳이나 숫자면 참(True) */
+/* [함수: 단어 판별] 알파벳이나 숫자면 참(True). 커널과 같은 기준 */
 int is_word_char(char c) {
-    return isalnum(c);
+    return wc_is_word_char(c);
 }
 
 /* * [스레드 작업 함수: 단어 세기]
@@ -46,91 +61,704 @@ void* count_words(void* arg) {
     // void* 로 받은 짐보따리를 다시 내 구조체 모양으로 캐스팅해서 풂
     ThreadArg* t_arg = (ThreadArg*) arg;
     
-    int in_word = 0; // 상태 플래그 (0: 단어 밖, 1: 단어 안)
-    int count = 0;   // 로컬 카운트
-
-    // 지정된 범위(start ~ end)만 반복
-    for (long i = t_arg->start; i < t_arg->end; i++) {
-        // [공유 메모리 접근] t_arg->buffer는 힙 영역에 있는 거대 배열
-        if (is_word_char(t_arg->buffer[i])) {
-            if (!in_word) { // 공백이었다가 문자가 나오면? -> 단어 시작!
-                count++;
-                in_word = 1;
+    int in_word = 0; // 상태 플래그 (0: 단어 밖, 1: 단어 안). 구역 시작은 항상 단어 밖
+
+    /* * 지정된 범위(start ~ end)만 셉니다.
+     * 바이트마다 "단어 시작인가?"를 분기하는 대신, 64바이트씩 단어 문자 여부를 비트마스크로 만들고
+     * "앞 비트는 0인데 나는 1"인 비트 수를 popcount로 셉니다. (자세한 건 wc_simd.h)
+     */
+    if (!t_arg->mapped) {
+        if (t_arg->end > t_arg->start)
+            t_arg->count = (long)wc_count_words(t_arg->buffer + t_arg->start,
+                                                (size_t)(t_arg->end - t_arg->start), &in_word);
+        else
+            t_arg->count = 0; // 앞 스레드가 경계를 넘어 다 가져간 경우
+        return NULL;
+    }
+
+    /* * [mmap 모드] MMAP_WINDOW씩 끊어서 세고, 다 센 창의 페이지는 MADV_DONTNEED로 내 매핑에서 뗍니다.
+     * in_word를 다음 창에 그대로 넘기므로 창 경계에서 단어가 잘려도 결과는 같습니다.
+     * 떼어낸 페이지는 페이지 캐시에 그대로 남아 있으므로(읽기 전용 매핑이라 버릴 변경 사항도 없음)
+     * 옆 스레드가 경계 근처를 다시 읽어도 캐시에서 다시 붙을 뿐입니다.
+     * -> 프로세스 RSS가 파일 크기가 아니라 "스레드 수 x 창 크기" 정도로 묶입니다.
+     */
+    long page = sysconf(_SC_PAGESIZE);
+    long count = 0;
+    for (long pos = t_arg->start; pos < t_arg->end; ) {
+        long next = pos + MMAP_WINDOW < t_arg->end ? pos + MMAP_WINDOW : t_arg->end;
+        count += (long)wc_count_words(t_arg->buffer + pos, (size_t)(next - pos), &in_word);
+
+        // 창 안에 완전히 들어 있는 페이지만 (madvise는 페이지 정렬된 주소가 필요)
+        long from = (pos + page - 1) / page * page, to = next / page * page;
+        if (to > from) madvise(t_arg->buffer + from, (size_t)(to - from), MADV_DONTNEED);
+        pos = next;
+    }
+    t_arg->count = count;
+    return NULL;
+}
+
+/* * ======================================================================================
+ * [트리 모드 (-r): 디렉터리를 통째로, 파일 수백만 개]
+ * 위의 기본 모드는 파일 하나를 스레드 수만큼 N빵합니다. 로그 디렉터리처럼 작은 파일이 수백만 개이거나
+ * 큰 파일/작은 파일이 섞여 있으면 "미리 똑같이 나누기"가 불가능하므로, 일을 작업(Task)으로 쪼개 두고
+ * 스레드마다 자기 덱(deque)에서 꺼내 쓰다가 비면 남의 덱에서 훔쳐 옵니다. (Work Stealing)
+ *
+ * 작업 종류:
+ * - DIR   : 디렉터리 하나를 읽어서 하위 디렉터리는 DIR 작업으로, 파일은 아래 둘 중 하나로 만듦
+ *           (디렉터리 훑기 자체도 병렬로 퍼짐)
+ * - BATCH : 작은 파일 여러 개 (합쳐서 TREE_BATCH_BYTES / TREE_BATCH_FILES까지). 파일 하나당 작업 하나면
+ *           작업을 만들고 나누는 비용이 세는 비용보다 커지므로 묶음
+ * - CHUNK : 큰 파일(TREE_CHUNK 초과)의 한 조각. 앞 조각의 마지막 1바이트를 같이 읽어 단어 경계를 정하고
+ *           (wc_mt_overlap의 pread 리더와 같은 방식), 파일의 단어 수에 원자적으로 더함
+ *
+ * [덱 (Chase-Lev Work-Stealing Deque)]
+ * - 주인 스레드만 아래쪽(bottom)에 넣고 꺼냄 (LIFO -> 방금 만든 작업은 캐시에 따뜻함, 락 없음)
+ * - 도둑은 위쪽(top)에서 CAS로 하나 가져감 (FIFO -> 오래된 큰 작업, 예: 상위 디렉터리부터 훔침)
+ * - 마지막 하나를 주인과 도둑이 동시에 노릴 때만 CAS로 승부를 냄
+ * - 칸 수는 고정(DEQUE_SIZE). 가득 차면 만든 스레드가 그 자리에서 바로 실행함 (일이 없어지지 않음)
+ *
+ * [끝내기] pending = 만들어졌는데 아직 안 끝난 작업 수. 0이 되면 모든 일이 끝난 것이므로
+ * 그 작업을 끝낸 스레드가 잠든 스레드를 모두 깨우고 다 같이 퇴근합니다.
+ * 일이 없는 스레드는 잠깐 훔치기를 반복하다가 futex로 잠들고, 작업이 덱에 들어올 때 깨어납니다.
+ *
+ * 출력: wc처럼 파일마다 "단어 수 경로" 한 줄 (경로 순으로 정렬), 마지막에 total. 시간/통계는 stderr로.
+ * 심볼릭 링크는 명령줄에 준 것만 따라가고, 디렉터리를 훑다가 만난 것은 건너뜁니다. (find와 같음)
+ * ======================================================================================
+ */
+#define TREE_CHUNK (1L << 20)         // 이보다 큰 파일은 1MB 청크 작업 여러 개로 쪼갬
+#define TREE_BATCH_BYTES (1L << 20)   // 작은 파일 묶음 하나의 최대 크기 (대략)
+#define TREE_BATCH_FILES 64           // 작은 파일 묶음 하나의 최대 파일 수
+#define DEQUE_SIZE 4096               // 스레드별 덱 칸 수 (2의 거듭제곱)
+#define STEAL_SPINS 64                // 잠들기 전에 훔치기를 몇 바퀴 돌아볼지
+#define CACHE_LINE 64
+
+/* [구조체: 파일 기록] 결과 한 줄. 만든 스레드의 목록(recs)에 들어가고 끝나면 메인이 모아서 정렬 */
+typedef struct {
+    char* path;
+    long words; // CHUNK 작업 여러 개가 원자적으로 더함
+    int err;    // 0 또는 errno (열기/읽기 실패)
+} FileRec;
+
+enum { TASK_DIR, TASK_BATCH, TASK_CHUNK };
+
+/* [구조체: 작업] type에 따라 쓰는 칸이 다름. BATCH의 files는 크기만큼 잡음 (flexible array) */
+typedef struct {
+    int type;
+    char* path;         // DIR: 디렉터리 경로
+    FileRec* file;      // CHUNK: 어느 파일의
+    long long off;      //        몇 번째 바이트부터
+    long len;           //        몇 바이트
+    int num_files;      // BATCH: 파일 수
+    FileRec* files[];   //        파일들
+} Task;
+
+/* [구조체: 덱] top은 도둑들이, bottom은 주인이 바꾸므로 캐시 라인을 띄움 */
+typedef struct {
+    long top;
+    char pad0[CACHE_LINE - sizeof(long)];
+    long bottom;
+    char pad1[CACHE_LINE - sizeof(long)];
+    Task* slots[DEQUE_SIZE];
+} Deque;
+
+/* [구조체: 트리 워커] 스레드마다 하나 */
+typedef struct {
+    Deque dq;
+    int id;
+    unsigned rng;          // 훔칠 상대를 고르는 난수 상태
+    char* buf;             // 읽기 버퍼 (1 + TREE_CHUNK)
+    FileRec** recs;        // 이 스레드가 만든 파일 기록들
+    size_t num_recs, cap_recs;
+    long tasks_run, steals; // 통계
+    char pad[CACHE_LINE];   // 다음 워커의 덱 top과 캐시 라인이 겹치지 않게
+} TreeWorker;
+
+static struct {
+    TreeWorker* workers;
+    int num_workers;
+    long pending;     // 만들어졌지만 아직 안 끝난 작업 수
+    char pad0[CACHE_LINE];
+    int work_seq;     // futex: 덱에 작업이 들어올 때(잠든 스레드가 있으면), 모두 끝날 때 증가
+    int idle;         // 잠들어 있는(또는 잠들려는) 스레드 수
+} tree;
+
+/* [매크로: 스핀 대기 힌트] x86의 pause 명령은 스핀 중임을 CPU에 알려 전력/하이퍼스레드 낭비를 줄임 */
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() ((void)0)
+#endif
+
+/* [함수: futex 대기/깨우기] *addr가 아직 expected면 잠들고, 값이 바뀌었으면 바로 돌아옴 */
+static void futex_wait(int* addr, int expected) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void futex_wake(int* addr, int n) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+/* [함수: 덱에 넣기] (주인만) 가득 찼으면 0 */
+static int deque_push(Deque* dq, Task* t) {
+    long b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED);
+    long top = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    if (b - top >= DEQUE_SIZE) return 0;
+    __atomic_store_n(&dq->slots[b & (DEQUE_SIZE - 1)], t, __ATOMIC_RELAXED);
+    __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELEASE); // 작업 내용을 다 쓴 뒤에 보이게
+    return 1;
+}
+
+/* * [함수: 덱에서 꺼내기] (주인만, 아래쪽에서) 비었으면 NULL
+ * bottom을 먼저 줄여서 "이 칸은 내가 가져감"을 알린 뒤 top을 봄. (둘 사이에 SEQ_CST 펜스가 있어야
+ * 도둑과 서로 상대의 변경을 놓치지 않음) 마지막 하나가 남았으면 도둑과 CAS로 승부.
+ */
+static Task* deque_take(Deque* dq) {
+    long b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&dq->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long top = __atomic_load_n(&dq->top, __ATOMIC_RELAXED);
+    if (top > b) { // 비어 있었음
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    Task* t = __atomic_load_n(&dq->slots[b & (DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (top == b) { // 마지막 하나
+        if (!__atomic_compare_exchange_n(&dq->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            t = NULL; // 도둑이 먼저 가져감
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return t;
+}
+
+/* * [함수: 훔치기] (누구나, 위쪽에서)
+ * 반환값: 작업 / NULL = 비어 있음. *contended = 1이면 다른 도둑/주인과 부딪혀서 진 것 (다시 해볼 만함)
+ */
+static Task* deque_steal(Deque* dq, int* contended) {
+    long top = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long b = __atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE);
+    if (top >= b) return NULL;
+    Task* t = __atomic_load_n(&dq->slots[top & (DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&dq->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        *contended = 1;
+        return NULL;
+    }
+    return t;
+}
+
+static void tree_run(TreeWorker* w, Task* t);
+
+/* * [함수: 작업 내놓기] pending을 먼저 올리고 내 덱에 넣음. 덱이 가득 찼으면 그 자리에서 실행.
+ * 잠든 스레드가 있을 때만 깨움 (잠드는 쪽은 "seq 읽기 -> idle 증가 -> 다시 훔쳐 보기 -> 잠듦" 순서라
+ * 엇갈려도 다시 훔쳐 보기에서 찾거나 futex가 바뀐 seq를 보고 바로 돌아옴)
+ */
+static void tree_spawn(TreeWorker* w, Task* t) {
+    __atomic_add_fetch(&tree.pending, 1, __ATOMIC_SEQ_CST);
+    if (!deque_push(&w->dq, t)) {
+        tree_run(w, t);
+        return;
+    }
+    // deque_push의 bottom 저장(release)이 idle 읽기보다 뒤로 밀리면, 막 잠들려는 워커는 빈 덱을 보고
+    // 우리는 idle == 0을 봐서 아무도 안 깨움 -> 저장-읽기 순서를 펜스로 고정 (deque_take와 같은 이유)
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&tree.idle, __ATOMIC_SEQ_CST) > 0) {
+        __atomic_add_fetch(&tree.work_seq, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&tree.work_seq, 1);
+    }
+}
+
+/* [함수: 작업 하나 끝] 마지막 작업이었으면 모두 깨워서 퇴근시킴 */
+static void tree_task_done(void) {
+    if (__atomic_sub_fetch(&tree.pending, 1, __ATOMIC_SEQ_CST) == 0) {
+        __atomic_add_fetch(&tree.work_seq, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&tree.work_seq, INT_MAX);
+    }
+}
+
+/* [함수: 파일 기록 만들기] 경로(path)의 주인이 기록으로 넘어감 */
+static FileRec* tree_new_rec(TreeWorker* w, char* path) {
+    if (w->num_recs == w->cap_recs) {
+        w->cap_recs = w->cap_recs ? w->cap_recs * 2 : 1024;
+        w->recs = realloc(w->recs, w->cap_recs * sizeof(FileRec*));
+        if (!w->recs) { perror("realloc"); exit(1); }
+    }
+    FileRec* r = calloc(1, sizeof(FileRec));
+    if (!r) { perror("calloc"); exit(1); }
+    r->path = path;
+    w->recs[w->num_recs++] = r;
+    return r;
+}
+
+static Task* tree_new_task(int type, int max_files) {
+    Task* t = calloc(1, sizeof(Task) + (size_t)max_files * sizeof(FileRec*));
+    if (!t) { perror("calloc"); exit(1); }
+    t->type = type;
+    return t;
+}
+
+/* * [함수: 파일 하나 등록] 큰 파일은 바로 청크 작업들로, 작은 파일은 *batch에 담고 차면 내놓음
+ * batch, batch_bytes는 부르는 쪽(디렉터리 하나, 또는 명령줄)이 들고 있다가 끝에 tree_flush_batch
+ */
+static void tree_add_file(TreeWorker* w, char* path, long long size, Task** batch, long long* batch_bytes) {
+    FileRec* r = tree_new_rec(w, path);
+    if (size > TREE_CHUNK) {
+        for (long long off = 0; off < size; off += TREE_CHUNK) {
+            Task* t = tree_new_task(TASK_CHUNK, 0);
+            t->file = r;
+            t->off = off;
+            t->len = size - off < TREE_CHUNK ? (long)(size - off) : TREE_CHUNK;
+            tree_spawn(w, t);
+        }
+        return;
+    }
+    if (!*batch) {
+        *batch = tree_new_task(TASK_BATCH, TREE_BATCH_FILES);
+        *batch_bytes = 0;
+    }
+    (*batch)->files[(*batch)->num_files++] = r;
+    *batch_bytes += size;
+    if ((*batch)->num_files == TREE_BATCH_FILES || *batch_bytes >= TREE_BATCH_BYTES) {
+        tree_spawn(w, *batch);
+        *batch = NULL;
+    }
+}
+
+static void tree_flush_batch(TreeWorker* w, Task** batch) {
+    if (*batch) tree_spawn(w, *batch);
+    *batch = NULL;
+}
+
+/* [함수: 경로 잇기] "dir" + "name" -> "dir/name" (dir이 '/'로 끝나면 그대로 붙임) */
+static char* path_join(const char* dir, const char* name) {
+    size_t dl = strlen(dir), nl = strlen(name);
+    int slash = dl > 0 && dir[dl - 1] != '/';
+    char* p = malloc(dl + slash + nl + 1);
+    if (!p) { perror("malloc"); exit(1); }
+    memcpy(p, dir, dl);
+    if (slash) p[dl] = '/';
+    memcpy(p + dl + slash, name, nl + 1);
+    return p;
+}
+
+/* [작업: DIR] 하위 디렉터리는 새 DIR 작업, 일반 파일은 등록. 링크/장치/소켓 등은 건너뜀 */
+static void tree_run_dir(TreeWorker* w, Task* t) {
+    DIR* d = opendir(t->path);
+    if (!d) {
+        tree_new_rec(w, t->path)->err = errno; // 에러도 결과 줄로 (경로 주인이 기록으로 넘어감)
+        return;
+    }
+    Task* batch = NULL;
+    long long batch_bytes = 0;
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        if (de->d_type == DT_DIR) {
+            Task* sub = tree_new_task(TASK_DIR, 0);
+            sub->path = path_join(t->path, de->d_name);
+            tree_spawn(w, sub);
+            continue;
+        }
+        if (de->d_type != DT_REG && de->d_type != DT_UNKNOWN) continue;
+
+        // 크기가 필요하므로 stat 한 번 (d_type을 안 주는 파일시스템이면 종류도 여기서)
+        struct stat st;
+        if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+            tree_new_rec(w, path_join(t->path, de->d_name))->err = errno;
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            Task* sub = tree_new_task(TASK_DIR, 0);
+            sub->path = path_join(t->path, de->d_name);
+            tree_spawn(w, sub);
+        } else if (S_ISREG(st.st_mode)) {
+            tree_add_file(w, path_join(t->path, de->d_name), st.st_size, &batch, &batch_bytes);
+        }
+    }
+    closedir(d);
+    tree_flush_batch(w, &batch);
+    free(t->path);
+}
+
+/* [작업: BATCH] 파일마다 열어서 TREE_CHUNK씩 읽으며 셈 (in_word를 다음 읽기로 넘김) */
+static void tree_run_batch(TreeWorker* w, Task* t) {
+    for (int i = 0; i < t->num_files; i++) {
+        FileRec* r = t->files[i];
+        int fd = open(r->path, O_RDONLY);
+        if (fd < 0) {
+            r->err = errno;
+            continue;
+        }
+        int in_word = 0;
+        long words = 0;
+        ssize_t n;
+        while ((n = read(fd, w->buf, TREE_CHUNK)) != 0) {
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                r->err = errno;
+                break;
             }
-        } else {
-            in_word = 0; // 공백이나 특수문자가 나오면 -> 단어 끝
+            words += (long)wc_count_words(w->buf, (size_t)n, &in_word);
         }
+        close(fd);
+        r->words = words;
     }
+}
 
-    // 결과 저장 (메인 스레드가 나중에 읽어갈 것임)
-    t_arg->count = count;
+/* [작업: CHUNK] 앞 청크의 마지막 1바이트 + 내 구역을 pread. 그 1바이트로 시작 상태(in_word)를 정함 */
+static void tree_run_chunk(TreeWorker* w, Task* t) {
+    FileRec* r = t->file;
+    int fd = open(r->path, O_RDONLY);
+    if (fd < 0) {
+        __atomic_store_n(&r->err, errno, __ATOMIC_RELAXED);
+        return;
+    }
+    int lead = t->off > 0;
+    size_t want = (size_t)t->len + lead, got = 0;
+    while (got < want) {
+        ssize_t n = pread(fd, w->buf + got, want - got, (off_t)(t->off - lead + (long long)got));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            __atomic_store_n(&r->err, errno, __ATOMIC_RELAXED);
+            break;
+        }
+        if (n == 0) break; // 세는 사이에 파일이 줄어듦 -> 있는 만큼만
+        got += (size_t)n;
+    }
+    close(fd);
+    if (got <= (size_t)lead) return;
+    int in_word = lead && is_word_char(w->buf[0]);
+    long words = (long)wc_count_words(w->buf + lead, got - lead, &in_word);
+    __atomic_add_fetch(&r->words, words, __ATOMIC_RELAXED);
+}
+
+/* [함수: 작업 실행] 끝나면 작업을 풀고 pending을 내림 */
+static void tree_run(TreeWorker* w, Task* t) {
+    switch (t->type) {
+    case TASK_DIR:   tree_run_dir(w, t); break;
+    case TASK_BATCH: tree_run_batch(w, t); break;
+    case TASK_CHUNK: tree_run_chunk(w, t); break;
+    }
+    free(t);
+    w->tasks_run++;
+    tree_task_done();
+}
+
+/* [함수: 훔치기 한 바퀴] 무작위 상대부터 모두 한 번씩. 부딪혀서 진 곳이 있으면 한 바퀴 더 */
+static Task* tree_steal(TreeWorker* w) {
+    int n = tree.num_workers;
+    for (int round = 0; round < 2; round++) {
+        int contended = 0;
+        w->rng = w->rng * 1103515245u + 12345u;
+        int start = (int)((w->rng >> 16) % (unsigned)n);
+        for (int k = 0; k < n; k++) {
+            int v = (start + k) % n;
+            if (v == w->id) continue;
+            Task* t = deque_steal(&tree.workers[v].dq, &contended);
+            if (t) {
+                w->steals++;
+                return t;
+            }
+        }
+        if (!contended) break;
+    }
     return NULL;
 }
 
+/* [스레드 함수: 트리 워커] 내 덱 -> 훔치기 -> 잠깐 더 훔쳐 보기 -> 잠듦. pending이 0이면 퇴근 */
+static void* tree_worker(void* arg) {
+    TreeWorker* w = (TreeWorker*)arg;
+    for (;;) {
+        Task* t = deque_take(&w->dq);
+        for (int spin = 0; !t && spin < STEAL_SPINS; spin++) {
+            t = tree_steal(w);
+            if (!t) {
+                if (__atomic_load_n(&tree.pending, __ATOMIC_SEQ_CST) == 0) return NULL;
+                cpu_relax();
+            }
+        }
+        if (t) {
+            tree_run(w, t);
+            continue;
+        }
+
+        int seq = __atomic_load_n(&tree.work_seq, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&tree.idle, 1, __ATOMIC_SEQ_CST);
+        t = tree_steal(w);
+        if (!t && __atomic_load_n(&tree.pending, __ATOMIC_SEQ_CST) > 0) futex_wait(&tree.work_seq, seq);
+        __atomic_sub_fetch(&tree.idle, 1, __ATOMIC_SEQ_CST);
+        if (t) tree_run(w, t);
+        else if (__atomic_load_n(&tree.pending, __ATOMIC_SEQ_CST) == 0) return NULL;
+    }
+}
+
+static int rec_cmp(const void* a, const void* b) {
+    return strcmp((*(FileRec* const*)a)->path, (*(FileRec* const*)b)->path);
+}
+
+/* * [함수: 트리 모드 본체] paths를 모두 세서 wc처럼 출력. 에러가 하나라도 있으면 1
+ * 명령줄의 경로는 메인(= 워커 0)이 등록하고, 나머지 워커들은 처음에 훔쳐 가면서 일이 퍼집니다.
+ */
+static int tree_main(const char* prog, char** paths, int num_paths, int num_threads) {
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+
+    tree.num_workers = num_threads;
+    if (posix_memalign((void**)&tree.workers, CACHE_LINE, sizeof(TreeWorker) * (size_t)num_threads) != 0) {
+        perror("posix_memalign");
+        return 1;
+    }
+    memset(tree.workers, 0, sizeof(TreeWorker) * (size_t)num_threads);
+    for (int i = 0; i < num_threads; i++) {
+        tree.workers[i].id = i;
+        tree.workers[i].rng = (unsigned)i * 2654435761u + 1;
+        tree.workers[i].buf = malloc(1 + TREE_CHUNK);
+        if (!tree.workers[i].buf) { perror("malloc"); return 1; }
+    }
+
+    // 명령줄 경로 등록 (심볼릭 링크는 따라감)
+    TreeWorker* w0 = &tree.workers[0];
+    Task* batch = NULL;
+    long long batch_bytes = 0;
+    for (int i = 0; i < num_paths; i++) {
+        struct stat st;
+        char* path = strdup(paths[i]);
+        if (!path) { perror("strdup"); return 1; }
+        if (stat(path, &st) < 0) {
+            tree_new_rec(w0, path)->err = errno;
+        } else if (S_ISDIR(st.st_mode)) {
+            Task* t = tree_new_task(TASK_DIR, 0);
+            t->path = path;
+            tree_spawn(w0, t);
+        } else {
+            tree_add_file(w0, path, st.st_size, &batch, &batch_bytes);
+        }
+    }
+    tree_flush_batch(w0, &batch);
+
+    // 워커 1..n-1 시작, 메인은 워커 0으로 일함
+    pthread_t* threads = calloc((size_t)num_threads, sizeof(pthread_t));
+    if (!threads) { perror("calloc"); return 1; }
+    for (int i = 1; i < num_threads; i++) {
+        if (pthread_create(&threads[i], NULL, tree_worker, &tree.workers[i]) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    tree_worker(w0);
+    for (int i = 1; i < num_threads; i++) pthread_join(threads[i], NULL);
+    gettimeofday(&end, NULL);
+
+    // [결과 취합] 스레드마다 모아 둔 기록을 하나로 -> 경로 순 정렬 -> 출력
+    size_t total_recs = 0;
+    for (int i = 0; i < num_threads; i++) total_recs += tree.workers[i].num_recs;
+    FileRec** all = malloc((total_recs ? total_recs : 1) * sizeof(FileRec*));
+    if (!all) { perror("malloc"); return 1; }
+    size_t k = 0;
+    long tasks = 0, steals = 0;
+    for (int i = 0; i < num_threads; i++) {
+        TreeWorker* w = &tree.workers[i];
+        memcpy(all + k, w->recs, w->num_recs * sizeof(FileRec*));
+        k += w->num_recs;
+        tasks += w->tasks_run;
+        steals += w->steals;
+    }
+    qsort(all, total_recs, sizeof(FileRec*), rec_cmp);
+
+    long total = 0, files = 0;
+    int status = 0;
+    for (size_t i = 0; i < total_recs; i++) {
+        FileRec* r = all[i];
+        if (r->err) {
+            fprintf(stderr, "%s: %s: %s\n", prog, r->path, strerror(r->err));
+            status = 1;
+        } else {
+            printf("%8ld %s\n", r->words, r->path);
+            total += r->words;
+            files++;
+        }
+        free(r->path);
+        free(r);
+    }
+    printf("%8ld total\n", total);
+
+    fprintf(stderr, "Elapsed time (total): %.2f ms\n", time_diff_ms(start, end));
+    fprintf(stderr, " Files: %ld, tasks: %ld, steals: %ld, threads: %d\n", files, tasks, steals, num_threads);
+    fprintf(stderr, " Kernel: %s\n", wc_kernel->name);
+
+    for (int i = 0; i < num_threads; i++) {
+        free(tree.workers[i].buf);
+        free(tree.workers[i].recs);
+    }
+    free(tree.workers);
+    free(threads);
+    free(all);
+    return status;
+}
+
+/* * [함수: 스레드 수 해석]
+ * "auto"(또는 0)면 이 머신에서 쓸 수 있는 CPU 수. 예전에는 16개로 막아 뒀지만, 코어가 더 많은 머신에서
+ * 손해이므로 배열을 스레드 수만큼 잡고 상한을 없앴습니다. 잘못된 값이면 0.
+ */
+static int parse_threads(const char* s) {
+    if (strcmp(s, "auto") == 0 || strcmp(s, "0") == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        return n > 0 ? (int)n : 1;
+    }
+    int n = atoi(s);
+    return n > 0 ? n : 0;
+}
+
 int main(int argc, char* argv[]) {
+    // [자체 검사] SIMD 커널들이 스칼라 버전과 같은 답을 내는지 확인만 하고 끝냄
+    if (argc == 2 && strcmp(argv[1], "--selftest") == 0)
+        return wc_simd_selftest() ? 1 : 0;
+
+    // [트리 모드] wc_mt -r [-t 스레드 수] 경로...
+    if (argc >= 2 && strcmp(argv[1], "-r") == 0) {
+        int arg = 2;
+        int num_threads = parse_threads("auto");
+        if (arg + 1 < argc && strcmp(argv[arg], "-t") == 0) {
+            num_threads = parse_threads(argv[arg + 1]);
+            arg += 2;
+        }
+        if (num_threads <= 0 || arg >= argc) {
+            printf("Usage: %s -r [-t <num_threads|auto>] <path>...\n", argv[0]);
+            return 1;
+        }
+        wc_simd_init();
+        return tree_main(argv[0], argv + arg, argc - arg, num_threads);
+    }
+
     // 인자 체크
-    if (argc != 3) {
-        printf("Usage: %s <filename> <num_threads>\n", argv[0]);
+    if (argc != 3 && argc != 4) {
+        printf("Usage: %s <filename> <num_threads|auto> [read|mmap]\n", argv[0]);
+        printf("       %s -r [-t <num_threads|auto>] <path>...\n", argv[0]);
+        printf("       %s --selftest\n", argv[0]);
         return 1;
     }
+    wc_simd_init(); // 이 CPU에서 쓸 단어 세기 커널 고르기 (WC_SIMD 환경 변수로 강제 가능)
 
     // [전체 시간 측정 시작]
     struct timeval total_start, total_end;
     gettimeofday(&total_start, NULL);
 
     char* filename = argv[1];
-    int num_threads = atoi(argv[2]); // 스레드 개수 파싱
+    int num_threads = parse_threads(argv[2]); // 스레드 개수 파싱 ("auto"면 CPU 수)
+    int use_mmap = 0;                // 입력 방식 (기본: read = 통째로 malloc + fread)
 
-    if (num_threads <= 0 || num_threads > MAX_THREADS) {
-        printf("Thread count must be between 1 and %d\n", MAX_THREADS);
-        return 1;
+    if (argc == 4) {
+        if (strcmp(argv[3], "mmap") == 0) {
+            use_mmap = 1;
+        } else if (strcmp(argv[3], "read") != 0) {
+            printf("Unknown input mode: %s (use read or mmap)\n", argv[3]);
+            return 1;
+        }
     }
 
-    FILE* fp = fopen(filename, "r");
-    if (!fp) {
-        perror("fopen");
+    if (num_threads <= 0) {
+        printf("Thread count must be a positive number or auto\n");
         return 1;
     }
 
-    /* * [파일 크기 구하기]
-     * 파일을 열자마자 끝(SEEK_END)으로 점프해서 위치(ftell)를 알아내면 그게 파일 크기입니다.
-     * 그리고 다시 처음(SEEK_SET)으로 돌아옵니다.
-     */
-    fseek(fp, 0, SEEK_END);
-    long size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
+    long size;
+    char* buffer;
 
     // [I/O 시간 측정 시작]
     struct timeval io_start, io_end;
-    gettimeofday(&io_start, NULL);
 
-    /* * [메모리 통째로 할당 (Load All Strategy)]
-     * 파일 크기만큼 힙 메모리를 할당합니다.
-     * 주의: 파일이 RAM보다 크면(예: 100GB) 이 방식은 컴퓨터를 뻗게 만듭니다. (OOM Kill 발생)
-     * 하지만 파일이 적당하다면 가장 빠른 방식 중 하나입니다.
-     */
-    char* buffer = malloc(size + 1);
-    
-    // 파일 내용을 한 방에 메모리로 복사 (Disk -> RAM)
-    // 이 부분이 프로그램 실행 시간의 대부분을 차지할 가능성이 큽니다 (I/O Bottleneck).
-    fread(buffer, 1, size, fp);
-    buffer[size] = '\0'; // 문자열 끝 처리 (Null-terminate)
+    if (!use_mmap) {
+        FILE* fp = fopen(filename, "r");
+        if (!fp) {
+            perror("fopen");
+            return 1;
+        }
+
+        /* * [파일 크기 구하기]
+         * 파일을 열자마자 끝(SEEK_END)으로 점프해서 위치(ftell)를 알아내면 그게 파일 크기입니다.
+         * 그리고 다시 처음(SEEK_SET)으로 돌아옵니다.
+         */
+        fseek(fp, 0, SEEK_END);
+        size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+
+        gettimeofday(&io_start, NULL);
+
+        /* * [메모리 통째로 할당 (Load All Strategy)]
+         * 파일 크기만큼 힙 메모리를 할당합니다.
+         * 주의: 파일이 RAM보다 크면(예: 100GB) 이 방식은 컴퓨터를 뻗게 만듭니다. (OOM Kill 발생)
+         * 하지만 파일이 적당하다면 가장 빠른 방식 중 하나입니다.
+         */
+        buffer = malloc(size + 1);
+
+        // 파일 내용을 한 방에 메모리로 복사 (Disk -> RAM)
+        // 이 부분이 프로그램 실행 시간의 대부분을 차지할 가능성이 큽니다 (I/O Bottleneck).
+        fread(buffer, 1, size, fp);
+        buffer[size] = '\0'; // 문자열 끝 처리 (Null-terminate)
+
+        gettimeofday(&io_end, NULL); // I/O 끝
+        fclose(fp);
+    } else {
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0) {
+            perror("open");
+            return 1;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            perror("fstat");
+            return 1;
+        }
+        size = (long)st.st_size;
 
-    gettimeofday(&io_end, NULL); // I/O 끝
-    fclose(fp);
+        gettimeofday(&io_start, NULL);
+
+        /* * [파일 매핑 (mmap, Zero-Copy)]
+         * 파일을 복사하지 않고 페이지 캐시를 그대로 내 주소 공간에 붙입니다. 여기서는 읽기가 일어나지 않아
+         * 파일 크기와 상관없이 금방 끝나고(O(1)), 실제 디스크 읽기는 스레드들이 자기 구역을 처음 건드릴 때
+         * (페이지 폴트) 각자 병렬로 일어납니다.
+         * - 힙에 사본을 만들지 않으므로 RAM보다 큰 파일도 셀 수 있습니다. 매핑된 페이지는 페이지 캐시라서
+         *   메모리가 부족하면 커널이 그냥 버렸다가 다시 읽습니다. (OOM이 아님)
+         *   게다가 스레드들이 다 센 부분은 매핑에서 떼어내므로 RSS도 파일 크기만큼 커지지 않습니다. (count_words)
+         * - MADV_SEQUENTIAL: 앞에서부터 차례로 읽는다고 알려서 미리 읽기(readahead)를 크게, 지나간 페이지는
+         *   먼저 버리게 함
+         * - MADV_HUGEPAGE: 지원되면(예: tmpfs) 2MB 페이지로 매핑해서 페이지 폴트/TLB 미스를 줄임.
+         *   일반 파일시스템에서는 거절될 수 있는데 그래도 동작에는 문제없으므로 결과를 무시합니다.
+         * - 크기 0인 파일은 매핑할 수 없으므로(EINVAL) 빈 버퍼로 둡니다.
+         */
+        buffer = NULL;
+        if (size > 0) {
+            buffer = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (buffer == MAP_FAILED) {
+                perror("mmap");
+                return 1;
+            }
+            madvise(buffer, (size_t)size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+            madvise(buffer, (size_t)size, MADV_HUGEPAGE);
+#endif
+        }
+        close(fd); // 매핑은 fd를 닫아도 유지됨
+
+        gettimeofday(&io_end, NULL); // I/O 끝 (매핑만 했으므로 읽기는 아래 스레드들이 함)
+    }
 
     // [단어 세기(Computation) 시간 측정 시작]
     struct timeval wc_start, wc_end;
     gettimeofday(&wc_start, NULL);
 
-    pthread_t threads[MAX_THREADS]; // 스레드 ID 배열
-    ThreadArg args[MAX_THREADS];    // 각 스레드에게 줄 인자 배열
+    pthread_t* threads = calloc((size_t)num_threads, sizeof(pthread_t)); // 스레드 ID 배열
+    ThreadArg* args = calloc((size_t)num_threads, sizeof(ThreadArg));    // 각 스레드에게 줄 인자 배열
+    if (!threads || !args) {
+        perror("calloc");
+        return 1;
+    }
     
     // [구역 나누기] 전체 크기를 스레드 수로 나눔 (N빵)
     long block = size / num_threads;
 
     for (int i = 0; i < num_threads; i++) {
         args[i].buffer = buffer; // 모든 스레드가 같은 버퍼(책)를 봅니다.
+        args[i].mapped = use_mmap;
         
         // [기본 구역 설정]
         args[i].start = i * block;
@@ -171,18 +799,25 @@ int main(int argc, char* argv[]) {
          */
 
         // 스레드 생성 (일 시작!)
-        pthread_create(&threads[i], NULL, count_words, &args[i]);
+        if (pthread_create(&threads[i], NULL, count_words, &args[i]) != 0) {
+            fprintf(stderr, "pthread_create failed (too many threads?)\n");
+            return 1;
+        }
     }
 
     // [결과 취합 (Reduce)]
-    int total = 0;
+    long total = 0; // 2^31 단어(수 GB 파일)를 넘어도 안 넘치게
     for (int i = 0; i < num_threads; i++) {
         pthread_join(threads[i], NULL); // 스레드가 퇴근할 때까지 대기
         total += args[i].count;         // 각자 세온 단어 수를 합산
     }
 
     gettimeofday(&wc_end, NULL); // 계산 끝
-    free(buffer); // 메모리 해제
+    free(threads);
+    free(args);
+    // 메모리 해제 (mmap 모드면 매핑 해제)
+    if (!use_mmap) free(buffer);
+    else if (buffer) munmap(buffer, (size_t)size);
 
     gettimeofday(&total_end, NULL); // 전체 끝
 
@@ -192,10 +827,13 @@ int main(int argc, char* argv[]) {
     double total_time = time_diff_ms(total_start, total_end);
 
     // 결과 출력
-    printf("Total words: %d\n", total);
+    printf("Total words: %ld\n", total);
     printf("Elapsed time (total): %.2f ms\n", total_time);
-    printf(" I/O time: %.2f ms\n", io_time);          // 파일 읽는 시간
+    printf(" I/O time: %.2f ms\n", io_time);          // 파일 읽는 시간 (mmap 모드면 매핑만 하는 시간)
     printf(" Word count time: %.2f ms\n", wc_time);   // 실제 스레드들이 일한 시간
+    printf(" Input: %s\n", use_mmap ? "mmap" : "read");
+    printf(" Threads: %d\n", num_threads);
+    printf(" Kernel: %s\n", wc_kernel->name);          // 단어 세기에 쓴 커널 (avx512/avx2/sse2/scalar)
 
     return 0;
 }
\ No newline at end of file
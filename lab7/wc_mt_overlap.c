@@ -1,235 +1,465 @@
 /* ==========================================================================
  * [헤더 파일 포함]
- * - stdio.h: 입출력 함수 (printf, fopen, fclose 등)
+ * - stdio.h: 입출력 함수 (printf, perror 등)
  * - stdlib.h: 메모리 할당/해제 (malloc, free), 프로세스 종료 (exit), 변환 (atoi)
- * - pthread.h: POSIX 스레드 라이브러리 (스레드 생성, 뮤텍스, 조건변수 등 핵심!)
- * - string.h: 문자열 처리 (사실 이 코드에선 크게 안 쓰임, 습관적으로 포함된 듯)
+ * - pthread.h: POSIX 스레드 라이브러리 (스레드 생성/종료)
+ * - string.h: 문자열 처리 (strcmp)
  * - ctype.h: 문자 타입 검사 (isalnum - 알파벳/숫자인지 확인)
  * - sys/time.h: 시간 측정 (gettimeofday - 성능 테스트용)
+ * - unistd.h, sys/syscall.h, linux/futex.h: 큐가 비었을 때/청크가 모자랄 때 잠들고 깨우는 futex
+ * - fcntl.h, sys/stat.h, errno.h: 파일 열기/크기 (open, fstat), 여러 리더의 pread
+ * - wc_simd.h: 청크 안의 단어 수를 SIMD로 세는 커널 (CPU에 맞는 것을 실행 시 고름)
  * ========================================================================== */
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
 #include <sys/time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "wc_simd.h"
 
 /* [상수 정의 (매크로)] */
 #define CHUNK_SIZE (64*1024)   // 64KB. 파일에서 한 번에 읽어올 데이터의 크기. (I/O 효율성 때문)
-#define BUFFER_CAPACITY 64     // 생산자와 소비자가 공유하는 큐(버퍼)의 최대 크기 (슬롯 개수)
-#define MAX_CONSUMERS 32       // 최대 생성 가능한 소비자 스레드 개수 제한
+#define BUFFER_CAPACITY 64     // 리더들이 미리 읽어 둘 수 있는 청크 수 (큐 깊이)
+#define DEFAULT_READERS 4      // 리더 수를 안 주면 (NVMe는 동시에 여러 요청이 걸려 있어야 제 속도가 남)
+#define CACHE_LINE 64
 
 /* * [구조체: Chunk]
  * 파일의 일부분(조각)을 담아서 소비자에게 전달하기 위한 택배 상자 같은 존재입니다.
+ * 상자는 시작할 때 pool_size개를 한꺼번에 만들어 두고 계속 돌려씁니다. (청크 풀)
  */
 typedef struct {
-    char* data;             // 실제 텍스트 데이터가 담긴 힙 메모리 주소 (malloc으로 할당됨)
+    char* buf;              // 풀을 만들 때 잡아 둔 공간 (1 + CHUNK_SIZE 바이트, 맨 앞 1바이트는 앞 청크의 끝)
+    char* data;             // 실제로 셀 텍스트의 시작 (buf 또는 buf + 1)
     size_t size;            // 이 조각의 데이터 크기 (바이트 단위)
     int starts_inside_word; // (중요) 이 조각이 단어 중간부터 시작하는지 여부.
                             // 예: 이전 청크가 "Ap"로 끝났고 이번이 "ple"로 시작하면 1.
-                            // 다만, 아래 생산자 로직을 보면 단어를 끊지 않고 가져오도록 구현되어 있어 
-                            // 실제로는 항상 0일 가능성이 높음 (방어적 코딩).
+                            // 청크는 파일을 CHUNK_SIZE씩 기계적으로 자른 것이라 단어 중간에서 잘리는 게 보통이고,
+                            // 리더가 앞 청크의 마지막 바이트를 같이 읽어서 이 값을 정합니다.
 } Chunk;
 
 /* ==========================================================================
- * [전역 변수 - 공유 자원]
- * 모든 스레드가 이 변수들을 공유하므로, 접근 시 반드시 동기화(Lock)가 필요합니다.
+ * [공유 자원: 청크 풀 + 락 없는 링 두 개]
+ * 예전에는 청크마다 malloc/free를 하고, 주고받을 때마다 전역 뮤텍스 하나와 조건변수 두 개를 거쳤고,
+ * 단어 수 합산(total_word_count)도 같은 뮤텍스 안에서 했습니다. 소비자가 많아지면 모두가
+ * 자물쇠 하나 앞에 줄을 서서, 단어를 세는 속도가 아니라 자물쇠가 전체 속도의 천장이 됩니다.
+ *
+ * 지금은:
+ * - 청크 풀: 상자 pool_size개(큐 깊이 + 리더 수 + 소비자 수)를 미리 만들어 두고
+ *   번호(인덱스)로만 주고받음 (malloc/free 없음)
+ * - full 링 : 리더(생산자) -> 소비자. 채운 청크 번호
+ * - free 링 : 소비자 -> 리더. 다 센 청크 번호를 돌려줌
+ * - 두 링 모두 락 없이 CAS만 쓰는 원형 큐(Vyukov 방식, lab8 webserver-mt의 작업 큐와 같은 구조)
+ *   칸마다 sequence 번호가 있어서 "이 칸이 지금 쓸 차례인지/읽을 차례인지"를 알려줌.
+ *   넣는 쪽/꺼내는 쪽 모두 여럿이어도 됨 (리더가 1개면 그쪽 CAS는 항상 첫 번에 성공)
+ * - 링 칸 수가 pool_size 이상(2의 거듭제곱)이라 넣기는 절대 실패하지 않음 (청크가 그보다 많이 존재하지 않음)
+ * - 단어 수: 소비자마다 자기 칸에 세고, 메인이 join한 뒤에 더함 (세는 동안 공유 쓰기 없음)
  * ========================================================================== */
-Chunk buffer[BUFFER_CAPACITY]; // 원형 큐(Circular Queue)로 사용될 버퍼 배열
-int in = 0;                    // 생산자가 데이터를 넣을 인덱스 (Head)
-int out = 0;                   // 소비자가 데이터를 꺼낼 인덱스 (Tail)
-int count = 0;                 // 현재 버퍼에 차 있는 데이터 개수
-
-int total_word_count = 0;      // [최종 결과] 모든 스레드가 합산한 총 단어 수
-int num_consumers = 1;         // 실행 시 입력받을 소비자 스레드 개수
-int is_done = 0;               // 생산자가 "나 일 다 끝났어(파일 다 읽음)"라고 알리는 플래그
-
-/* * [동기화 객체]
- * - mutex: 공유 자원(위의 전역 변수들)을 한 번에 하나의 스레드만 건드리게 하는 자물쇠
- * - not_empty: "버퍼가 비어있지 않음"을 알리는 신호 (소비자가 대기할 때 사용)
- * - not_full: "버퍼가 가득 차지 않음"을 알리는 신호 (생산자가 대기할 때 사용)
+typedef struct {
+    size_t seq; // 이 칸의 순번 (원자적으로 읽고 씀)
+    int idx;    // 담긴 청크 번호
+} RingSlot;
+
+/* 자주 바뀌는 변수끼리 같은 캐시 라인에 있으면 코어끼리 라인을 뺏고 뺏기므로(False Sharing) 64바이트씩 띄움 */
+typedef struct {
+    RingSlot* slots;          // 칸 배열 (크기는 2의 거듭제곱 -> % 대신 & mask)
+    size_t mask;
+    char pad0[CACHE_LINE];
+    size_t enqueue_pos;       // 다음에 넣을 위치
+    char pad1[CACHE_LINE - sizeof(size_t)];
+    size_t dequeue_pos;       // 다음에 꺼낼 위치
+    char pad2[CACHE_LINE - sizeof(size_t)];
+} Ring;
+
+Chunk* pool;           // 청크 풀 (상자 자체는 움직이지 않고 번호만 링을 오감)
+int pool_size;
+Ring full_ring;        // 생산자 -> 소비자
+Ring free_ring;        // 소비자 -> 생산자
+
+int num_consumers = 1; // 실행 시 입력받을 소비자 스레드 개수
+int is_done = 0;       // 마지막 리더가 "다 끝났어(파일 다 읽음)"라고 알리는 플래그 (원자적으로 읽고 씀)
+
+/* * [리더(생산자) 공유 상태]
+ * 파일을 CHUNK_SIZE씩 자른 청크 번호 k의 위치는 k * CHUNK_SIZE로 미리 정해져 있으므로,
+ * 리더들은 다음 번호(next_chunk)를 원자적으로 하나씩 가져가서 서로 기다리지 않고 pread합니다.
+ */
+struct {
+    int fd;           // 읽을 파일
+    int seekable;     // 일반 파일이면 1 (pread 가능). 파이프 등이면 0 -> 리더 1개가 read로 차례대로
+    long long size;   // 파일 크기 (seekable일 때)
+    long num_chunks;  // 청크 개수 (seekable일 때)
+    long next_chunk;  // 다음에 가져갈 청크 번호 (리더들이 원자적으로 증가)
+    int readers_left; // 아직 일하는 리더 수 (0이 되는 리더가 is_done을 켬)
+    char last_byte;   // seekable이 아닐 때: 지금까지 읽은 마지막 바이트 (리더 1개만 씀)
+} input;
+
+/* * [잠들기/깨우기용 futex 변수]
+ * 링이 비거나 청크가 모자랄 때 계속 돌면(spin) CPU를 태우므로, 잠깐 돌아본 뒤 futex로 잠듭니다.
+ * 깨우는 쪽은 잠든 스레드가 있을 때만 시스템 콜을 씁니다.
  */
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t not_empty = PTHREAD_COND_INITIALIZER;
-pthread_cond_t not_full = PTHREAD_COND_INITIALIZER;
+struct {
+    int work_seq;             // 소비자 futex: 생산자가 청크를 넣을 때(그리고 끝날 때) 증가
+    int idle_consumers;       // 잠들어 있는(또는 잠들려는) 소비자 수
+    char pad0[CACHE_LINE - 2 * sizeof(int)];
+    int space_seq;            // 리더 futex: 소비자가 청크를 돌려줄 때마다 증가
+    int blocked_producers;    // 빈 청크를 기다리며 잠든 리더 수
+} waiters;
+
+/* * [구조체: 소비자 인자/결과]
+ * 소비자마다 자기 단어 수를 따로 적습니다. 배열로 붙어 있으므로 캐시 라인 하나씩 차지하게 띄움.
+ */
+typedef struct {
+    long count;  // [결과] 이 소비자가 센 단어 수 (혼자만 씀, 메인이 join 후에 읽음)
+    long chunks; // [결과] 이 소비자가 처리한 청크 수
+    char pad[CACHE_LINE - 2 * sizeof(long)];
+} ConsumerArg;
+
+/* [매크로: 스핀 대기 힌트] x86의 pause 명령은 스핀 중임을 CPU에 알려 전력/하이퍼스레드 낭비를 줄임 */
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() ((void)0)
+#endif
+
+/* [함수: futex 대기/깨우기] *addr가 아직 expected면 잠들고, 값이 바뀌었으면 바로 돌아옴 */
+static void futex_wait(int* addr, int expected) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
 
-/* [함수: 단어 문자 판별] 알파벳이나 숫자인가? */
-int is_word_char(char c) {
-    return isalnum(c); // ctype.h 함수 사용
+static void futex_wake(int* addr, int n) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
 }
 
-/* * [함수: 청크 내 단어 수 세기]
- * 소비자가 실행하는 핵심 로직입니다. 텍스트 덩어리를 받아 단어 몇 개인지 셉니다.
+/* [함수: 링 초기화] depth를 2의 거듭제곱으로 올리고, 칸마다 순번을 자기 인덱스로 맞춰둠 (= 모두 비어 있음) */
+static int ring_init(Ring* r, size_t depth) {
+    size_t cap = 2;
+    while (cap < depth) cap <<= 1;
+    r->slots = calloc(cap, sizeof(RingSlot));
+    if (!r->slots) return -1;
+    for (size_t i = 0; i < cap; i++) r->slots[i].seq = i;
+    r->mask = cap - 1;
+    r->enqueue_pos = r->dequeue_pos = 0;
+    return 0;
+}
+
+/* * [함수: 넣기 시도]
+ * 칸의 순번 == 내 위치   -> 비어 있음. CAS로 위치를 차지한 뒤 번호를 쓰고 순번을 pos+1로 올림 ("읽어도 됨")
+ * 칸의 순번 <  내 위치   -> 아직 안 꺼내감 = 링이 가득 참
+ * 칸의 순번 >  내 위치   -> 다른 스레드가 먼저 차지함. 최신 위치를 다시 읽고 재시도
+ * 반환값: 1 = 성공, 0 = 가득 참
  */
-int count_words_in_chunk(char* buf, size_t size, int starts_inside_word) {
-    int count = 0;      // 단어 수
-    int in_word = 0;    // 현재 '단어 내부'를 지나가고 있는지 상태 플래그 (State Machine 기법)
-    size_t i = 0;
-
-    // 만약 이전 청크에서 단어가 끊겨서 넘어왔다면, 이번 청크의 시작 부분은 
-    // 새로운 단어가 아니라 이전 단어의 꼬리이므로 건너뛰어야 함.
-    if (starts_inside_word) {
-        while (i < size && is_word_char(buf[i])) i++;
+static int ring_try_push(Ring* r, int idx) {
+    size_t pos = __atomic_load_n(&r->enqueue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        RingSlot* slot = &r->slots[pos & r->mask];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&r->enqueue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                slot->idx = idx;
+                __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+            // CAS 실패 시 pos는 최신 값으로 자동 갱신됨
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&r->enqueue_pos, __ATOMIC_RELAXED);
+        }
     }
+}
 
-    // 데이터 끝까지 순회
-    for (; i < size; i++) {
-        if (is_word_char(buf[i])) { // 현재 문자가 단어의 일부라면
-            if (!in_word) {         // 방금 전까지 공백이었다면? -> "새 단어 시작!"
-                count++;            // 카운트 증가
-                in_word = 1;        // 상태를 '단어 안'으로 변경
+/* * [함수: 꺼내기 시도]
+ * 칸의 순번 == 내 위치 + 1 이면 데이터가 들어 있음. 꺼낸 뒤 순번을 한 바퀴 뒤(pos + 크기)로 올려
+ * "다음 바퀴에 넣어도 됨"을 표시합니다.
+ * 반환값: 1 = 성공(*idx에 결과), 0 = 비어 있음
+ */
+static int ring_try_pop(Ring* r, int* idx) {
+    size_t pos = __atomic_load_n(&r->dequeue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        RingSlot* slot = &r->slots[pos & r->mask];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&r->dequeue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *idx = slot->idx;
+                __atomic_store_n(&slot->seq, pos + r->mask + 1, __ATOMIC_RELEASE);
+                return 1;
             }
-        } else {                    // 현재 문자가 공백/특수문자라면
-            in_word = 0;            // 상태를 '단어 밖'으로 변경
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&r->dequeue_pos, __ATOMIC_RELAXED);
         }
     }
-    return count;
 }
 
-/* * [스레드 함수: 생산자 (Producer)]
- * 파일을 읽어서 Chunk로 만들고 버퍼에 넣는 역할 (딱 1개의 스레드만 생성됨)
+/* [함수: 청크 풀 만들기] 데이터 공간은 한 번에 잡고 잘라 씀. 처음엔 전부 free 링에 */
+static int pool_init(int size) {
+    pool_size = size;
+    pool = calloc((size_t)size, sizeof(Chunk));
+    char* mem = malloc((size_t)size * (1 + CHUNK_SIZE));
+    if (!pool || !mem) return -1;
+    if (ring_init(&full_ring, (size_t)size) < 0 || ring_init(&free_ring, (size_t)size) < 0) return -1;
+    for (int i = 0; i < size; i++) {
+        pool[i].buf = mem + (size_t)i * (1 + CHUNK_SIZE);
+        ring_try_push(&free_ring, i);
+    }
+    return 0;
+}
+
+/* * [함수: 빈 청크 얻기] (리더)
+ * 소비자들이 아직 다 못 세서 빈 상자가 없으면 잠깐 돌아보다가 잠듦.
+ * [잠든 스레드 깨우기 - Lost Wakeup 방지]
+ * 잠드는 쪽: "seq 읽기 -> 잠든 수 증가 -> 링 재확인 -> seq가 그대로면 잠듦"
+ * 깨우는 쪽: "넣기 -> 잠든 수 확인 -> 있으면 seq 증가 + 깨우기"
+ * 둘이 엇갈려도 재확인에서 보거나, futex가 바뀐 seq를 보고 바로 돌아옵니다. (소비자 쪽도 같은 순서)
+ * 단, 양쪽 모두 "쓰기 -> 다른 변수 읽기" 사이에 seq_cst 펜스가 있어야 함. 링에 넣기는 release 저장이라
+ * 펜스가 없으면 잠든 수 읽기가 넣기보다 앞당겨질 수 있고, 그러면 둘 다 상대를 못 보고 잠듦
+ * (wc_mt.c의 tree_spawn / deque_take와 같은 이유)
  */
-void* producer(void* arg) {
-    char* filename = (char*)arg; // void* 매개변수를 문자열 포인터로 캐스팅
-    FILE* fp = fopen(filename, "r");
-    if (!fp) {
-        perror("fopen"); // 파일 열기 실패 시 에러 출력
-        exit(1);
+static int chunk_get(void) {
+    int idx;
+    for (;;) {
+        for (int spin = 0; spin < 100; spin++) {
+            if (ring_try_pop(&free_ring, &idx)) return idx;
+            cpu_relax();
+        }
+
+        int seq = __atomic_load_n(&waiters.space_seq, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&waiters.blocked_producers, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        int got = ring_try_pop(&free_ring, &idx);
+        if (!got) futex_wait(&waiters.space_seq, seq);
+        __atomic_sub_fetch(&waiters.blocked_producers, 1, __ATOMIC_SEQ_CST);
+        if (got) return idx;
     }
+}
 
-    int prev_ends_in_word = 0; // 이전 청크가 단어 중간에서 끝났는지 추적
+/* [함수: 다 센 청크 돌려주기] (소비자) 빈 상자를 기다리며 잠든 리더가 있을 때만 깨움 */
+static void chunk_put(int idx) {
+    ring_try_push(&free_ring, idx); // 링이 풀보다 크므로 항상 성공
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&waiters.blocked_producers, __ATOMIC_SEQ_CST) > 0) {
+        __atomic_add_fetch(&waiters.space_seq, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&waiters.space_seq, 1);
+    }
+}
 
-    while (1) {
-        // [메모리 할당] 청크 데이터를 담을 공간. 
-        // +256을 하는 이유: 아래에서 단어가 잘리는 걸 방지하기 위해 
-        // CHUNK_SIZE보다 조금 더 읽을 수도 있기 때문에 여유 공간(Padding)을 둠.
-        char* buf = malloc(CHUNK_SIZE + 256);
-        if (!buf) {
-            perror("malloc");
-            exit(1);
-        }
+/* [함수: 채운 청크 보내기] (리더) 자고 있는 소비자가 있을 때만 시스템 콜을 씀 */
+static void chunk_send(int idx) {
+    ring_try_push(&full_ring, idx); // 링이 풀보다 크므로 항상 성공
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&waiters.idle_consumers, __ATOMIC_SEQ_CST) > 0) {
+        __atomic_add_fetch(&waiters.work_seq, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&waiters.work_seq, 1);
+    }
+}
 
-        // 파일에서 CHUNK_SIZE만큼 읽음
-        size_t size = fread(buf, 1, CHUNK_SIZE, fp);
-        if (size == 0) { // 파일 끝(EOF) 도달
-            free(buf);   // 빈 버퍼는 해제
-            break;       // 루프 종료
+/* * [함수: 채운 청크 받기] (소비자)
+ * 반환값: 청크 번호, 또는 -1 = 링이 비었고 리더도 다 끝남 (퇴근)
+ * is_done을 본 뒤에 한 번 더 꺼내 보므로, 리더들이 끝나기 전에 넣은 청크를 놓치지 않습니다.
+ */
+static int chunk_receive(void) {
+    int idx;
+    for (;;) {
+        for (int spin = 0; spin < 100; spin++) {
+            if (ring_try_pop(&full_ring, &idx)) return idx;
+            cpu_relax();
         }
 
-        // [중요 로직: 단어 경계 처리]
-        // 읽어온 데이터의 마지막이 단어 문자라면(예: "appl"), 단어가 짤린 것일 수 있음.
-        // 따라서 공백이 나올 때까지 파일에서 1바이트씩 더 읽어서 buf에 붙임.
-        // 이렇게 하면 항상 청크는 온전한 단어로 끝나게 됨.
-        int c;
-        while (size > 0 && is_word_char(buf[size - 1]) && (c = fgetc(fp)) != EOF) {
-            buf[size++] = (char)c; // 버퍼 뒤에 붙이고 size 증가
-        }
+        int seq = __atomic_load_n(&waiters.work_seq, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&waiters.idle_consumers, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        int done = __atomic_load_n(&is_done, __ATOMIC_SEQ_CST);
+        int got = ring_try_pop(&full_ring, &idx);
+        if (!got && !done) futex_wait(&waiters.work_seq, seq);
+        __atomic_sub_fetch(&waiters.idle_consumers, 1, __ATOMIC_SEQ_CST);
+        if (got) return idx;
+        if (done) return -1;
+    }
+}
+
+/* [함수: 단어 문자 판별] 알파벳이나 숫자인가? */
+int is_word_char(char c) {
+    return wc_is_word_char(c); // SIMD 커널과 같은 기준 (ctype.h의 isalnum)
+}
+
+/* * [함수: 청크 내 단어 수 세기]
+ * 소비자가 실행하는 핵심 로직입니다. 텍스트 덩어리를 받아 단어 몇 개인지 셉니다.
+ */
+int count_words_in_chunk(char* buf, size_t size, int starts_inside_word) {
+    // 만약 이전 청크에서 단어가 끊겨서 넘어왔다면, 이번 청크의 시작 부분은
+    // 새로운 단어가 아니라 이전 단어의 꼬리이므로 세면 안 됨.
+    // -> "바로 앞이 단어 안이었다"는 상태(in_word = 1)로 시작하면 커널이 알아서 건너뜀.
+    int in_word = starts_inside_word;
 
-        // 구조체 생성 및 데이터 설정
-        Chunk chunk = {
-            .data = buf,
-            .size = size,
-            .starts_inside_word = prev_ends_in_word // 위 로직 덕분에 사실상 항상 0일 것임
-        };
+    // 64바이트씩 단어 문자 비트마스크를 만들어 단어 시작 비트만 popcount (자세한 건 wc_simd.h)
+    return (int)wc_count_words(buf, size, &in_word);
+}
 
-        // 현재 청크의 마지막이 단어 문자인지 확인 (다음 청크를 위해)
-        // 위 while문에서 공백까지 읽었으므로 대부분 0이 됨.
-        prev_ends_in_word = is_word_char(buf[size - 1]);
+/* * [함수: 끝까지 읽기] 짧게 읽히면(시그널, 파이프) 이어서 읽음. 읽은 바이트 수 (EOF면 len보다 작음), 에러면 -1
+ * off < 0 이면 pread 대신 read (파일 위치를 차례대로 쓰는 스트림)
+ */
+static ssize_t read_full(int fd, char* buf, size_t len, long long off) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = off < 0 ? read(fd, buf + got, len - got)
+                            : pread(fd, buf + got, len - got, (off_t)(off + (long long)got));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        if (n == 0) break;
+        got += (size_t)n;
+    }
+    return (ssize_t)got;
+}
 
-        /* ----- 임계 영역 (Critical Section) 시작 ----- */
-        pthread_mutex_lock(&mutex); // 자물쇠 잠금
+/* * [스레드 함수: 리더 (Producer)]
+ * 예전에는 생산자 스레드 하나가 fread로 읽고, 청크 끝의 단어를 fgetc로 1바이트씩 더 읽어 붙였습니다.
+ * 그러면 디스크(NVMe)가 아무리 빨라도 스레드 하나의 읽기 속도가 전체의 천장이 됩니다.
+ *
+ * 지금은 리더 여러 개가 청크 번호를 하나씩 가져가서 자기 위치(k * CHUNK_SIZE)를 pread합니다.
+ * - 청크를 단어 경계까지 늘리지 않고 CHUNK_SIZE에서 그냥 자름
+ * - 대신 앞 청크의 마지막 바이트 1개를 같이 읽어서(buf[0]) starts_inside_word를 정함
+ *   -> 앞 청크가 "Ap"로 끝나고 이번이 "ple"로 시작하면 buf[0] = 'p' 라서 1, "ple"은 안 셈
+ * - 청크마다 답이 독립적이라 어떤 순서로 읽고 세도 합은 같음
+ * 그래서 읽기 병렬도(리더 수)와 세기 병렬도(소비자 수)를 따로 정할 수 있습니다.
+ *
+ * 파이프 같은 스트림은 pread가 안 되므로 리더 1개가 read로 차례대로 읽고 마지막 바이트를 기억해 둡니다.
+ */
+void* reader(void* arg) {
+    (void)arg;
+    for (;;) {
+        long k = 0;
+        long long off = -1;
+        size_t len = CHUNK_SIZE;
+        if (input.seekable) {
+            k = __atomic_fetch_add(&input.next_chunk, 1, __ATOMIC_RELAXED);
+            if (k >= input.num_chunks) break;
+            off = (long long)k * CHUNK_SIZE;
+            if (input.size - off < (long long)len) len = (size_t)(input.size - off);
+        }
 
-        // 버퍼가 꽉 찼다면? 빈 공간이 생길 때까지 대기(Sleep)
-        // while을 쓰는 이유: 깨어났는데 그새 다른 스레드가 채웠을 수도 있어서 재확인 필수 (Spurious Wakeup)
-        while (count == BUFFER_CAPACITY) {
-            pthread_cond_wait(&not_full, &mutex); // 자물쇠를 잠시 풀고 not_full 신호를 기다림
+        // [빈 청크 얻기] 새로 malloc하지 않고 소비자가 돌려준 상자를 다시 씀
+        int idx = chunk_get();
+        Chunk* chunk = &pool[idx];
+
+        ssize_t n;
+        if (!input.seekable) {
+            chunk->buf[0] = input.last_byte; // 앞 청크의 끝 (처음엔 0 = 단어 밖)
+            n = read_full(input.fd, chunk->buf + 1, len, -1);
+            if (n > 0) input.last_byte = chunk->buf[n];
+            n = n > 0 ? n + 1 : n;
+        } else if (off == 0) {
+            chunk->buf[0] = 0;               // 파일 맨 앞은 단어 밖에서 시작
+            n = read_full(input.fd, chunk->buf + 1, len, 0);
+            n = n >= 0 ? n + 1 : n;
+        } else {
+            n = read_full(input.fd, chunk->buf, len + 1, off - 1); // 앞 청크 끝 1바이트 + 내 구역
+        }
+        if (n < 0) {
+            perror("read");
+            exit(1);
+        }
+        if (n <= 1) {             // EOF (스트림의 끝, 또는 읽는 사이에 파일이 줄어듦)
+            chunk_put(idx);       // 안 쓴 상자는 풀에 반납
+            if (!input.seekable) break;
+            continue;
         }
 
-        // 데이터 넣기 (원형 큐 로직)
-        buffer[in] = chunk;
-        in = (in + 1) % BUFFER_CAPACITY;
-        count++; // 데이터 개수 증가
+        chunk->starts_inside_word = is_word_char(chunk->buf[0]);
+        chunk->data = chunk->buf + 1;
+        chunk->size = (size_t)n - 1;
 
-        // "버퍼에 데이터 있다!"라고 소비자들에게 신호 보냄
-        pthread_cond_signal(&not_empty); 
-        
-        pthread_mutex_unlock(&mutex); // 자물쇠 반납
-        /* ----- 임계 영역 끝 ----- */
+        // full 링에 넣기 (락 없음). 잠든 소비자가 있으면 하나 깨움
+        chunk_send(idx);
     }
-    
-    fclose(fp); // 파일 닫기
-
-    /* [종료 처리] 생산 완료 알림 */
-    pthread_mutex_lock(&mutex);
-    is_done = 1; // "나 끝났음" 플래그 설정
-    // 대기 중인 모든 소비자 스레드를 다 깨움 (broadcast). 
-    // 왜? 자고 있는 소비자들이 일어나서 is_done을 확인하고 퇴근해야 하니까.
-    pthread_cond_broadcast(&not_empty); 
-    pthread_mutex_unlock(&mutex);
 
+    /* [종료 처리] 마지막 리더가 생산 완료를 알림
+     * 대기 중인 모든 소비자 스레드를 다 깨움 (broadcast).
+     * 왜? 자고 있는 소비자들이 일어나서 is_done을 확인하고 퇴근해야 하니까.
+     */
+    if (__atomic_sub_fetch(&input.readers_left, 1, __ATOMIC_SEQ_CST) == 0) {
+        __atomic_store_n(&is_done, 1, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&waiters.work_seq, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&waiters.work_seq, INT_MAX);
+    }
     return NULL;
 }
 
 /* * [스레드 함수: 소비자 (Consumer)]
- * 버퍼에서 Chunk를 꺼내 단어를 세고 결과를 합산 (여러 개의 스레드가 동시에 실행됨)
+ * full 링에서 청크를 꺼내 단어를 세고 청크를 풀에 돌려줌 (여러 개의 스레드가 동시에 실행됨)
  */
 void* consumer(void* arg) {
-    while (1) {
-        /* ----- 임계 영역 시작 ----- */
-        pthread_mutex_lock(&mutex);
+    ConsumerArg* c_arg = (ConsumerArg*)arg;
+    long count = 0, chunks = 0; // 로컬 합계 (끝날 때 한 번만 내 칸에 씀)
 
-        // 버퍼가 비어있고, 아직 생산자가 일을 안 끝냈다면? -> 대기
-        while (count == 0 && !is_done) {
-            pthread_cond_wait(&not_empty, &mutex);
-        }
+    for (;;) {
+        int idx = chunk_receive(); // 링이 비었으면 잠듦, -1이면 생산자도 끝남 -> 퇴근
+        if (idx < 0) break;
 
-        // 버퍼도 비어있고, 생산자도 끝났다면? -> 나도 퇴근(루프 종료)
-        if (count == 0 && is_done) {
-            pthread_mutex_unlock(&mutex); // 나가기 전에 자물쇠 꼭 풀기!
-            break;
-        }
+        // [작업 수행] 공유 자원을 아무것도 잡지 않고 셈
+        Chunk* chunk = &pool[idx];
+        count += count_words_in_chunk(chunk->data, chunk->size, chunk->starts_inside_word);
+        chunks++;
 
-        // 데이터 꺼내기 (원형 큐 로직)
-        Chunk chunk = buffer[out];
-        out = (out + 1) % BUFFER_CAPACITY;
-        count--; // 데이터 개수 감소
-        
-        // "버퍼에 빈 공간 생겼다!"라고 생산자에게 신호 보냄
-        pthread_cond_signal(&not_full);
-        
-        pthread_mutex_unlock(&mutex);
-        /* ----- 임계 영역 끝 ----- */
-
-        // [작업 수행] 
-        // 자물쇠 밖에서 수행함 (매우 중요!). 
-        // 여기서 시간을 써야 병렬 처리의 의미가 있음. 
-        // 자물쇠 안에서 이걸 하면 사실상 싱글 스레드랑 다를 게 없음.
-        int wc = count_words_in_chunk(chunk.data, chunk.size, chunk.starts_inside_word);
-
-        // 생산자가 malloc한 메모리를 여기서 소비자가 해제 (책임 전가)
-        free(chunk.data);
-
-        // [결과 합산]
-        // 전역 변수 total_word_count를 건드리므로 다시 자물쇠 필요
-        pthread_mutex_lock(&mutex);
-        total_word_count += wc;
-        pthread_mutex_unlock(&mutex);
+        // 다 센 상자는 free 링으로 돌려보냄 (free 대신 재활용)
+        chunk_put(idx);
     }
+
+    c_arg->count = count;
+    c_arg->chunks = chunks;
     return NULL;
 }
 
 /* [메인 함수] */
 int main(int argc, char* argv[]) {
-    // 인자 확인 (실행 파일명, 대상 파일, 스레드 수)
-    if (argc != 3) {
-        printf("Usage: %s <filename> <num_consumers>\n", argv[0]);
+    // [자체 검사] SIMD 커널들이 스칼라 버전과 같은 답을 내는지 확인만 하고 끝냄
+    if (argc == 2 && strcmp(argv[1], "--selftest") == 0)
+        return wc_simd_selftest() ? 1 : 0;
+
+    // 인자 확인 (실행 파일명, 대상 파일, 소비자 수, [리더 수])
+    if (argc != 3 && argc != 4) {
+        printf("Usage: %s <filename> <num_consumers|auto> [num_readers]\n", argv[0]);
+        printf("       %s --selftest\n", argv[0]);
         return 1;
     }
+    wc_simd_init(); // 이 CPU에서 쓸 단어 세기 커널 고르기 (WC_SIMD 환경 변수로 강제 가능)
 
     // 소비자 스레드 개수 파싱 및 유효성 검사
-    num_consumers = atoi(argv[2]);
-    if (num_consumers <= 0 || num_consumers > MAX_CONSUMERS) {
-        printf("Number of consumers must be between 1 and %d\n", MAX_CONSUMERS);
+    // "auto"(또는 0)면 CPU 수. 예전에는 32개로 막았지만 이제 풀/링/배열을 개수에 맞춰 잡으므로 상한이 없음
+    if (strcmp(argv[2], "auto") == 0 || strcmp(argv[2], "0") == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        num_consumers = n > 0 ? (int)n : 1;
+    } else {
+        num_consumers = atoi(argv[2]);
+    }
+    if (num_consumers <= 0) {
+        printf("Number of consumers must be a positive number or auto\n");
+        return 1;
+    }
+
+    // 리더(생산자) 스레드 개수 (기본 DEFAULT_READERS)
+    int num_readers = argc == 4 ? atoi(argv[3]) : DEFAULT_READERS;
+    if (num_readers <= 0) {
+        printf("Number of readers must be a positive number\n");
+        return 1;
+    }
+
+    // 청크 풀 미리 만들기 (여기서 한 번만 할당). 리더/소비자가 하나씩 들고 있어도 큐 깊이만큼은 남게
+    if (pool_init(BUFFER_CAPACITY + num_readers + num_consumers) < 0) {
+        perror("malloc");
         return 1;
     }
 
@@ -237,22 +467,64 @@ int main(int argc, char* argv[]) {
     struct timeval start, end;
     gettimeofday(&start, NULL);
 
-    pthread_t prod; // 생산자 스레드 ID
-    pthread_t consumers[MAX_CONSUMERS]; // 소비자 스레드 ID 배열
+    // 파일 열기 + 청크 나누기 (청크 k = [k * CHUNK_SIZE, (k + 1) * CHUNK_SIZE))
+    input.fd = open(argv[1], O_RDONLY);
+    if (input.fd < 0) {
+        perror("open");
+        return 1;
+    }
+    struct stat st;
+    if (fstat(input.fd, &st) < 0) {
+        perror("fstat");
+        return 1;
+    }
+    input.seekable = S_ISREG(st.st_mode);
+    if (input.seekable) {
+        input.size = st.st_size;
+        input.num_chunks = (long)((input.size + CHUNK_SIZE - 1) / CHUNK_SIZE);
+        if (num_readers > input.num_chunks) num_readers = input.num_chunks > 0 ? (int)input.num_chunks : 1;
+        posix_fadvise(input.fd, 0, 0, POSIX_FADV_SEQUENTIAL); // 미리 읽기(readahead)를 크게
+    } else {
+        num_readers = 1; // 스트림은 순서대로 한 명만 읽을 수 있음
+    }
+    input.readers_left = num_readers;
+
+    pthread_t* readers = calloc((size_t)num_readers, sizeof(pthread_t));     // 리더(생산자) 스레드 ID 배열
+    pthread_t* consumers = calloc((size_t)num_consumers, sizeof(pthread_t)); // 소비자 스레드 ID 배열
+    ConsumerArg* c_args = NULL;                                              // 소비자별 결과 칸 (캐시 라인 단위)
+    if (!readers || !consumers ||
+        posix_memalign((void**)&c_args, CACHE_LINE, sizeof(ConsumerArg) * (size_t)num_consumers) != 0) {
+        perror("calloc");
+        return 1;
+    }
+    memset(c_args, 0, sizeof(ConsumerArg) * (size_t)num_consumers);
+
+    // 1. 리더 스레드들 생성
+    for (int i = 0; i < num_readers; i++) {
+        if (pthread_create(&readers[i], NULL, reader, NULL) != 0) {
+            fprintf(stderr, "pthread_create failed (too many threads?)\n");
+            return 1;
+        }
+    }
 
-    // 1. 생산자 스레드 생성 (파일 이름을 인자로 넘김)
-    pthread_create(&prod, NULL, producer, argv[1]);
-    
     // 2. 소비자 스레드들 생성
     for (int i = 0; i < num_consumers; i++) {
-        pthread_create(&consumers[i], NULL, consumer, NULL);
+        if (pthread_create(&consumers[i], NULL, consumer, &c_args[i]) != 0) {
+            fprintf(stderr, "pthread_create failed (too many threads?)\n");
+            return 1;
+        }
     }
 
-    // 3. 스레드 종료 대기 (Join)
+    // 3. 스레드 종료 대기 (Join) + [결과 취합 (Reduce)]
     // 메인 스레드는 여기서 블락되어 자식들이 다 끝날 때까지 기다림
-    pthread_join(prod, NULL); // 생산자가 끝날 때까지 대기
+    // 소비자마다 따로 센 값을 끝난 뒤에 더하므로 합산에 자물쇠가 필요 없음
+    long total_word_count = 0;
+    for (int i = 0; i < num_readers; i++) {
+        pthread_join(readers[i], NULL); // 리더들이 끝날 때까지 대기
+    }
     for (int i = 0; i < num_consumers; i++) {
         pthread_join(consumers[i], NULL); // 모든 소비자가 끝날 때까지 대기
+        total_word_count += c_args[i].count;
     }
 
     // [시간 측정 종료]
@@ -262,8 +534,22 @@ int main(int argc, char* argv[]) {
                      (end.tv_usec - start.tv_usec) / 1000.0;
 
     // 결과 출력
-    printf("Total words: %d\n", total_word_count);
+    printf("Total words: %ld\n", total_word_count);
     printf("Elapsed time (total): %.2f ms\n", elapsed);
+    printf(" Kernel: %s\n", wc_kernel->name);
+    printf(" Readers: %d\n", num_readers);
+    printf(" Chunks per consumer:");
+    for (int i = 0; i < num_consumers; i++) printf(" %ld", c_args[i].chunks);
+    printf("\n");
+
+    close(input.fd);
+    free(pool[0].buf); // 청크 풀 데이터 (한 덩어리로 잡았음)
+    free(pool);
+    free(full_ring.slots);
+    free(free_ring.slots);
+    free(readers);
+    free(consumers);
+    free(c_args);
 
     return 0;
-}
\ No newline at end of file
+}
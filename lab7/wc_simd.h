@@ -0,0 +1,290 @@
+/* wc_simd.h */
+
+/* * ======================================================================================
+ * [단어 세기 커널 (SIMD + CPUID 디스패치)]
+ * wc_mt.c / wc_mt_overlap.c 가 함께 include 하는 "버퍼 안의 단어 수 세기" 함수입니다.
+ *
+ * 스칼라 버전(기준):
+ *   바이트마다 isalnum()으로 분기하고 in_word 상태를 바꿉니다. 분기가 데이터에 따라 달라져서
+ *   예측이 자주 빗나가고, 한 번에 1바이트씩이라 메모리 대역폭의 일부밖에 못 씁니다.
+ *
+ * SIMD 버전:
+ *   64바이트를 한꺼번에 "단어 문자인가?"로 분류해서 64비트 마스크 w를 만들고(비트 i = 바이트 i),
+ *   단어 시작 = "나는 단어 문자인데 바로 앞은 아님" 이므로
+ *       starts = w & ~((w << 1) | carry)      (carry = 앞 블록 마지막 바이트가 단어 문자였는지)
+ *   의 1비트 수(popcount)를 더합니다. 분기가 없습니다.
+ *   - SSE2    : 16바이트 x 4
+ *   - AVX2    : 32바이트 x 2
+ *   - AVX-512 : 64바이트 x 1 (AVX512BW의 부호 없는 비교가 바로 마스크를 돌려줌)
+ *
+ * 디스패치: 처음 쓸 때 CPUID(__builtin_cpu_supports)로 쓸 수 있는 가장 넓은 커널을 고릅니다.
+ *   컴파일 옵션(-mavx2 등) 없이도 AVX2/AVX-512 커널이 들어가도록 함수마다 target 속성을 붙였습니다.
+ *   환경 변수 WC_SIMD=scalar|sse2|avx2|avx512 로 강제할 수 있습니다. (벤치마크 비교용)
+ *
+ * 단어 문자 = ASCII 영문자/숫자. 두 프로그램은 setlocale을 안 부르므로 "C" 로케일의 isalnum과 같습니다.
+ * wc_simd_selftest()가 모든 커널을 스칼라 버전과 대조합니다. (./wc_mt --selftest)
+ * ======================================================================================
+ */
+#ifndef WC_SIMD_H
+#define WC_SIMD_H
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define WC_SIMD_X86
+#include <immintrin.h>
+#endif
+
+/* [커널 모양] p[0..n)의 단어 시작 수를 돌려줌
+ * *in_word: 들어올 때 = p 바로 앞 바이트가 단어 문자였는지 (0이 아니면 참 -> isalnum 결과를 그대로 줘도 됨)
+ *                      참이면 p의 첫 단어는 이어지는 꼬리라 안 셈
+ *           나갈 때   = 마지막 바이트가 단어 문자였는지 (다음 조각에 그대로 넘기면 됨) */
+typedef size_t (*wc_kernel_fn)(const unsigned char* p, size_t n, int* in_word);
+
+/* [함수: 스칼라 기준 구현] 원래 두 프로그램에 있던 루프 그대로 */
+static size_t wc_count_scalar(const unsigned char* p, size_t n, int* in_word) {
+    size_t count = 0;
+    int w = *in_word != 0;
+    for (size_t i = 0; i < n; i++) {
+        if (isalnum(p[i])) {
+            if (!w) { // 공백이었다가 문자가 나오면 -> 단어 시작
+                count++;
+                w = 1;
+            }
+        } else {
+            w = 0;
+        }
+    }
+    *in_word = w;
+    return count;
+}
+
+#ifdef WC_SIMD_X86
+
+/* [함수: 64비트 마스크 -> 단어 시작 수] carry는 다음 블록을 위해 마지막 비트로 바뀜 */
+#define WC_STARTS(w, carry) __builtin_popcountll((w) & ~(((w) << 1) | (carry)))
+
+/* * [함수: SSE2 분류] 16바이트 -> 16비트 마스크
+ * SSE2에는 부호 없는 바이트 비교가 없으므로, 범위 [lo, lo+len)을 빼고 0x80을 더해
+ * [-128, -128+len) 으로 옮긴 뒤 부호 있는 비교(<)를 씁니다.
+ * 영문자는 0x20을 OR해서 소문자로 모은 뒤 한 번에 비교합니다. ('@'|0x20 = '`', '['|0x20 = '{' 이라 안전)
+ */
+__attribute__((target("sse2")))
+static inline uint64_t wc_class_sse2(const unsigned char* p) {
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i a = _mm_add_epi8(lower, _mm_set1_epi8((char)(0x80 - 'a')));
+    __m128i d = _mm_add_epi8(v, _mm_set1_epi8((char)(0x80 - '0')));
+    __m128i is_alpha = _mm_cmplt_epi8(a, _mm_set1_epi8((char)(-128 + 26)));
+    __m128i is_digit = _mm_cmplt_epi8(d, _mm_set1_epi8((char)(-128 + 10)));
+    return (uint16_t)_mm_movemask_epi8(_mm_or_si128(is_alpha, is_digit));
+}
+
+__attribute__((target("sse2")))
+static size_t wc_count_sse2(const unsigned char* p, size_t n, int* in_word) {
+    size_t count = 0;
+    uint64_t carry = *in_word != 0;
+    for (; n >= 64; p += 64, n -= 64) {
+        uint64_t w = wc_class_sse2(p) | wc_class_sse2(p + 16) << 16 |
+                     wc_class_sse2(p + 32) << 32 | wc_class_sse2(p + 48) << 48;
+        count += WC_STARTS(w, carry);
+        carry = w >> 63;
+    }
+    *in_word = (int)carry;
+    return count + wc_count_scalar(p, n, in_word); // 64바이트가 안 되는 꼬리
+}
+
+/* [함수: AVX2 분류] 32바이트 -> 32비트 마스크 (SSE2와 같은 식을 두 배 폭으로) */
+__attribute__((target("avx2")))
+static inline uint64_t wc_class_avx2(const unsigned char* p) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)p);
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i a = _mm256_add_epi8(lower, _mm256_set1_epi8((char)(0x80 - 'a')));
+    __m256i d = _mm256_add_epi8(v, _mm256_set1_epi8((char)(0x80 - '0')));
+    __m256i is_alpha = _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(-128 + 26)), a);
+    __m256i is_digit = _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(-128 + 10)), d);
+    return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(is_alpha, is_digit));
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t wc_count_avx2(const unsigned char* p, size_t n, int* in_word) {
+    size_t count = 0;
+    uint64_t carry = *in_word != 0;
+    for (; n >= 64; p += 64, n -= 64) {
+        uint64_t w = wc_class_avx2(p) | wc_class_avx2(p + 32) << 32;
+        count += WC_STARTS(w, carry);
+        carry = w >> 63;
+    }
+    *in_word = (int)carry;
+    return count + wc_count_scalar(p, n, in_word);
+}
+
+/* [함수: AVX-512 분류] 64바이트 -> 64비트 마스크. 부호 없는 비교가 있어서 0x80 보정이 필요 없음 */
+__attribute__((target("avx512f,avx512bw")))
+static inline uint64_t wc_class_avx512(const unsigned char* p) {
+    __m512i v = _mm512_loadu_si512((const void*)p);
+    __m512i lower = _mm512_or_si512(v, _mm512_set1_epi8(0x20));
+    __mmask64 is_alpha = _mm512_cmplt_epu8_mask(_mm512_sub_epi8(lower, _mm512_set1_epi8('a')),
+                                                _mm512_set1_epi8(26));
+    __mmask64 is_digit = _mm512_cmplt_epu8_mask(_mm512_sub_epi8(v, _mm512_set1_epi8('0')),
+                                                _mm512_set1_epi8(10));
+    return (uint64_t)(is_alpha | is_digit);
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+static size_t wc_count_avx512(const unsigned char* p, size_t n, int* in_word) {
+    size_t count = 0;
+    uint64_t carry = *in_word != 0;
+    for (; n >= 64; p += 64, n -= 64) {
+        uint64_t w = wc_class_avx512(p);
+        count += WC_STARTS(w, carry);
+        carry = w >> 63;
+    }
+    *in_word = (int)carry;
+    return count + wc_count_scalar(p, n, in_word);
+}
+
+#endif /* WC_SIMD_X86 */
+
+/* [표: 커널 목록] 넓은 것부터. supported가 0이면 이 CPU에서 못 씀 */
+typedef struct {
+    const char* name;
+    wc_kernel_fn fn;
+    int supported;
+} WcKernel;
+
+static WcKernel wc_kernels[] = {
+#ifdef WC_SIMD_X86
+    {"avx512", wc_count_avx512, 0},
+    {"avx2", wc_count_avx2, 0},
+    {"sse2", wc_count_sse2, 0},
+#endif
+    {"scalar", wc_count_scalar, 1},
+};
+#define WC_NUM_KERNELS (sizeof(wc_kernels) / sizeof(wc_kernels[0]))
+
+static const WcKernel* wc_kernel; // 고른 커널 (wc_simd_init 전엔 NULL)
+
+/* [함수: CPUID로 지원 여부 채우기] */
+static void wc_kernels_probe(void) {
+#ifdef WC_SIMD_X86
+    __builtin_cpu_init();
+    for (size_t i = 0; i < WC_NUM_KERNELS; i++) {
+        const char* name = wc_kernels[i].name;
+        if (strcmp(name, "avx512") == 0)
+            wc_kernels[i].supported = __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("popcnt");
+        else if (strcmp(name, "avx2") == 0)
+            wc_kernels[i].supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+        else if (strcmp(name, "sse2") == 0)
+            wc_kernels[i].supported = __builtin_cpu_supports("sse2");
+    }
+#endif
+}
+
+/* * [함수: 커널 고르기] 스레드를 만들기 전에 메인에서 한 번 부름
+ * WC_SIMD로 지정했는데 이 CPU가 지원하지 않거나 모르는 이름이면 경고하고 자동 선택으로 돌아감.
+ */
+static void wc_simd_init(void) {
+    wc_kernels_probe();
+    const char* want = getenv("WC_SIMD");
+    for (size_t i = 0; want && *want && i < WC_NUM_KERNELS; i++) {
+        if (strcmp(want, wc_kernels[i].name) != 0) continue;
+        if (wc_kernels[i].supported) {
+            wc_kernel = &wc_kernels[i];
+            return;
+        }
+        break;
+    }
+    if (want && *want) fprintf(stderr, "WC_SIMD=%s not available, picking automatically\n", want);
+    for (size_t i = 0; i < WC_NUM_KERNELS; i++) {
+        if (wc_kernels[i].supported) {
+            wc_kernel = &wc_kernels[i];
+            return;
+        }
+    }
+}
+
+/* [함수: 단어 세기] 고른 커널로 (in_word 의미는 wc_kernel_fn 참고) */
+static inline size_t wc_count_words(const char* buf, size_t n, int* in_word) {
+    return wc_kernel->fn((const unsigned char*)buf, n, in_word);
+}
+
+/* [함수: 단어 문자 판별] 커널들과 같은 기준 (청크 경계 조정용) */
+static inline int wc_is_word_char(char c) {
+    return isalnum((unsigned char)c);
+}
+
+/* * [함수: 자체 검사] 이 CPU에서 쓸 수 있는 모든 커널을 스칼라 기준과 대조. 실패 수를 돌려줌
+ * 1. 256개 바이트 값 전부를 64바이트 블록의 모든 위치(레인)에 하나씩 넣어 보고 (분류 검사)
+ * 2. 블록 경계(64바이트)를 가로지르는 20바이트 창에 단어/공백 패턴 2^20개를 전부 넣어 보고 (carry 검사)
+ * 3. 길이 0~300, 시작 in_word 0/1/8, 시작 주소 정렬 0~63 을 무작위 내용으로 (꼬리/정렬 검사)
+ * 각 경우에 돌려준 개수와 나갈 때의 in_word가 모두 같아야 통과입니다.
+ */
+#define WC_SELFTEST_WINDOW 20
+
+static int wc_check_one(const WcKernel* k, const unsigned char* p, size_t n, int in_word) {
+    int w_ref = in_word, w_k = in_word;
+    size_t ref = wc_count_scalar(p, n, &w_ref);
+    size_t got = k->fn(p, n, &w_k);
+    if (ref == got && w_ref == w_k) return 0;
+    fprintf(stderr, "selftest: %s mismatch (len %zu, in_word %d): got %zu/%d, expected %zu/%d\n",
+            k->name, n, in_word, got, w_k, ref, w_ref);
+    return 1;
+}
+
+static int wc_simd_selftest(void) {
+    static unsigned char buf[64 + 512];
+    int failures = 0;
+    wc_kernels_probe();
+
+    for (size_t ki = 0; ki < WC_NUM_KERNELS; ki++) {
+        const WcKernel* k = &wc_kernels[ki];
+        if (!k->supported) {
+            printf("selftest: %-6s skipped (not supported by this CPU)\n", k->name);
+            continue;
+        }
+        int before = failures;
+
+        // 1. 모든 바이트 값 x 모든 레인 (나머지는 'a' 또는 ' ')
+        for (int fill = 0; fill < 2 && failures - before < 10; fill++) {
+            for (int b = 0; b < 256; b++) {
+                for (int lane = 0; lane < 64; lane++) {
+                    memset(buf, fill ? 'a' : ' ', 128);
+                    buf[lane] = (unsigned char)b;
+                    failures += wc_check_one(k, buf, 128, 0);
+                }
+            }
+        }
+
+        // 2. 블록 경계(64)를 가로지르는 창: 54..73 에 모든 단어/공백 패턴
+        for (uint32_t bits = 0; bits < (1u << WC_SELFTEST_WINDOW) && failures - before < 10; bits++) {
+            memset(buf, 'x', 128);
+            for (int j = 0; j < WC_SELFTEST_WINDOW; j++)
+                buf[54 + j] = (bits >> j & 1) ? 'x' : ' ';
+            failures += wc_check_one(k, buf, 128, (int)(bits & 1));
+        }
+
+        // 3. 무작위 내용 x 길이 x 정렬 x 시작 상태
+        srand(12345);
+        for (size_t len = 0; len <= 300 && failures - before < 10; len++) {
+            for (int align = 0; align < 64; align++) {
+                for (size_t j = 0; j < len; j++) {
+                    int r = rand();
+                    buf[align + j] = (r & 3) ? (unsigned char)(r >> 8) : " \n.,"[r >> 2 & 3];
+                }
+                failures += wc_check_one(k, buf + align, len, 0);
+                failures += wc_check_one(k, buf + align, len, 1);
+                failures += wc_check_one(k, buf + align, len, 8); // isalnum()처럼 1이 아닌 참
+            }
+        }
+
+        printf("selftest: %-6s %s\n", k->name, failures == before ? "ok" : "FAILED");
+    }
+    return failures;
+}
+
+#endif /* WC_SIMD_H */
@@ -0,0 +1,530 @@
+/* http_parser.h */
+
+/* * ======================================================================================
+ * [스트리밍(증분) HTTP 요청 파서]
+ * webserver.c / webserver-mt.c / http_parser_bench.c 가 함께 쓰는 헤더 전용(header-only) 파서입니다.
+ *
+ * 예전 방식: read 한 번 -> sscanf("%s %s")
+ *   - 요청이 TCP 조각 여러 개로 나뉘어 오면 깨짐
+ *   - 헤더는 아예 안 봄 (Connection 헤더도 strcasestr로 대충 찾음)
+ *
+ * 이 파서의 특징:
+ * - 증분(Incremental): 데이터가 덜 왔으면 HTTP_PARSE_INCOMPLETE를 돌려주고, 어디까지 봤는지 기억합니다.
+ *   더 읽어서 다시 호출하면 이미 검사한 바이트는 다시 보지 않고 이어서 진행합니다.
+ * - 무할당(Zero-Allocation): malloc도 복사도 없습니다. method/target/헤더는 전부
+ *   "원래 버퍼 안의 위치 + 길이"로 돌려줍니다. (그래서 파싱이 끝날 때까지 버퍼를 옮기면 안 됨)
+ * - SIMD: 줄 끝('\n')을 16바이트(SSE2) / 32바이트(AVX2)씩 한꺼번에 비교해서 찾습니다.
+ *   -DHTTP_PARSER_NO_SIMD로 컴파일하면 바이트 단위 스칼라 버전으로 바뀝니다. (벤치마크 비교용)
+ * ======================================================================================
+ */
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h> // 조건부 요청의 날짜 (strptime/timegm은 _GNU_SOURCE 필요)
+
+#if !defined(HTTP_PARSER_NO_SIMD) && (defined(__SSE2__) || defined(__AVX2__))
+#include <immintrin.h>
+#endif
+
+/* * [상수 정의]
+ * - HTTP_MAX_HEADERS: 요청 하나에서 기억할 수 있는 최대 헤더 수 (넘으면 에러)
+ * - 반환값: 양수 = 요청 헤더 부분의 전체 길이(바이트), 아래 두 값은 음수 코드
+ */
+#define HTTP_MAX_HEADERS 32
+#define HTTP_PARSE_ERROR -1      // 문법 오류 (400 Bad Request)
+#define HTTP_PARSE_INCOMPLETE -2 // 아직 빈 줄까지 안 옴 -> 더 읽고 다시 호출
+
+/* [구조체: 헤더 하나] 이름과 값 모두 원래 버퍼를 가리킴 (NUL로 끝나지 않음!) */
+typedef struct {
+    const char* name;
+    size_t name_len;
+    const char* value;
+    size_t value_len;
+} HttpHeader;
+
+/* [구조체: 요청 + 파서 진행 상태] */
+typedef struct {
+    // --- 파싱 결과 (버퍼 안을 가리킴) ---
+    const char* method;      // 예: "GET"
+    size_t method_len;
+    const char* target;      // 예: "/index.html"
+    size_t target_len;
+    int version_minor;       // HTTP/1.0 -> 0, HTTP/1.1 -> 1
+    HttpHeader headers[HTTP_MAX_HEADERS];
+    size_t num_headers;
+
+    // --- 진행 상태 (다음 호출 때 이어서 하기 위함) ---
+    int state;               // 0 = 요청 라인 대기, 1 = 헤더 읽는 중
+    size_t line_start;       // 지금 보고 있는 줄의 시작 위치
+    size_t scan_pos;         // 이 위치 전까지는 '\n'이 없다고 이미 확인함
+} HttpRequest;
+
+/* [함수: 파서 초기화] 새 요청을 읽기 시작할 때마다 호출 */
+static inline void http_parser_init(HttpRequest* r) {
+    r->num_headers = 0;
+    r->state = 0;
+    r->line_start = 0;
+    r->scan_pos = 0;
+}
+
+/* * [함수: 줄 끝 찾기 (SIMD)]
+ * [p, end) 구간에서 첫 '\n'의 위치를 찾습니다. 없으면 NULL.
+ * 16/32바이트를 한 번에 '\n'과 비교(cmpeq) -> 결과를 비트마스크로 모음(movemask)
+ * -> 가장 낮은 1비트 위치(ctz)가 첫 '\n'입니다. 나머지 짜투리는 한 바이트씩 봅니다.
+ */
+static inline const char* http_find_lf(const char* p, const char* end) {
+#if !defined(HTTP_PARSER_NO_SIMD) && defined(__AVX2__)
+    const __m256i lf32 = _mm256_set1_epi8('\n');
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, lf32));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+#endif
+#if !defined(HTTP_PARSER_NO_SIMD) && defined(__SSE2__)
+    const __m128i lf16 = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf16));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    for (; p < end; p++) {
+        if (*p == '\n') return p;
+    }
+    return NULL;
+}
+
+/* [함수: 요청 라인 해석] "METHOD SP TARGET SP HTTP/1.x" -> 0 성공, -1 실패 */
+static inline int http_parse_request_line(HttpRequest* r, const char* p, const char* end) {
+    const char* sp1 = memchr(p, ' ', end - p);
+    if (!sp1 || sp1 == p) return -1;
+    for (const char* q = p; q < sp1; q++) {
+        if (*q < 'A' || *q > 'Z') return -1; // 메소드는 대문자 토큰
+    }
+    const char* t = sp1 + 1;
+    const char* sp2 = memchr(t, ' ', end - t);
+    if (!sp2 || sp2 == t) return -1;
+    const char* v = sp2 + 1;
+    if (end - v != 8 || memcmp(v, "HTTP/1.", 7) != 0 || v[7] < '0' || v[7] > '9') return -1;
+
+    r->method = p;
+    r->method_len = sp1 - p;
+    r->target = t;
+    r->target_len = sp2 - t;
+    r->version_minor = v[7] - '0';
+    return 0;
+}
+
+/* [함수: 헤더 한 줄 해석] "Name: value" (값 앞뒤 공백/탭은 잘라냄) -> 0 성공, -1 실패 */
+static inline int http_parse_header_line(HttpRequest* r, const char* p, const char* end) {
+    if (*p == ' ' || *p == '\t') return -1; // 옛날식 여러 줄 헤더(obs-fold)는 거부
+    const char* colon = memchr(p, ':', end - p);
+    if (!colon || colon == p) return -1;
+    for (const char* q = p; q < colon; q++) {
+        if (*q == ' ' || *q == '\t') return -1; // 이름과 ':' 사이 공백은 금지 (요청 스머글링 방지)
+    }
+    if (r->num_headers == HTTP_MAX_HEADERS) return -1;
+
+    const char* v = colon + 1;
+    while (v < end && (*v == ' ' || *v == '\t')) v++;
+    const char* ve = end;
+    while (ve > v && (ve[-1] == ' ' || ve[-1] == '\t')) ve--;
+
+    HttpHeader* h = &r->headers[r->num_headers++];
+    h->name = p;
+    h->name_len = colon - p;
+    h->value = v;
+    h->value_len = ve - v;
+    return 0;
+}
+
+/* * ======================================================================================
+ * [함수: 요청 파싱 (증분)]
+ * buf[0..len) 에 지금까지 받은 바이트를 넘깁니다. 이전 호출과 같은 버퍼(같은 시작 주소)여야 합니다.
+ * 반환값:
+ *   > 0                   : 요청 헤더가 완성됨. 값은 빈 줄까지 포함한 길이 (그 뒤는 다음 요청 = 파이프라이닝)
+ *   HTTP_PARSE_INCOMPLETE : 더 읽어서 다시 호출
+ *   HTTP_PARSE_ERROR      : 잘못된 요청
+ * 줄 끝은 "\r\n"이 표준이지만, 관대하게 "\n"만 와도 받아줍니다.
+ * ======================================================================================
+ */
+static inline int http_parse(HttpRequest* r, const char* buf, size_t len) {
+    for (;;) {
+        const char* lf = http_find_lf(buf + r->scan_pos, buf + len);
+        if (!lf) {
+            r->scan_pos = len; // 여기까지는 다음에 다시 안 봐도 됨
+            return HTTP_PARSE_INCOMPLETE;
+        }
+
+        const char* line = buf + r->line_start;
+        const char* line_end = (lf > line && lf[-1] == '\r') ? lf - 1 : lf;
+        size_t next = (size_t)(lf - buf) + 1;
+
+        if (r->state == 0) {
+            // 요청 라인 앞의 빈 줄은 무시 (RFC 9112: 이전 요청 뒤의 여분 CRLF 허용)
+            if (line_end != line) {
+                if (http_parse_request_line(r, line, line_end) < 0) return HTTP_PARSE_ERROR;
+                r->state = 1;
+            }
+        } else {
+            if (line_end == line) return (int)next; // 빈 줄 = 헤더 끝
+            if (http_parse_header_line(r, line, line_end) < 0) return HTTP_PARSE_ERROR;
+        }
+        r->line_start = r->scan_pos = next;
+    }
+}
+
+/* [함수: 헤더 찾기] 이름은 대소문자 구분 없이 비교. 없으면 NULL */
+static inline const HttpHeader* http_find_header(const HttpRequest* r, const char* name) {
+    size_t n = strlen(name);
+    for (size_t i = 0; i < r->num_headers; i++) {
+        if (r->headers[i].name_len == n && strncasecmp(r->headers[i].name, name, n) == 0)
+            return &r->headers[i];
+    }
+    return NULL;
+}
+
+/* * [함수: 헤더 값에 토큰이 있는지]
+ * "Connection: keep-alive, Upgrade" 처럼 쉼표로 나열된 값에서 token을 대소문자 구분 없이 찾음
+ */
+static inline int http_header_has_token(const HttpHeader* h, const char* token) {
+    size_t n = strlen(token);
+    const char* p = h->value;
+    const char* end = h->value + h->value_len;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+        const char* s = p;
+        while (p < end && *p != ',') p++;
+        const char* e = p;
+        while (e > s && (e[-1] == ' ' || e[-1] == '\t')) e--;
+        if ((size_t)(e - s) == n && strncasecmp(s, token, n) == 0) return 1;
+    }
+    return 0;
+}
+
+/* * [함수: Keep-Alive 여부]
+ * - HTTP/1.1: 기본이 유지, "Connection: close"면 끊음
+ * - HTTP/1.0: 기본이 끊기, "Connection: keep-alive"면 유지
+ */
+static inline int http_keep_alive(const HttpRequest* r) {
+    const HttpHeader* h = http_find_header(r, "Connection");
+    if (h && http_header_has_token(h, "close")) return 0;
+    if (h && http_header_has_token(h, "keep-alive")) return 1;
+    return r->version_minor >= 1;
+}
+
+/* * [함수: Accept-Encoding 해석]
+ * 클라이언트가 받을 수 있는 압축 방식을 비트마스크로 돌려줍니다. (HTTP_ENC_GZIP | HTTP_ENC_BR)
+ * - "gzip;q=0"처럼 q가 0이면 명시적으로 거절한 것
+ * - "*"는 따로 언급되지 않은 나머지 방식 전부를 뜻함
+ */
+#define HTTP_ENC_GZIP 1
+#define HTTP_ENC_BR 2
+
+static inline int http_accept_encoding(const HttpRequest* r) {
+    const HttpHeader* h = http_find_header(r, "Accept-Encoding");
+    if (!h) return 0;
+    int accepted = 0, mentioned = 0, star = 0;
+    const char* p = h->value;
+    const char* end = h->value + h->value_len;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+        const char* s = p;
+        while (p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') p++;
+        size_t n = p - s;
+
+        // 파라미터 중 q=0 (0, 0.0, 0.000) 이면 거절
+        int refused = 0;
+        while (p < end && *p != ',') {
+            if (*p == ';') {
+                const char* q = p + 1;
+                while (q < end && (*q == ' ' || *q == '\t')) q++;
+                if (end - q >= 3 && (q[0] == 'q' || q[0] == 'Q') && q[1] == '=' && q[2] == '0') {
+                    refused = 1;
+                    for (q += 3; q < end && *q != ',' && *q != ';' && *q != ' '; q++) {
+                        if (*q != '.' && *q != '0') refused = 0;
+                    }
+                }
+            }
+            p++;
+        }
+
+        int bit = 0;
+        if ((n == 4 && strncasecmp(s, "gzip", 4) == 0) || (n == 6 && strncasecmp(s, "x-gzip", 6) == 0))
+            bit = HTTP_ENC_GZIP;
+        else if (n == 2 && strncasecmp(s, "br", 2) == 0)
+            bit = HTTP_ENC_BR;
+        else if (n == 1 && *s == '*')
+            star = !refused;
+        mentioned |= bit;
+        if (!refused) accepted |= bit;
+    }
+    if (star > 0) accepted |= (HTTP_ENC_GZIP | HTTP_ENC_BR) & ~mentioned;
+    return accepted;
+}
+
+/* * ======================================================================================
+ * [조건부 요청 / Range 도우미]
+ * - 검증자(Validator): ETag(파일 버전을 구분하는 따옴표 문자열)와 Last-Modified(수정 시각)
+ *   클라이언트가 If-None-Match / If-Modified-Since로 "가진 버전"을 알려주면, 안 바뀐 경우 304로 본문 생략
+ * - Range: "bytes=0-99,200-,-500" 처럼 파일의 일부만 요청 (이어받기, 동영상 탐색)
+ * ======================================================================================
+ */
+#define HTTP_DATE_LEN 30  // "Sun, 06 Nov 1994 08:49:37 GMT" + '\0'
+#define HTTP_MAX_RANGES 8 // 이보다 구간이 많으면 Range를 무시하고 전체를 보냄 (잘게 쪼갠 요청으로 괴롭히기 방지)
+
+/* [구조체: 바이트 구간] 양끝 포함 (bytes=0-99 -> start 0, end 99) */
+typedef struct {
+    long long start;
+    long long end;
+} HttpRange;
+
+/* [함수: HTTP 날짜 만들기] 항상 GMT 기준의 IMF-fixdate 형식 */
+static inline void http_format_date(time_t t, char out[HTTP_DATE_LEN]) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(out, HTTP_DATE_LEN, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+/* [함수: HTTP 날짜 해석] 실패하면 -1 (해석 못 한 조건은 없는 것으로 취급) */
+static inline time_t http_parse_date(const char* s, size_t len) {
+    char buf[64];
+    struct tm tm;
+    if (len >= sizeof(buf)) return -1;
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end || *end) return -1;
+    return timegm(&tm);
+}
+
+/* * [함수: ETag 목록에 일치하는 것이 있는지]
+ * If-None-Match: "abc", W/"def"  또는  *
+ * If-None-Match는 약한 비교(W/ 접두사 무시)를 씁니다.
+ */
+static inline int http_etag_list_matches(const HttpHeader* h, const char* etag) {
+    size_t n = strlen(etag);
+    const char* p = h->value;
+    const char* end = h->value + h->value_len;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+        const char* s = p;
+        while (p < end && *p != ',') p++;
+        const char* e = p;
+        while (e > s && (e[-1] == ' ' || e[-1] == '\t')) e--;
+        if (e - s == 1 && *s == '*') return 1;
+        if (e - s >= 2 && s[0] == 'W' && s[1] == '/') s += 2;
+        if ((size_t)(e - s) == n && memcmp(s, etag, n) == 0) return 1;
+    }
+    return 0;
+}
+
+/* * [함수: 304 Not Modified로 답해도 되는지]
+ * If-None-Match가 있으면 그것만 보고(더 정확함), 없을 때만 If-Modified-Since를 봅니다. (RFC 9110 13.2.2)
+ */
+static inline int http_not_modified(const HttpRequest* r, const char* etag, time_t mtime) {
+    const HttpHeader* inm = http_find_header(r, "If-None-Match");
+    if (inm) return http_etag_list_matches(inm, etag);
+    const HttpHeader* ims = http_find_header(r, "If-Modified-Since");
+    if (ims) {
+        time_t t = http_parse_date(ims->value, ims->value_len);
+        return t != (time_t)-1 && mtime <= t;
+    }
+    return 0;
+}
+
+/* [함수: 10진수 읽기] 숫자가 하나도 없거나 너무 크면 -1 */
+static inline long long http_parse_num(const char** pp, const char* end) {
+    const char* p = *pp;
+    long long v = 0;
+    if (p >= end || *p < '0' || *p > '9') return -1;
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (v > (0x7fffffffffffffffLL - 9) / 10) return -1;
+        v = v * 10 + (*p++ - '0');
+    }
+    *pp = p;
+    return v;
+}
+
+/* * ======================================================================================
+ * [함수: Range 해석]
+ * size 바이트짜리 파일에 대한 Range 헤더를 구간 목록으로 바꿉니다.
+ * 반환값:
+ *   > 0 : 만족 가능한 구간 수 (out에 채움)  -> 206 Partial Content
+ *   0   : Range가 없거나, 문법이 틀렸거나, 구간이 너무 많음 -> 무시하고 200으로 전체 전송
+ *   -1  : 문법은 맞지만 전부 파일 범위 밖 -> 416 Range Not Satisfiable
+ * If-Range가 있으면 그 값(ETag 또는 날짜)이 지금 파일과 정확히 같을 때만 Range를 따릅니다.
+ * (파일이 바뀌었는데 예전 파일 뒤에 새 파일 조각을 이어 붙이면 깨진 파일이 되므로, 그땐 전체를 다시 보냄)
+ * ======================================================================================
+ */
+static inline int http_parse_range(const HttpRequest* r, long long size, const char* etag, time_t mtime,
+                                   HttpRange out[HTTP_MAX_RANGES]) {
+    const HttpHeader* h = http_find_header(r, "Range");
+    if (!h) return 0;
+
+    const HttpHeader* ir = http_find_header(r, "If-Range");
+    if (ir) {
+        if (ir->value_len > 0 && ir->value[0] == '"') { // ETag는 강한 비교: 정확히 같아야 함
+            if (ir->value_len != strlen(etag) || memcmp(ir->value, etag, ir->value_len) != 0) return 0;
+        } else if (http_parse_date(ir->value, ir->value_len) != mtime) {
+            return 0;
+        }
+    }
+
+    const char* p = h->value;
+    const char* end = h->value + h->value_len;
+    if (end - p < 6 || strncasecmp(p, "bytes=", 6) != 0) return 0; // 모르는 단위는 무시
+    p += 6;
+
+    int count = 0, specs = 0;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t')) p++;
+        long long first, last = -1;
+        if (p < end && *p == '-') { // "-500" = 마지막 500바이트
+            p++;
+            long long suffix = http_parse_num(&p, end);
+            if (suffix < 0) return 0;
+            first = (suffix == 0 || size == 0) ? -1 : (suffix >= size ? 0 : size - suffix);
+            last = size - 1;
+        } else {                    // "100-199" 또는 "100-" (끝까지)
+            first = http_parse_num(&p, end);
+            if (first < 0 || p >= end || *p != '-') return 0;
+            p++;
+            if (p < end && *p >= '0' && *p <= '9') {
+                last = http_parse_num(&p, end);
+                if (last < first) return 0; // "500-100"은 문법 오류 -> 헤더 전체 무시
+            }
+            if (first >= size) first = -1; // 파일 밖 구간은 버림
+            else if (last < 0 || last >= size) last = size - 1;
+        }
+        while (p < end && (*p == ' ' || *p == '\t')) p++;
+        if (p < end && *p++ != ',') return 0;
+
+        if (++specs > HTTP_MAX_RANGES) return 0;
+        if (first >= 0) {
+            out[count].start = first;
+            out[count].end = last;
+            count++;
+        }
+    }
+    if (specs == 0) return 0;
+    return count > 0 ? count : -1;
+}
+
+/* [함수: 메소드 비교] NUL로 끝나지 않으므로 길이까지 비교 */
+static inline int http_method_is(const HttpRequest* r, const char* method) {
+    size_t n = strlen(method);
+    return r->method_len == n && memcmp(r->method, method, n) == 0;
+}
+
+/* * ======================================================================================
+ * [요청 본문 디코더 (Content-Length / chunked)]
+ * POST 같은 요청은 헤더 뒤에 본문이 따라옵니다. 본문의 끝은 둘 중 하나로 알려 줌:
+ * - Content-Length: 정확히 그만큼의 바이트
+ * - Transfer-Encoding: chunked: "16진수 길이\r\n" + 그만큼의 데이터 + "\r\n" 을 반복, 길이 0이면 끝
+ *   (그 뒤에 트레일러 헤더가 올 수 있고 빈 줄로 끝남)
+ * 헤더 파서처럼 증분 방식이라 조각으로 와도 되고, 디코딩은 제자리(in-place)에서 합니다.
+ * chunked를 풀면 바이트가 줄기만 하므로 결과를 입력 버퍼 앞쪽에 덮어써도 아직 안 읽은 입력을 밟지 않음
+ * 두 헤더가 함께 있거나 값이 이상하면 거부합니다. (프록시와 서버가 본문 끝을 다르게 보면
+ * 본문 안에 숨긴 두 번째 요청이 실행되는 Request Smuggling 공격이 됨)
+ * ======================================================================================
+ */
+#define HTTP_BODY_MAX_LINE 1024 // chunk 길이 줄 / 트레일러 한 줄의 최대 길이
+
+typedef struct {
+    int chunked;              // 1 = chunked, 0 = Content-Length
+    int state;                // chunked: 0 길이 줄, 1 데이터, 2 데이터 뒤 CRLF, 3 트레일러, 4 끝
+    unsigned long long remain; // Content-Length: 남은 바이트 / chunked: 지금 조각에서 남은 바이트
+} HttpBody;
+
+/* [함수: 본문 디코더 초기화] 반환값: 1 = 본문 있음, 0 = 없음, HTTP_PARSE_ERROR = 잘못된 길이 정보 */
+static inline int http_body_init(HttpBody* b, const HttpRequest* r) {
+    const HttpHeader* te = http_find_header(r, "Transfer-Encoding");
+    const HttpHeader* cl = http_find_header(r, "Content-Length");
+    b->chunked = 0;
+    b->state = 0;
+    b->remain = 0;
+    if (te) {
+        // chunked만 지원 (gzip 등 다른 전송 인코딩과 섞인 것은 거부)
+        if (cl || te->value_len != 7 || strncasecmp(te->value, "chunked", 7) != 0) return HTTP_PARSE_ERROR;
+        b->chunked = 1;
+        return 1;
+    }
+    if (!cl) return 0;
+    const char* p = cl->value;
+    long long n = http_parse_num(&p, cl->value + cl->value_len);
+    if (n < 0 || p != cl->value + cl->value_len) return HTTP_PARSE_ERROR;
+    b->remain = n;
+    return n > 0;
+}
+
+/* [함수: 본문을 끝까지 받았는지] */
+static inline int http_body_done(const HttpBody* b) {
+    return b->chunked ? b->state == 4 : b->remain == 0;
+}
+
+/* * [함수: 본문 디코딩]
+ * buf[0, len) 에서 읽을 수 있는 만큼 읽고 풀어낸 데이터를 buf 앞쪽에 씀 (*out_len 바이트)
+ * 반환값: 소비한 입력 바이트 수 (뒤에 남은 것은 다음 요청이거나 아직 덜 온 줄), 문법 오류면 HTTP_PARSE_ERROR
+ */
+static inline long http_body_decode(HttpBody* b, char* buf, size_t len, size_t* out_len) {
+    size_t in = 0, out = 0;
+    if (!b->chunked) {
+        size_t n = len < b->remain ? len : (size_t)b->remain;
+        b->remain -= n;
+        *out_len = n;
+        return n;
+    }
+    while (in < len && b->state != 4) {
+        if (b->state == 1) { // 데이터: 그대로 앞으로 당김
+            size_t n = len - in < b->remain ? len - in : (size_t)b->remain;
+            memmove(buf + out, buf + in, n);
+            in += n;
+            out += n;
+            b->remain -= n;
+            if (b->remain == 0) b->state = 2;
+            continue;
+        }
+        // 나머지 상태는 모두 줄 단위
+        const char* lf = memchr(buf + in, '\n', len - in);
+        if (!lf) {
+            if (len - in > HTTP_BODY_MAX_LINE) return HTTP_PARSE_ERROR;
+            break; // 줄이 덜 옴
+        }
+        const char* p = buf + in;
+        const char* e = lf;
+        if (e > p && e[-1] == '\r') e--;
+        in = lf - buf + 1;
+        if (b->state == 0) { // "1a2b;ext=1" -> 0x1a2b (확장은 무시)
+            unsigned long long v = 0;
+            int digits = 0;
+            for (; p < e; p++, digits++) {
+                int d = *p >= '0' && *p <= '9' ? *p - '0'
+                      : (*p | 0x20) >= 'a' && (*p | 0x20) <= 'f' ? (*p | 0x20) - 'a' + 10 : -1;
+                if (d < 0) break;
+                if (digits == 15) return HTTP_PARSE_ERROR; // 60비트를 넘는 길이
+                v = v * 16 + d;
+            }
+            while (p < e && (*p == ' ' || *p == '\t')) p++;
+            if (digits == 0 || (p < e && *p != ';')) return HTTP_PARSE_ERROR;
+            b->remain = v;
+            b->state = v ? 1 : 3;
+        } else if (b->state == 2) { // 데이터 바로 뒤는 빈 줄이어야 함
+            if (e != p) return HTTP_PARSE_ERROR;
+            b->state = 0;
+        } else if (e == p) {        // 트레일러는 읽고 버림, 빈 줄이면 끝
+            b->state = 4;
+        }
+    }
+    *out_len = out;
+    return in;
+}
+
+#endif /* HTTP_PARSER_H */
@@ -0,0 +1,537 @@
+/* loadgen.c */
+
+/* * ======================================================================================
+ * [부하 생성기 + 지연 시간 측정기]
+ * webserver.c / webserver-mt.c 를 같은 조건에서 비교하기 위한 HTTP 부하 도구입니다.
+ *
+ * 두 가지 모드:
+ * - 닫힌 루프(Closed-Loop, 기본): 연결마다 "요청 -> 응답 받으면 바로 다음 요청"을 반복합니다.
+ *   서버가 낼 수 있는 최대 처리량을 잴 때 씁니다.
+ * - 열린 루프(Open-Loop, -R rate): 서버가 느려지든 말든 정해진 속도(초당 rate개)로 요청을 "예약"합니다.
+ *   지연 시간은 실제로 보낸 시각이 아니라 "보냈어야 할 시각"부터 잽니다.
+ *   (닫힌 루프는 서버가 멈추면 요청도 같이 멈춰서 나쁜 지연이 숨어버림 = Coordinated Omission)
+ *
+ * 지연 시간은 HDR 히스토그램(유효숫자 약 3자리, 1ns ~ 약 18분)에 모아 p50/p99/p99.9를 계산합니다.
+ * -o 파일을 주면 결과를 JSON 한 줄로 덧붙여서(append) 여러 실행 결과를 나중에 비교할 수 있습니다.
+ *
+ * 컴파일: gcc -O2 -o loadgen loadgen.c -pthread
+ * 사용 예:
+ *   ./loadgen -c 64 -t 2 -d 10 -u /index.html -l "pool q16" -o results.jsonl
+ *   ./loadgen -c 64 -R 20000 -d 10 -l "epoll open-loop" -o results.jsonl
+ * ======================================================================================
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <pthread.h>
+#include <time.h>
+
+/* * [상수 정의]
+ * - RESP_BUF: 응답 헤더를 모아두는 버퍼 크기 (본문은 세기만 하고 버림)
+ * - MAX_EVENTS: epoll_wait 한 번에 돌려받을 최대 이벤트 수
+ * - RETRY_NS: 연결 실패 후 다시 시도하기까지 기다리는 시간 (서버가 꺼져 있을 때 헛돌지 않게)
+ * - HIST_SUB_BITS: HDR 히스토그램 정밀도. 2^11 = 2048 -> 같은 자릿수 안에서 1/1024 간격 (약 0.1%)
+ * - HIST_MAX_BITS: 기록 가능한 최대값 2^40 ns (약 18분). 더 크면 최대 칸에 넣음
+ */
+#define RESP_BUF 8192
+#define MAX_EVENTS 256
+#define RETRY_NS 10000000LL
+#define HIST_SUB_BITS 11
+#define HIST_SUB_HALF (1 << (HIST_SUB_BITS - 1))
+#define HIST_MAX_BITS 40
+#define HIST_BUCKETS (HIST_SUB_HALF * (HIST_MAX_BITS - HIST_SUB_BITS + 3))
+
+/* * ======================================================================================
+ * [HDR 히스토그램]
+ * 값의 크기(최상위 비트 위치)마다 1024칸씩을 두는 로그-선형(log-linear) 구조입니다.
+ * - 0 ~ 2047ns 는 1ns 단위로 정확히
+ * - 그 이상은 "자릿수(2의 거듭제곱)마다 1024칸" -> 상대 오차가 항상 1/1024 이하
+ * 고정 크기 배열이라 기록이 O(1)이고, 스레드별로 따로 모은 뒤 칸끼리 더하면 합쳐집니다.
+ * ======================================================================================
+ */
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t min, max;
+    double sum;
+} Hist;
+
+static int hist_index(uint64_t v) {
+    if (v >= (1ULL << HIST_MAX_BITS)) v = (1ULL << HIST_MAX_BITS) - 1;
+    if (v < 2 * HIST_SUB_HALF) return (int)v;
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - (HIST_SUB_BITS - 1);                 // v >> shift 가 [1024, 2048) 에 들어오게
+    return HIST_SUB_HALF * (shift + 1) + (int)((v >> shift) - HIST_SUB_HALF);
+}
+
+/* [함수: 칸 번호 -> 그 칸이 대표하는 가장 큰 값] (HdrHistogram의 highestEquivalentValue와 같은 규칙) */
+static uint64_t hist_value(int idx) {
+    if (idx < 2 * HIST_SUB_HALF) return (uint64_t)idx;
+    int shift = idx / HIST_SUB_HALF - 1;
+    uint64_t sub = (uint64_t)(idx % HIST_SUB_HALF + HIST_SUB_HALF);
+    return (sub << shift) + ((1ULL << shift) - 1);
+}
+
+static void hist_record(Hist* h, uint64_t v) {
+    h->counts[hist_index(v)]++;
+    if (h->total == 0 || v < h->min) h->min = v;
+    if (v > h->max) h->max = v;
+    h->total++;
+    h->sum += (double)v;
+}
+
+static void hist_merge(Hist* dst, const Hist* src) {
+    if (src->total == 0) return;
+    for (int i = 0; i < HIST_BUCKETS; i++) dst->counts[i] += src->counts[i];
+    if (dst->total == 0 || src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+    dst->total += src->total;
+    dst->sum += src->sum;
+}
+
+/* [함수: 백분위수] 누적 개수가 전체의 p%를 처음 넘는 칸의 값 */
+static uint64_t hist_percentile(const Hist* h, double p) {
+    if (h->total == 0) return 0;
+    uint64_t want = (uint64_t)(p / 100.0 * (double)h->total + 0.5);
+    if (want < 1) want = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= want) {
+            uint64_t v = hist_value(i);
+            return v > h->max ? h->max : v;
+        }
+    }
+    return h->max;
+}
+
+/* * ======================================================================================
+ * [설정 (명령행 옵션)]
+ * ======================================================================================
+ */
+static struct {
+    const char* host;
+    int port;
+    const char* path;
+    int connections;
+    int threads;
+    double duration;   // 초
+    double rate;       // 초당 요청 수 (0 = 닫힌 루프)
+    int keep_alive;    // 0이면 요청마다 새 연결 (Connection: close)
+    const char* out;   // 결과 JSON을 덧붙일 파일
+    const char* label; // 결과에 같이 적을 이름 (예: "pool q16")
+} cfg = { "127.0.0.1", 8080, "/index.html", 64, 1, 10.0, 0.0, 1, NULL, "" };
+
+static struct sockaddr_in server_addr;
+static char request[1024];
+static size_t request_len;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* * ======================================================================================
+ * [연결 하나의 상태]
+ * IDLE -> (CONNECTING) -> WRITING -> READING -> IDLE ... 을 반복합니다.
+ * - due: IDLE일 때 다음 요청을 시작할 시각 (열린 루프에서는 예약 시각, 실패 후에는 재시도 시각)
+ * - start: 지연 시간 측정의 기준 시각
+ * ======================================================================================
+ */
+typedef enum { C_IDLE, C_CONNECTING, C_WRITING, C_READING } ConnState;
+
+typedef struct {
+    int fd;                   // -1이면 아직 연결 안 됨
+    ConnState state;
+    int64_t due;
+    int64_t start;
+    size_t sent;              // 요청 바이트 중 보낸 양
+    char buf[RESP_BUF];       // 응답 헤더
+    size_t len;
+    int header_done;
+    int status;               // 응답 상태 코드
+    long long body_remain;    // 남은 본문 길이 (-1 = Content-Length 없음 -> EOF까지)
+    int server_close;         // 응답 뒤 서버가 연결을 닫음
+} Conn;
+
+/* [스레드 하나의 상태] 카운터와 히스토그램은 스레드마다 따로 두고 끝에 합침 (공유 없음 = 락 없음) */
+typedef struct {
+    pthread_t tid;
+    int epfd, timerfd;
+    Conn* conns;
+    int nconns;
+    int first;                // 전체 연결 중 이 스레드가 맡은 첫 번호 (열린 루프 시작 시각을 엇갈리게)
+    int64_t interval;         // 열린 루프에서 연결 하나가 요청을 보내는 간격
+    int64_t end;              // 측정 종료 시각
+    int rearm;                // 재시도가 예약되어 타이머를 다시 맞춰야 함
+    Hist hist;
+    uint64_t requests, errors, non2xx, bytes, connects;
+} Worker;
+
+static void conn_reset(Worker* w, Conn* c, int failed, int64_t now) {
+    if (c->fd >= 0) {
+        epoll_ctl(w->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+        c->fd = -1;
+    }
+    c->state = C_IDLE;
+    if (failed) {
+        w->errors++;
+        w->rearm = 1;
+        // 실패한 요청은 에러로만 세고, 잠시 뒤 새 연결로 다시 시작 (열린 루프는 예약이 그만큼 밀림)
+        c->due = now + RETRY_NS;
+    }
+}
+
+/* [함수: 요청 보내기] 보낼 수 있는 만큼 보내고, 다 보냈으면 READING으로 */
+static int conn_write(Conn* c) {
+    while (c->sent < request_len) {
+        ssize_t n = send(c->fd, request + c->sent, request_len - c->sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        c->sent += n;
+    }
+    c->state = C_READING;
+    c->len = 0;
+    c->header_done = 0;
+    return 0;
+}
+
+/* [함수: 새 요청 시작] 연결이 없으면 먼저 connect (논블로킹이라 완료는 EPOLLOUT으로 알 수 있음) */
+static int conn_begin(Worker* w, Conn* c, int64_t now) {
+    // 지연 시간 기준: 열린 루프는 예약 시각, 닫힌 루프는 지금
+    c->start = cfg.rate > 0 ? c->due : now;
+    c->sent = 0;
+
+    if (c->fd < 0) {
+        c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (c->fd < 0) return -1;
+        int one = 1;
+        setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLET, .data.ptr = c };
+        epoll_ctl(w->epfd, EPOLL_CTL_ADD, c->fd, &ev);
+        w->connects++;
+        if (connect(c->fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+            if (errno != EINPROGRESS) return -1;
+            c->state = C_CONNECTING;
+            return 0;
+        }
+    }
+    c->state = C_WRITING;
+    return conn_write(c);
+}
+
+/* * [함수: 응답 헤더 해석]
+ * 상태 코드, Content-Length, Connection: close 만 봅니다. 헤더 뒤에 이미 받은 바이트는 본문으로 셈.
+ * 반환값: 1 = 헤더 완성, 0 = 더 읽어야 함, -1 = 잘못된 응답
+ */
+static int parse_response_header(Conn* c) {
+    char* end = memmem(c->buf, c->len, "\r\n\r\n", 4);
+    if (!end) return c->len == sizeof(c->buf) - 1 ? -1 : 0;
+    size_t hdr_len = (size_t)(end - c->buf) + 4;
+    c->buf[hdr_len - 2] = '\0'; // 헤더만 문자열로 다룰 수 있게 잘라냄
+
+    if (sscanf(c->buf, "HTTP/1.%*d %d", &c->status) != 1) return -1;
+    c->body_remain = -1;
+    c->server_close = 0;
+    for (char* line = strstr(c->buf, "\r\n"); line; line = strstr(line + 2, "\r\n")) {
+        char* h = line + 2;
+        if (strncasecmp(h, "Content-Length:", 15) == 0) c->body_remain = atoll(h + 15);
+        else if (strncasecmp(h, "Connection:", 11) == 0 && strcasestr(h + 11, "close")) c->server_close = 1;
+    }
+    // 본문이 없는 응답 (1xx / 204 / 304)
+    if (c->status / 100 == 1 || c->status == 204 || c->status == 304) c->body_remain = 0;
+    if (c->body_remain >= 0) c->body_remain -= (long long)(c->len - hdr_len);
+    c->header_done = 1;
+    return 1;
+}
+
+/* [함수: 응답 하나 완료] 지연 시간을 기록하고 다음 요청 시각을 정함 */
+static void conn_complete(Worker* w, Conn* c, int64_t now) {
+    if (now <= w->end) {
+        hist_record(&w->hist, (uint64_t)(now - c->start));
+        w->requests++;
+        if (c->status / 100 != 2) w->non2xx++;
+    }
+    if (c->server_close || !cfg.keep_alive) conn_reset(w, c, 0, now);
+    c->state = C_IDLE;
+    c->due = cfg.rate > 0 ? c->due + w->interval : now;
+}
+
+/* [함수: 연결 하나 구동] 이벤트가 올 때마다 상태에 맞게 진행. -1이면 연결을 버림 */
+static int conn_drive(Worker* w, Conn* c, int64_t now) {
+    if (c->state == C_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err == EINPROGRESS || err == EALREADY) return 0;
+        if (err) return -1;
+        c->state = C_WRITING;
+    }
+    if (c->state == C_WRITING && conn_write(c) < 0) return -1;
+    if (c->state != C_READING) return 0;
+
+    while (1) {
+        char sink[65536];
+        char* dst = c->header_done ? sink : c->buf + c->len;
+        size_t room = c->header_done ? sizeof(sink) : sizeof(c->buf) - 1 - c->len;
+        ssize_t n = read(c->fd, dst, room);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        if (n == 0) {
+            // 연결 종료: 길이 없는 응답이면 이게 본문의 끝
+            if (c->header_done && c->body_remain < 0) {
+                c->server_close = 1;
+                conn_complete(w, c, now);
+                return 0;
+            }
+            return -1;
+        }
+        w->bytes += n;
+        if (!c->header_done) {
+            c->len += n;
+            int r = parse_response_header(c);
+            if (r < 0) return -1;
+            if (r == 0) continue;
+        } else if (c->body_remain > 0) {
+            c->body_remain -= n;
+        }
+        if (c->body_remain == 0) {
+            conn_complete(w, c, now);
+            return 0;
+        }
+        if (c->body_remain < -1) return -1; // Content-Length보다 많이 옴
+    }
+}
+
+/* [함수: 타이머 맞추기] IDLE 연결 중 가장 이른 due에 timerfd가 울리게 함 (절대 시각) */
+static void arm_timer(Worker* w) {
+    int64_t next = w->end;
+    for (int i = 0; i < w->nconns; i++) {
+        if (w->conns[i].state == C_IDLE && w->conns[i].due < next) next = w->conns[i].due;
+    }
+    struct itimerspec its = { { 0, 0 }, { next / 1000000000LL, next % 1000000000LL } };
+    if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) its.it_value.tv_nsec = 1;
+    timerfd_settime(w->timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* [함수: 때가 된 IDLE 연결들에 요청 시작] */
+static void start_due(Worker* w, int64_t now) {
+    for (int i = 0; i < w->nconns; i++) {
+        Conn* c = &w->conns[i];
+        if (c->state == C_IDLE && c->due <= now && now < w->end) {
+            if (conn_begin(w, c, now) < 0) conn_reset(w, c, 1, now);
+        }
+    }
+}
+
+/* * ======================================================================================
+ * [워커 스레드]
+ * 자기 몫의 연결들을 epoll 하나로 돌립니다. 시간 관련 일(열린 루프 예약, 재시도, 종료)은 timerfd 하나로 처리.
+ * ======================================================================================
+ */
+static void* worker_main(void* arg) {
+    Worker* w = arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    struct epoll_event tev = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->timerfd, &tev);
+
+    int64_t now = now_ns();
+    start_due(w, now);
+    arm_timer(w);
+
+    while ((now = now_ns()) < w->end) {
+        int n = epoll_wait(w->epfd, events, MAX_EVENTS, -1);
+        if (n < 0 && errno != EINTR) break;
+        now = now_ns();
+        int timer_fired = 0;
+        for (int i = 0; i < n; i++) {
+            Conn* c = events[i].data.ptr;
+            if (!c) {
+                uint64_t expirations;
+                if (read(w->timerfd, &expirations, sizeof(expirations)) < 0) { /* 이미 읽힘 */ }
+                timer_fired = 1;
+                continue;
+            }
+            if (c->fd < 0) continue; // 같은 배치에서 이미 닫힘
+            if (conn_drive(w, c, now) < 0) conn_reset(w, c, 1, now);
+        }
+        // 닫힌 루프는 응답을 받은 연결이 바로(due = now) 다음 요청을 보냄
+        start_due(w, now);
+        if (timer_fired || cfg.rate > 0 || w->rearm) {
+            w->rearm = 0;
+            arm_timer(w);
+        }
+    }
+
+    for (int i = 0; i < w->nconns; i++) {
+        if (w->conns[i].fd >= 0) close(w->conns[i].fd);
+    }
+    return NULL;
+}
+
+/* [함수: JSON 문자열 안전하게 쓰기] 따옴표/역슬래시/제어문자만 처리하면 충분 */
+static void json_string(FILE* f, const char* s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20) fprintf(f, "\\u%04x", *s);
+        else fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s [-c connections] [-t threads] [-d seconds] [-R rate] [-H host] [-p port]\n"
+            "          [-u path] [-k] [-o results.jsonl] [-l label]\n"
+            "  -R rate : 열린 루프 (초당 요청 수). 생략하면 닫힌 루프\n"
+            "  -k      : Keep-Alive 끄기 (요청마다 새 연결)\n",
+            prog);
+    exit(1);
+}
+
+/* * ======================================================================================
+ * [메인 함수]
+ * 옵션 해석 -> 스레드별로 연결을 나눠 맡겨 실행 -> 결과 합치기 -> 화면과 파일(JSON)에 출력
+ * ======================================================================================
+ */
+int main(int argc, char* argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "c:t:d:R:H:p:u:ko:l:")) != -1) {
+        switch (opt) {
+        case 'c': cfg.connections = atoi(optarg); break;
+        case 't': cfg.threads = atoi(optarg); break;
+        case 'd': cfg.duration = atof(optarg); break;
+        case 'R': cfg.rate = atof(optarg); break;
+        case 'H': cfg.host = optarg; break;
+        case 'p': cfg.port = atoi(optarg); break;
+        case 'u': cfg.path = optarg; break;
+        case 'k': cfg.keep_alive = 0; break;
+        case 'o': cfg.out = optarg; break;
+        case 'l': cfg.label = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (cfg.connections < 1 || cfg.threads < 1 || cfg.duration <= 0 || cfg.rate < 0) usage(argv[0]);
+    if (cfg.threads > cfg.connections) cfg.threads = cfg.connections;
+
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(cfg.port);
+    if (inet_pton(AF_INET, cfg.host, &server_addr.sin_addr) != 1) {
+        fprintf(stderr, "bad host (IPv4 address expected): %s\n", cfg.host);
+        return 1;
+    }
+    request_len = snprintf(request, sizeof(request),
+                           "GET %s HTTP/1.1\r\nHost: %s:%d\r\nUser-Agent: loadgen\r\nConnection: %s\r\n\r\n",
+                           cfg.path, cfg.host, cfg.port, cfg.keep_alive ? "keep-alive" : "close");
+    if (request_len >= sizeof(request)) {
+        fprintf(stderr, "path too long\n");
+        return 1;
+    }
+
+    // 연결을 스레드 수로 나눠 맡김 (나머지는 앞쪽 스레드가 하나씩 더)
+    Worker* workers = calloc(cfg.threads, sizeof(Worker));
+    Conn* conns = calloc(cfg.connections, sizeof(Conn));
+    if (!workers || !conns) { perror("calloc"); return 1; }
+
+    int64_t t0 = now_ns();
+    int64_t end = t0 + (int64_t)(cfg.duration * 1e9);
+    int64_t gap = cfg.rate > 0 ? (int64_t)(1e9 / cfg.rate) : 0; // 전체 기준 요청 간격
+    int next = 0;
+    for (int i = 0; i < cfg.threads; i++) {
+        Worker* w = &workers[i];
+        w->nconns = cfg.connections / cfg.threads + (i < cfg.connections % cfg.threads);
+        w->first = next;
+        w->conns = conns + next;
+        w->interval = gap * cfg.connections;
+        w->end = end;
+        w->epfd = epoll_create1(EPOLL_CLOEXEC);
+        w->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (w->epfd < 0 || w->timerfd < 0) { perror("epoll/timerfd"); return 1; }
+        for (int j = 0; j < w->nconns; j++) {
+            w->conns[j].fd = -1;
+            w->conns[j].state = C_IDLE;
+            // 열린 루프: 연결 k는 t0 + k*gap 에 첫 요청 -> 전체적으로 gap 간격으로 고르게 퍼짐
+            w->conns[j].due = t0 + gap * (w->first + j);
+        }
+        next += w->nconns;
+    }
+
+    for (int i = 0; i < cfg.threads; i++) pthread_create(&workers[i].tid, NULL, worker_main, &workers[i]);
+
+    Hist* total = calloc(1, sizeof(Hist));
+    uint64_t requests = 0, errors = 0, non2xx = 0, bytes = 0, connects = 0;
+    for (int i = 0; i < cfg.threads; i++) {
+        Worker* w = &workers[i];
+        pthread_join(w->tid, NULL);
+        hist_merge(total, &w->hist);
+        requests += w->requests;
+        errors += w->errors;
+        non2xx += w->non2xx;
+        bytes += w->bytes;
+        connects += w->connects;
+        close(w->epfd);
+        close(w->timerfd);
+    }
+
+    double elapsed = (end - t0) / 1e9;
+    double rps = requests / elapsed;
+    double mean_us = total->total ? total->sum / total->total / 1e3 : 0;
+    double p50 = hist_percentile(total, 50) / 1e3, p90 = hist_percentile(total, 90) / 1e3;
+    double p99 = hist_percentile(total, 99) / 1e3, p999 = hist_percentile(total, 99.9) / 1e3;
+    double min_us = total->min / 1e3, max_us = total->max / 1e3;
+    const char* mode = cfg.rate > 0 ? "open" : "closed";
+
+    printf("%s-loop %s:%d%s  %d conns / %d threads / %.1fs%s\n", mode, cfg.host, cfg.port, cfg.path,
+           cfg.connections, cfg.threads, elapsed, cfg.keep_alive ? "" : " (no keep-alive)");
+    if (cfg.rate > 0) printf("  target rate  %.0f req/s\n", cfg.rate);
+    printf("  requests     %llu  (%.0f req/s, %.2f MB/s)\n", (unsigned long long)requests, rps,
+           bytes / elapsed / 1e6);
+    printf("  errors       %llu  non-2xx %llu  connects %llu\n", (unsigned long long)errors,
+           (unsigned long long)non2xx, (unsigned long long)connects);
+    printf("  latency(us)  min %.1f  mean %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           min_us, mean_us, p50, p90, p99, p999, max_us);
+
+    if (cfg.out) {
+        FILE* f = fopen(cfg.out, "a");
+        if (!f) { perror(cfg.out); return 1; }
+        fprintf(f, "{\"time\":%lld,\"label\":", (long long)time(NULL));
+        json_string(f, cfg.label);
+        fprintf(f, ",\"mode\":\"%s\",\"target\":", mode);
+        char target[512];
+        snprintf(target, sizeof(target), "%s:%d%s", cfg.host, cfg.port, cfg.path);
+        json_string(f, target);
+        fprintf(f, ",\"connections\":%d,\"threads\":%d,\"keep_alive\":%s,\"duration_s\":%.3f,\"rate\":%.1f,"
+                   "\"requests\":%llu,\"errors\":%llu,\"non_2xx\":%llu,\"connects\":%llu,\"bytes\":%llu,"
+                   "\"rps\":%.1f,\"latency_us\":{\"min\":%.1f,\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,"
+                   "\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}\n",
+                cfg.connections, cfg.threads, cfg.keep_alive ? "true" : "false", elapsed, cfg.rate,
+                (unsigned long long)requests, (unsigned long long)errors, (unsigned long long)non2xx,
+                (unsigned long long)connects, (unsigned long long)bytes, rps, min_us, mean_us, p50, p90, p99,
+                p999, max_us);
+        fclose(f);
+    }
+
+    free(total);
+    free(conns);
+    free(workers);
+    return 0;
+}
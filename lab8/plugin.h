@@ -0,0 +1,74 @@
+/* plugin.h */
+
+/* * ======================================================================================
+ * [핸들러 플러그인 API]
+ * webserver-mt.c 가 ./www 의 정적 파일 말고도, 공유 라이브러리(.so)로 만든 핸들러에게
+ * URL 접두어("/api/" 등)를 통째로 맡길 수 있게 하는 약속입니다. 서버와 플러그인이 함께 include 합니다.
+ *
+ * 별도의 앱 서버(예: 헬스 체크용 작은 JSON 서버)로 프록시하면 요청마다 네트워크를 한 번 더 건너야 하지만,
+ * 플러그인은 서버 프로세스 안에서 함수 호출 한 번으로 응답을 만듭니다.
+ *
+ * 사용법:
+ *   gcc -O2 -shared -fPIC -o plugin_status.so plugin_status.c
+ *   ./webserver-mt -L /api/=./plugin_status.so
+ *
+ * 플러그인이 할 일:
+ * - Lab8Plugin 구조체를 LAB8_PLUGIN_SYMBOL("lab8_plugin")이라는 이름으로 내보냄 (서버가 dlsym으로 찾음)
+ * - handle은 여러 워커/루프 스레드에서 동시에 불림 -> 공유 상태는 스스로 원자적 연산/락으로 지켜야 함
+ * - 이벤트 루프 모드(epoll/uring/coro)에서는 handle이 루프 스레드에서 돌므로 오래 블록되면 그 루프의
+ *   다른 연결이 모두 멈춤. 느린 일(DB, 외부 호출)은 스레드 풀 모드에서 돌리거나 하지 말 것
+ *
+ * 요청 본문: Content-Length든 chunked든 서버가 끝까지 받아서 풀어 둔 뒤 handle을 부름 (body/body_len)
+ * 응답 본문: api->write / api->printf로 여러 번 나눠 씀 (스트리밍)
+ * - 다 쓰기 전에 작으면 서버가 모아서 Content-Length와 함께 한 번에 보냄
+ * - 스레드 풀 모드에서 모은 양이 커지면 그때부터 Transfer-Encoding: chunked로 쓰는 대로 바로 내보냄
+ *   (status / header_add는 첫 write 전에 불러야 함. 이미 헤더가 나갔으면 -1)
+ * ======================================================================================
+ */
+#ifndef LAB8_PLUGIN_H
+#define LAB8_PLUGIN_H
+
+#include <stddef.h>
+
+#define LAB8_PLUGIN_ABI 1               // 구조체 모양이 바뀌면 올림 (다르면 서버가 로드를 거부)
+#define LAB8_PLUGIN_SYMBOL "lab8_plugin"
+
+typedef struct Lab8Response Lab8Response; // 서버 내부 구조 (플러그인은 api 함수로만 만짐)
+
+/* [구조체: 요청] 문자열은 모두 NUL로 끝나고, handle이 돌아올 때까지만 유효함 */
+typedef struct {
+    const char* method;  // "GET", "POST", ...
+    const char* path;    // "/api/health" (쿼리 제외)
+    const char* subpath; // path에서 라우트 접두어를 뗀 나머지 (접두어 "/api/"면 "health")
+    const char* query;   // '?' 뒤 (없으면 "")
+    const char* body;    // 요청 본문 (없으면 NULL)
+    size_t body_len;
+    const void* http;    // 서버의 파싱 결과 (헤더는 api->header로 찾음)
+} Lab8Request;
+
+/* [구조체: 서버가 플러그인에게 주는 함수들] 성공하면 0, 실패하면 -1 */
+typedef struct {
+    int abi;
+    // 요청 헤더 값 (이름은 대소문자 무시). 값은 NUL로 끝나지 않으므로 *len을 씀. 없으면 NULL
+    const char* (*header)(const Lab8Request* req, const char* name, size_t* len);
+    void (*status)(Lab8Response* res, int code, const char* reason); // 기본 200 OK
+    int (*header_add)(Lab8Response* res, const char* name, const char* value);
+    int (*write)(Lab8Response* res, const void* data, size_t len);
+    int (*printf)(Lab8Response* res, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+} Lab8Api;
+
+/* * [구조체: 플러그인이 내보내는 것]
+ * - init: 로드할 때 한 번. prefix = 맡은 접두어, arg = "-L 접두어=파일.so:arg" 의 arg (없으면 "")
+ *         *state에 넣은 값이 handle/fini에 그대로 돌아옴. 실패하면 -1 (서버 시작 취소)
+ * - handle: 요청마다. 0 = 응답 완료, -1 = 실패 (아직 아무것도 안 보냈으면 서버가 500으로 바꿈)
+ * - fini: 서버가 끝날 때 (없어도 됨)
+ */
+typedef struct {
+    int abi; // LAB8_PLUGIN_ABI
+    const char* name;
+    int (*init)(const Lab8Api* api, const char* prefix, const char* arg, void** state);
+    int (*handle)(void* state, const Lab8Request* req, Lab8Response* res);
+    void (*fini)(void* state);
+} Lab8Plugin;
+
+#endif /* LAB8_PLUGIN_H */
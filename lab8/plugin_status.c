@@ -0,0 +1,108 @@
+/* plugin_status.c */
+
+/* * ======================================================================================
+ * [예제 플러그인: 헬스 체크 / 상태 JSON]
+ * webserver-mt 프로세스 안에서 작은 JSON 엔드포인트를 돌려줍니다. (API는 plugin.h 참고)
+ *
+ * 컴파일 & 실행:
+ *   gcc -O2 -shared -fPIC -o plugin_status.so plugin_status.c
+ *   ./webserver-mt -L /api/=./plugin_status.so:my-service
+ *
+ * 엔드포인트 (접두어가 "/api/"일 때):
+ *   GET  /api/health           -> {"status":"ok"}
+ *   GET  /api/status           -> pid, 가동 시간, 이 플러그인이 처리한 요청 수, 서비스 이름(arg)
+ *   POST /api/echo             -> 받은 본문을 그대로 돌려줌 (Content-Length / chunked 모두)
+ *   GET  /api/stream?lines=N   -> N줄짜리 텍스트를 한 줄씩 write (큰 응답 스트리밍 예시)
+ * ======================================================================================
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "plugin.h"
+
+#define STREAM_MAX_LINES 1000000
+
+/* [구조체: 플러그인 상태] init에서 만들고 모든 스레드가 함께 씀 (requests만 바뀌므로 원자적으로) */
+typedef struct {
+    const Lab8Api* api;
+    char name[64];
+    time_t started;
+    unsigned long requests;
+} StatusPlugin;
+
+static int status_init(const Lab8Api* api, const char* prefix, const char* arg, void** state) {
+    (void)prefix;
+    StatusPlugin* p = calloc(1, sizeof(StatusPlugin));
+    if (!p) return -1;
+    p->api = api;
+    snprintf(p->name, sizeof(p->name), "%s", *arg ? arg : "webserver-mt");
+    p->started = time(NULL);
+    *state = p;
+    return 0;
+}
+
+/* [함수: JSON 응답] 본문은 짧으므로 printf 한 번 */
+static int reply_json(StatusPlugin* p, Lab8Response* res, int code, const char* reason, const char* json) {
+    p->api->status(res, code, reason);
+    p->api->header_add(res, "Content-Type", "application/json");
+    p->api->header_add(res, "Cache-Control", "no-store");
+    return p->api->printf(res, "%s\n", json);
+}
+
+static int status_handle(void* state, const Lab8Request* req, Lab8Response* res) {
+    StatusPlugin* p = state;
+    unsigned long n = __atomic_add_fetch(&p->requests, 1, __ATOMIC_RELAXED);
+    int get = strcmp(req->method, "GET") == 0 || strcmp(req->method, "HEAD") == 0;
+
+    if (strcmp(req->subpath, "health") == 0 && get)
+        return reply_json(p, res, 200, "OK", "{\"status\":\"ok\"}");
+
+    if (strcmp(req->subpath, "status") == 0 && get) {
+        char json[256];
+        snprintf(json, sizeof(json), "{\"service\":\"%s\",\"pid\":%d,\"uptime_seconds\":%ld,\"requests\":%lu}",
+                 p->name, (int)getpid(), (long)(time(NULL) - p->started), n);
+        return reply_json(p, res, 200, "OK", json);
+    }
+
+    if (strcmp(req->subpath, "echo") == 0) {
+        if (strcmp(req->method, "POST") != 0 && strcmp(req->method, "PUT") != 0) {
+            p->api->header_add(res, "Allow", "POST, PUT");
+            return reply_json(p, res, 405, "Method Not Allowed", "{\"error\":\"use POST\"}");
+        }
+        // 받은 Content-Type을 그대로 (헤더 값은 NUL로 안 끝나므로 복사)
+        size_t len;
+        const char* type = p->api->header(req, "Content-Type", &len);
+        char ctype[128];
+        snprintf(ctype, sizeof(ctype), "%.*s", type ? (int)len : 0, type ? type : "");
+        p->api->header_add(res, "Content-Type", *ctype ? ctype : "application/octet-stream");
+        return p->api->write(res, req->body, req->body_len);
+    }
+
+    if (strcmp(req->subpath, "stream") == 0 && get) {
+        long lines = 100;
+        const char* q = strstr(req->query, "lines=");
+        if (q) lines = atol(q + 6);
+        if (lines < 0 || lines > STREAM_MAX_LINES) lines = STREAM_MAX_LINES;
+        p->api->header_add(res, "Content-Type", "text/plain");
+        for (long i = 0; i < lines; i++)
+            if (p->api->printf(res, "line %ld\n", i) < 0) return -1; // 클라이언트가 끊음
+        return 0;
+    }
+
+    return reply_json(p, res, 404, "Not Found", "{\"error\":\"not found\"}");
+}
+
+static void status_fini(void* state) {
+    free(state);
+}
+
+const Lab8Plugin lab8_plugin = {
+    .abi = LAB8_PLUGIN_ABI,
+    .name = "status",
+    .init = status_init,
+    .handle = status_handle,
+    .fini = status_fini,
+};
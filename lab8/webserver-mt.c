@@ -7,256 +7,4642 @@
  * - fcntl.h: 파일 제어 (open 함수 옵션 등)
  * - unistd.h: 유닉스 표준 시스템 콜 (read, write, close)
  * - limits.h: 시스템 제한 상수 (PATH_MAX 등)
+ * - sys/epoll.h: 이벤트 루프 모드에서 사용하는 epoll (리눅스 전용 I/O 멀티플렉싱)
+ * - errno.h: 논블로킹 I/O에서 EAGAIN(지금은 할 게 없음)을 구분하기 위해 필요
+ * - sys/sendfile.h: 커널 안에서 파일 -> 소켓으로 바로 복사하는 sendfile (Zero-Copy)
+ * - sys/uio.h: 흩어진 여러 버퍼를 한 번에 보내는 writev (캐시 적중 응답)
+ * - sys/inotify.h: 파일 변경 알림 (캐시 무효화)
+ * - linux/futex.h, sys/syscall.h: 락 없는 작업 큐에서 워커를 재우고 깨우는 futex
+ * - zlib.h, brotli/encode.h: 텍스트 파일을 gzip / brotli로 압축해서 보내기 위함
+ * - linux/io_uring.h: io_uring 모드의 링 구조체 (liburing 없이 직접 사용)
+ * - sys/mman.h: mmap (io_uring 링 공유, -m 모드의 파일 매핑, 연결 상태 slab)
+ * - signal.h, sys/wait.h: SIGPIPE 무시, 재설정(SIGHUP) / 무중단 교체(SIGUSR2) / 드레인 종료(SIGTERM)
+ * - linux/openat2.h: 웹 루트 밖으로 못 나가게 여는 openat2(RESOLVE_BENEATH)의 open_how 구조체
+ * - dlfcn.h, stdarg.h: 핸들러 플러그인(.so)을 dlopen으로 읽기, 플러그인용 printf
+ *
+ * 컴파일: gcc -O2 -o webserver-mt webserver-mt.c -pthread -lz -lbrotlienc -ldl
  * ======================================================================================
  */
+#define _GNU_SOURCE // splice()는 GNU 확장이라 모든 헤더보다 먼저 정의해야 함
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sys/time.h>
 #include <pthread.h>
 #include <limits.h>
+#include <time.h>
+#include <zlib.h>
+#include <brotli/encode.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <linux/openat2.h>
+#include <dlfcn.h>
+#include <stdarg.h>
+
+#include "http_parser.h" // 증분 HTTP 요청 파서 (같은 디렉토리의 헤더 전용 파일)
+#include "plugin.h"      // 핸들러 플러그인 API (플러그인 .so와 함께 씀)
 
 /* * [매크로 상수 정의]
  * - PORT: 서버가 귀를 기울일 포트 번호 (8080은 보통 개발용 웹서버 포트)
  * - BUF_SIZE: 데이터 송수신 버퍼 크기 (4KB는 메모리 페이지 크기와 유사해 효율적)
- * - MAX_QUEUE: 대기열(Queue)에 쌓아둘 수 있는 최대 클라이언트 요청 수
- * - THREAD_POOL_SIZE: 미리 만들어둘 일꾼(Worker) 스레드의 개수
+ * - MAX_QUEUE: 대기열(Queue)에 쌓아둘 수 있는 클라이언트 수의 기본값 (-q 옵션으로 변경, 2의 거듭제곱으로 올림)
+ * - MAX_EVENTS: epoll_wait 한 번에 돌려받을 최대 이벤트 수 (이벤트 루프 모드 전용)
+ * - KEEPALIVE_TIMEOUT: Keep-Alive 연결이 아무 요청 없이 버틸 수 있는 시간(초)
  */
 #define PORT 8080
 #define BUF_SIZE 4096
 #define MAX_QUEUE 16
-#define THREAD_POOL_SIZE 4
 #define PATH_MAX 4096
+#define MAX_EVENTS 256
+#define KEEPALIVE_TIMEOUT 5
+
+/* * ======================================================================================
+ * [공유 자원: 작업 대기열 (Lock-Free MPMC Ring)]
+ * 메인 스레드(생산자)가 클라이언트 소켓(fd)을 넣고, 워커 스레드(소비자)가 꺼내가는 공간입니다.
+ * 예전에는 뮤텍스 하나 + 조건변수 두 개로 지켰는데, 그러면 accept 스레드와 모든 워커가
+ * 자물쇠 하나 앞에 줄을 서게 되어 연결이 몰릴 때 큐 자체가 병목이 됩니다.
+ *
+ * 지금은 락 없이 원자적 연산(CAS)만으로 동작하는 원형 큐(Vyukov 방식)를 씁니다.
+ * - 칸(slot)마다 sequence 번호가 있어서 "이 칸이 지금 쓸 차례인지/읽을 차례인지"를 알려줌
+ * - 생산자/소비자는 각자 위치(enqueue_pos/dequeue_pos)를 CAS로 하나씩 차지하고 그 칸만 만짐
+ * - 큐가 비면 워커는 잠깐 돌아보다가(spin) futex로 잠듦 -> 생산자가 넣을 때 잠든 워커가 있을 때만 깨움
+ * - 큐가 가득 차면 정책에 따라 503으로 바로 거절(shed)하거나, 빈 칸이 날 때까지 accept를 멈춤(block)
+ * ======================================================================================
+ */
+typedef struct {
+    size_t seq;       // 이 칸의 순번 (원자적으로 읽고 씀)
+    int fd;           // 담긴 클라이언트 소켓
+    int ip_slot;      // IP별 연결 수를 센 칸 (ip_admit 결과, 워커가 연결을 닫을 때 돌려줌)
+    long long enq_ns; // 넣은 시각 (큐에서 기다린 시간 통계 + 입장 제어가 맨 앞 칸을 훔쳐봄)
+} QueueSlot;
+
+/* 자주 바뀌는 변수끼리 같은 캐시 라인에 있으면 코어끼리 라인을 뺏고 뺏기므로(False Sharing) 64바이트씩 띄움 */
+#define CACHE_LINE 64
+static struct {
+    QueueSlot* slots;         // 칸 배열 (크기는 2의 거듭제곱 -> % 대신 & mask)
+    size_t mask;
+    int shed_on_full;         // 1이면 가득 찼을 때 503으로 거절, 0이면 빈 칸이 날 때까지 대기
+    char pad0[CACHE_LINE];
+    size_t enqueue_pos;       // 다음에 넣을 위치
+    char pad1[CACHE_LINE - sizeof(size_t)];
+    size_t dequeue_pos;       // 다음에 꺼낼 위치
+    char pad2[CACHE_LINE - sizeof(size_t)];
+    int work_seq;             // 워커 futex: 생산자가 일감을 넣을 때마다 증가
+    int idle_workers;         // 잠들어 있는(또는 잠들려는) 워커 수
+    char pad3[CACHE_LINE - 2 * sizeof(int)];
+    int space_seq;            // 생산자 futex: 워커가 칸을 비울 때마다 증가
+    int blocked_producers;    // 빈 칸을 기다리며 잠든 생산자 수
+} work_queue;
+
+/* * ======================================================================================
+ * [스레드별 통계 (Per-thread Stats)]
+ * 큐가 얼마나 차 있는지, 연결이 큐에서 얼마나 기다리는지, 워커가 얼마나 바쁜지를 /metrics로 보여줍니다.
+ * 요청마다 공유 카운터를 원자적으로 올리면 모든 코어가 그 캐시 라인 하나를 두고 다투게 되므로,
+ * - 스레드마다 자기 칸(WorkerStats)을 하나씩 갖고 자기 칸에만 씀 (쓰는 스레드가 하나라 원자적 덧셈 불필요)
+ * - 칸은 캐시 라인 단위로 정렬해서 이웃 스레드와 False Sharing이 생기지 않게 함
+ * - /metrics를 만들 때만 모든 칸을 읽어서 합침 (락 없음. 읽는 순간의 값이라 서로 살짝 어긋날 수는 있음)
+ * 히스토그램 구간은 1us, 2us, 4us, ... 2^23us(약 8.4초)의 2배씩 늘어나는 경계 + 그 이상(+Inf)
+ * ======================================================================================
+ */
+#define STATS_MAX_THREADS 2048 // 이보다 많으면 마지막 칸을 함께 씀 (값이 조금 틀려도 멈추지는 않음)
+#define STATS_HIST_BUCKETS 24
+
+typedef struct {
+    unsigned long count[STATS_HIST_BUCKETS + 1]; // 구간별 개수 (누적 아님, 마지막은 +Inf)
+    unsigned long sum_ns;
+} StatsHist;
+
+typedef struct {
+    const char* role;          // "worker" / "acceptor" / "epoll" / "uring"
+    unsigned long connections; // 맡은 연결 수
+    unsigned long accepted;    // 이 스레드가 accept한 연결 수 (스레드 풀에서는 accept 스레드)
+    unsigned long closed;      // 이 스레드가 닫은 연결 수 (모든 스레드의 accepted - closed = 열려 있는 연결)
+    unsigned long requests;    // 응답을 끝까지 보낸 요청 수
+    unsigned long responses[6]; // 상태 코드 종류별 (1xx..5xx, [0]은 안 씀)
+    unsigned long rejected;    // 큐가 가득 차서 503으로 돌려보낸 연결 (shed 정책)
+    unsigned long shed;        // 큐 대기 시간이 목표를 계속 넘어서 503으로 돌려보낸 연결 (입장 제어)
+    unsigned long ip_limited;  // IP별 동시 연결 한도를 넘어서 429로 돌려보낸 연결
+    unsigned long log_dropped; // 링이 가득 차서 버린 접근 로그 기록 수
+    unsigned long busy_ns;     // 일한 시간 (풀 워커: 연결 하나를 맡은 시간, 이벤트 루프: 이벤트 처리 시간)
+    StatsHist queue_wait;      // accept -> 워커가 꺼낼 때까지 큐에서 기다린 시간 (스레드 풀 모드)
+    StatsHist request;         // 요청 해석 -> 응답 전송 완료까지 걸린 시간
+} __attribute__((aligned(CACHE_LINE))) WorkerStats;
+
+static WorkerStats stats_slots[STATS_MAX_THREADS];
+static int stats_num_slots = 0;
+static __thread WorkerStats* my_stats = &stats_slots[STATS_MAX_THREADS - 1]; // 등록 안 한 스레드용
+
+/* [매크로: 내 칸에 더하기] 쓰는 스레드는 나 하나뿐이라 읽고-더하고-쓰기를 원자적 store 한 번으로 공개 */
+#define STAT_ADD(field, v) __atomic_store_n(&my_stats->field, my_stats->field + (v), __ATOMIC_RELAXED)
+
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* [함수: 통계 칸 받기] 스레드 시작할 때 한 번 */
+static void stats_register(const char* role) {
+    int i = __atomic_fetch_add(&stats_num_slots, 1, __ATOMIC_RELAXED);
+    if (i >= STATS_MAX_THREADS) i = STATS_MAX_THREADS - 1;
+    my_stats = &stats_slots[i];
+    my_stats->role = role;
+}
+
+/* * [함수: 열려 있는 연결 수]
+ * 모든 칸의 accepted 합 - closed 합. 칸마다 따로 읽으므로 순간값이지만, accept를 모두 멈춘 뒤라면
+ * accepted는 더 늘지 않고 closed는 늦게 보일 수만 있으므로 실제보다 작게 나오는 일은 없음 (드레인 판단용)
+ */
+static long stats_open_connections(void) {
+    int n = __atomic_load_n(&stats_num_slots, __ATOMIC_ACQUIRE);
+    if (n > STATS_MAX_THREADS) n = STATS_MAX_THREADS;
+    long open = 0;
+    for (int i = 0; i < n; i++)
+        open += (long)(__atomic_load_n(&stats_slots[i].accepted, __ATOMIC_RELAXED) -
+                       __atomic_load_n(&stats_slots[i].closed, __ATOMIC_RELAXED));
+    return open;
+}
+
+/* [함수: 히스토그램에 하나 기록] 구간 = ceil(log2(마이크로초)) */
+static void stats_hist_add(StatsHist* h, long long ns) {
+    if (ns < 0) ns = 0;
+    unsigned long long us = ns / 1000;
+    int b = us <= 1 ? 0 : 64 - __builtin_clzll(us - 1);
+    if (b > STATS_HIST_BUCKETS) b = STATS_HIST_BUCKETS;
+    __atomic_store_n(&h->count[b], h->count[b] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->sum_ns, h->sum_ns + ns, __ATOMIC_RELAXED);
+}
+
+/* * ======================================================================================
+ * [핫 파일 캐시 (Sharded LRU Cache)]
+ * 같은 index.html을 백만 번 요청받아도 매번 realpath -> open -> fstat -> sendfile을 반복하던 것을,
+ * 작은 파일은 "헤더 + 본문"을 통째로 메모리에 들고 있다가 writev 한 번으로 보내도록 바꿉니다.
+ *
+ * - 키: 요청 URL 경로 (예: "/index.html"). 적중(hit)하면 파일 시스템 시스템 콜이 하나도 없습니다.
+ *   (realpath 결과도 함께 저장해서 inotify 이벤트와 맞춰보는 데 사용)
+ *   압축본은 "인코딩:경로" (예: "br:/index.html")를 키로 같은 캐시에 들어갑니다. (아래 콘텐츠 인코딩 참고)
+ * - 샤딩: 락 하나를 모든 워커가 두고 다투지 않도록 해시값으로 CACHE_SHARDS개 조각으로 나눔
+ * - LRU: 조각마다 "최근 사용 순서" 리스트를 두고, 용량을 넘으면 가장 오래 안 쓴 것부터 버림
+ * - 무효화: inotify로 파일이 있는 디렉토리를 감시하다가 수정/삭제/이름변경 이벤트가 오면 버림
+ *   (inotify를 못 쓰는 환경이면 적중 때마다 stat으로 mtime/크기를 비교하는 방식으로 대체)
+ * - 참조 카운트: 이벤트 루프 모드에서는 전송 도중에 항목이 버려질 수 있으므로,
+ *   마지막 사용자가 놓을 때 메모리를 해제합니다.
+ * - mmap 모드(-m): 파일 내용을 힙에 복사(pread)하지 않고 파일을 그대로 mmap해서 본문으로 씀
+ *   페이지 캐시의 페이지를 직접 가리키므로 같은 내용이 메모리에 두 벌 생기지 않고, MAP_POPULATE로
+ *   처음에 페이지 테이블까지 채워 두어 요청마다 페이지 폴트가 나지 않음.
+ *   파일이 교체(rename)되면 inotify가 항목을 떼어내지만, 매핑은 옛 inode를 계속 가리키고
+ *   마지막 응답이 참조를 놓을 때 munmap되므로 전송 중인 응답은 끝까지 옛 내용을 온전히 보냄
+ * ======================================================================================
+ */
+#define CACHE_SHARDS 16                   // 조각 개수 (2의 거듭제곱)
+#define CACHE_BUCKETS 256                 // 조각당 해시 버킷 수
+#define CACHE_MAX_BYTES (64 * 1024 * 1024) // 캐시 전체 용량 기본값 (조각마다 1/CACHE_SHARDS씩)
+#define CACHE_MAX_FILE (1024 * 1024)      // 이보다 큰 파일은 캐시하지 않고 sendfile로 보냄 (기본값)
+
+static int cache_use_mmap = 0; // -m: 캐시 본문을 파일 매핑으로
+// 용량 한도: 설정 파일(-f)로 바꿀 수 있고 SIGHUP 재설정 중에도 바뀌므로 읽을 때마다 원자적으로 읽음
+static size_t cache_max_bytes = CACHE_MAX_BYTES;
+static off_t cache_max_file = CACHE_MAX_FILE;
+
+typedef struct CacheEntry {
+    char* key;                   // URL 경로 (압축본이면 "br:/index.html" 처럼 인코딩이 앞에 붙음)
+    char* resolved;              // 원본 파일의 실제 절대 경로 (무효화 때 비교)
+    char* hdr[2];                // 미리 만들어 둔 응답 헤더 [0] Connection: close, [1] keep-alive
+    size_t hdr_len[2];
+    char* body;                  // 보낼 본문 (원본 파일 내용 또는 압축본)
+    size_t body_len;
+    void* map;                   // mmap 모드면 body가 가리키는 파일 매핑 (NULL이면 본문이 항목 뒤에 붙어 있음)
+    struct stat st;              // 캐시할 때의 원본 파일 상태 (stat 비교 방식에서 사용)
+    char etag[64];               // 이 본문의 ETag (조건부 요청 304 판단용)
+    time_t mtime;                // 이 본문의 Last-Modified
+    size_t charge;               // 이 항목이 차지하는 메모리 (용량 계산용)
+    int refs;                    // 참조 카운트 (캐시 자신이 1개 + 사용 중인 응답 수)
+    int linked;                  // 아직 캐시에 매달려 있는지
+    struct CacheEntry* hnext;    // 같은 버킷의 다음 항목
+    struct CacheEntry* lru_prev; // LRU 리스트 (앞쪽이 최근 사용)
+    struct CacheEntry* lru_next;
+} CacheEntry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    CacheEntry* buckets[CACHE_BUCKETS];
+    CacheEntry* lru_head;
+    CacheEntry* lru_tail;
+    size_t bytes;
+} CacheShard;
+
+static CacheShard cache_shards[CACHE_SHARDS];
+static int cache_inotify_fd = -1;       // -1이면 stat 비교 방식으로 무효화
+static char** cache_watch_dirs = NULL;  // inotify watch 번호(wd) -> 디렉토리 경로
+static int cache_watch_cap = 0;
+static pthread_mutex_t cache_watch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* [함수: 문자열 해시 (FNV-1a)] 짧은 문자열에 빠르고 분포가 고름 */
+static unsigned int cache_hash(const char* s) {
+    unsigned int h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* [함수: 참조 해제] 마지막 참조가 사라지면 메모리 해제 (항목은 malloc 한 덩어리 + mmap 모드면 파일 매핑) */
+static void cache_release(CacheEntry* e) {
+    if (__atomic_sub_fetch(&e->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        if (e->map) munmap(e->map, e->body_len);
+        free(e);
+    }
+}
+
+/* [함수: 캐시에서 떼어내기] 조각 락을 잡은 상태에서 호출. 캐시가 들고 있던 참조를 놓음 */
+static void cache_unlink(CacheShard* sh, CacheEntry* e) {
+    unsigned int b = (cache_hash(e->key) / CACHE_SHARDS) % CACHE_BUCKETS;
+    CacheEntry** pp = &sh->buckets[b];
+    while (*pp != e) pp = &(*pp)->hnext;
+    *pp = e->hnext;
+
+    if (e->lru_prev) e->lru_prev->lru_next = e->lru_next; else sh->lru_head = e->lru_next;
+    if (e->lru_next) e->lru_next->lru_prev = e->lru_prev; else sh->lru_tail = e->lru_prev;
+
+    sh->bytes -= e->charge;
+    e->linked = 0;
+    cache_release(e);
+}
+
+/* [함수: LRU 맨 앞으로 옮기기] 조각 락을 잡은 상태에서 호출 */
+static void cache_lru_front(CacheShard* sh, CacheEntry* e) {
+    if (sh->lru_head == e) return;
+    if (e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+    if (e->lru_next) e->lru_next->lru_prev = e->lru_prev; else sh->lru_tail = e->lru_prev;
+    e->lru_prev = NULL;
+    e->lru_next = sh->lru_head;
+    if (sh->lru_head) sh->lru_head->lru_prev = e;
+    sh->lru_head = e;
+    if (!sh->lru_tail) sh->lru_tail = e;
+}
+
+/* * [함수: 캐시 조회]
+ * 적중하면 참조 카운트를 올려서 돌려줍니다. 다 쓰면 반드시 cache_release 해야 합니다.
+ */
+static CacheEntry* cache_lookup(const char* key) {
+    unsigned int h = cache_hash(key);
+    CacheShard* sh = &cache_shards[h % CACHE_SHARDS];
+    unsigned int b = (h / CACHE_SHARDS) % CACHE_BUCKETS;
+
+    pthread_mutex_lock(&sh->lock);
+    CacheEntry* e = sh->buckets[b];
+    while (e && strcmp(e->key, key) != 0) e = e->hnext;
+    if (e && cache_inotify_fd < 0) {
+        // inotify가 없으면 파일이 바뀌었는지 직접 확인 (시스템 콜 1번은 감수)
+        struct stat st;
+        if (stat(e->resolved, &st) < 0 || st.st_ino != e->st.st_ino || st.st_size != e->st.st_size ||
+            st.st_mtim.tv_sec != e->st.st_mtim.tv_sec || st.st_mtim.tv_nsec != e->st.st_mtim.tv_nsec) {
+            cache_unlink(sh, e);
+            e = NULL;
+        }
+    }
+    if (e) {
+        cache_lru_front(sh, e);
+        __atomic_add_fetch(&e->refs, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return e;
+}
+
+/* * [함수: 디렉토리 감시 등록]
+ * 같은 디렉토리를 여러 번 등록해도 inotify는 같은 wd를 돌려주므로 중복 걱정은 없습니다.
+ * 파일 내용을 읽기 "전에" 등록해야, 읽는 도중 바뀐 경우도 이벤트로 잡힙니다.
+ */
+static void cache_watch_dir_of(const char* resolved) {
+    if (cache_inotify_fd < 0) return;
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", resolved);
+    char* slash = strrchr(dir, '/');
+    if (!slash) return;
+    *(slash == dir ? slash + 1 : slash) = '\0';
+
+    int wd = inotify_add_watch(cache_inotify_fd, dir,
+                               IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM |
+                               IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+    if (wd < 0) return;
+
+    pthread_mutex_lock(&cache_watch_lock);
+    if (wd >= cache_watch_cap) {
+        int cap = cache_watch_cap ? cache_watch_cap : 16;
+        while (cap <= wd) cap *= 2;
+        char** grown = realloc(cache_watch_dirs, cap * sizeof(char*));
+        if (grown) {
+            memset(grown + cache_watch_cap, 0, (cap - cache_watch_cap) * sizeof(char*));
+            cache_watch_dirs = grown;
+            cache_watch_cap = cap;
+        }
+    }
+    if (wd < cache_watch_cap && !cache_watch_dirs[wd])
+        cache_watch_dirs[wd] = strdup(dir);
+    pthread_mutex_unlock(&cache_watch_lock);
+}
+
+/* [함수: 파일 전체 읽기] pread는 파일 위치를 건드리지 않음. 도중에 파일이 줄어들면 -1 */
+static int read_whole(int fd, char* buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = pread(fd, buf + got, len - got, got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        got += n;
+    }
+    return 0;
+}
+
+static int docroot_current_contains(const char* resolved); // 아래 경로 해석 섹션
+
+/* * [함수: 캐시에 넣기]
+ * 본문과 두 가지 헤더를 malloc 한 덩어리에 담아 캐시에 넣습니다.
+ * - 본문: data가 있으면 그걸 복사하고, NULL이면 file_fd에서 len 바이트를 읽음
+ * - extra_hdr: 헤더에 덧붙일 줄들 (예: "Content-Encoding: br\r\n"), 없으면 ""
+ * - etag / mtime: 헤더의 ETag / Last-Modified로 쓰고, 적중 때 304 판단에도 씀
+ * - st: 원본 파일의 상태 (압축본이어도 원본 기준으로 바뀜 여부를 판단)
+ * 성공하면 (캐시 참조와 별도로) 호출자 몫의 참조를 하나 더 올려서 돌려줍니다.
+ */
+static CacheEntry* cache_insert(const char* key, const char* resolved, const char* extra_hdr, const char* etag,
+                                time_t mtime, int file_fd, const char* data, size_t len, const struct stat* st) {
+    char hdr[2][384];
+    int hdr_len[2];
+    char last_modified[HTTP_DATE_LEN];
+    http_format_date(mtime, last_modified);
+    for (int ka = 0; ka < 2; ka++) {
+        hdr_len[ka] = snprintf(hdr[ka], sizeof(hdr[ka]),
+                               "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\nETag: %s\r\nLast-Modified: %s\r\n"
+                               "%sConnection: %s\r\n\r\n",
+                               len, etag, last_modified, extra_hdr, ka ? "keep-alive" : "close");
+    }
+    size_t key_len = strlen(key) + 1, res_len = strlen(resolved) + 1;
+    size_t charge = sizeof(CacheEntry) + key_len + res_len + hdr_len[0] + hdr_len[1] + len;
+
+    // mmap 모드: 본문 자리 대신 파일 매핑 (용량 계산에는 그대로 넣음. 매핑된 페이지도 메모리에 상주하므로)
+    void* map = NULL;
+    if (cache_use_mmap && !data && len > 0) {
+        map = mmap(NULL, len, PROT_READ, MAP_SHARED | MAP_POPULATE, file_fd, 0);
+        if (map == MAP_FAILED) map = NULL; // 매핑 실패 -> 복사 방식으로
+    }
+
+    CacheEntry* e = malloc(map ? charge - len : charge);
+    if (!e) {
+        if (map) munmap(map, len);
+        return NULL;
+    }
+    char* p = (char*)(e + 1);
+    e->key = memcpy(p, key, key_len);                  p += key_len;
+    e->resolved = memcpy(p, resolved, res_len);        p += res_len;
+    e->hdr[0] = memcpy(p, hdr[0], hdr_len[0]);         p += hdr_len[0];
+    e->hdr[1] = memcpy(p, hdr[1], hdr_len[1]);         p += hdr_len[1];
+    e->hdr_len[0] = hdr_len[0];
+    e->hdr_len[1] = hdr_len[1];
+    e->body = map ? map : p;
+    e->body_len = len;
+    e->map = map;
+    e->st = *st;
+    snprintf(e->etag, sizeof(e->etag), "%s", etag);
+    e->mtime = mtime;
+    e->charge = charge;
+    e->refs = 2; // 캐시 1 + 호출자 1
+    e->linked = 1;
+
+    cache_watch_dir_of(resolved);
+
+    if (data) {
+        memcpy(e->body, data, len);
+    } else if (!map && read_whole(file_fd, e->body, len) < 0) { // 읽는 도중 파일이 줄어듦 -> 캐시하지 않음
+        free(e);
+        return NULL;
+    }
+
+    unsigned int h = cache_hash(key);
+    CacheShard* sh = &cache_shards[h % CACHE_SHARDS];
+    unsigned int b = (h / CACHE_SHARDS) % CACHE_BUCKETS;
+
+    pthread_mutex_lock(&sh->lock);
+    // 그사이 SIGHUP으로 웹 루트가 바뀌었으면 옛 웹 루트의 파일이므로 넣지 않음
+    // (재설정은 새 웹 루트를 공개한 "다음에" 캐시를 비우므로, 비우기 전에 넣은 것은 비울 때 같이 버려짐)
+    if (!docroot_current_contains(resolved)) {
+        pthread_mutex_unlock(&sh->lock);
+        if (map) munmap(map, len);
+        free(e);
+        return NULL;
+    }
+    // 다른 워커가 먼저 넣었다면 새 것으로 교체
+    for (CacheEntry* old = sh->buckets[b]; old; old = old->hnext) {
+        if (strcmp(old->key, key) == 0) {
+            cache_unlink(sh, old);
+            break;
+        }
+    }
+    e->hnext = sh->buckets[b];
+    sh->buckets[b] = e;
+    e->lru_prev = NULL;
+    e->lru_next = sh->lru_head;
+    if (sh->lru_head) sh->lru_head->lru_prev = e;
+    sh->lru_head = e;
+    if (!sh->lru_tail) sh->lru_tail = e;
+    sh->bytes += charge;
+
+    // 용량 초과 -> 가장 오래 안 쓴 것부터 버림 (방금 넣은 것은 맨 앞이라 마지막까지 남음)
+    while (sh->bytes > __atomic_load_n(&cache_max_bytes, __ATOMIC_RELAXED) / CACHE_SHARDS && sh->lru_tail != e)
+        cache_unlink(sh, sh->lru_tail);
+    pthread_mutex_unlock(&sh->lock);
+    return e;
+}
+
+/* * [함수: 무효화 대상인지]
+ * 원본 파일이 바뀌면 그 파일에서 나온 압축본도 전부 버려야 하고,
+ * 미리 압축해 둔 형제 파일(index.html.gz / .br)이 바뀌어도 그걸 담은 항목을 버려야 합니다.
+ */
+static int cache_entry_matches(const CacheEntry* e, const char* changed, size_t len) {
+    size_t elen = strlen(e->resolved);
+    if (len < elen || strncmp(changed, e->resolved, elen) != 0) return 0;
+    return changed[elen] == '\0' || strcmp(changed + elen, ".gz") == 0 || strcmp(changed + elen, ".br") == 0;
+}
+
+static void path_cache_invalidate(const char* resolved, int whole_dir); // 아래 경로 해석 섹션
+
+/* [함수: 무효화] resolved가 NULL이면 전부, 아니면 그 경로(또는 그 디렉토리 아래)의 항목만 버림 */
+static void cache_invalidate(const char* resolved, int whole_dir) {
+    size_t len = resolved ? strlen(resolved) : 0;
+    path_cache_invalidate(resolved, whole_dir); // 경로 -> fd 캐시도 같은 이벤트로
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard* sh = &cache_shards[i];
+        pthread_mutex_lock(&sh->lock);
+        CacheEntry* e = sh->lru_head;
+        while (e) {
+            CacheEntry* next = e->lru_next;
+            if (!resolved ||
+                (whole_dir ? strncmp(e->resolved, resolved, len) == 0 && e->resolved[len] == '/'
+                           : cache_entry_matches(e, resolved, len)))
+                cache_unlink(sh, e);
+            e = next;
+        }
+        pthread_mutex_unlock(&sh->lock);
+    }
+}
+
+/* [함수: 용량 맞추기] 한도를 줄였을 때(SIGHUP) 다음 삽입을 기다리지 않고 바로 오래된 것부터 버림 */
+static void cache_trim(void) {
+    size_t limit = __atomic_load_n(&cache_max_bytes, __ATOMIC_RELAXED) / CACHE_SHARDS;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard* sh = &cache_shards[i];
+        pthread_mutex_lock(&sh->lock);
+        while (sh->bytes > limit && sh->lru_tail)
+            cache_unlink(sh, sh->lru_tail);
+        pthread_mutex_unlock(&sh->lock);
+    }
+}
+
+/* * [스레드 함수: inotify 이벤트 처리]
+ * 파일이 수정/삭제/교체되면 그 경로의 캐시 항목을 버립니다. 워커는 이 스레드를 기다리지 않습니다.
+ */
+static void* cache_inotify_thread(void* arg) {
+    (void)arg;
+    char buf[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (1) {
+        ssize_t n = read(cache_inotify_fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+
+        for (char* p = buf; p < buf + n;) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) { // 이벤트를 놓쳤을 수 있음 -> 안전하게 전부 버림
+                cache_invalidate(NULL, 0);
+                continue;
+            }
+            pthread_mutex_lock(&cache_watch_lock);
+            char* dir = (ev->wd >= 0 && ev->wd < cache_watch_cap) ? cache_watch_dirs[ev->wd] : NULL;
+            char path[PATH_MAX];
+            if (dir) {
+                if (ev->len > 0)
+                    snprintf(path, sizeof(path), "%s/%s", strcmp(dir, "/") ? dir : "", ev->name);
+                else
+                    snprintf(path, sizeof(path), "%s", dir);
+            }
+            if (dir && (ev->mask & IN_IGNORED)) { // 디렉토리 감시가 풀림 -> 다음 캐시 때 다시 등록
+                free(dir);
+                cache_watch_dirs[ev->wd] = NULL;
+            }
+            pthread_mutex_unlock(&cache_watch_lock);
+            if (!dir) continue;
+
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+                cache_invalidate(path, 1); // 디렉토리 자체가 사라짐
+            else if (ev->len > 0)
+                cache_invalidate(path, 0);
+        }
+    }
+    return NULL;
+}
+
+/* [함수: 캐시 초기화] inotify를 못 쓰면 경고만 찍고 stat 비교 방식으로 동작 */
+static void cache_init(void) {
+    for (int i = 0; i < CACHE_SHARDS; i++)
+        pthread_mutex_init(&cache_shards[i].lock, NULL);
+
+    cache_inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (cache_inotify_fd < 0) {
+        perror("inotify_init1 (falling back to mtime checks)");
+        return;
+    }
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, cache_inotify_thread, NULL) != 0) {
+        close(cache_inotify_fd);
+        cache_inotify_fd = -1;
+        return;
+    }
+    pthread_detach(tid);
+}
+
+/* * ======================================================================================
+ * [웹 루트 / 경로 해석 (Path Resolution)]
+ * 예전에는 캐시에 없는 요청마다 realpath("./www")와 realpath(요청 경로)를 불렀습니다.
+ * realpath는 경로 구성 요소마다 lstat을 하므로, 바뀌지도 않는 웹 루트까지 매번 처음부터 다시 걸었습니다.
+ * - 웹 루트: 시작할 때 한 번만 절대 경로를 구하고, O_PATH 디렉토리 fd로 열어 둠
+ * - 파일 열기: openat2(웹 루트 fd, "css/a.css", RESOLVE_BENEATH)
+ *   커널이 경로를 따라가다가 ".."이나 심볼릭 링크로 웹 루트 밖으로 나가려 하면 EXDEV로 거부함 (-> 403)
+ *   검사와 open이 한 번에 일어나므로 "검사 후 open 전에 링크 바꿔치기(TOCTOU)"도 통하지 않고,
+ *   "/www2" 같은 이웃 디렉토리가 문자열 비교("/www"로 시작?)를 통과하는 문제도 없음
+ *   (리눅스 5.6 미만이라 openat2가 없으면 예전 realpath 검사로 대체)
+ * - 경로 캐시: URL 경로 -> 이미 열린 fd. 적중하면 dup + fstat 두 번으로 끝나서 경로 탐색이 아예 없음
+ *   읽기는 락 없이 칸마다 seqlock(순번이 홀수면 쓰는 중, 읽기 전후 순번이 같아야 유효)으로 확인.
+ *   같은 fd를 여러 응답이 dup으로 나눠 쓰는데, 일반 파일은 모두 오프셋을 지정해서 읽으므로(pread,
+ *   sendfile의 offset, splice의 off_in, mmap) 파일 위치를 공유해도 서로 방해하지 않음.
+ *   무효화는 콘텐츠 캐시와 같은 inotify 이벤트로, 그리고 fstat의 링크 수가 0이면(지워짐/교체됨) 즉시
+ * ======================================================================================
+ */
+#define PATH_CACHE_SLOTS 1024 // 칸 수 (2의 거듭제곱). 해시가 겹치면 나중 것이 덮어씀
+
+typedef struct {
+    unsigned seq;            // seqlock 순번 (짝수 = 안정, 홀수 = 쓰는 중)
+    int fd;                  // 열어 둔 파일 (-1이면 빈 칸)
+    char key[256];           // URL 경로 (prepare_response의 path와 같은 크기)
+    char resolved[512];      // 실제 절대 경로 (콘텐츠 캐시/inotify용). 이보다 길면 캐시하지 않음
+} __attribute__((aligned(CACHE_LINE))) PathSlot;
+
+typedef struct {
+    char path[PATH_MAX]; // 웹 루트의 절대 경로
+    size_t len;
+    int fd;              // 웹 루트 디렉토리 (openat2의 기준)
+} DocRoot;
+
+static DocRoot* docroot;          // 지금 웹 루트 (SIGHUP 재설정으로 통째로 바뀔 수 있음)
+static int use_openat2 = 1;       // 커널이 openat2를 모르면(ENOSYS) 0으로 바뀜
+static PathSlot path_slots[PATH_CACHE_SLOTS];
+
+/* * [함수: 웹 루트 설정]
+ * 시작할 때, 그리고 SIGHUP으로 설정을 다시 읽을 때 부름. 실패하면 -1 (지금 웹 루트는 그대로)
+ * 바꾸는 순간에도 옛 웹 루트로 파일을 열고 있는 요청이 있을 수 있으므로 옛 DocRoot는 해제하지 않음
+ * (재설정 한 번에 fd 하나와 PATH_MAX 바이트. 드물게 일어나는 일이라 그냥 둠)
+ */
+static int docroot_set(const char* dir) {
+    DocRoot* r = malloc(sizeof(DocRoot));
+    if (!r) return -1;
+    if (!realpath(dir, r->path) || (r->fd = open(r->path, O_PATH | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        free(r);
+        return -1;
+    }
+    r->len = strlen(r->path);
+    if (!docroot)
+        for (int i = 0; i < PATH_CACHE_SLOTS; i++) path_slots[i].fd = -1;
+    __atomic_store_n(&docroot, r, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* [함수: 웹 루트 아래인지] "/www2"처럼 이름만 겹치는 이웃 디렉토리는 바로 뒤가 '/'인지로 걸러냄 */
+static int docroot_contains(const DocRoot* r, const char* resolved) {
+    return strncmp(resolved, r->path, r->len) == 0 && (resolved[r->len] == '/' || resolved[r->len] == '\0');
+}
+
+static int docroot_current_contains(const char* resolved) {
+    return docroot_contains(__atomic_load_n(&docroot, __ATOMIC_ACQUIRE), resolved);
+}
+
+/* [함수: 경로 캐시 조회] 적중하면 복제한 fd (resolved도 채움), 아니면 -1. 락 없음 */
+static int path_cache_open(const char* key, char* resolved) {
+    PathSlot* s = &path_slots[cache_hash(key) & (PATH_CACHE_SLOTS - 1)];
+    unsigned seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1) return -1;
+    if (strncmp(s->key, key, sizeof(s->key)) != 0) return -1;
+    int fd = dup(__atomic_load_n(&s->fd, __ATOMIC_RELAXED));
+    memcpy(resolved, s->resolved, sizeof(s->resolved));
+    // 읽는 동안 누가 칸을 바꿨다면 (옛 fd가 닫히고 번호가 재사용됐을 수도 있음) 전부 버림
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    resolved[sizeof(s->resolved) - 1] = '\0';
+    return fd;
+}
+
+/* * [함수: 경로 캐시 칸 바꾸기]
+ * 순번을 CAS로 홀수로 만든 스레드만 씀 (다른 스레드가 쓰는 중이면 그냥 포기 - 캐시라서 괜찮음)
+ * 옛 fd는 순번을 바꾼 뒤에 닫으므로, 그 사이 옛 fd를 dup한 읽기 쪽은 순번 검사에서 걸러짐
+ * fd < 0이면 칸을 비움
+ */
+static void path_cache_set(PathSlot* s, const char* key, int fd, const char* resolved) {
+    unsigned seq = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+    if ((seq & 1) || !__atomic_compare_exchange_n(&s->seq, &seq, seq + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        if (fd >= 0) close(fd);
+        return;
+    }
+    int old = s->fd;
+    __atomic_store_n(&s->fd, fd, __ATOMIC_RELAXED);
+    snprintf(s->key, sizeof(s->key), "%s", fd >= 0 ? key : "");
+    snprintf(s->resolved, sizeof(s->resolved), "%s", fd >= 0 ? resolved : "");
+    __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+    if (old >= 0) close(old);
+}
+
+static void path_cache_store(const char* key, int fd, const char* resolved) {
+    // inotify가 없으면 이름 바꾸기(mv)를 알아챌 방법이 없으므로 캐시하지 않음
+    if (cache_inotify_fd < 0 || strlen(key) >= sizeof(path_slots[0].key) ||
+        strlen(resolved) >= sizeof(path_slots[0].resolved))
+        return;
+    int copy = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (copy < 0) return;
+    cache_watch_dir_of(resolved); // 이 디렉토리의 변경도 알림 받기
+    path_cache_set(&path_slots[cache_hash(key) & (PATH_CACHE_SLOTS - 1)], key, copy, resolved);
+}
+
+/* [함수: 경로 캐시 무효화] cache_invalidate와 같은 규칙. 이벤트는 드물어서 전체를 훑어도 충분 */
+static void path_cache_invalidate(const char* resolved, int whole_dir) {
+    size_t len = resolved ? strlen(resolved) : 0;
+    for (int i = 0; i < PATH_CACHE_SLOTS; i++) {
+        PathSlot* s = &path_slots[i];
+        if (__atomic_load_n(&s->fd, __ATOMIC_RELAXED) < 0) continue;
+        char r[sizeof(s->resolved)];
+        memcpy(r, s->resolved, sizeof(r));
+        r[sizeof(r) - 1] = '\0';
+        if (!resolved || (whole_dir ? strncmp(r, resolved, len) == 0 && r[len] == '/' : strcmp(r, resolved) == 0))
+            path_cache_set(s, NULL, -1, NULL);
+    }
+}
+
+/* * [함수: 웹 루트 아래 파일 열기]
+ * url_path는 "/css/a.css" 같은 요청 경로. 성공하면 fd를 돌려주고 st와 resolved(실제 절대 경로, 모르면 "")를 채움
+ * 실패하면 -1, errno가 EXDEV면 웹 루트 밖을 가리킴(403), 그 외는 없음(404)
+ */
+static int docroot_open(const char* url_path, struct stat* st, char* resolved) {
+    const DocRoot* root = __atomic_load_n(&docroot, __ATOMIC_ACQUIRE);
+    int fd = path_cache_open(url_path, resolved);
+    if (fd >= 0) {
+        if (fstat(fd, st) == 0 && st->st_nlink > 0 && docroot_contains(root, resolved)) return fd;
+        // 그새 지워지거나 다른 파일로 교체됨 (또는 웹 루트가 바뀜) -> 칸을 비우고 처음부터 다시 찾음
+        close(fd);
+        path_cache_set(&path_slots[cache_hash(url_path) & (PATH_CACHE_SLOTS - 1)], NULL, -1, NULL);
+    }
+
+    const char* rel = url_path;
+    while (*rel == '/') rel++; // openat2는 상대 경로로 (절대 경로는 RESOLVE_BENEATH가 거부함)
+    resolved[0] = '\0';
+    if (use_openat2) {
+        // RESOLVE_NO_MAGICLINKS: /proc/self/fd/N 같은 "마법 링크"로 빠져나가는 것도 막음
+        struct open_how how = { .flags = O_RDONLY | O_CLOEXEC,
+                                .resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS };
+        fd = syscall(SYS_openat2, root->fd, *rel ? rel : ".", &how, sizeof(how));
+        if (fd < 0 && errno == ENOSYS) use_openat2 = 0;
+    }
+    if (!use_openat2) {
+        // 예전 방식: realpath로 절대 경로를 구해서 웹 루트 아래인지 문자열로 검사
+        char full_path[PATH_MAX + 300]; // 웹 루트 + 요청 경로
+        snprintf(full_path, sizeof(full_path), "%s/%s", root->path, rel);
+        if (!realpath(full_path, resolved)) {
+            resolved[0] = '\0';
+        } else if (!docroot_contains(root, resolved)) {
+            errno = EXDEV;
+            return -1;
+        }
+        fd = open(full_path, O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) return -1;
+    if (fstat(fd, st) < 0) {
+        close(fd);
+        errno = ENOENT;
+        return -1;
+    }
+
+    if (use_openat2) {
+        // 실제 경로는 콘텐츠 캐시와 inotify에만 필요. 커널이 fd에서 바로 알려주므로 경로를 다시 걷지 않음
+        char link[32];
+        snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+        ssize_t n = readlink(link, resolved, PATH_MAX - 1);
+        resolved[n > 0 ? n : 0] = '\0';
+    }
+    if (S_ISREG(st->st_mode) && resolved[0]) path_cache_store(url_path, fd, resolved);
+    return fd;
+}
+
+/* * ======================================================================================
+ * [콘텐츠 인코딩 (gzip / brotli)]
+ * HTML/CSS/JS 같은 텍스트는 압축하면 보통 1/3 ~ 1/5로 줄어서 네트워크 대역폭을 크게 아낍니다.
+ * 클라이언트의 Accept-Encoding을 보고 br > gzip 순으로 하나를 고른 뒤:
+ * 1. 미리 압축된 형제 파일(index.html.br / index.html.gz)이 있고 원본보다 새것이면 그걸 그대로 보냄
+ * 2. 없으면 처음 요청될 때 한 번 압축해서 "인코딩:경로" 키로 캐시에 넣음
+ *    -> 이후 요청은 캐시 적중이라 같은 파일을 두 번 압축하지 않음
+ *    (원본이 바뀌면 inotify 무효화로 압축본도 같이 버려짐. 캐시 용량 한도도 그대로 적용)
+ * 압축해도 줄지 않는 파일은 원본을 같은 키로 넣어서 다음에 또 압축을 시도하지 않게 합니다.
+ * 압축 여부와 상관없이 Vary: Accept-Encoding을 붙여야 중간 캐시(프록시)가 엉뚱한 버전을 주지 않습니다.
+ * ======================================================================================
+ */
+enum { ENC_IDENTITY = 0, ENC_GZIP, ENC_BR };
+static const char* const enc_name[] = { "identity", "gzip", "br" };
+static const char* const enc_suffix[] = { "", ".gz", ".br" };
+#define GZIP_LEVEL 6   // zlib 기본값 (속도/압축률 균형)
+#define BROTLI_LEVEL 5 // 11이 최고지만 첫 요청이 너무 느려짐. 5면 gzip -9보다 작고 빠름
+
+/* [함수: 압축할 만한 파일인지] 이미 압축된 형식(png, jpg, zip...)은 다시 압축해도 안 줄어듦 */
+static int is_compressible(const char* path) {
+    static const char* const exts[] = { ".html", ".htm", ".css", ".js", ".mjs", ".json", ".txt",
+                                        ".svg", ".xml", ".md", ".csv", NULL };
+    const char* dot = strrchr(path, '.');
+    if (!dot || strchr(dot, '/')) return 0;
+    for (int i = 0; exts[i]; i++) {
+        if (strcasecmp(dot, exts[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+/* [함수: 인코딩 고르기] 압축률이 더 좋은 brotli를 먼저 */
+static int choose_encoding(const HttpRequest* req, const char* path) {
+    if (!is_compressible(path)) return ENC_IDENTITY;
+    int accepted = http_accept_encoding(req);
+    if (accepted & HTTP_ENC_BR) return ENC_BR;
+    if (accepted & HTTP_ENC_GZIP) return ENC_GZIP;
+    return ENC_IDENTITY;
+}
+
+/* * [함수: 메모리 압축]
+ * 성공하면 malloc한 압축 결과를 돌려줍니다 (호출자가 free). 실패하면 NULL.
+ * gzip은 windowBits에 16을 더하면 zlib 형식이 아니라 gzip 헤더/트레일러가 붙은 형식으로 나옴
+ */
+static char* compress_buffer(int enc, const char* src, size_t len, size_t* out_len) {
+    if (enc == ENC_GZIP) {
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        if (deflateInit2(&zs, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return NULL;
+        size_t cap = deflateBound(&zs, len);
+        char* out = malloc(cap);
+        if (!out) { deflateEnd(&zs); return NULL; }
+        zs.next_in = (Bytef*)src;
+        zs.avail_in = len;
+        zs.next_out = (Bytef*)out;
+        zs.avail_out = cap;
+        int r = deflate(&zs, Z_FINISH);
+        *out_len = zs.total_out;
+        deflateEnd(&zs);
+        if (r != Z_STREAM_END) { free(out); return NULL; }
+        return out;
+    }
+    size_t cap = BrotliEncoderMaxCompressedSize(len);
+    char* out = cap ? malloc(cap) : NULL;
+    if (!out) return NULL;
+    *out_len = cap;
+    if (!BrotliEncoderCompress(BROTLI_LEVEL, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, len,
+                               (const uint8_t*)src, out_len, (uint8_t*)out)) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+/* * [함수: 압축본 만들어서 캐시에 넣기]
+ * 원본을 읽어 압축한 결과를 key(예: "gzip:/index.html")로 캐시에 넣고 그 항목을 돌려줍니다.
+ * 압축해도 줄지 않으면 원본을 (Content-Encoding 없이) 넣음. 실패하면 NULL.
+ */
+static CacheEntry* cache_insert_compressed(const char* key, const char* resolved, int enc, const char* etag,
+                                           int file_fd, const struct stat* st) {
+    char* raw = malloc(st->st_size);
+    if (!raw) return NULL;
+    if (read_whole(file_fd, raw, st->st_size) < 0) {
+        free(raw);
+        return NULL;
+    }
+    size_t zlen = 0;
+    char* z = compress_buffer(enc, raw, st->st_size, &zlen);
+    CacheEntry* e;
+    if (z && zlen < (size_t)st->st_size) {
+        char extra[96];
+        snprintf(extra, sizeof(extra), "Content-Encoding: %s\r\nVary: Accept-Encoding\r\n", enc_name[enc]);
+        e = cache_insert(key, resolved, extra, etag, st->st_mtime, -1, z, zlen, st);
+    } else {
+        e = cache_insert(key, resolved, "Vary: Accept-Encoding\r\n", etag, st->st_mtime, -1, raw, st->st_size, st);
+    }
+    free(z);
+    free(raw);
+    return e;
+}
+
+/* * [함수: 미리 압축된 형제 파일 열기]
+ * path + ".br"/".gz" 가 웹 루트 안의 일반 파일이고 원본보다 오래되지 않았으면 열어서 돌려줌 (없으면 -1)
+ * 형제 파일도 심볼릭 링크로 웹 루트 밖을 가리킬 수 있으므로 docroot_open의 같은 검사를 거침 (경로 캐시도 같이 씀)
+ */
+static int open_sibling(const char* path, const struct stat* st, int enc, struct stat* sib_st) {
+    char sib_path[300], sib_resolved[PATH_MAX];
+    snprintf(sib_path, sizeof(sib_path), "%s%s", path, enc_suffix[enc]);
+    int fd = docroot_open(sib_path, sib_st, sib_resolved);
+    if (fd >= 0 && (!S_ISREG(sib_st->st_mode) ||
+                    sib_st->st_mtim.tv_sec < st->st_mtim.tv_sec)) { // 원본보다 오래된 압축본은 무시
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/* * ======================================================================================
+ * [검증자 (ETag / Last-Modified)]
+ * 브라우저는 받아둔 파일을 다시 쓸 때 "이 버전 그대로야?"라고 물어봅니다 (If-None-Match / If-Modified-Since).
+ * 그대로면 304 Not Modified (헤더만 ~150바이트)로 답해서 본문 전송을 통째로 건너뜁니다.
+ * - ETag: fstat 결과(inode, 크기, 나노초 단위 수정 시각)로 만듦. 내용을 해시하지 않아도 파일이 바뀌면 달라짐
+ *   압축본은 원본과 바이트가 다르므로 인코딩 이름을 붙여 다른 ETag를 씀
+ * - Last-Modified: 초 단위 수정 시각 (ETag를 못 쓰는 옛날 클라이언트용)
+ * ======================================================================================
+ */
+#define BYTERANGES_BOUNDARY "LAB8_BYTERANGES_7d3f0a9c1e5b" // multipart/byteranges 구간 구분자
+
+static void make_etag(char out[64], const struct stat* st, int enc) {
+    snprintf(out, 64, "\"%llx-%llx-%llx%s%s\"", (unsigned long long)st->st_ino,
+             (unsigned long long)st->st_size,
+             (unsigned long long)st->st_mtim.tv_sec * 1000000000ULL + st->st_mtim.tv_nsec,
+             enc == ENC_IDENTITY ? "" : "-", enc == ENC_IDENTITY ? "" : enc_name[enc]);
+}
+
+/* * ======================================================================================
+ * [구조체: 응답 계획 (Response)]
+ * 요청을 해석한 결과 "무엇을 보낼지"만 정리해 둔 것입니다. 실제 전송 방법은 모드마다 다릅니다.
+ * - 스레드 풀 모드: 블로킹 write로 한 번에 쭉 보냄
+ * - 이벤트 루프 모드: 소켓이 쓸 수 있을 때마다 조금씩 이어서 보냄
+ * ======================================================================================
+ */
+typedef struct {
+    char header[512];  // 상태줄 + 헤더 (에러 응답은 짧은 본문까지 여기에 포함)
+    size_t header_len; // header에 담긴 바이트 수
+    int file_fd;       // 본문으로 보낼 파일 (-1이면 본문 없음)
+    int file_regular;  // 일반 파일이면 1 (sendfile 가능), 파이프/장치 등이면 0 (splice 사용)
+    off_t body_offset; // 다음에 보낼 파일 위치 (sendfile이 알아서 전진시킴)
+    off_t body_remain; // 일반 파일에서 아직 안 보낸 바이트 수
+    int keep_alive;    // 응답 후 연결을 유지할지 (HTTP/1.1 Keep-Alive)
+    CacheEntry* cached; // 캐시 적중이면 헤더+본문을 여기서 바로 보냄 (NULL이면 header/file_fd 사용)
+    size_t cached_sent; // 캐시 응답 중 이미 보낸 바이트 수 (헤더 + 본문 합산)
+    off_t content_length; // header 뒤에 따라가는 본문 길이 (접근 로그용, 모르면 -1)
+    const HttpRequest* req; // 접근 로그에 남길 요청 (요청 줄을 못 읽었으면 NULL)
+
+    // Range 요청이 구간 여러 개면 multipart/byteranges: 구간마다 작은 헤더를 끼워 넣으며 sendfile
+    int nranges;                       // 2 이상일 때만 사용 (구간 1개는 body_offset/body_remain으로 충분)
+    HttpRange ranges[HTTP_MAX_RANGES];
+    int part;                          // 다음에 시작할 구간 번호 (nranges면 끝 구분자 차례)
+    off_t file_size;                   // Content-Range의 "/전체크기"
+    char part_hdr[128];                // 지금 구간 앞에 붙는 구분자 + Content-Range
+    size_t part_hdr_len, part_hdr_sent;
+} Response;
+
+/* * [함수: 고정 응답 채우기]
+ * 에러 응답처럼 헤더 + 짧은 본문만으로 끝나는 응답을 준비합니다.
+ * Keep-Alive에서는 클라이언트가 "응답이 어디서 끝나는지" 알아야 다음 응답을 읽을 수 있으므로
+ * 본문이 비어 있어도 Content-Length를 반드시 붙입니다.
+ */
+static void set_simple_response(Response* res, const char* status, const char* body, int keep_alive) {
+    res->header_len = snprintf(res->header, sizeof(res->header),
+                               "HTTP/1.1 %s\r\nContent-Length: %zu\r\nConnection: %s\r\n\r\n%s",
+                               status, strlen(body), keep_alive ? "keep-alive" : "close", body);
+    res->file_fd = -1;
+    res->content_length = 0;
+    res->keep_alive = keep_alive;
+    res->cached = NULL;
+    res->nranges = 0;
+}
+
+/* [함수: 304 응답 채우기] 본문이 없는 응답이라 Content-Length 없이도 연결을 유지할 수 있음 */
+static void set_not_modified(Response* res, const char* etag, time_t mtime, const char* vary, int keep_alive) {
+    char last_modified[HTTP_DATE_LEN];
+    http_format_date(mtime, last_modified);
+    res->header_len = snprintf(res->header, sizeof(res->header),
+                               "HTTP/1.1 304 Not Modified\r\nETag: %s\r\nLast-Modified: %s\r\n%s"
+                               "Connection: %s\r\n\r\n",
+                               etag, last_modified, vary, keep_alive ? "keep-alive" : "close");
+    res->file_fd = -1;
+    res->content_length = 0;
+    res->keep_alive = keep_alive;
+    res->cached = NULL;
+    res->nranges = 0;
+}
+
+/* * [함수: 파일 전송 응답 채우기]
+ * 200 (전체) 또는 206 (일부) 응답의 헤더를 만들고 file_fd에서 [offset, offset+len) 을 보내도록 설정합니다.
+ * hdr_lines에는 ETag/Last-Modified/Content-Range 등 상태줄과 Connection 사이에 들어갈 줄들을 넘김
+ */
+static void set_file_response(Response* res, const char* status, int file_fd, off_t offset, off_t len,
+                              const char* hdr_lines, int keep_alive) {
+    res->header_len = snprintf(res->header, sizeof(res->header),
+                               "HTTP/1.1 %s\r\nContent-Length: %lld\r\n%sConnection: %s\r\n\r\n",
+                               status, (long long)len, hdr_lines, keep_alive ? "keep-alive" : "close");
+    res->keep_alive = keep_alive;
+    res->cached = NULL;
+    res->nranges = 0;
+    res->file_regular = 1;
+    res->body_offset = offset;
+    res->body_remain = len;
+    res->content_length = len;
+    res->file_fd = file_fd;
+    if (len == 0) {
+        close(file_fd); // 보낼 본문이 없음 (헤더의 MSG_MORE가 걸린 채 남지 않도록)
+        res->file_fd = -1;
+    }
+}
+
+/* [함수: multipart 구간 헤더] i번째 구간 앞의 구분자 + Content-Range (i == nranges면 끝 구분자) */
+static size_t format_part_header(char* buf, size_t cap, const Response* res, int i) {
+    if (i == res->nranges)
+        return snprintf(buf, cap, "\r\n--" BYTERANGES_BOUNDARY "--\r\n");
+    return snprintf(buf, cap, "%s--" BYTERANGES_BOUNDARY "\r\nContent-Range: bytes %lld-%lld/%lld\r\n\r\n",
+                    i ? "\r\n" : "", res->ranges[i].start, res->ranges[i].end, (long long)res->file_size);
+}
+
+/* * [함수: Range 응답 채우기 (206 Partial Content)]
+ * - 구간 1개: Content-Range 헤더 + 그 구간만 sendfile (오프셋만 바꾸면 되므로 Zero-Copy 그대로)
+ * - 구간 여러 개: multipart/byteranges. 전체 길이를 미리 계산해 Content-Length로 알려줌
+ */
+static void set_range_response(Response* res, int file_fd, const struct stat* st, const HttpRange* ranges,
+                               int nranges, const char* validators, int keep_alive) {
+    char lines[384];
+    if (nranges == 1) {
+        snprintf(lines, sizeof(lines), "Content-Range: bytes %lld-%lld/%lld\r\n%s", ranges[0].start,
+                 ranges[0].end, (long long)st->st_size, validators);
+        set_file_response(res, "206 Partial Content", file_fd, ranges[0].start,
+                          ranges[0].end - ranges[0].start + 1, lines, keep_alive);
+        return;
+    }
+
+    memcpy(res->ranges, ranges, nranges * sizeof(HttpRange));
+    res->nranges = nranges;
+    res->file_size = st->st_size;
+    off_t total = 0;
+    for (int i = 0; i <= nranges; i++) {
+        total += format_part_header(res->part_hdr, sizeof(res->part_hdr), res, i);
+        if (i < nranges) total += ranges[i].end - ranges[i].start + 1;
+    }
+    snprintf(lines, sizeof(lines), "Content-Type: multipart/byteranges; boundary=" BYTERANGES_BOUNDARY "\r\n%s",
+             validators);
+    set_file_response(res, "206 Partial Content", file_fd, 0, total, lines, keep_alive);
+    // 실제 파일 위치는 구간마다 send_multipart_chunk가 정함
+    res->nranges = nranges;
+    res->part = 0;
+    res->part_hdr_len = res->part_hdr_sent = 0;
+    res->body_remain = 0;
+}
+
+/* * ======================================================================================
+ * [접근 로그 (Access Log)]
+ * 요청마다 "메소드, 경로, 상태 코드, 보낸 바이트, 처리 시간"을 한 줄씩 남깁니다. (-l 파일, "-"면 표준 출력)
+ *   time=2026-10-16T09:30:00.123Z method=GET path="/index.html" status=200 bytes=1234 duration_us=87
+ * 워커가 요청마다 fprintf/write를 직접 하면 파일 하나(와 stdio 락)를 두고 모든 스레드가 줄을 서고,
+ * 디스크가 느려지면 응답까지 같이 느려집니다. 그래서
+ * - 스레드마다 고정 크기 기록을 담는 원형 버퍼(링)를 하나씩 가짐 (쓰는 쪽 = 그 스레드 하나, 읽는 쪽 =
+ *   로그 스레드 하나인 SPSC 링이라 락도 CAS도 없이 head/tail 원자적 store만으로 충분)
+ * - 워커는 기록 하나(128바이트)를 링에 복사하고 끝. 문자열 만들기와 write는 전부 로그 스레드 몫
+ * - 로그 스레드는 ACCESS_LOG_FLUSH_MS마다(링이 절반 넘게 차면 바로) 모든 링을 비우면서 줄을 만들고
+ *   링마다 모은 덩어리를 writev 한 번으로 내보냄 (요청마다 시스템 콜 1번 -> 수천 줄에 1번)
+ * - 링이 가득 차면(로그 스레드가 디스크를 못 따라감) 워커는 기다리지 않고 그 기록을 버리고 log_dropped를 셈
+ *   -> /metrics의 webserver_access_log_dropped_total
+ * - 링은 스레드가 처음 요청을 끝낼 때 만듦 (accept 스레드처럼 요청을 안 하는 스레드는 링이 없음)
+ * - SIGHUP 재설정 때 로그 파일을 다시 엶 (logrotate가 파일을 옮긴 뒤 새 파일에 이어 쓰도록)
+ * ======================================================================================
+ */
+#define ACCESS_LOG_RING 4096        // 스레드마다 담아 둘 수 있는 기록 수 (2의 거듭제곱)
+#define ACCESS_LOG_FLUSH_MS 100     // 로그 스레드가 링을 비우는 주기
+#define ACCESS_LOG_BATCH (64 * 1024) // writev 한 번에 모으는 최대 바이트
+#define ACCESS_LOG_LINE_MAX 512     // 한 줄의 최대 길이 (경로를 이스케이프해도 넘지 않음)
+#define ACCESS_LOG_IOV 64
+#define ACCESS_LOG_STOP_TIMEOUT 2   // 종료할 때 남은 기록을 쓰도록 기다려 주는 시간 (초)
+
+/* [구조체: 기록 하나] 캐시 라인 2개에 딱 맞게 (경로는 잘라서 담음) */
+typedef struct {
+    long long time_ns;     // 응답을 끝낸 시각 (CLOCK_REALTIME)
+    long long duration_ns; // 요청 해석 -> 응답 전송 완료
+    long long bytes;       // 보낸 바이트 (헤더 + 본문, 모르면 -1)
+    int status;
+    char method[8];        // 없으면 "" (요청 줄을 못 읽은 400 등)
+    char path[92];
+} AccessLogRecord;
+
+typedef struct {
+    size_t head;       // 다음에 쓸 위치 (주인 스레드만 씀)
+    size_t tail_cache; // 주인 스레드가 마지막으로 본 tail (가득 찼을 때만 다시 읽음)
+    char pad0[CACHE_LINE - 2 * sizeof(size_t)];
+    size_t tail;       // 다음에 읽을 위치 (로그 스레드만 씀)
+    char pad1[CACHE_LINE - sizeof(size_t)];
+    AccessLogRecord recs[ACCESS_LOG_RING];
+} AccessLogRing;
+
+static struct {
+    int fd;                 // 로그를 쓸 fd (-1이면 접근 로그 끔)
+    const char* path;       // -l 인자 (NULL이면 표준 출력)
+    AccessLogRing* rings[STATS_MAX_THREADS];
+    int num_rings;
+    int wake_seq;           // futex: 링이 절반 넘게 찬 워커가 올려서 로그 스레드를 깨움
+    int sleeping;           // 로그 스레드가 잠들어 있는지
+    int reopen;             // SIGHUP: 다음 차례에 로그 파일을 다시 엶
+    int stop;               // 드레인 끝: 남은 기록을 다 쓰고 끝냄
+    pthread_t tid;
+} access_log = { .fd = -1 };
+
+static __thread AccessLogRing* my_log;   // 이 스레드의 링 (처음 쓸 때 만듦)
+static __thread int my_log_tried;        // 링 만들기를 시도했는지 (실패했으면 기록은 계속 버림)
+
+static int writev_all(int fd, struct iovec* iov, int n); // 아래 [핸들러 플러그인] 섹션
+
+/* [함수: 이 스레드의 링 만들기] 로그 스레드가 찾을 수 있게 rings[]에 공개 */
+static AccessLogRing* access_log_ring(void) {
+    my_log_tried = 1;
+    int i = __atomic_fetch_add(&access_log.num_rings, 1, __ATOMIC_RELAXED);
+    if (i >= STATS_MAX_THREADS) return NULL;
+    AccessLogRing* r = aligned_alloc(CACHE_LINE, sizeof(AccessLogRing));
+    if (!r) return NULL;
+    r->head = r->tail_cache = r->tail = 0;
+    __atomic_store_n(&access_log.rings[i], r, __ATOMIC_RELEASE);
+    my_log = r;
+    return r;
+}
+
+/* * [함수: 기록 하나 남기기 (워커 쪽)]
+ * 절대 기다리지 않음: 링이 가득 찼으면 버리고 세기만 함
+ */
+static void access_log_add(const Response* res, int status, long long duration_ns) {
+    AccessLogRing* r = my_log;
+    if (!r && (my_log_tried || !(r = access_log_ring()))) {
+        STAT_ADD(log_dropped, 1);
+        return;
+    }
+    size_t head = r->head;
+    if (head - r->tail_cache >= ACCESS_LOG_RING) {
+        r->tail_cache = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        if (head - r->tail_cache >= ACCESS_LOG_RING) {
+            STAT_ADD(log_dropped, 1);
+            return;
+        }
+    }
+
+    AccessLogRecord* rec = &r->recs[head & (ACCESS_LOG_RING - 1)];
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts); // 밀리초 단위로만 남기므로 vDSO의 거친 시계로 충분
+    rec->time_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    rec->duration_ns = duration_ns;
+    rec->status = status;
+    if (res->cached)
+        rec->bytes = res->cached_sent;
+    else
+        rec->bytes = res->content_length < 0 ? -1 : (long long)res->header_len + res->content_length;
+    const HttpRequest* req = res->req;
+    size_t mlen = req && req->method_len < sizeof(rec->method) ? req->method_len : 0;
+    size_t plen = req ? req->target_len : 0;
+    if (plen >= sizeof(rec->path)) plen = sizeof(rec->path) - 1;
+    memcpy(rec->method, req ? req->method : "", mlen);
+    rec->method[mlen] = '\0';
+    memcpy(rec->path, req ? req->target : "", plen);
+    rec->path[plen] = '\0';
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+
+    // 절반을 막 넘었으면 주기를 기다리지 말고 비워 달라고 깨움 (tail_cache가 옛 값이라 조금 이르게 깨울 수는 있음)
+    if (head + 1 - r->tail_cache == ACCESS_LOG_RING / 2 && __atomic_load_n(&access_log.sleeping, __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(&access_log.wake_seq, 1, __ATOMIC_RELEASE);
+        syscall(SYS_futex, &access_log.wake_seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+/* [함수: 기록 -> 한 줄] 경로의 따옴표/역슬래시/제어 문자는 이스케이프 (로그 줄을 위조하지 못하게) */
+static size_t access_log_format(char* out, const AccessLogRecord* rec, time_t* last_sec, char stamp[32]) {
+    time_t sec = rec->time_ns / 1000000000LL;
+    if (sec != *last_sec) { // 초가 바뀔 때만 날짜 문자열을 다시 만듦
+        struct tm tm;
+        gmtime_r(&sec, &tm);
+        strftime(stamp, 32, "%Y-%m-%dT%H:%M:%S", &tm);
+        *last_sec = sec;
+    }
+    char* p = out;
+    p += sprintf(p, "time=%s.%03dZ method=%s path=\"", stamp, (int)(rec->time_ns / 1000000 % 1000),
+                 rec->method[0] ? rec->method : "-");
+    for (const unsigned char* s = (const unsigned char*)rec->path; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            *p++ = '\\';
+            *p++ = *s;
+        } else if (*s < 0x20 || *s >= 0x7f) {
+            p += sprintf(p, "\\x%02x", *s);
+        } else {
+            *p++ = *s;
+        }
+    }
+    p += sprintf(p, "\" status=%d bytes=", rec->status);
+    p += rec->bytes < 0 ? sprintf(p, "-") : sprintf(p, "%lld", rec->bytes);
+    p += sprintf(p, " duration_us=%lld\n", rec->duration_ns / 1000);
+    return p - out;
+}
+
+/* [함수: 모은 덩어리 내보내기] 실패해도(디스크 가득 등) 워커에는 영향 없음. 그 줄들만 잃음 */
+static void access_log_flush(struct iovec* iov, int* niov, size_t* used) {
+    if (*niov > 0) writev_all(access_log.fd, iov, *niov);
+    *niov = 0;
+    *used = 0;
+}
+
+/* * [함수: 모든 링 한 바퀴 비우기]
+ * 링마다 tail..head를 줄로 만들어 batch에 이어 붙이고, 링 하나 = iovec 하나로 모았다가 writev
+ * 반환값: 쓴 기록 수
+ */
+static long access_log_sweep(char* batch, time_t* last_sec, char stamp[32]) {
+    struct iovec iov[ACCESS_LOG_IOV];
+    int niov = 0;
+    size_t used = 0;
+    long total = 0;
+    int n = __atomic_load_n(&access_log.num_rings, __ATOMIC_ACQUIRE);
+    if (n > STATS_MAX_THREADS) n = STATS_MAX_THREADS;
+    for (int i = 0; i < n; i++) {
+        AccessLogRing* r = __atomic_load_n(&access_log.rings[i], __ATOMIC_ACQUIRE);
+        if (!r) continue; // 방금 번호만 받고 아직 공개 전
+        size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        size_t tail = r->tail;
+        while (tail != head) {
+            if (used + ACCESS_LOG_LINE_MAX > ACCESS_LOG_BATCH || niov == ACCESS_LOG_IOV)
+                access_log_flush(iov, &niov, &used);
+            size_t start = used;
+            // 링 하나에서 batch가 허락하는 만큼 연달아 만들고, 그 덩어리를 iovec 하나로
+            while (tail != head && used + ACCESS_LOG_LINE_MAX <= ACCESS_LOG_BATCH) {
+                used += access_log_format(batch + used, &r->recs[tail & (ACCESS_LOG_RING - 1)], last_sec, stamp);
+                tail++;
+                total++;
+            }
+            iov[niov].iov_base = batch + start;
+            iov[niov++].iov_len = used - start;
+            // 줄로 옮겼으니 그 칸들은 워커에게 돌려줌 (write가 끝나기를 기다리지 않음)
+            __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+        }
+    }
+    access_log_flush(iov, &niov, &used);
+    return total;
+}
+
+/* [함수: 로그 파일 열기] 덧붙이기 모드. SIGHUP 때는 같은 fd 번호에 새 파일을 dup2로 갈아 끼움 */
+static int access_log_open(void) {
+    int fd = open(access_log.path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror(access_log.path);
+        return -1;
+    }
+    if (access_log.fd < 0) return fd;
+    dup2(fd, access_log.fd);
+    close(fd);
+    return access_log.fd;
+}
+
+/* [스레드 함수: 로그 쓰기] 주기마다(또는 깨워지면) 한 바퀴. stop이면 마지막으로 한 번 더 비우고 끝냄 */
+static void* access_log_thread(void* arg) {
+    (void)arg;
+    char* batch = malloc(ACCESS_LOG_BATCH);
+    time_t last_sec = 0;
+    char stamp[32] = "";
+    for (;;) {
+        int stop = __atomic_load_n(&access_log.stop, __ATOMIC_ACQUIRE);
+        if (__atomic_exchange_n(&access_log.reopen, 0, __ATOMIC_ACQ_REL) && access_log.path)
+            access_log_open();
+        access_log_sweep(batch, &last_sec, stamp);
+        if (stop) break;
+
+        int seq = __atomic_load_n(&access_log.wake_seq, __ATOMIC_ACQUIRE);
+        struct timespec tmo = { .tv_sec = 0, .tv_nsec = ACCESS_LOG_FLUSH_MS * 1000000L };
+        __atomic_store_n(&access_log.sleeping, 1, __ATOMIC_SEQ_CST);
+        syscall(SYS_futex, &access_log.wake_seq, FUTEX_WAIT_PRIVATE, seq, &tmo, NULL, 0);
+        __atomic_store_n(&access_log.sleeping, 0, __ATOMIC_RELAXED);
+    }
+    free(batch);
+    return NULL;
+}
+
+/* [함수: 접근 로그 시작] path가 NULL이면 표준 출력 */
+static int access_log_start(const char* path) {
+    access_log.path = path;
+    access_log.fd = path ? access_log_open() : STDOUT_FILENO;
+    if (access_log.fd < 0) return -1;
+    return pthread_create(&access_log.tid, NULL, access_log_thread, NULL) == 0 ? 0 : -1;
+}
+
+/* * [함수: 접근 로그 끝내기] 드레인이 끝난 뒤(더 쓸 워커가 없음) 남은 기록을 다 쓰고 돌아옴
+ * 로그 대상이 막혀 있으면(아무도 안 읽는 파이프 등) ACCESS_LOG_STOP_TIMEOUT초만 기다리고 포기
+ */
+static void access_log_stop(void) {
+    if (access_log.fd < 0) return;
+    __atomic_store_n(&access_log.stop, 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&access_log.wake_seq, 1, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &access_log.wake_seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ACCESS_LOG_STOP_TIMEOUT;
+    if (pthread_timedjoin_np(access_log.tid, NULL, &deadline) != 0)
+        fprintf(stderr, "access log: writer is stuck, giving up on unwritten records\n");
+}
+
+/* * [함수: 요청 하나 완료 기록] 상태 코드 종류와 처리 시간 ("HTTP/1.1 200"의 9~11번째 글자)
+ * 접근 로그가 켜져 있으면 이 스레드의 링에도 한 줄 남김
+ */
+static void stats_request_done(const Response* res, long long start_ns) {
+    const char* status = (res->cached ? res->cached->hdr[0] : res->header) + 9;
+    int cls = status[0] - '0';
+    if (cls < 1 || cls > 5) cls = 5;
+    long long elapsed = monotonic_ns() - start_ns;
+    STAT_ADD(requests, 1);
+    STAT_ADD(responses[cls], 1);
+    stats_hist_add(&my_stats->request, elapsed);
+    if (access_log.fd >= 0) access_log_add(res, atoi(status), elapsed);
+}
+
+/* [함수: 히스토그램 출력] 모든 스레드의 칸을 합쳐서 Prometheus 형식(누적 le 구간)으로 씀 */
+static void metrics_write_hist(FILE* f, const char* name, const char* help, size_t offset, int n) {
+    unsigned long count[STATS_HIST_BUCKETS + 1] = { 0 }, sum_ns = 0;
+    for (int i = 0; i < n; i++) {
+        const StatsHist* h = (const StatsHist*)((const char*)&stats_slots[i] + offset);
+        for (int b = 0; b <= STATS_HIST_BUCKETS; b++) count[b] += __atomic_load_n(&h->count[b], __ATOMIC_RELAXED);
+        sum_ns += __atomic_load_n(&h->sum_ns, __ATOMIC_RELAXED);
+    }
+    fprintf(f, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    unsigned long cum = 0;
+    for (int b = 0; b < STATS_HIST_BUCKETS; b++) {
+        cum += count[b];
+        fprintf(f, "%s_bucket{le=\"%g\"} %lu\n", name, (double)(1UL << b) / 1e6, cum);
+    }
+    cum += count[STATS_HIST_BUCKETS];
+    fprintf(f, "%s_bucket{le=\"+Inf\"} %lu\n%s_sum %.9f\n%s_count %lu\n", name, cum, name, sum_ns / 1e9, name, cum);
+}
+
+/* [함수: 스레드별 카운터 출력] 값이 있는 스레드만 한 줄씩 */
+static void metrics_write_counter(FILE* f, const char* name, const char* help, size_t offset, int n, double scale) {
+    fprintf(f, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    for (int i = 0; i < n; i++) {
+        if (!stats_slots[i].role) continue;
+        unsigned long v = __atomic_load_n((const unsigned long*)((const char*)&stats_slots[i] + offset),
+                                          __ATOMIC_RELAXED);
+        fprintf(f, "%s{thread=\"%d\",role=\"%s\"} %.9g\n", name, i, stats_slots[i].role, v * scale);
+    }
+}
+
+/* * [함수: 일회용 응답 항목]
+ * 메모리에서 만든 본문(/metrics, 플러그인 응답)을 캐시 적중과 같은 경로(헤더 + 본문 writev)로 보내기 위한
+ * CacheEntry. 캐시에는 매달지 않으므로 보내고 나서 cache_release가 해제함
+ * hdr_lines는 상태줄과 Connection 사이에 들어갈 줄들, content_length는 보통 body_len과 같음 (HEAD면 본문 없이 길이만)
+ */
+static CacheEntry* memory_entry(const char* status, const char* hdr_lines, const char* body, size_t body_len,
+                                size_t content_length) {
+    const char* fmt = "HTTP/1.1 %s\r\nContent-Length: %zu\r\n%sConnection: %s\r\n\r\n";
+    int hdr_len[2];
+    for (int ka = 0; ka < 2; ka++)
+        hdr_len[ka] = snprintf(NULL, 0, fmt, status, content_length, hdr_lines, ka ? "keep-alive" : "close");
+    CacheEntry* e = malloc(sizeof(CacheEntry) + hdr_len[0] + hdr_len[1] + 2 + body_len);
+    if (!e) return NULL;
+    char* p = (char*)(e + 1);
+    for (int ka = 0; ka < 2; ka++) {
+        e->hdr[ka] = p;
+        e->hdr_len[ka] = hdr_len[ka];
+        p += snprintf(p, hdr_len[ka] + 1, fmt, status, content_length, hdr_lines, ka ? "keep-alive" : "close") + 1;
+    }
+    e->body = body_len ? memcpy(p, body, body_len) : p;
+    e->body_len = body_len;
+    e->map = NULL;
+    e->refs = 1; // 응답 하나만 들고 있음 (캐시에는 안 매달림)
+    e->linked = 0;
+    return e;
+}
+
+/* * [함수: /metrics 응답 만들기]
+ * 큐 상태(gauge)는 work_queue의 위치/카운터를 그대로 읽고, 나머지는 스레드별 칸을 합쳐서 만듭니다.
+ * 본문 길이가 매번 달라서 Response.header에는 안 들어가므로 일회용 CacheEntry(memory_entry)로 보냄
+ */
+static CacheEntry* metrics_entry(void) {
+    char* body = NULL;
+    size_t len = 0;
+    FILE* f = open_memstream(&body, &len);
+    if (!f) return NULL;
+
+    int n = __atomic_load_n(&stats_num_slots, __ATOMIC_RELAXED);
+    if (n > STATS_MAX_THREADS) n = STATS_MAX_THREADS;
+    size_t head = __atomic_load_n(&work_queue.dequeue_pos, __ATOMIC_RELAXED);
+    size_t tail = __atomic_load_n(&work_queue.enqueue_pos, __ATOMIC_RELAXED);
+    fprintf(f, "# HELP webserver_queue_depth Connections waiting in the work queue.\n"
+               "# TYPE webserver_queue_depth gauge\nwebserver_queue_depth %zu\n",
+            tail > head ? tail - head : 0);
+    fprintf(f, "# HELP webserver_queue_capacity Work queue size (0 outside thread-pool mode).\n"
+               "# TYPE webserver_queue_capacity gauge\nwebserver_queue_capacity %zu\n",
+            work_queue.slots ? work_queue.mask + 1 : 0);
+    fprintf(f, "# HELP webserver_queue_idle_workers Workers sleeping on an empty queue.\n"
+               "# TYPE webserver_queue_idle_workers gauge\nwebserver_queue_idle_workers %d\n",
+            __atomic_load_n(&work_queue.idle_workers, __ATOMIC_RELAXED));
+    fprintf(f, "# HELP webserver_queue_blocked_producers Acceptors blocked on a full queue.\n"
+               "# TYPE webserver_queue_blocked_producers gauge\nwebserver_queue_blocked_producers %d\n",
+            __atomic_load_n(&work_queue.blocked_producers, __ATOMIC_RELAXED));
+
+    fprintf(f, "# HELP webserver_open_connections Client connections currently open.\n"
+               "# TYPE webserver_open_connections gauge\nwebserver_open_connections %ld\n",
+            stats_open_connections());
+
+    unsigned long responses[6] = { 0 };
+    for (int i = 0; i < n; i++)
+        for (int c = 1; c <= 5; c++) responses[c] += __atomic_load_n(&stats_slots[i].responses[c], __ATOMIC_RELAXED);
+    fprintf(f, "# HELP webserver_responses_total Completed responses by status class.\n"
+               "# TYPE webserver_responses_total counter\n");
+    for (int c = 1; c <= 5; c++) fprintf(f, "webserver_responses_total{code=\"%dxx\"} %lu\n", c, responses[c]);
+
+    metrics_write_counter(f, "webserver_connections_total", "Connections handled per thread.",
+                          offsetof(WorkerStats, connections), n, 1);
+    metrics_write_counter(f, "webserver_requests_total", "Requests completed per thread.",
+                          offsetof(WorkerStats, requests), n, 1);
+    metrics_write_counter(f, "webserver_rejected_total", "Connections refused with 503 because the queue was full.",
+                          offsetof(WorkerStats, rejected), n, 1);
+    metrics_write_counter(f, "webserver_shed_total", "Connections refused with 503 because queue wait stayed above the target.",
+                          offsetof(WorkerStats, shed), n, 1);
+    metrics_write_counter(f, "webserver_ip_limited_total", "Connections refused with 429 by the per-IP limit.",
+                          offsetof(WorkerStats, ip_limited), n, 1);
+    metrics_write_counter(f, "webserver_access_log_dropped_total", "Access log records dropped because the ring was full.",
+                          offsetof(WorkerStats, log_dropped), n, 1);
+    metrics_write_counter(f, "webserver_busy_seconds_total", "Time spent serving connections or events.",
+                          offsetof(WorkerStats, busy_ns), n, 1e-9);
+    metrics_write_hist(f, "webserver_queue_wait_seconds", "Time from accept until a worker dequeued the connection.",
+                       offsetof(WorkerStats, queue_wait), n);
+    metrics_write_hist(f, "webserver_request_duration_seconds", "Time from parsed request until response sent.",
+                       offsetof(WorkerStats, request), n);
+    if (fclose(f) != 0) {
+        free(body);
+        return NULL;
+    }
+
+    CacheEntry* e = memory_entry("200 OK", "Content-Type: text/plain; version=0.0.4\r\nCache-Control: no-store\r\n",
+                                 body, len, len);
+    free(body);
+    return e;
+}
+
+/* [드레인 상태] SIGUSR2(후계 프로세스로 교체)나 SIGTERM을 받으면 켜짐. 아래 [운영 신호] 섹션 참고 */
+static int server_draining = 0;
+static int accepting_threads = 0; // 아직 accept를 멈추지 않은 스레드 수 (드레인은 이게 0이 되기를 기다림)
+
+/* * ======================================================================================
+ * [핸들러 플러그인 (라우트 표)]
+ * 정적 파일만 보내던 서버에, URL 접두어별로 공유 라이브러리 핸들러를 붙입니다. (API는 plugin.h)
+ *   -L /api/=./plugin_status.so        -> "/api/..." 요청은 전부 이 플러그인이 처리
+ *   -L /echo=./plugin_status.so:echo   -> ':' 뒤는 플러그인 init에 그대로 넘어감
+ * - 라우트는 시작할 때 dlopen으로 읽고 그 뒤로 바뀌지 않음 (그래서 요청 처리 중에는 락 없이 읽음)
+ *   새 .so로 바꾸려면 SIGUSR2 교체: 새 프로세스가 같은 명령줄로 다시 dlopen함
+ * - 접두어가 겹치면 가장 긴 것이 이김 ("/api/admin/"이 "/api/"보다 먼저)
+ * - 플러그인 라우트만 GET 말고 다른 메소드와 요청 본문을 받음 (정적 파일은 여전히 GET 전용, 딸려 온 본문은 읽어서 버림)
+ * - 요청 본문은 Content-Length / chunked 모두 끝까지 받아서(PLUGIN_MAX_BODY까지) 풀어 둔 뒤 핸들러를 부름
+ *   본문을 읽는 동안에도 헤더는 버퍼에 그대로 두고, 본문 바이트만 버퍼에서 빼서 따로 모음
+ *   -> 요청 길이(req_len)가 헤더 길이와 같아지므로 파이프라이닝 처리(memmove)는 그대로 동작
+ * ======================================================================================
+ */
+#define MAX_ROUTES 32
+#define PLUGIN_MAX_BODY (1 << 20)        // 요청 본문 최대 (넘으면 413)
+#define STATIC_MAX_BODY (64 * 1024)      // 정적 라우트: 읽어서 버릴 본문 최대 (넘으면 413)
+#define PLUGIN_STREAM_AFTER (16 * 1024)  // 스레드 풀 모드: 응답이 이보다 커지면 chunked로 바로 흘려보냄
+#define PLUGIN_MAX_OUTPUT (64 << 20)     // 모아서 보내는 응답의 최대 크기 (넘으면 500)
+#define REQ_BODY_TOO_LARGE -3            // request_parse 결과: 413 Content Too Large
+
+typedef struct {
+    char prefix[128];
+    size_t prefix_len;
+    const Lab8Plugin* plugin;
+    void* state; // init이 돌려준 값
+} Route;
+
+static Route routes[MAX_ROUTES]; // 접두어가 긴 것부터 (앞에서부터 처음 맞는 것 = 가장 긴 접두어)
+static int num_routes = 0;
+
+/* [구조체: 플러그인 응답 작성기] plugin.h의 Lab8Response 실체 (요청 하나 동안 스택에 있음) */
+struct Lab8Response {
+    int status;
+    char reason[64];
+    char headers[1024];  // 플러그인이 추가한 헤더 줄들
+    size_t headers_len;
+    char* body;          // 모아 둔 본문
+    size_t len, cap;     // len: 지금까지 쓴 바이트 (HEAD면 세기만 함)
+    int fd;              // 스레드 풀 모드면 클라이언트 소켓 (>= 0이어야 chunked로 흘려보낼 수 있음)
+    int can_stream;      // HTTP/1.1 클라이언트 + 블로킹 소켓일 때만
+    int streaming;       // 헤더를 이미 보냈음 (이후 write는 chunk 하나씩 바로 전송)
+    int head;            // HEAD 요청: 본문은 버리고 길이만
+    int keep_alive;
+    int failed;          // 전송 실패 / 너무 큼 -> 연결을 닫음
+};
+
+static int io_retry(int fd, int events, int idle); // 아래 [코루틴 모드] 섹션
+
+/* [함수: 블로킹 소켓에 iovec 전부 쓰기] 부분 전송이면 남은 부분부터 이어서 (코루틴이면 쓸 수 있을 때까지 양보) */
+static int writev_all(int fd, struct iovec* iov, int n) {
+    while (n > 0) {
+        ssize_t w = writev(fd, iov, n);
+        if (w < 0 && io_retry(fd, EPOLLOUT, 0)) continue;
+        if (w <= 0) return -1;
+        while (n > 0 && (size_t)w >= iov->iov_len) {
+            w -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char*)iov->iov_base + w;
+            iov->iov_len -= w;
+        }
+    }
+    return 0;
+}
+
+/* [함수: chunk 하나 전송] "길이(16진수)\r\n" + 데이터 + "\r\n" */
+static int plugin_send_chunk(Lab8Response* r, const void* data, size_t len) {
+    char size_line[24];
+    struct iovec iov[3] = {
+        { size_line, snprintf(size_line, sizeof(size_line), "%zx\r\n", len) },
+        { (void*)data, len },
+        { "\r\n", 2 },
+    };
+    if (writev_all(r->fd, iov, 3) < 0) r->failed = 1;
+    return r->failed ? -1 : 0;
+}
+
+/* [함수: 흘려보내기 시작] 헤더(chunked) + 지금까지 모은 본문을 첫 chunk로 */
+static int plugin_start_stream(Lab8Response* r) {
+    char hdr[1280];
+    int n = snprintf(hdr, sizeof(hdr), "HTTP/1.1 %d %s\r\nTransfer-Encoding: chunked\r\n%.*sConnection: %s\r\n\r\n",
+                     r->status, r->reason, (int)r->headers_len, r->headers, r->keep_alive ? "keep-alive" : "close");
+    struct iovec iov = { hdr, n };
+    r->streaming = 1;
+    if (writev_all(r->fd, &iov, 1) < 0) r->failed = 1;
+    if (!r->failed && r->len > 0) plugin_send_chunk(r, r->body, r->len);
+    free(r->body);
+    r->body = NULL;
+    r->len = r->cap = 0;
+    return r->failed ? -1 : 0;
+}
+
+static const char* plugin_api_header(const Lab8Request* req, const char* name, size_t* len) {
+    const HttpHeader* h = http_find_header(req->http, name);
+    if (!h) return NULL;
+    *len = h->value_len;
+    return h->value;
+}
+
+static void plugin_api_status(Lab8Response* r, int code, const char* reason) {
+    if (r->streaming || code < 100 || code > 599) return;
+    r->status = code;
+    snprintf(r->reason, sizeof(r->reason), "%s", reason ? reason : "");
+}
+
+/* [함수: 헤더 추가] 줄바꿈이 섞인 값은 거부 (헤더를 하나 더 끼워 넣는 Response Splitting 방지) */
+static int plugin_api_header_add(Lab8Response* r, const char* name, const char* value) {
+    if (r->streaming || strpbrk(name, "\r\n:") || strpbrk(value, "\r\n")) return -1;
+    size_t room = sizeof(r->headers) - r->headers_len;
+    int n = snprintf(r->headers + r->headers_len, room, "%s: %s\r\n", name, value);
+    if (n < 0 || (size_t)n >= room) {
+        r->headers[r->headers_len] = '\0';
+        return -1;
+    }
+    r->headers_len += n;
+    return 0;
+}
+
+static int plugin_api_write(Lab8Response* r, const void* data, size_t len) {
+    if (r->failed) return -1;
+    if (len == 0) return 0;
+    if (r->streaming) return plugin_send_chunk(r, data, len);
+    if (r->len + len > PLUGIN_MAX_OUTPUT) {
+        r->failed = 1;
+        return -1;
+    }
+    if (!r->head) {
+        if (r->len + len > r->cap) {
+            size_t cap = r->cap ? r->cap : 4096;
+            while (cap < r->len + len) cap *= 2;
+            char* p = realloc(r->body, cap);
+            if (!p) {
+                r->failed = 1;
+                return -1;
+            }
+            r->body = p;
+            r->cap = cap;
+        }
+        memcpy(r->body + r->len, data, len);
+    }
+    r->len += len;
+    if (r->can_stream && r->len > PLUGIN_STREAM_AFTER) return plugin_start_stream(r);
+    return 0;
+}
+
+static int plugin_api_printf(Lab8Response* r, const char* fmt, ...) {
+    char small[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(small, sizeof(small), fmt, ap);
+    va_end(ap);
+    if (n < 0) return -1;
+    if ((size_t)n < sizeof(small)) return plugin_api_write(r, small, n);
+    char* big = malloc(n + 1);
+    if (!big) return -1;
+    va_start(ap, fmt);
+    vsnprintf(big, n + 1, fmt, ap);
+    va_end(ap);
+    int ret = plugin_api_write(r, big, n);
+    free(big);
+    return ret;
+}
+
+static const Lab8Api plugin_api = {
+    .abi = LAB8_PLUGIN_ABI,
+    .header = plugin_api_header,
+    .status = plugin_api_status,
+    .header_add = plugin_api_header_add,
+    .write = plugin_api_write,
+    .printf = plugin_api_printf,
+};
+
+/* * [함수: 라우트 등록] spec = "접두어=파일.so[:인자]". 시작할 때만 부름. 실패하면 -1
+ * 같은 .so를 여러 접두어에 걸면 dlopen은 한 번만 열리고 init은 접두어마다 불림
+ */
+static int route_add(const char* spec) {
+    char buf[PATH_MAX + 256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    char* file = strchr(buf, '=');
+    if (buf[0] != '/' || !file || num_routes == MAX_ROUTES) {
+        fprintf(stderr, "plugin: expected /prefix=file.so[:arg], got '%s'\n", spec);
+        return -1;
+    }
+    *file++ = '\0';
+    char* arg = strchr(file, ':');
+    if (arg) *arg++ = '\0';
+    if (strlen(buf) >= sizeof(routes[0].prefix)) {
+        fprintf(stderr, "plugin: prefix too long: %s\n", buf);
+        return -1;
+    }
+
+    // RTLD_NOW: 빠진 심볼이 있으면 요청 도중이 아니라 지금 실패 / RTLD_LOCAL: 플러그인끼리 심볼이 섞이지 않음
+    void* dl = dlopen(file, RTLD_NOW | RTLD_LOCAL);
+    if (!dl) {
+        fprintf(stderr, "plugin: %s\n", dlerror());
+        return -1;
+    }
+    const Lab8Plugin* plugin = dlsym(dl, LAB8_PLUGIN_SYMBOL);
+    if (!plugin || plugin->abi != LAB8_PLUGIN_ABI || !plugin->handle) {
+        fprintf(stderr, "plugin: %s does not export a compatible " LAB8_PLUGIN_SYMBOL " (ABI %d)\n", file,
+                LAB8_PLUGIN_ABI);
+        dlclose(dl);
+        return -1;
+    }
+    void* state = NULL;
+    if (plugin->init && plugin->init(&plugin_api, buf, arg ? arg : "", &state) < 0) {
+        fprintf(stderr, "plugin: %s failed to initialize\n", file);
+        dlclose(dl);
+        return -1;
+    }
+
+    // 접두어 길이 내림차순 자리에 끼워 넣음
+    int i = num_routes++;
+    while (i > 0 && routes[i - 1].prefix_len < strlen(buf)) {
+        routes[i] = routes[i - 1];
+        i--;
+    }
+    snprintf(routes[i].prefix, sizeof(routes[i].prefix), "%s", buf);
+    routes[i].prefix_len = strlen(buf);
+    routes[i].plugin = plugin;
+    routes[i].state = state;
+    printf("Route %s -> %s (%s)\n", buf, file, plugin->name ? plugin->name : "?");
+    return 0;
+}
+
+/* [함수: 플러그인 정리] 드레인이 깨끗하게 끝났을 때만 (아직 handle을 도는 스레드가 없을 때) */
+static void routes_fini(void) {
+    for (int i = 0; i < num_routes; i++)
+        if (routes[i].plugin->fini) routes[i].plugin->fini(routes[i].state);
+}
+
+/* * [함수: 라우트 찾기]
+ * target의 경로 부분(쿼리 앞)이 접두어로 시작하면 그 라우트. "/api"는 "/api", "/api/x"와 맞고 "/apix"와는 안 맞음
+ */
+static const Route* route_match(const char* target, size_t len) {
+    const char* q = memchr(target, '?', len);
+    if (q) len = q - target;
+    for (int i = 0; i < num_routes; i++) {
+        const Route* r = &routes[i];
+        if (len < r->prefix_len || memcmp(target, r->prefix, r->prefix_len) != 0) continue;
+        if (r->prefix[r->prefix_len - 1] == '/' || len == r->prefix_len || target[r->prefix_len] == '/') return r;
+    }
+    return NULL;
+}
+
+/* [구조체: 요청 본문을 받는 중인 상태] 연결마다 하나 (스레드 풀은 스택, 이벤트 루프는 Connection 안) */
+typedef struct {
+    int active;      // 헤더는 다 왔고 본문을 받는 중
+    int discard;     // 정적 라우트: 본문을 읽기만 하고 버림 (len만 셈)
+    size_t hdr_len;  // 버퍼에서 헤더가 차지하는 길이 (본문은 이 뒤에 도착함)
+    HttpBody dec;
+    char* data;      // 풀어 낸 본문
+    size_t len, cap;
+} RequestBody;
+
+static void request_body_free(RequestBody* b) {
+    free(b->data);
+    memset(b, 0, sizeof(*b));
+}
+
+/* * [함수: 요청 하나 해석 (헤더 + 본문)]
+ * http_parse와 같은 규칙: 양수 = 처리할 요청의 길이, HTTP_PARSE_INCOMPLETE = 더 읽어서 다시 부를 것
+ * 본문 바이트는 버퍼에서 빼서 b->data로 옮기므로 *len이 줄어듦 (돌려주는 길이는 헤더 길이)
+ * 정적 파일은 본문을 쓰지 않지만 끝까지 읽어서 버림 (STATIC_MAX_BODY까지)
+ * -> 안 읽으면 본문 안에 숨긴 요청이 파이프라이닝된 다음 요청으로 실행됨 (Request Smuggling)
+ * fd는 "100 Continue" 중간 응답용 (curl은 큰 본문을 보내기 전에 이걸 1초까지 기다림)
+ */
+static int request_parse(HttpRequest* req, RequestBody* b, char* buf, size_t* len, int fd) {
+    if (!b->active) {
+        int r = http_parse(req, buf, *len);
+        if (r < 0) return r;
+        int has_body = http_body_init(&b->dec, req);
+        if (has_body <= 0) return has_body < 0 ? HTTP_PARSE_ERROR : r;
+        b->discard = !route_match(req->target, req->target_len);
+        if (!b->dec.chunked && b->dec.remain > (b->discard ? STATIC_MAX_BODY : PLUGIN_MAX_BODY))
+            return REQ_BODY_TOO_LARGE;
+        b->active = 1;
+        b->hdr_len = r;
+        b->len = 0;
+        const HttpHeader* expect = http_find_header(req, "Expect");
+        if (expect && *len == (size_t)r && http_header_has_token(expect, "100-continue"))
+            send(fd, "HTTP/1.1 100 Continue\r\n\r\n", 25, MSG_DONTWAIT); // 송신 버퍼가 비어 있으므로 다 들어감
+    }
+
+    size_t out;
+    long used = http_body_decode(&b->dec, buf + b->hdr_len, *len - b->hdr_len, &out);
+    if (used < 0) return HTTP_PARSE_ERROR;
+    if (b->len + out > (b->discard ? STATIC_MAX_BODY : PLUGIN_MAX_BODY)) return REQ_BODY_TOO_LARGE;
+    if (b->discard) {
+        b->len += out;
+    } else {
+        if (b->len + out > b->cap) {
+            size_t cap = b->cap ? b->cap : 4096;
+            while (cap < b->len + out) cap *= 2;
+            char* p = realloc(b->data, cap);
+            if (!p) return REQ_BODY_TOO_LARGE;
+            b->data = p;
+            b->cap = cap;
+        }
+        memcpy(b->data + b->len, buf + b->hdr_len, out);
+        b->len += out;
+    }
+    memmove(buf + b->hdr_len, buf + b->hdr_len + used, *len - b->hdr_len - used);
+    *len -= used;
+    if (!http_body_done(&b->dec)) return HTTP_PARSE_INCOMPLETE;
+    b->active = 0;
+    return b->hdr_len;
+}
+
+/* * [함수: 플러그인으로 응답 만들기]
+ * 핸들러가 쓴 것을 모았다가 일회용 캐시 항목(memory_entry)으로 보냄 -> 모든 모드가 같은 전송 경로를 씀
+ * 스레드 풀 모드에서 핸들러가 큰 본문을 흘려보냈다면(chunked) 이미 다 나갔으므로 header_len = 0으로 돌려줌
+ * (header에는 상태줄만 남겨서 상태 코드 통계에 쓰임)
+ */
+static void plugin_respond(const Route* rt, const HttpRequest* req, const char* path, const RequestBody* body,
+                           int fd, int keep_alive, Response* res) {
+    char method[16], full[256];
+    if (req->method_len >= sizeof(method)) {
+        set_simple_response(res, "501 Not Implemented", "", 0);
+        return;
+    }
+    memcpy(method, req->method, req->method_len);
+    method[req->method_len] = '\0';
+    snprintf(full, sizeof(full), "%s", path);
+    char* query = strchr(full, '?');
+    if (query) *query++ = '\0';
+
+    Lab8Request r = {
+        .method = method,
+        .path = full,
+        .subpath = full + (strlen(full) < rt->prefix_len ? strlen(full) : rt->prefix_len),
+        .query = query ? query : "",
+        .body = body && body->len ? body->data : NULL,
+        .body_len = body ? body->len : 0,
+        .http = req,
+    };
+    Lab8Response out = {
+        .status = 200, .reason = "OK", .fd = fd, .keep_alive = keep_alive,
+        .head = http_method_is(req, "HEAD"),
+    };
+    out.can_stream = fd >= 0 && req->version_minor >= 1 && !out.head;
+
+    int rc = rt->plugin->handle(rt->state, &r, &out);
+
+    res->file_fd = -1;
+    res->cached = NULL;
+    res->keep_alive = keep_alive;
+    if (out.streaming) {
+        // 끝 표시(길이 0 chunk). 핸들러가 도중에 실패했으면 끝 표시 없이 끊어서 클라이언트가 알게 함
+        if (rc == 0 && !out.failed) {
+            struct iovec iov = { "0\r\n\r\n", 5 };
+            if (writev_all(fd, &iov, 1) < 0) out.failed = 1;
+        }
+        snprintf(res->header, sizeof(res->header), "HTTP/1.1 %03d", out.status);
+        res->header_len = 0;
+        res->content_length = -1; // 이미 chunked로 흘려보냄 (길이를 따로 세지 않음)
+        res->keep_alive = keep_alive && rc == 0 && !out.failed;
+        return;
+    }
+    if (rc < 0 || out.failed) {
+        free(out.body);
+        set_simple_response(res, "500 Internal Server Error", "", keep_alive);
+        return;
+    }
+    char status[80];
+    snprintf(status, sizeof(status), "%d %s", out.status, out.reason);
+    out.headers[out.headers_len] = '\0';
+    res->cached = memory_entry(status, out.headers, out.body, out.head ? 0 : out.len, out.len);
+    res->header_len = 0;
+    free(out.body);
+    if (!res->cached) set_simple_response(res, "500 Internal Server Error", "", keep_alive);
+}
+
+/* * ======================================================================================
+ * [함수: 요청 해석 (Business Logic)]
+ * 파서가 나눠 둔 요청(method/target/헤더)을 보고 파일을 찾아서 Response를 채웁니다.
+ * 소켓에는 손대지 않으므로 스레드 풀 모드와 이벤트 루프 모드가 같은 로직을 그대로 공유합니다.
+ * (예외: 플러그인 라우트에서 fd >= 0이면 큰 응답을 그 소켓으로 바로 흘려보낼 수 있음. 이벤트 루프는 -1)
+ * body: request_parse가 모아 둔 요청 본문 (플러그인 라우트에서만 채워짐)
+ * ======================================================================================
+ */
+void prepare_response(const HttpRequest* req, const RequestBody* body, int fd, Response* res) {
+    // 0. 연결 유지 여부 (에러 응답도 길이가 정해져 있으면 연결을 유지할 수 있음)
+    // 드레인 중이면 지금 응답을 끝으로 연결을 닫도록 알림 (Connection: close) -> 클라이언트는 새 프로세스로 다시 연결
+    int keep_alive = http_keep_alive(req) && !__atomic_load_n(&server_draining, __ATOMIC_RELAXED);
+    res->cached = NULL;
+    res->cached_sent = 0;
+    res->nranges = 0;
+
+    // 1. 요청 경로 꺼내기 (예: "GET /index.html HTTP/1.1"의 "/index.html")
+    // 파서는 버퍼 안의 위치와 길이만 알려주므로, 파일 경로로 쓰려면 '\0'으로 끝나는 사본이 필요함
+    char path[256];
+    if (req->target_len >= sizeof(path)) {
+        set_simple_response(res, "414 URI Too Long", "", 0);
+        return;
+    }
+    memcpy(path, req->target, req->target_len);
+    path[req->target_len] = '\0';
+
+    // 플러그인 라우트: 메소드/쿼리/본문 해석은 플러그인 몫
+    const Route* rt = route_match(req->target, req->target_len);
+    if (rt) {
+        plugin_respond(rt, req, path, body, fd, keep_alive, res);
+        return;
+    }
+
+    // 2. 메소드 검사 (GET 방식만 지원)
+    // 다른 메소드는 지원하지 않으므로 연결을 끊어서 정리함 (본문은 request_parse가 이미 읽어서 버림)
+    if (!http_method_is(req, "GET")) {
+        set_simple_response(res, "405 Method Not Allowed", "", 0);
+        return;
+    }
+
+    // 운영용 통계 (Prometheus 텍스트 형식). 만들 때마다 값이 바뀌므로 캐시/조건부 요청 없이 매번 새로 만듦
+    if (strcmp(path, "/metrics") == 0) {
+        res->cached = metrics_entry();
+        res->keep_alive = keep_alive;
+        res->file_fd = -1;
+        res->header_len = 0;
+        if (!res->cached) set_simple_response(res, "500 Internal Server Error", "", keep_alive);
+        return;
+    }
+
+    // 3. 루트 경로("/") 처리 -> index.html로 매핑
+    if (strcmp(path, "/") == 0)
+        strcpy(path, "/index.html");
+
+    // 압축 협상: 보낼 인코딩을 정하고 캐시 키를 만듦 (원본은 경로 그대로, 압축본은 "br:/index.html")
+    // Range 요청은 원본 바이트 기준으로만 처리 (압축본의 일부를 잘라 주면 클라이언트가 풀 수 없음)
+    int has_range = http_find_header(req, "Range") != NULL;
+    int enc = has_range ? ENC_IDENTITY : choose_encoding(req, path);
+    const char* vary = is_compressible(path) ? "Vary: Accept-Encoding\r\n" : "";
+    char key[sizeof(path) + 16];
+    if (enc == ENC_IDENTITY)
+        snprintf(key, sizeof(key), "%s", path);
+    else
+        snprintf(key, sizeof(key), "%s:%s", enc_name[enc], path);
+
+    // * 캐시 적중: 경로 검사/open을 이미 통과했던 파일이므로 바로 응답 (시스템 콜 0번) *
+    // (Range 요청은 sendfile 오프셋으로 처리하므로 캐시를 건너뜀)
+    CacheEntry* hit = has_range ? NULL : cache_lookup(key);
+    if (hit && http_not_modified(req, hit->etag, hit->mtime)) {
+        set_not_modified(res, hit->etag, hit->mtime, vary, keep_alive);
+        cache_release(hit);
+        return;
+    }
+    if (hit) {
+        res->cached = hit;
+        res->keep_alive = keep_alive;
+        res->file_fd = -1;
+        res->header_len = 0;
+        return;
+    }
+
+    // 4~5. 파일 열기 (웹 루트 fd 기준 openat2, 최근에 연 경로면 경로 캐시에서 dup)
+    // * [보안 중요!] Directory Traversal 공격 방지 로직 *
+    // 해커가 "GET /../../etc/passwd" 같은 요청을 보낼 수 있음.
+    // 커널이 경로를 따라가면서 웹 루트 밖으로 나가는 순간 거부함 (EXDEV) -> 403 Forbidden
+    char resolved_path[PATH_MAX];
+    struct stat st;
+    int file_fd = docroot_open(path, &st, resolved_path);
+    if (file_fd < 0 && errno == EXDEV) {
+        set_simple_response(res, "403 Forbidden", "<h1>403 Forbidden</h1>\n", keep_alive);
+        return;
+    }
+    if (file_fd < 0 || S_ISDIR(st.st_mode)) {
+        // 파일이 없으면 404 Not Found 전송
+        if (file_fd >= 0) close(file_fd);
+        set_simple_response(res, "404 Not Found", "<h1>404 Not Found</h1>\n", keep_alive);
+        return;
+    }
+    int resolved_ok = resolved_path[0] != '\0'; // 실제 경로를 모르면 캐시(무효화 대상)에 넣지 않음
+    off_t max_file = __atomic_load_n(&cache_max_file, __ATOMIC_RELAXED);
+
+    // 6. 정상 응답 헤더 (200 OK) + 본문 파일
+    // fstat으로 크기와 종류를 알아두면 sendfile에 "몇 바이트 남았는지"를 정확히 넘길 수 있음
+    if (!S_ISREG(st.st_mode)) {
+        // 파이프 등은 길이를 미리 알 수 없음 -> "연결 종료 = 본문 끝"으로 알려줄 수밖에 없음
+        // (크기도 수정 시각도 의미가 없으므로 검증자/Range 없이 그대로 흘려보냄)
+        res->header_len = snprintf(res->header, sizeof(res->header),
+                                   "HTTP/1.1 200 OK\r\nConnection: close\r\n\r\n");
+        res->keep_alive = 0;
+        res->file_fd = file_fd;
+        res->file_regular = 0;
+        res->content_length = -1;
+        return;
+    }
+
+    // 7. 보낼 표현 고르기: 미리 압축된 형제 파일 > 직접 압축(작은 파일만) > 원본
+    int rep_enc = ENC_IDENTITY;
+    int sib_fd = -1;
+    struct stat sib_st;
+    if (enc != ENC_IDENTITY && resolved_ok) {
+        sib_fd = open_sibling(path, &st, enc, &sib_st);
+        if (sib_fd >= 0 || (st.st_size > 0 && st.st_size <= max_file)) rep_enc = enc;
+    }
+
+    // 8. 조건부 요청: 실제로 보낼 파일의 검증자로 판단 (같으면 압축도 읽기도 안 하고 304)
+    const struct stat* vst = sib_fd >= 0 ? &sib_st : &st;
+    char etag[64], last_modified[HTTP_DATE_LEN], validators[192];
+    make_etag(etag, vst, rep_enc);
+    http_format_date(vst->st_mtime, last_modified);
+    if (http_not_modified(req, etag, vst->st_mtime)) {
+        close(file_fd);
+        if (sib_fd >= 0) close(sib_fd);
+        set_not_modified(res, etag, vst->st_mtime, vary, keep_alive);
+        return;
+    }
+
+    // 9. 압축본: 작으면 캐시에 넣고 캐시 항목으로 응답, 큰 형제 파일은 sendfile로 바로 보냄
+    if (rep_enc != ENC_IDENTITY) {
+        snprintf(validators, sizeof(validators), "ETag: %s\r\nLast-Modified: %s\r\nContent-Encoding: %s\r\n%s",
+                 etag, last_modified, enc_name[rep_enc], vary);
+        CacheEntry* e = NULL;
+        if (sib_fd >= 0) {
+            char extra[96];
+            snprintf(extra, sizeof(extra), "Content-Encoding: %s\r\n%s", enc_name[rep_enc], vary);
+            if (sib_st.st_size > 0 && sib_st.st_size <= max_file)
+                e = cache_insert(key, resolved_path, extra, etag, sib_st.st_mtime, sib_fd, NULL, sib_st.st_size, &st);
+            if (!e) {
+                close(file_fd);
+                set_file_response(res, "200 OK", sib_fd, 0, sib_st.st_size, validators, keep_alive);
+                return;
+            }
+            close(sib_fd);
+        } else {
+            e = cache_insert_compressed(key, resolved_path, rep_enc, etag, file_fd, &st);
+        }
+        if (e) {
+            close(file_fd);
+            res->cached = e;
+            res->keep_alive = keep_alive;
+            res->file_fd = -1;
+            res->header_len = 0;
+            return;
+        }
+        // 압축 실패(메모리 부족 등) -> 원본으로
+        make_etag(etag, &st, ENC_IDENTITY);
+        http_format_date(st.st_mtime, last_modified);
+    }
+    snprintf(validators, sizeof(validators), "ETag: %s\r\nLast-Modified: %s\r\nAccept-Ranges: bytes\r\n%s",
+             etag, last_modified, vary);
+
+    // 10. Range 요청 (이어받기 등): 필요한 구간만 sendfile 오프셋으로 보냄
+    HttpRange ranges[HTTP_MAX_RANGES];
+    int nranges = http_parse_range(req, st.st_size, etag, st.st_mtime, ranges);
+    if (nranges < 0) {
+        close(file_fd);
+        res->header_len = snprintf(res->header, sizeof(res->header),
+                                   "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%lld\r\n"
+                                   "Content-Length: 0\r\nConnection: %s\r\n\r\n",
+                                   (long long)st.st_size, keep_alive ? "keep-alive" : "close");
+        res->keep_alive = keep_alive;
+        res->file_fd = -1;
+        return;
+    }
+    if (nranges > 0) {
+        set_range_response(res, file_fd, &st, ranges, nranges, validators, keep_alive);
+        return;
+    }
+
+    // 11. 전체 파일 (200 OK)
+    // 작은 일반 파일은 캐시에 담아 두고 캐시 항목으로 응답 (다음부터는 위의 적중 경로로 감)
+    // (압축본을 받을 수 있는 클라이언트라도 위에서 실패했다면 원본을 보내되, 원본 키로는 넣지 않음)
+    if (st.st_size > 0 && st.st_size <= max_file && resolved_ok && enc == ENC_IDENTITY) {
+        char extra[64];
+        snprintf(extra, sizeof(extra), "Accept-Ranges: bytes\r\n%s", vary);
+        CacheEntry* e = cache_insert(key, resolved_path, extra, etag, st.st_mtime, file_fd, NULL, st.st_size, &st);
+        if (e) {
+            close(file_fd);
+            res->cached = e;
+            res->keep_alive = keep_alive;
+            res->file_fd = -1;
+            res->header_len = 0;
+            return;
+        }
+    }
+    set_file_response(res, "200 OK", file_fd, 0, st.st_size, validators, keep_alive);
+}
+
+/* * ======================================================================================
+ * [함수: 본문 일부 전송 (Zero-Copy)]
+ * 예전 방식(read -> write)은 4KB마다 시스템 콜 2번 + 커널<->유저 복사 2번이 들어갑니다.
+ * - 일반 파일: sendfile()이 페이지 캐시에서 소켓으로 커널 안에서 바로 보냄 (유저 공간 복사 0번)
+ * - 파이프/장치 등: sendfile이 안 되므로 splice()로 "파일 -> 파이프 -> 소켓"을 커널 안에서 연결
+ *   (splice는 한쪽이 반드시 파이프여야 해서 중간 파이프 pipe_fds가 필요함)
+ * 소켓이 논블로킹이면 일부만 보내고 EAGAIN이 날 수 있으므로, 진행 상황은 res와 pipe_pending에 남깁니다.
+ * 반환값: >0 이번에 보낸 바이트 수, 0 = 본문 전송 완료, -1 = 에러(errno 확인, EAGAIN 포함)
+ * ======================================================================================
+ */
+static ssize_t send_multipart_chunk(int sock, Response* res);
+
+static ssize_t send_body_chunk(int sock, Response* res, int pipe_fds[2], size_t* pipe_pending) {
+    if (res->nranges > 1) return send_multipart_chunk(sock, res);
+    if (res->file_regular) {
+        if (res->body_remain <= 0) return 0;
+        // sendfile은 부분 전송이 정상. body_offset은 커널이 보낸 만큼 전진시켜 줌
+        ssize_t n = sendfile(sock, res->file_fd, &res->body_offset, res->body_remain);
+        if (n == 0) return 0; // 전송 도중 파일이 잘림 -> 있는 만큼만 보내고 끝
+        if (n > 0) res->body_remain -= n;
+        return n;
+    }
+
+    // 파이프에 남은 게 없으면 파일에서 새로 끌어옴 (파이프는 처음 필요할 때 만듦)
+    if (*pipe_pending == 0) {
+        if (pipe_fds[0] < 0 && pipe(pipe_fds) < 0) return -1;
+        ssize_t r = splice(res->file_fd, NULL, pipe_fds[1], NULL, 64 * 1024, SPLICE_F_MOVE);
+        if (r <= 0) return r; // 0 = 파일 끝
+        *pipe_pending = r;
+    }
+    // 소켓 쪽 블로킹 여부는 소켓의 O_NONBLOCK 플래그를 그대로 따름
+    ssize_t n = splice(pipe_fds[0], NULL, sock, NULL, *pipe_pending, SPLICE_F_MOVE);
+    if (n > 0) *pipe_pending -= n;
+    return n;
+}
+
+/* * [함수: multipart 다음 단계 준비]
+ * 지금 구간 헤더와 파일 구간을 다 보냈으면 다음 구간 헤더를 만들고 파일 위치를 옮깁니다.
+ * 끝 구분자까지 다 보냈으면 0, 아직 보낼 게 있으면 1 (io_uring 모드도 같은 순서로 진행함)
+ */
+static int multipart_next(Response* res) {
+    if (res->part_hdr_sent < res->part_hdr_len || res->body_remain > 0) return 1;
+    if (res->part > res->nranges) return 0;
+    res->part_hdr_len = format_part_header(res->part_hdr, sizeof(res->part_hdr), res, res->part);
+    res->part_hdr_sent = 0;
+    if (res->part < res->nranges) {
+        res->body_offset = res->ranges[res->part].start;
+        res->body_remain = res->ranges[res->part].end - res->ranges[res->part].start + 1;
+    }
+    res->part++;
+    return 1;
+}
+
+/* * [함수: multipart/byteranges 본문 일부 전송]
+ * "구간 헤더 -> 파일 구간(sendfile) -> 다음 구간 헤더 -> ... -> 끝 구분자" 순서로 진행합니다.
+ * 어디까지 보냈는지는 part / part_hdr_sent / body_offset / body_remain에 남으므로 논블로킹에서도 이어 보낼 수 있음
+ */
+static ssize_t send_multipart_chunk(int sock, Response* res) {
+    if (!multipart_next(res)) return 0; // 끝 구분자까지 다 보냄
+    if (res->part_hdr_sent < res->part_hdr_len) {
+        // 끝 구분자가 아니면 곧 파일 구간이 이어지므로 MSG_MORE로 작은 패킷을 막음
+        int more = res->part <= res->nranges ? MSG_MORE : 0;
+        ssize_t n = send(sock, res->part_hdr + res->part_hdr_sent, res->part_hdr_len - res->part_hdr_sent, more);
+        if (n > 0) res->part_hdr_sent += n;
+        return n;
+    }
+    ssize_t n = sendfile(sock, res->file_fd, &res->body_offset, res->body_remain);
+    if (n == 0) return 0; // 전송 도중 파일이 잘림
+    if (n > 0) res->body_remain -= n;
+    return n;
+}
+
+/* [함수: 캐시 응답의 남은 부분을 iovec으로] 헤더 + 본문 중 cached_sent 이후만 담음. 남은 게 없으면 0 */
+static int cached_iov(const Response* res, struct iovec iov[2]) {
+    const CacheEntry* e = res->cached;
+    size_t hlen = e->hdr_len[res->keep_alive ? 1 : 0];
+    size_t total = hlen + e->body_len;
+    if (res->cached_sent >= total) return 0;
+
+    int cnt = 0;
+    if (res->cached_sent < hlen) {
+        iov[cnt].iov_base = e->hdr[res->keep_alive ? 1 : 0] + res->cached_sent;
+        iov[cnt++].iov_len = hlen - res->cached_sent;
+        iov[cnt].iov_base = e->body;
+        iov[cnt++].iov_len = e->body_len;
+    } else {
+        iov[cnt].iov_base = e->body + (res->cached_sent - hlen);
+        iov[cnt++].iov_len = total - res->cached_sent;
+    }
+    return cnt;
+}
+
+/* * [함수: 캐시 응답 일부 전송]
+ * 미리 만들어 둔 헤더와 파일 내용을 writev 한 번으로 보냅니다. 부분 전송이면 cached_sent부터 이어 보냄.
+ * 반환값은 send_body_chunk와 같음 (>0 보낸 양, 0 = 완료, -1 = 에러)
+ */
+static ssize_t send_cached_chunk(int sock, Response* res) {
+    struct iovec iov[2];
+    int cnt = cached_iov(res, iov);
+    if (cnt == 0) return 0;
+    ssize_t n = writev(sock, iov, cnt);
+    if (n > 0) res->cached_sent += n;
+    return n;
+}
+
+/* [함수: 버퍼 전부 보내기] 블로킹 소켓이면 send 한 번으로 끝나지만, 코루틴의 논블로킹 소켓은 나눠 나갈 수 있음 */
+static int send_all(int fd, const char* buf, size_t len, int flags) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, flags);
+        if (n < 0 && io_retry(fd, EPOLLOUT, 0)) continue;
+        if (n <= 0) return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* * ======================================================================================
+ * [함수: HTTP 요청 처리 (스레드 풀 모드 / 코루틴 모드)]
+ * 워커 스레드가 실제로 수행하는 일입니다.
+ * 1. 요청 읽기 -> 2. 파싱/파일 찾기(prepare_response) -> 3. 응답 보내기
+ * Keep-Alive 연결이면 1~3을 반복하고, 파이프라이닝으로 미리 와 있는 요청은 도착 순서대로 처리합니다.
+ * 주의: 스레드 풀 모드에서는 유휴 Keep-Alive 연결도 워커 하나를 붙잡고 있으므로,
+ *       연결을 많이 재사용하는 환경이라면 이벤트 루프(epoll) 모드가 적합합니다.
+ * 코루틴 모드에서는 같은 코드가 연결마다 코루틴 하나로 돌고, read/send가 EAGAIN이면 io_retry 안에서
+ * 그 코루틴만 멈춤 (스레드는 다른 연결로 넘어감. 아래 [코루틴 모드] 참고)
+ * ======================================================================================
+ */
+void handle_request(int client_fd) {
+    char buffer[BUF_SIZE];
+    size_t len = 0; // 버퍼에 쌓여 있는 바이트 수 (다음 요청의 앞부분이 남아 있을 수 있음)
+
+    // 유휴 타임아웃: 다음 요청이 KEEPALIVE_TIMEOUT초 안에 안 오면 read가 실패하고 연결을 닫음
+    struct timeval tv = { .tv_sec = KEEPALIVE_TIMEOUT, .tv_usec = 0 };
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    HttpRequest req;
+    RequestBody body = { 0 };
+    while (1) {
+        // 1. 요청 하나가 완성될 때까지 소켓에서 읽기 (이미 버퍼에 있으면 바로 통과)
+        // 파서는 증분 방식이라, 더 읽은 뒤 다시 불러도 이미 본 바이트는 다시 검사하지 않음
+        // 본문이 있으면 본문까지 다 받아야 완성 (버퍼에서 빠져서 플러그인 라우트면 body로 가고, 정적 파일이면 버려짐)
+        http_parser_init(&req);
+        int req_len;
+        while ((req_len = request_parse(&req, &body, buffer, &len, client_fd)) == HTTP_PARSE_INCOMPLETE) {
+            if (len == sizeof(buffer)) break; // 헤더가 버퍼보다 큼
+            ssize_t n = read(client_fd, buffer + len, sizeof(buffer) - len);
+            if (n < 0 && io_retry(client_fd, EPOLLIN, len == 0)) continue; // EINTR, 또는 코루틴이 기다렸다 옴
+            if (n <= 0) goto out; // 연결 끊김 또는 유휴 시간 초과
+            len += n;
+        }
+
+        // 2. 요청 해석 (잘못된 요청이면 에러 응답 후 연결 종료)
+        long long req_start = monotonic_ns();
+        Response res;
+        res.req = req_len >= 0 ? &req : NULL;
+        if (req_len == HTTP_PARSE_INCOMPLETE) {
+            set_simple_response(&res, "431 Request Header Fields Too Large", "", 0);
+            req_len = len;
+        } else if (req_len == HTTP_PARSE_ERROR) {
+            set_simple_response(&res, "400 Bad Request", "", 0);
+            req_len = len;
+        } else if (req_len == REQ_BODY_TOO_LARGE) {
+            set_simple_response(&res, "413 Content Too Large", "", 0);
+            req_len = len;
+        } else {
+            prepare_response(&req, &body, client_fd, &res);
+        }
+        request_body_free(&body);
+
+        // 캐시 적중: 헤더 + 본문을 writev로 한 번에 전송
+        if (res.cached) {
+            ssize_t n;
+            while ((n = send_cached_chunk(client_fd, &res)) != 0) {
+                if (n < 0 && !io_retry(client_fd, EPOLLOUT, 0)) break;
+            }
+            if (n == 0) stats_request_done(&res, req_start);
+            cache_release(res.cached);
+            if (n != 0) goto out;
+            memmove(buffer, buffer + req_len, len - req_len);
+            len -= req_len;
+            if (!res.keep_alive) break;
+            continue;
+        }
+
+        // 3. 헤더 전송
+        // MSG_MORE: "곧 본문이 이어진다"고 알려서 헤더만 담긴 작은 패킷이 따로 나가지 않게 함
+        // (작은 패킷 + Nagle + Delayed ACK가 겹치면 Keep-Alive에서 요청마다 40ms씩 멈출 수 있음)
+        if (send_all(client_fd, res.header, res.header_len, res.file_fd >= 0 ? MSG_MORE : 0) < 0) {
+            if (res.file_fd >= 0) close(res.file_fd);
+            goto out;
+        }
+
+        // 4. 파일 내용 전송 (sendfile/splice로 끝까지 밀어 넣음)
+        // 블로킹 소켓이라 부분 전송이 나와도 다음 호출에서 이어서 보내면 됨
+        if (res.file_fd >= 0) {
+            int pipe_fds[2] = { -1, -1 };
+            size_t pipe_pending = 0;
+            ssize_t n;
+            while ((n = send_body_chunk(client_fd, &res, pipe_fds, &pipe_pending)) != 0) {
+                if (n < 0 && !io_retry(client_fd, EPOLLOUT, 0)) break; // 클라이언트가 끊었으면 중단
+            }
+            if (pipe_fds[0] >= 0) {
+                close(pipe_fds[0]);
+                close(pipe_fds[1]);
+            }
+            close(res.file_fd);
+            if (n != 0) goto out; // 본문을 다 못 보냈으면 이 연결은 더 못 씀
+        }
+        stats_request_done(&res, req_start);
+
+        // 5. 처리한 요청을 버퍼에서 제거 (뒤에 붙어 온 파이프라이닝 요청은 앞으로 당김)
+        memmove(buffer, buffer + req_len, len - req_len);
+        len -= req_len;
+
+        if (!res.keep_alive) break;
+    }
+
+out:
+    // 6. 리소스 정리 (소켓 닫기, 본문을 받다가 끊겼으면 모으던 것도 버림)
+    request_body_free(&body);
+    close(client_fd);
+}
+
+/* * ======================================================================================
+ * [락 없는 작업 큐 함수들]
+ * ======================================================================================
+ */
+
+/* [매크로: 스핀 대기 힌트] x86의 pause 명령은 스핀 중임을 CPU에 알려 전력/하이퍼스레드 낭비를 줄임 */
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() ((void)0)
+#endif
+
+/* [함수: futex 대기/깨우기] *addr가 아직 expected면 잠들고, 값이 바뀌었으면 바로 돌아옴 */
+static void futex_wait(int* addr, int expected) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void futex_wake(int* addr, int n) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+/* [함수: 큐 초기화] depth를 2의 거듭제곱으로 올리고, 칸마다 순번을 자기 인덱스로 맞춰둠 */
+static int queue_init(size_t depth, int shed_on_full) {
+    size_t cap = 2;
+    while (cap < depth) cap <<= 1;
+    work_queue.slots = calloc(cap, sizeof(QueueSlot));
+    if (!work_queue.slots) return -1;
+    for (size_t i = 0; i < cap; i++) work_queue.slots[i].seq = i;
+    work_queue.mask = cap - 1;
+    work_queue.shed_on_full = shed_on_full;
+    return 0;
+}
+
+/* * [함수: 넣기 시도]
+ * 칸의 순번 == 내 위치   -> 비어 있음. CAS로 위치를 차지한 뒤 fd를 쓰고 순번을 pos+1로 올림 ("읽어도 됨")
+ * 칸의 순번 <  내 위치   -> 소비자가 아직 안 꺼내감 = 큐가 가득 참
+ * 칸의 순번 >  내 위치   -> 다른 생산자가 먼저 차지함. 최신 위치를 다시 읽고 재시도
+ * 반환값: 1 = 성공, 0 = 가득 참
+ */
+static int queue_try_push(int fd, int ip_slot) {
+    size_t pos = __atomic_load_n(&work_queue.enqueue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        QueueSlot* slot = &work_queue.slots[pos & work_queue.mask];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&work_queue.enqueue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                slot->fd = fd;
+                slot->ip_slot = ip_slot;
+                __atomic_store_n(&slot->enq_ns, monotonic_ns(), __ATOMIC_RELAXED); // queue_head_wait가 몰래 읽음
+                __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+            // CAS 실패 시 pos는 최신 값으로 자동 갱신됨
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&work_queue.enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/* * [함수: 꺼내기 시도]
+ * 칸의 순번 == 내 위치 + 1 이면 데이터가 들어 있음. 꺼낸 뒤 순번을 한 바퀴 뒤(pos + 크기)로 올려
+ * "다음 바퀴의 생산자가 써도 됨"을 표시합니다.
+ * 반환값: 1 = 성공(*fd, *ip_slot, *enq_ns에 결과), 0 = 비어 있음
+ */
+static int queue_try_pop(int* fd, int* ip_slot, long long* enq_ns) {
+    size_t pos = __atomic_load_n(&work_queue.dequeue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        QueueSlot* slot = &work_queue.slots[pos & work_queue.mask];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&work_queue.dequeue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *fd = slot->fd;
+                *ip_slot = slot->ip_slot;
+                *enq_ns = slot->enq_ns;
+                __atomic_store_n(&slot->seq, pos + work_queue.mask + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&work_queue.dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/* * [함수: 과부하 응답]
+ * 큐가 가득 찼거나(shed 정책) 입장 제어에 걸렸을 때 accept 스레드/루프가 직접 보내는 짧은 응답.
+ * - 503: 서버 전체가 밀림 / 429: 이 클라이언트(IP)가 연결을 너무 많이 열었음
+ * 방금 accept한 소켓은 송신 버퍼가 비어 있으므로 write가 블록되지 않습니다. (논블로킹이어도 다 들어감)
+ */
+static void send_overload_response(int client_fd, int code) {
+    static const char busy[] =
+        "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    static const char too_many[] =
+        "HTTP/1.1 429 Too Many Requests\r\nRetry-After: 1\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    if (code == 429) write(client_fd, too_many, sizeof(too_many) - 1);
+    else write(client_fd, busy, sizeof(busy) - 1);
+    close(client_fd);
+}
+
+/* * ======================================================================================
+ * [입장 제어 (Admission Control)]
+ * 큐가 가득 찼을 때 거절하면 이미 늦습니다. 16칸이 모두 찬 뒤에는 accept 스레드가 enqueue 안에서
+ * 멈추고(block 정책), 그동안 새 연결은 OS backlog(10)에 쌓였다가 클라이언트가 아무 응답 없이 타임아웃됩니다.
+ * 큐 길이 대신 "큐에서 얼마나 기다리는가"를 봅니다. (CoDel, Controlled Delay)
+ * - 큐 맨 앞(가장 오래 기다린) 연결의 대기 시간이 목표(target) 아래로 한 번이라도 내려가면 정상
+ *   -> 순간적인 폭주(burst)는 큐가 흡수하고, 워커가 따라잡으면 대기 시간이 다시 내려감
+ * - interval(= target x 10) 동안 내내 목표 위에 있으면 "빠지지 않는 큐" = 워커가 따라잡지 못하는 과부하
+ *   -> 새 연결은 큐에 넣지 않고 accept 스레드가 바로 503 + Retry-After (클라이언트는 1초 뒤 재시도)
+ *   대기 시간이 목표 아래로 내려가는 순간 다시 받기 시작함
+ * - 판단은 accept 스레드마다 따로 하지만(SO_REUSEPORT면 여러 개) 모두 같은 큐를 보므로 결론도 같음
+ *   워커는 아무것도 안 함 (공유 변수에 쓰는 사람이 없어 캐시 라인을 다투지 않음)
+ * - IP별 동시 연결 한도(-I): 한 클라이언트가 연결을 잔뜩 열어 워커/큐를 독차지하지 못하게 429로 거절
+ *   IP 주소를 해시한 IP_BUCKETS개 카운터로 셈. 해시가 겹치는 IP끼리는 한도를 나눠 쓰므로 조금 일찍
+ *   거절될 수는 있어도 한도를 넘길 수는 없음 (정확한 표를 두면 락이나 삭제 처리가 필요함)
+ *   모든 모드에서 동작 (epoll/uring도 연결 하나가 루프의 fd/메모리를 차지하므로)
+ * 둘 다 SIGHUP 재설정으로 바뀜 (한도를 켜기 전에 받은 연결은 세지 않음)
+ * ======================================================================================
+ */
+#define CODEL_TARGET_MS 50       // 기본 목표 대기 시간 (-A, 0이면 끔)
+#define CODEL_INTERVAL_FACTOR 10 // interval = target x 10 (CoDel의 기본값 5ms / 100ms와 같은 비율)
+#define IP_BUCKET_BITS 12
+#define IP_BUCKETS (1 << IP_BUCKET_BITS)
+#define IP_REJECT (-2)           // ip_admit: 한도 초과
+
+static int admission_target_ms = CODEL_TARGET_MS; // 재설정 때 바뀌므로 원자적으로 읽음
+static int max_conns_per_ip = 0;                  // 0이면 끔
+static int ip_conns[IP_BUCKETS];                  // 해시 칸별 열린 연결 수
+
+/* [구조체: accept 스레드 하나의 CoDel 상태] */
+typedef struct {
+    long long first_above_ns; // 대기 시간이 목표 위로 올라간 뒤 interval이 끝나는 시각 (0 = 목표 아래)
+} CoDel;
+
+/* * [함수: 맨 앞 연결의 대기 시간]
+ * 큐가 비어 있으면 0. 꺼내는 쪽과 락 없이 엇갈려 읽으므로 그 사이 칸이 다시 채워졌다면 더 최근 시각을
+ * 보게 되는데, 그러면 대기 시간이 짧게 나와서 "받아들이는" 쪽으로만 틀림 (거절을 잘못 하지는 않음)
+ */
+static long long queue_head_wait(long long now) {
+    size_t pos = __atomic_load_n(&work_queue.dequeue_pos, __ATOMIC_RELAXED);
+    QueueSlot* slot = &work_queue.slots[pos & work_queue.mask];
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) return 0;
+    return now - __atomic_load_n(&slot->enq_ns, __ATOMIC_RELAXED);
+}
+
+/* [함수: 큐에 넣어도 되는지] 1 = 받아들임, 0 = 503으로 거절 */
+static int codel_admit(CoDel* cd) {
+    int target_ms = __atomic_load_n(&admission_target_ms, __ATOMIC_RELAXED);
+    if (target_ms <= 0) return 1;
+    long long now = monotonic_ns(), target = target_ms * 1000000LL;
+    if (queue_head_wait(now) < target) {
+        cd->first_above_ns = 0;
+        return 1;
+    }
+    if (cd->first_above_ns == 0) {
+        cd->first_above_ns = now + target * CODEL_INTERVAL_FACTOR;
+        return 1;
+    }
+    return now < cd->first_above_ns;
+}
+
+/* * [함수: IP별 연결 수 세기]
+ * 한도가 꺼져 있거나 IPv4가 아니면 -1 (세지 않음), 한도를 넘으면 IP_REJECT, 아니면 센 칸 번호
+ * 칸 번호는 연결과 함께 들고 다니다가 닫을 때 ip_release로 돌려줌
+ */
+static int ip_admit(const struct sockaddr_in* peer) {
+    int cap = __atomic_load_n(&max_conns_per_ip, __ATOMIC_RELAXED);
+    if (cap <= 0 || peer->sin_family != AF_INET) return -1;
+    int slot = (ntohl(peer->sin_addr.s_addr) * 2654435761u) >> (32 - IP_BUCKET_BITS); // 곱셈 해시
+    if (__atomic_add_fetch(&ip_conns[slot], 1, __ATOMIC_RELAXED) > cap) {
+        __atomic_sub_fetch(&ip_conns[slot], 1, __ATOMIC_RELAXED);
+        return IP_REJECT;
+    }
+    return slot;
+}
+
+/* [함수: 이미 연결된 소켓으로 세기] accept가 주소를 안 돌려주는 경로용 (한도가 켜져 있을 때만 getpeername) */
+static int ip_admit_fd(int fd) {
+    if (__atomic_load_n(&max_conns_per_ip, __ATOMIC_RELAXED) <= 0) return -1;
+    struct sockaddr_in peer;
+    socklen_t len = sizeof(peer);
+    if (getpeername(fd, (struct sockaddr*)&peer, &len) < 0) return -1;
+    return ip_admit(&peer);
+}
+
+static void ip_release(int slot) {
+    if (slot >= 0) __atomic_sub_fetch(&ip_conns[slot], 1, __ATOMIC_RELAXED);
+}
+
+/* * ======================================================================================
+ * [함수: 생산자 (Producer)]
+ * 메인 스레드가 accept()로 받은 클라이언트 소켓을 큐에 넣습니다.
+ * 반환값: 1 = 넣음, 0 = 큐가 가득 차서 거절함 (shed 정책일 때만)
+ * ip_slot: ip_admit 결과. 연결과 함께 워커에게 넘어가서 워커가 닫을 때 돌려줌
+ *
+ * [잠든 워커 깨우기 - Lost Wakeup 방지]
+ * 워커는 "work_seq 읽기 -> idle_workers 증가 -> 큐 재확인 -> work_seq가 그대로면 잠듦" 순서로 잠듭니다.
+ * 생산자는 "넣기 -> idle_workers 확인 -> 있으면 work_seq 증가 + 깨우기" 순서라서,
+ * 둘이 엇갈려도 워커가 재확인에서 일감을 보거나, futex가 바뀐 work_seq를 보고 바로 돌아옵니다.
+ * 단, 양쪽 모두 "쓰기 -> 다른 변수 읽기" 순서가 지켜져야 합니다. 칸 공개는 release 저장일 뿐이라
+ * 그 뒤의 idle_workers 읽기가 앞당겨질 수 있음 (저장-읽기 재배치) -> 둘 사이에 seq_cst 펜스를 둠
+ * (워커 쪽 "idle_workers 증가 -> 큐 재확인"도 같은 펜스. dequeue의 blocked_producers도 마찬가지)
+ * ======================================================================================
+ */
+int enqueue(int client_fd, int ip_slot) {
+    while (!queue_try_push(client_fd, ip_slot)) {
+        if (work_queue.shed_on_full) return 0;
+
+        // back-pressure: 빈 칸이 날 때까지 잠듦 (그동안 새 연결은 OS backlog에 쌓임)
+        int seq = __atomic_load_n(&work_queue.space_seq, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&work_queue.blocked_producers, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (!queue_try_push(client_fd, ip_slot)) {
+            futex_wait(&work_queue.space_seq, seq);
+            __atomic_sub_fetch(&work_queue.blocked_producers, 1, __ATOMIC_SEQ_CST);
+            continue;
+        }
+        __atomic_sub_fetch(&work_queue.blocked_producers, 1, __ATOMIC_SEQ_CST);
+        break;
+    }
+
+    // "자, 일감 들어왔다!" -> 자고 있는 워커가 있을 때만 시스템 콜을 씀
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // 칸 공개가 idle_workers 읽기보다 먼저 보이도록
+    if (__atomic_load_n(&work_queue.idle_workers, __ATOMIC_SEQ_CST) > 0) {
+        __atomic_add_fetch(&work_queue.work_seq, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&work_queue.work_seq, 1);
+    }
+    return 1;
+}
+
+/* * ======================================================================================
+ * [스레드 풀 크기 조정 (SIGHUP)]
+ * 워커는 번호(0, 1, 2, ...)를 갖고, 번호가 pool_target 이상이 되면 하던 연결을 끝낸 뒤 큐에서
+ * 더 꺼내지 않고 끝납니다. 늘릴 때는 빈 번호의 워커만 새로 만듦 (pool_alive)
+ * 번호가 곧 CPU 순번이라 -P 고정도 줄었다 늘어도 그대로 유지됩니다.
+ * ======================================================================================
+ */
+#define POOL_MAX_WORKERS 4096 // -w 최대값
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static int pool_target = 0;                        // 돌고 있어야 할 워커 수
+static int pool_pin = 0;                           // -P: 워커 번호 = CPU 순번으로 고정
+static unsigned char pool_alive[POOL_MAX_WORKERS]; // 그 번호의 워커가 살아 있는지
+
+/* * [함수: 워커 은퇴 확인]
+ * 번호가 줄어든 범위 밖이면 살아 있음 표시를 지우고 1. 평소에는 원자적 읽기 한 번이고,
+ * 은퇴할 때만 락을 잡아서 "줄였다가 바로 다시 늘림"과 엇갈려도 같은 번호의 워커가 둘 생기지 않게 함
+ */
+static int pool_should_retire(int idx) {
+    if (idx < __atomic_load_n(&pool_target, __ATOMIC_RELAXED)) return 0;
+    pthread_mutex_lock(&pool_lock);
+    int retire = idx >= pool_target;
+    if (retire) pool_alive[idx] = 0;
+    pthread_mutex_unlock(&pool_lock);
+    return retire;
+}
+
+/* * [함수: 큐에서 꺼내기]
+ * 워커 스레드가 호출합니다. 일감이 생길 때까지 돌아오지 않습니다.
+ * 바로 잠들면 깨우는 데 시스템 콜이 두 번 들어가므로, 잠깐 확인을 반복(spin)해본 뒤에 잠듭니다.
+ * 풀이 줄어서 이 워커(idx)가 은퇴해야 하면 -1. *ip_slot에는 연결을 닫을 때 돌려줄 IP 칸
+ */
+int dequeue(int idx, int* ip_slot) {
+    int client_fd;
+    long long enq_ns;
+    for (;;) {
+        if (pool_should_retire(idx)) return -1;
+        for (int spin = 0; spin < 100; spin++) {
+            if (queue_try_pop(&client_fd, ip_slot, &enq_ns)) goto got;
+            cpu_relax();
+        }
+
+        int seq = __atomic_load_n(&work_queue.work_seq, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&work_queue.idle_workers, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (queue_try_pop(&client_fd, ip_slot, &enq_ns)) {
+            __atomic_sub_fetch(&work_queue.idle_workers, 1, __ATOMIC_SEQ_CST);
+            goto got;
+        }
+        futex_wait(&work_queue.work_seq, seq);
+        __atomic_sub_fetch(&work_queue.idle_workers, 1, __ATOMIC_SEQ_CST);
+    }
+
+got:
+    stats_hist_add(&my_stats->queue_wait, monotonic_ns() - enq_ns);
+    STAT_ADD(connections, 1);
+
+    // "빈 자리 생겼어!" -> back-pressure로 잠든 생산자가 있을 때만 깨움
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // 꺼내기(칸 비움)가 blocked_producers 읽기보다 먼저 보이도록
+    if (__atomic_load_n(&work_queue.blocked_producers, __ATOMIC_SEQ_CST) > 0) {
+        __atomic_add_fetch(&work_queue.space_seq, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&work_queue.space_seq, 1);
+    }
+    return client_fd;
+}
+
+/* * ======================================================================================
+ * [CPU 배치 (Affinity)]
+ * 스레드가 코어 사이를 떠돌면 연결 상태/캐시 항목/소켓 버퍼가 든 캐시 라인이 코어마다 옮겨 다니고,
+ * 멀티 소켓(NUMA) 장비에서는 다른 노드의 메모리를 읽느라 더 느려집니다.
+ * - i번째 워커/루프를 "쓸 수 있는 CPU 목록"의 i번째에 고정 (-P, SO_REUSEPORT 모드는 항상)
+ * - 고정된 스레드가 직접 할당한 메모리(연결 상태, 링, 버퍼)는 리눅스의 first-touch 정책에 따라
+ *   그 CPU가 속한 NUMA 노드에 잡히므로 따로 노드를 지정하지 않아도 로컬 메모리가 됨
+ * - CPU 번호는 0부터 빈틈없이 이어진다는 보장이 없으므로(taskset, cgroup cpuset, 꺼진 코어)
+ *   시작할 때 sched_getaffinity로 실제로 쓸 수 있는 번호 목록을 만들어 둠
+ * ======================================================================================
+ */
+static int cpu_ids[CPU_SETSIZE]; // 쓸 수 있는 CPU 번호들
+static int num_cpus = 0;
+
+static void cpu_init(void) {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int c = 0; c < CPU_SETSIZE; c++)
+            if (CPU_ISSET(c, &set)) cpu_ids[num_cpus++] = c;
+    }
+    if (num_cpus == 0) { // affinity를 못 읽으면 온라인 CPU가 0..N-1이라고 가정
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int c = 0; c < n && c < CPU_SETSIZE; c++) cpu_ids[num_cpus++] = c;
+    }
+    if (num_cpus == 0) cpu_ids[num_cpus++] = 0;
+}
+
+/* [함수: 스레드를 CPU 하나에 고정] slot번째 CPU (CPU 수보다 크면 한 바퀴 돎), slot < 0이면 아무것도 안 함 */
+static void pin_to_cpu(int slot) {
+    if (slot < 0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu_ids[slot % num_cpus], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/* * ======================================================================================
+ * [함수: 소비자 (Consumer / Worker Thread)]
+ * 스레드 풀의 각 스레드가 실행할 함수입니다. 무한 루프를 돌며 일감을 기다립니다.
+ * ======================================================================================
+ */
+void* worker_thread(void* arg) {
+    int idx = (int)(intptr_t)arg; // 워커 번호
+    pin_to_cpu(pool_pin ? idx : -1);
+    stats_register("worker");
+    while (1) {
+        // 1. 일감 꺼내기 (락 없음. 비어 있으면 dequeue 안에서 잠듦). 풀이 줄었으면 끝냄
+        int ip_slot;
+        int client_fd = dequeue(idx, &ip_slot);
+        if (client_fd < 0) break;
+
+        // 2. 실제 업무 처리 (병렬 처리 구간). 연결을 붙잡고 있는 시간 = 이 워커가 바쁜 시간
+        long long t0 = monotonic_ns();
+        handle_request(client_fd);
+        STAT_ADD(busy_ns, monotonic_ns() - t0);
+        STAT_ADD(closed, 1);
+        ip_release(ip_slot);
+    }
+    return NULL;
+}
+
+/* * [함수: 풀 크기 바꾸기]
+ * 시작할 때와 SIGHUP 재설정 때 부름. 줄일 때는 잠든 워커를 모두 깨워서 자기 번호를 다시 보게 함
+ * (바쁜 워커는 지금 연결을 끝낸 뒤에 은퇴하므로 처리 중인 요청은 끊기지 않음)
+ */
+static void pool_resize(int n) {
+    pthread_mutex_lock(&pool_lock);
+    int shrink = n < pool_target;
+    __atomic_store_n(&pool_target, n, __ATOMIC_RELAXED);
+    for (int i = 0; i < n; i++) {
+        if (pool_alive[i]) continue; // 아직 은퇴 전이면 그대로 계속 일함
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, worker_thread, (void*)(intptr_t)i) != 0) {
+            perror("pthread_create");
+            break;
+        }
+        pthread_detach(tid);
+        pool_alive[i] = 1;
+    }
+    pthread_mutex_unlock(&pool_lock);
+    if (shrink) {
+        __atomic_add_fetch(&work_queue.work_seq, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&work_queue.work_seq, INT_MAX);
+    }
+}
+
+/* * ======================================================================================
+ * [리슨 소켓 / accept 관련 설정]
+ * - listen_backlog: listen()에 넘기는 OS 대기열 크기 (-b)
+ * - use_accept4: accept4(SOCK_NONBLOCK)로 받자마자 논블로킹 소켓을 얻음 (-n, epoll 모드)
+ *   accept + fcntl(F_GETFL) + fcntl(F_SETFL) 세 번의 시스템 콜이 한 번으로 줄어듦
+ *   (끄더라도 accept4(SOCK_CLOEXEC)로 받음: 교체 때 새 프로세스가 클라이언트 소켓을 물려받지 않게)
+ * ======================================================================================
+ */
+static int listen_backlog = -1; // -1이면 모드별 기본값 (pool 10, epoll SOMAXCONN)
+static int use_accept4 = 0;
+
+/* [구조체: accept 루프 / 이벤트 루프 스레드 인자] */
+typedef struct {
+    int server_fd;
+    int cpu; // 고정할 CPU 순번 (cpu_ids의 인덱스, -1이면 고정 안 함)
+} AcceptorArg;
+
+/* * ======================================================================================
+ * [연결 상태 Slab (루프별 메모리 풀)]
+ * 이벤트 루프/io_uring 모드는 연결마다 요청 버퍼와 응답 헤더가 든 큰 구조체(약 5KB)를 만들고 버립니다.
+ * 매번 calloc/free를 부르면 malloc 내부 락/arena를 거치고, 처음 쓰는 페이지마다 페이지 폴트가 납니다.
+ * - 루프마다 자기 풀을 가짐 (루프 스레드만 쓰므로 락 없음)
+ * - 2MB 덩어리를 한 번에 받아서 같은 크기 칸으로 잘라 씀. 반납된 칸은 free list로 다시 씀
+ *   (덩어리는 OS에 돌려주지 않음 -> 최대 동시 연결 수만큼만 커지고, 그 뒤로는 할당/폴트가 없음)
+ * - 덩어리는 huge page(2MB)로 받아서 TLB 항목 하나로 연결 수백 개를 덮음
+ *   미리 잡아둔 hugetlbfs 페이지가 있으면 MAP_HUGETLB, 없으면 2MB 정렬 + MADV_HUGEPAGE(THP)로 요청
+ * - 칸 크기는 캐시 라인 배수로 올려서 이웃 연결과 같은 캐시 라인을 나눠 쓰지 않게 함
+ * ======================================================================================
+ */
+#define SLAB_CHUNK (2 * 1024 * 1024)
+
+typedef struct {
+    size_t obj_size;  // 칸 크기 (CACHE_LINE 배수)
+    void* free_list;  // 반납된 칸 (칸의 첫 8바이트에 다음 칸 주소를 적어 둠)
+    char* cur;        // 지금 덩어리에서 아직 안 나눠 준 부분
+    char* end;
+} SlabArena;
+
+static void slab_init(SlabArena* a, size_t obj_size) {
+    a->obj_size = (obj_size + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+    a->free_list = NULL;
+    a->cur = a->end = NULL;
+}
+
+/* [함수: 2MB 덩어리 받기] huge page를 못 받으면 일반 페이지로라도 */
+static char* slab_chunk(void) {
+    char* p = mmap(NULL, SLAB_CHUNK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) return p;
+
+    // THP는 2MB 경계에 맞춰진 영역만 huge page로 채울 수 있으므로 두 배로 받아서 정렬된 부분만 남김
+    char* raw = mmap(NULL, 2 * SLAB_CHUNK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return NULL;
+    p = (char*)(((unsigned long)raw + SLAB_CHUNK - 1) & ~(unsigned long)(SLAB_CHUNK - 1));
+    if (p > raw) munmap(raw, p - raw);
+    munmap(p + SLAB_CHUNK, raw + 2 * SLAB_CHUNK - (p + SLAB_CHUNK));
+    madvise(p, SLAB_CHUNK, MADV_HUGEPAGE);
+    return p;
+}
+
+/* [함수: 칸 하나 받기] calloc처럼 0으로 채워서 돌려줌. 메모리가 없으면 NULL */
+static void* slab_alloc(SlabArena* a) {
+    void* p = a->free_list;
+    if (p) {
+        a->free_list = *(void**)p;
+    } else {
+        if (a->cur == NULL || a->cur + a->obj_size > a->end) {
+            char* chunk = slab_chunk();
+            if (!chunk) return NULL;
+            a->cur = chunk;
+            a->end = chunk + SLAB_CHUNK;
+        }
+        p = a->cur;
+        a->cur += a->obj_size;
+    }
+    memset(p, 0, a->obj_size);
+    return p;
+}
+
+static void slab_free(SlabArena* a, void* p) {
+    *(void**)p = a->free_list;
+    a->free_list = p;
+}
+
+/* * ======================================================================================
+ * [이벤트 루프 모드 (epoll, Edge-Triggered)]
+ * 스레드 풀 모드는 연결 하나가 워커 하나를 처음부터 끝까지 붙잡습니다.
+ * 느린 클라이언트 4명이면 서버 전체가 멈추는 구조입니다.
+ *
+ * 이벤트 루프 모드에서는:
+ * - 워커마다 자기 epoll 인스턴스를 갖고, 리슨 소켓을 EPOLLEXCLUSIVE로 함께 감시합니다.
+ *   (연결이 들어오면 워커 하나만 깨어나서 accept -> 그 연결은 끝까지 그 워커 소유)
+ * - 모든 소켓은 논블로킹. read/write가 EAGAIN을 돌려주면 "지금은 여기까지"라는 뜻이므로
+ *   연결 상태(state)를 저장해두고 다음 이벤트 때 이어서 진행합니다.
+ * - Edge-Triggered(EPOLLET)는 "상태가 바뀌는 순간"에만 알려주므로,
+ *   깨어났을 때 EAGAIN이 나올 때까지 끝까지 읽고/써야 합니다. (안 그러면 영영 안 깨워줌)
+ * ======================================================================================
+ */
+
+/* [연결 상태 (State Machine)] 요청 읽는 중 -> 헤더 보내는 중 -> 본문 보내는 중 -> (Keep-Alive면) 다시 요청 읽기
+ * 캐시 적중 응답은 헤더와 본문이 메모리에 함께 있으므로 CONN_SEND_CACHED 한 단계로 끝남 */
+typedef enum {
+    CONN_READ_REQUEST,
+    CONN_SEND_HEADER,
+    CONN_SEND_BODY,
+    CONN_SEND_CACHED
+} ConnState;
+
+/* [구조체: 연결 하나의 상태] 블로킹 모드라면 스택에 있었을 변수들을 힙으로 옮겨둔 것 */
+typedef struct Connection {
+    int fd;                // 클라이언트 소켓
+    int ip_slot;           // IP별 연결 수를 센 칸 (닫을 때 ip_release)
+    ConnState state;       // 현재 진행 단계
+    char req[BUF_SIZE];    // 받은 요청 바이트 (파이프라이닝된 다음 요청들이 뒤에 붙어 있을 수 있음)
+    size_t req_len;
+    HttpRequest parser;    // 증분 파서 상태 (요청이 여러 조각으로 와도 이어서 파싱)
+    RequestBody body;      // 플러그인 라우트의 요청 본문 (받는 중이면 active)
+    size_t cur_req_len;    // 지금 응답 중인 요청이 req 앞쪽에서 차지하는 길이
+    long long req_start_ns; // 지금 요청을 해석하기 시작한 시각 (처리 시간 통계용)
+    Response res;          // prepare_response 결과 (본문 전송 위치도 여기에 기록됨)
+    size_t header_sent;    // 헤더 중 이미 보낸 바이트 수
+    int pipe_fds[2];       // splice용 중간 파이프 (일반 파일이 아닐 때만 생성)
+    size_t pipe_pending;   // 파이프에 들어 있지만 아직 소켓으로 못 보낸 바이트 수
+    time_t last_active;    // 마지막으로 읽기/쓰기가 진행된 시각 (유휴 타임아웃 판단용)
+    struct Connection* prev; // 유휴 목록 (오래된 것이 앞쪽)
+    struct Connection* next;
+} Connection;
+
+/* * [구조체: 이벤트 루프 하나]
+ * 워커 스레드 하나가 소유하는 epoll과 연결 목록. 다른 스레드는 건드리지 않으므로 락이 필요 없습니다.
+ * 연결은 "마지막 활동 시각" 순서로 이중 연결 리스트에 매달아 두고, 활동이 생길 때마다 맨 뒤로 옮깁니다.
+ * 그러면 유휴 연결 정리는 맨 앞에서부터 타임아웃 안 된 연결을 만날 때까지만 보면 됩니다. (O(정리할 개수))
+ */
+typedef struct {
+    int epfd;
+    int server_fd;
+    Connection* head; // 가장 오래 조용했던 연결
+    Connection* tail; // 가장 최근에 활동한 연결
+    SlabArena conns;  // 연결 상태를 받아 오는 이 루프 전용 풀
+} EventLoop;
+
+/* [함수: 단조 증가 시계(초)] 시스템 시간을 바꿔도 타임아웃 계산이 꼬이지 않음 */
+static time_t monotonic_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/* [함수: 소켓을 논블로킹으로 전환] */
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/* [함수: 유휴 목록에서 떼어내기 / 맨 뒤에 붙이기]
+ * idle_unlink는 여러 번 불러도 안전하다. io_uring 모드는 타임아웃/드레인 sweep에서
+ * 먼저 떼어내고 완료 경로(uring_conn_free)에서 한 번 더 부르는데,
+ * 이미 빠진 노드로 head/tail을 덮어쓰면 나머지 유휴 연결이 목록에서 사라진다. */
+static void idle_unlink(EventLoop* loop, Connection* c) {
+    if (!c->prev && loop->head != c) return;   /* 목록에 없음 */
+    if (c->prev) c->prev->next = c->next; else loop->head = c->next;
+    if (c->next) c->next->prev = c->prev; else loop->tail = c->prev;
+    c->prev = c->next = NULL;
+}
+
+static void idle_touch(EventLoop* loop, Connection* c) {
+    if (loop->tail != c) {
+        idle_unlink(loop, c);
+        c->prev = loop->tail;
+        if (loop->tail) loop->tail->next = c; else loop->head = c;
+        loop->tail = c;
+    }
+    c->last_active = monotonic_sec();
+}
+
+/* [함수: 연결 정리] epoll에서 빼고, 열린 파일/소켓을 닫고, 상태 메모리 해제 */
+static void conn_close(EventLoop* loop, Connection* c) {
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    idle_unlink(loop, c);
+    if (c->res.file_fd >= 0) close(c->res.file_fd);
+    if (c->res.cached) cache_release(c->res.cached);
+    if (c->pipe_fds[0] >= 0) {
+        close(c->pipe_fds[0]);
+        close(c->pipe_fds[1]);
+    }
+    request_body_free(&c->body);
+    close(c->fd);
+    STAT_ADD(closed, 1);
+    ip_release(c->ip_slot);
+    slab_free(&loop->conns, c);
+}
+
+/* * [함수: 응답 하나 완료]
+ * Keep-Alive가 아니면 연결을 닫고(-1), 맞으면 처리한 요청을 버퍼에서 지우고 다음 요청 읽기로 돌아갑니다.
+ * 버퍼에 다음 요청이 이미 와 있다면(파이프라이닝) 읽기 단계에서 바로 처리되므로 순서가 보장됩니다.
+ */
+static int conn_finish_response(Connection* c) {
+    stats_request_done(&c->res, c->req_start_ns);
+    if (c->res.file_fd >= 0) {
+        close(c->res.file_fd);
+        c->res.file_fd = -1;
+    }
+    if (c->res.cached) {
+        cache_release(c->res.cached);
+        c->res.cached = NULL;
+    }
+    if (!c->res.keep_alive) return -1;
+
+    memmove(c->req, c->req + c->cur_req_len, c->req_len - c->cur_req_len);
+    c->req_len -= c->cur_req_len;
+    c->cur_req_len = 0;
+    c->state = CONN_READ_REQUEST;
+    http_parser_init(&c->parser);
+    return 0;
+}
+
+/* * [함수: 상태 머신 한 번 돌리기]
+ * 더 진행할 수 없을 때(EAGAIN)까지 최대한 진행합니다.
+ * 반환값: 0 = 연결 유지(다음 이벤트 대기), -1 = 연결 종료해야 함
+ */
+static int conn_drive(Connection* c) {
+    for (;;) {
+        switch (c->state) {
+        case CONN_READ_REQUEST: {
+            // 버퍼에 완성된 요청이 없을 때만 소켓에서 더 읽음
+            int req_len = request_parse(&c->parser, &c->body, c->req, &c->req_len, c->fd);
+            if (req_len == HTTP_PARSE_INCOMPLETE && c->req_len < sizeof(c->req)) {
+                ssize_t n = read(c->fd, c->req + c->req_len, sizeof(c->req) - c->req_len);
+                if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+                if (n == 0) return -1; // 클라이언트가 연결을 끊음
+                c->req_len += n;
+                break; // 새로 온 부분부터 이어서 파싱
+            }
+
+            c->req_start_ns = monotonic_ns();
+            c->res.req = req_len >= 0 ? &c->parser : NULL;
+            if (req_len == HTTP_PARSE_INCOMPLETE) {        // 헤더가 버퍼보다 큼
+                set_simple_response(&c->res, "431 Request Header Fields Too Large", "", 0);
+                req_len = c->req_len;
+            } else if (req_len == HTTP_PARSE_ERROR) {      // 문법 오류
+                set_simple_response(&c->res, "400 Bad Request", "", 0);
+                req_len = c->req_len;
+            } else if (req_len == REQ_BODY_TOO_LARGE) {
+                set_simple_response(&c->res, "413 Content Too Large", "", 0);
+                req_len = c->req_len;
+            } else {
+                prepare_response(&c->parser, &c->body, -1, &c->res);
+            }
+            request_body_free(&c->body);
+
+            c->cur_req_len = req_len;
+            c->header_sent = 0;
+            c->state = c->res.cached ? CONN_SEND_CACHED : CONN_SEND_HEADER;
+            break;
+        }
+        case CONN_SEND_HEADER: {
+            // MSG_MORE: 본문이 이어질 때 헤더만 담긴 작은 패킷이 따로 나가지 않게 함
+            ssize_t n = send(c->fd, c->res.header + c->header_sent,
+                             c->res.header_len - c->header_sent,
+                             c->res.file_fd >= 0 ? MSG_MORE : 0);
+            if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+            c->header_sent += n;
+            if (c->header_sent < c->res.header_len) break; // 일부만 나감 -> 나머지 계속
+            if (c->res.file_fd < 0) {                       // 본문 없는 응답은 여기서 끝
+                if (conn_finish_response(c) < 0) return -1;
+                break;
+            }
+            c->state = CONN_SEND_BODY;
+            break;
+        }
+        case CONN_SEND_BODY: {
+            // 소켓 버퍼가 찰 때(EAGAIN)까지 sendfile/splice로 계속 밀어 넣음
+            ssize_t n = send_body_chunk(c->fd, &c->res, c->pipe_fds, &c->pipe_pending);
+            if (n == 0) { // 본문 전송 완료
+                if (conn_finish_response(c) < 0) return -1;
+                break;
+            }
+            if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+            break;
+        }
+        case CONN_SEND_CACHED: {
+            ssize_t n = send_cached_chunk(c->fd, &c->res);
+            if (n == 0) { // 캐시 응답 전송 완료
+                if (conn_finish_response(c) < 0) return -1;
+                break;
+            }
+            if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+            break;
+        }
+        }
+    }
+}
+
+/* * [함수: 새 연결 모두 받기]
+ * 리슨 소켓도 Edge-Triggered이므로 EAGAIN이 나올 때까지 accept를 반복해야 합니다.
+ */
+static void accept_connections(EventLoop* loop) {
+    for (;;) {
+        // -n: accept4가 논블로킹 소켓을 바로 돌려줌 (fcntl 두 번 절약)
+        // CLOEXEC는 항상: 교체(SIGUSR2) 때 exec되는 새 프로세스가 클라이언트 소켓을 물려받으면
+        // 옛 프로세스가 닫아도 FIN이 안 나가서 클라이언트가 멈춤
+        struct sockaddr_in peer;
+        socklen_t peer_len = sizeof(peer);
+        int client_fd = accept4(loop->server_fd, (struct sockaddr*)&peer, &peer_len,
+                                use_accept4 ? SOCK_NONBLOCK | SOCK_CLOEXEC : SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                perror("accept");
+            return;
+        }
+        STAT_ADD(accepted, 1);
+        if (!use_accept4) set_nonblocking(client_fd);
+
+        int ip_slot = ip_admit(&peer);
+        if (ip_slot == IP_REJECT) {
+            send_overload_response(client_fd, 429);
+            STAT_ADD(ip_limited, 1);
+            STAT_ADD(closed, 1);
+            continue;
+        }
+        Connection* c = slab_alloc(&loop->conns);
+        if (!c) {
+            close(client_fd);
+            STAT_ADD(closed, 1);
+            ip_release(ip_slot);
+            continue;
+        }
+        STAT_ADD(connections, 1);
+        c->fd = client_fd;
+        c->ip_slot = ip_slot;
+        c->state = CONN_READ_REQUEST;
+        http_parser_init(&c->parser);
+        memset(&c->body, 0, sizeof(c->body));
+        c->res.file_fd = -1;
+        c->pipe_fds[0] = c->pipe_fds[1] = -1;
+
+        // 읽기/쓰기 모두 Edge-Triggered로 한 번만 등록해두면 상태가 바뀔 때마다 알려줌
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+                                  .data.ptr = c };
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+            close(client_fd);
+            STAT_ADD(closed, 1);
+            ip_release(ip_slot);
+            slab_free(&loop->conns, c);
+            continue;
+        }
+        idle_touch(loop, c);
+        // 요청이 이미 도착해 있을 수도 있으니 바로 한 번 돌려봄
+        if (conn_drive(c) < 0) conn_close(loop, c);
+    }
+}
+
+/* * [함수: 유휴 연결 정리]
+ * 목록 앞쪽(가장 오래 조용한 연결)부터 KEEPALIVE_TIMEOUT이 지난 것들을 닫습니다.
+ * 요청을 안 보내는 Keep-Alive 연결뿐 아니라, 응답을 안 받아 가는 느린 클라이언트도 여기서 정리됩니다.
+ */
+static void close_idle_connections(EventLoop* loop) {
+    time_t now = monotonic_sec();
+    while (loop->head && now - loop->head->last_active >= KEEPALIVE_TIMEOUT) {
+        conn_close(loop, loop->head);
+    }
+}
+
+/* * [함수: 드레인 - 조용한 연결 닫기]
+ * 다음 요청을 기다리기만 하는 Keep-Alive 연결(받은 바이트 없음)은 드레인 중에 바로 닫습니다.
+ * 응답 중인 연결은 건드리지 않음 (prepare_response가 Connection: close를 붙이므로 응답이 끝나면 닫힘)
+ */
+static void close_quiet_connections(EventLoop* loop) {
+    Connection* c = loop->head;
+    while (c) {
+        Connection* next = c->next;
+        if (c->state == CONN_READ_REQUEST && c->req_len == 0) conn_close(loop, c);
+        c = next;
+    }
+}
+
+/* * [함수: 이벤트 루프 워커]
+ * 각 워커가 자기 epoll을 돌립니다. 락도, 공유 큐도 없습니다.
+ */
+void* event_loop_thread(void* arg) {
+    AcceptorArg* a = arg;
+    EventLoop loop = { .server_fd = a->server_fd, .head = NULL, .tail = NULL };
+    pin_to_cpu(a->cpu);
+    stats_register("epoll");
+    slab_init(&loop.conns, sizeof(Connection));
+
+    loop.epfd = epoll_create1(0);
+    if (loop.epfd < 0) {
+        perror("epoll_create1");
+        return NULL;
+    }
+
+    // EPOLLEXCLUSIVE: 연결 하나에 워커 전부가 깨어나는 "Thundering Herd" 방지
+    // (SO_REUSEPORT 모드에서는 리슨 소켓이 루프마다 따로라서 원래 한 루프만 깨어남)
+    // 리슨 소켓은 data.ptr 대신 NULL로 표시해서 클라이언트 연결과 구분함
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL };
+    if (epoll_ctl(loop.epfd, EPOLL_CTL_ADD, loop.server_fd, &ev) < 0) {
+        perror("epoll_ctl");
+        close(loop.epfd);
+        return NULL;
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    int stopped = 0; // 드레인으로 accept를 멈췄는지
+    while (1) {
+        // 1초마다는 깨어나서 유휴 연결을 정리함 (드레인 시작도 이때 알아챔)
+        int n = epoll_wait(loop.epfd, events, MAX_EVENTS, 1000);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        long long t0 = monotonic_ns();
+        for (int i = 0; i < n; i++) {
+            Connection* c = events[i].data.ptr;
+            if (c == NULL) {
+                accept_connections(&loop);
+                continue;
+            }
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) || conn_drive(c) < 0) {
+                conn_close(&loop, c);
+                continue;
+            }
+            idle_touch(&loop, c);
+        }
+        close_idle_connections(&loop);
+        if (!stopped && __atomic_load_n(&server_draining, __ATOMIC_ACQUIRE)) {
+            // 리슨 소켓을 이 루프의 epoll에서만 뺌 (소켓 자체는 새 프로세스가 계속 씀)
+            epoll_ctl(loop.epfd, EPOLL_CTL_DEL, loop.server_fd, NULL);
+            stopped = 1;
+            __atomic_sub_fetch(&accepting_threads, 1, __ATOMIC_RELEASE);
+        }
+        if (stopped) close_quiet_connections(&loop);
+        if (n > 0) STAT_ADD(busy_ns, monotonic_ns() - t0);
+    }
+    close(loop.epfd);
+    return NULL;
+}
+
+/* * ======================================================================================
+ * [io_uring 모드]
+ * epoll 모드는 "준비됐다"는 알림을 받은 뒤 read/send/sendfile을 직접 부르므로
+ * 요청 하나에 시스템 콜이 최소 서너 번 들어갑니다.
+ * io_uring 모드는 할 일을 공유 링(SQ)에 적어 두고 io_uring_enter 한 번으로 한꺼번에 제출한 뒤,
+ * 끝난 결과를 완료 링(CQ)에서 꺼내 봅니다. (liburing 없이 시스템 콜 3개와 mmap만으로 구현)
+ * - multishot accept: accept SQE 하나가 연결이 들어올 때마다 완료를 계속 만들어 줌
+ * - provided buffer ring: recv에 버퍼를 미리 붙여두지 않고, 데이터가 도착한 순간 커널이
+ *   루프의 공용 버퍼 풀에서 하나 골라 씀 (조용한 Keep-Alive 연결은 수신 버퍼를 붙잡지 않음)
+ * - 링크된 SQE (IOSQE_IO_LINK): "헤더 send -> 파일->파이프 splice -> 파이프->소켓 splice"를
+ *   한 번에 제출하면 커널이 순서대로 실행함. 앞 단계가 짧게 끝나면 뒤 단계는 -ECANCELED로 취소되고,
+ *   어디까지 갔는지는 완료 결과로 기록해 두었다가 이어서 다시 제출함
+ * 요청 해석(prepare_response)과 캐시는 다른 모드와 그대로 공유합니다.
+ * 파일 open/fstat은 prepare_response 안에서 그대로 하는데, Content-Length/ETag/304/416과 캐시 여부가
+ * 전부 stat 결과에 달려 있어서 링크 체인 중간에 분기할 수가 없기 때문입니다.
+ * ======================================================================================
+ */
+#define URING_ENTRIES 256            // SQ 크기 (CQ는 커널이 두 배로 잡음)
+#define URING_BUF_COUNT 256          // 수신 버퍼 풀의 버퍼 개수 (2의 거듭제곱)
+#define URING_BUF_GROUP 0            // 버퍼 그룹 번호 (recv SQE가 이 그룹에서 골라 씀)
+#define URING_PIPE_SIZE (1024 * 1024) // splice 중간 파이프 크기 = 제출 한 번에 보낼 수 있는 파일 양
+
+/* [완료 종류] user_data 아래 3비트에 담음. 연결 포인터가 NULL이면 루프 자신의 SQE */
+enum {
+    UOP_RECV = 0,
+    UOP_SEND,        // 응답 헤더 (에러 응답은 짧은 본문까지)
+    UOP_SEND_PART,   // multipart 구간 헤더 / 끝 구분자
+    UOP_SEND_CACHED, // 캐시 적중 응답 (헤더 + 본문 sendmsg)
+    UOP_SPLICE_IN,   // 파일 -> 파이프
+    UOP_SPLICE_OUT,  // 파이프 -> 소켓
+    UOP_ACCEPT,
+    UOP_TIMEOUT
+};
+#define UOP_MASK 7
+
+/* [구조체: 링 하나] mmap으로 커널과 공유하는 SQ/CQ 포인터들 */
+typedef struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    unsigned sq_entries;
+    unsigned sqe_tail; // 우리가 채운 SQE 끝 (io_uring_enter 때 sq_tail로 공개)
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    struct io_uring_buf_ring* buf_ring; // 수신 버퍼 풀 (커널이 head, 우리가 tail을 움직임)
+    unsigned short buf_tail;
+    char* bufs;
+} Uring;
+
+/* * [구조체: io_uring 연결]
+ * 상태 머신/버퍼/Response는 epoll 모드의 Connection을 그대로 씀 (conn_finish_response, 유휴 목록 재사용)
+ * 커널이 아직 붙잡고 있는 SQE가 있으면 메모리를 풀 수 없으므로 inflight로 셈
+ */
+typedef struct {
+    Connection c;        // 반드시 첫 멤버 (유휴 목록의 Connection*를 그대로 캐스팅함)
+    int inflight;        // 제출했지만 아직 완료가 안 온 SQE 수
+    int closing;         // 에러/종료 결정됨 -> inflight가 0이 되면 해제
+    int pipe_size;       // 중간 파이프 크기 (F_SETPIPE_SZ 결과)
+    struct iovec iov[2]; // 캐시 응답 sendmsg용 (완료될 때까지 커널이 참조하므로 연결에 둠)
+    struct msghdr msg;
+} UringConn;
+
+/* [구조체: io_uring 이벤트 루프] 유휴 목록, 리슨 소켓, 연결 slab은 EventLoop 것을 그대로 씀 (epfd는 안 씀) */
+typedef struct {
+    Uring ring;
+    EventLoop base;
+    struct __kernel_timespec tick; // 유휴 연결 정리 주기 (IORING_OP_TIMEOUT)
+    int draining;                  // 드레인 시작함 (accept 취소를 제출함)
+} UringLoop;
 
-/* * ======================================================================================
- * [공유 자원: 작업 대기열 (Circular Queue)]
- * 메인 스레드(생산자)가 클라이언트 소켓(fd)을 넣고, 워커 스레드(소비자)가 꺼내가는 공간입니다.
- * 모든 스레드가 공유하므로 반드시 동기화가 필요합니다.
- * ======================================================================================
+/* [함수: 링 만들기] io_uring_setup -> SQ/CQ/SQE 배열 mmap -> 수신 버퍼 링 등록 */
+static int uring_init(Uring* r) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    // DEFER_TASKRUN: 완료 처리를 우리가 io_uring_enter로 기다릴 때로 미뤄서 인터럽트/IPI를 줄임 (6.1+)
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    r->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (r->fd < 0 && errno == EINVAL) {
+        memset(&p, 0, sizeof(p));
+        r->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    }
+    if (r->fd < 0) return -1;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) { // SQ와 CQ를 한 번에 mmap (5.4+)
+        errno = ENOSYS;
+        return -1;
+    }
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    size_t ring_size = sq_size > cq_size ? sq_size : cq_size;
+    char* ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+                      IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) return -1;
+    r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) return -1;
+
+    r->sq_head = (unsigned*)(ring + p.sq_off.head);
+    r->sq_tail = (unsigned*)(ring + p.sq_off.tail);
+    r->sq_mask = (unsigned*)(ring + p.sq_off.ring_mask);
+    r->sq_entries = p.sq_entries;
+    r->sqe_tail = *r->sq_tail;
+    r->cq_head = (unsigned*)(ring + p.cq_off.head);
+    r->cq_tail = (unsigned*)(ring + p.cq_off.tail);
+    r->cq_mask = (unsigned*)(ring + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(ring + p.cq_off.cqes);
+    // SQ 인덱스 배열은 SQE 배열과 1:1로 고정 (SQE를 순서대로 채우므로 다시 건드릴 필요 없음)
+    unsigned* array = (unsigned*)(ring + p.sq_off.array);
+    for (unsigned i = 0; i < p.sq_entries; i++) array[i] = i;
+
+    // 수신 버퍼 링 등록 (5.19+). 링 자체는 페이지 정렬된 메모리여야 함
+    r->buf_ring = mmap(NULL, URING_BUF_COUNT * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    r->bufs = malloc((size_t)URING_BUF_COUNT * BUF_SIZE);
+    if (r->buf_ring == MAP_FAILED || !r->bufs) return -1;
+    struct io_uring_buf_reg reg = { .ring_addr = (unsigned long)r->buf_ring,
+                                    .ring_entries = URING_BUF_COUNT,
+                                    .bgid = URING_BUF_GROUP };
+    if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return -1;
+    r->buf_tail = 0;
+    for (int i = 0; i < URING_BUF_COUNT; i++) {
+        struct io_uring_buf* b = &r->buf_ring->bufs[r->buf_tail & (URING_BUF_COUNT - 1)];
+        b->addr = (unsigned long)(r->bufs + (size_t)i * BUF_SIZE);
+        b->len = BUF_SIZE;
+        b->bid = i;
+        r->buf_tail++;
+    }
+    __atomic_store_n(&r->buf_ring->tail, r->buf_tail, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* [함수: 다 쓴 수신 버퍼를 풀에 돌려주기] tail을 공개하는 순간 커널이 다시 쓸 수 있음 */
+static void uring_buf_recycle(Uring* r, int bid) {
+    struct io_uring_buf* b = &r->buf_ring->bufs[r->buf_tail & (URING_BUF_COUNT - 1)];
+    b->addr = (unsigned long)(r->bufs + (size_t)bid * BUF_SIZE);
+    b->len = BUF_SIZE;
+    b->bid = bid;
+    r->buf_tail++;
+    __atomic_store_n(&r->buf_ring->tail, r->buf_tail, __ATOMIC_RELEASE);
+}
+
+/* * [함수: 제출 (+ 완료 대기)]
+ * 채워 둔 SQE를 sq_tail로 공개하고 io_uring_enter 한 번으로 제출합니다.
+ * wait > 0이면 완료가 그만큼 쌓일 때까지 같은 시스템 콜 안에서 잠듦 (제출과 대기가 시스템 콜 1번)
  */
-int queue[MAX_QUEUE]; // 소켓 파일 디스크립터(int)를 저장하는 배열
-int front = 0;        // 데이터를 꺼낼 위치 (Head)
-int rear = 0;         // 데이터를 넣을 위치 (Tail)
-int count = 0;        // 현재 대기열에 있는 요청 개수
+static int uring_submit(Uring* r, unsigned wait) {
+    __atomic_store_n(r->sq_tail, r->sqe_tail, __ATOMIC_RELEASE);
+    unsigned pending = r->sqe_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    if (pending == 0 && wait == 0) return 0;
+    return syscall(__NR_io_uring_enter, r->fd, pending, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
 
-/* * [동기화 객체 (Synchronization Primitives)]
- * - mutex: 대기열(queue)에 접근할 때 한 번에 한 놈만 건드리게 하는 자물쇠.
- * - cond_nonempty: "큐가 비어있지 않다(일감이 있다)"라고 워커들을 깨우는 신호.
- * - cond_nonfull: "큐가 꽉 차지 않았다(공간 있다)"라고 메인 스레드를 깨우는 신호.
+/* * [함수: SQE n개 자리 확보]
+ * 링크 체인은 한 번의 제출 안에 통째로 들어가야 하므로(중간에 잘리면 링크가 끊김)
+ * 체인을 채우기 전에 자리가 모자라면 지금까지 채운 것을 먼저 제출해서 비움
  */
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t cond_nonempty = PTHREAD_COND_INITIALIZER;
-pthread_cond_t cond_nonfull = PTHREAD_COND_INITIALIZER;
+static void uring_reserve(Uring* r, unsigned n) {
+    if (r->sqe_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) + n > r->sq_entries)
+        uring_submit(r, 0);
+}
 
-/* * ======================================================================================
- * [함수: HTTP 요청 처리 (Business Logic)]
- * 워커 스레드가 실제로 수행하는 일입니다.
- * 1. 요청 읽기 -> 2. 파싱 -> 3. 파일 찾기 -> 4. 응답 보내기
- * ======================================================================================
+static struct io_uring_sqe* uring_sqe(Uring* r, int op, UringConn* uc) {
+    struct io_uring_sqe* sqe = &r->sqes[r->sqe_tail & *r->sq_mask];
+    r->sqe_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = (unsigned long)uc | op;
+    if (uc) uc->inflight++;
+    return sqe;
+}
+
+static void uring_prep_send(struct io_uring_sqe* sqe, int fd, const void* buf, size_t len, int flags) {
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)buf;
+    sqe->len = len;
+    // MSG_WAITALL: 부분 전송이면 커널이 알아서 이어 보내고, 그래도 모자라면 체인의 뒤 단계를 취소함
+    // (없으면 짧게 끝난 send 뒤로 본문이 먼저 나가서 바이트 순서가 깨질 수 있음)
+    sqe->msg_flags = flags | MSG_WAITALL;
+}
+
+static void uring_prep_splice(struct io_uring_sqe* sqe, int fd_in, long long off_in, int fd_out, size_t len,
+                              unsigned flags) {
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->splice_fd_in = fd_in;
+    sqe->splice_off_in = off_in; // -1이면 파일의 현재 위치 (파이프/FIFO)
+    sqe->fd = fd_out;
+    sqe->off = -1;
+    sqe->len = len;
+    sqe->splice_flags = flags | SPLICE_F_MOVE;
+}
+
+/* [함수: multishot accept 걸기] 한 번 걸면 IORING_CQE_F_MORE가 빠질 때까지 계속 살아 있음 */
+static void uring_arm_accept(UringLoop* l) {
+    uring_reserve(&l->ring, 1);
+    struct io_uring_sqe* sqe = uring_sqe(&l->ring, UOP_ACCEPT, NULL);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = l->base.server_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC; // 블로킹 소켓 그대로 둠 (io-wq에서 도는 splice가 EAGAIN 없이 끝까지 쓰도록)
+}
+
+static void uring_arm_timeout(UringLoop* l) {
+    uring_reserve(&l->ring, 1);
+    struct io_uring_sqe* sqe = uring_sqe(&l->ring, UOP_TIMEOUT, NULL);
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (unsigned long)&l->tick;
+    sqe->len = 1;
+}
+
+/* * [함수: 본문 다음 단계 제출]
+ * 파이프에 남은 게 있으면 그것부터 소켓으로, 아니면 (multipart면 구간 헤더 ->) 파일 -> 파이프 -> 소켓.
+ * link가 1이면 바로 앞에 넣은 SQE(응답 헤더)에 이어 붙는 체인의 일부로 들어감
  */
-void handle_request(int client_fd) {
-    char buffer[BUF_SIZE];
-    
-    // 1. 소켓에서 데이터 읽기 (브라우저가 보낸 요청)
-    int bytes = read(client_fd, buffer, BUF_SIZE - 1);
-    if (bytes <= 0) {
-        close(client_fd); // 읽기 실패하거나 연결 끊김
+static void uring_queue_body(UringLoop* l, UringConn* uc) {
+    Connection* c = &uc->c;
+    Response* res = &c->res;
+    struct io_uring_sqe* sqe;
+    uring_reserve(&l->ring, 3);
+
+    if (c->pipe_pending > 0) { // 앞 체인이 중간에 끊겨서 파이프에 남은 데이터
+        int more = res->body_remain > 0 || res->nranges > 1;
+        sqe = uring_sqe(&l->ring, UOP_SPLICE_OUT, uc);
+        uring_prep_splice(sqe, c->pipe_fds[0], -1, c->fd, c->pipe_pending, more ? SPLICE_F_MORE : 0);
         return;
     }
-    buffer[bytes] = '\0'; // 문자열 끝 처리
+    if (res->nranges > 1) {
+        multipart_next(res);
+        if (res->part_hdr_sent < res->part_hdr_len) {
+            int more = res->part <= res->nranges;
+            sqe = uring_sqe(&l->ring, UOP_SEND_PART, uc);
+            uring_prep_send(sqe, c->fd, res->part_hdr + res->part_hdr_sent,
+                            res->part_hdr_len - res->part_hdr_sent, more ? MSG_MORE : 0);
+            if (res->body_remain <= 0) return; // 끝 구분자
+            sqe->flags |= IOSQE_IO_LINK;
+        }
+    }
 
-    // 2. HTTP 요청 라인 파싱 (예: "GET /index.html HTTP/1.1")
-    char method[8], path[256];
-    // sscanf로 첫 번째 단어(Method)와 두 번째 단어(Path)만 추출
-    sscanf(buffer, "%s %s", method, path);
+    size_t chunk = res->body_remain < uc->pipe_size ? res->body_remain : uc->pipe_size;
+    int more = res->nranges > 1 || (off_t)chunk < res->body_remain;
+    sqe = uring_sqe(&l->ring, UOP_SPLICE_IN, uc);
+    uring_prep_splice(sqe, res->file_fd, res->file_regular ? res->body_offset : -1, c->pipe_fds[1], chunk, 0);
+    sqe->flags |= IOSQE_IO_LINK;
+    sqe = uring_sqe(&l->ring, UOP_SPLICE_OUT, uc);
+    uring_prep_splice(sqe, c->pipe_fds[0], -1, c->fd, chunk, more ? SPLICE_F_MORE : 0);
+}
 
-    // 3. 메소드 검사 (GET 방식만 지원)
-    if (strcmp(method, "GET") != 0) {
-        const char* error = "HTTP/1.1 405 Method Not Allowed\r\n\r\n";
-        write(client_fd, error, strlen(error));
-        close(client_fd);
-        return;
+/* [함수: 본문을 다 보냈는지] 파이프까지 비어야 끝 */
+static int uring_body_done(const UringConn* uc) {
+    const Response* res = &uc->c.res;
+    if (uc->c.pipe_pending > 0 || res->body_remain > 0) return 0;
+    return res->nranges <= 1 || (res->part > res->nranges && res->part_hdr_sent == res->part_hdr_len);
+}
+
+/* [함수: 연결 해제] 커널에 걸린 SQE가 하나도 없을 때만 부름 */
+static void uring_conn_free(UringLoop* l, UringConn* uc) {
+    Connection* c = &uc->c;
+    idle_unlink(&l->base, c);
+    if (c->res.file_fd >= 0) close(c->res.file_fd);
+    if (c->res.cached) cache_release(c->res.cached);
+    if (c->pipe_fds[0] >= 0) {
+        close(c->pipe_fds[0]);
+        close(c->pipe_fds[1]);
     }
+    request_body_free(&c->body);
+    close(c->fd);
+    STAT_ADD(closed, 1);
+    ip_release(c->ip_slot);
+    slab_free(&l->base.conns, uc);
+}
 
-    // 4. 루트 경로("/") 처리 -> index.html로 매핑
-    if (strcmp(path, "/") == 0)
-        strcpy(path, "/index.html");
+/* * [함수: 상태 머신 진행]
+ * 이 연결의 SQE가 모두 완료됐을 때 불려서, 다음에 할 일을 SQE로 제출합니다. (epoll 모드의 conn_drive에 해당)
+ * 요청 해석 -> 응답 헤더(+본문 첫 조각) 체인 제출 -> 완료 -> 남은 본문 제출 -> ... -> 다음 요청 읽기
+ */
+static void uring_advance(UringLoop* l, UringConn* uc) {
+    Connection* c = &uc->c;
+    struct io_uring_sqe* sqe;
+    if (uc->closing) {
+        uring_conn_free(l, uc);
+        return;
+    }
+    for (;;) {
+        switch (c->state) {
+        case CONN_READ_REQUEST: {
+            int req_len = request_parse(&c->parser, &c->body, c->req, &c->req_len, c->fd);
+            if (req_len == HTTP_PARSE_INCOMPLETE && c->req_len < sizeof(c->req)) {
+                // 버퍼는 데이터가 도착하는 순간 커널이 풀에서 고름. len으로 남은 공간만큼만 받게 제한
+                uring_reserve(&l->ring, 1);
+                sqe = uring_sqe(&l->ring, UOP_RECV, uc);
+                sqe->opcode = IORING_OP_RECV;
+                sqe->fd = c->fd;
+                sqe->len = sizeof(c->req) - c->req_len;
+                sqe->flags = IOSQE_BUFFER_SELECT;
+                sqe->buf_group = URING_BUF_GROUP;
+                return;
+            }
 
-    // 5. 파일 경로 조합 (./www + /index.html)
-    char full_path[512];
-    // snprintf는 버퍼 오버플로우를 방지하는 안전한 함수입니다.
-    snprintf(full_path, sizeof(full_path), "./www%s", path);
+            c->req_start_ns = monotonic_ns();
+            c->res.req = req_len >= 0 ? &c->parser : NULL;
+            if (req_len == HTTP_PARSE_INCOMPLETE) {
+                set_simple_response(&c->res, "431 Request Header Fields Too Large", "", 0);
+                req_len = c->req_len;
+            } else if (req_len == HTTP_PARSE_ERROR) {
+                set_simple_response(&c->res, "400 Bad Request", "", 0);
+                req_len = c->req_len;
+            } else if (req_len == REQ_BODY_TOO_LARGE) {
+                set_simple_response(&c->res, "413 Content Too Large", "", 0);
+                req_len = c->req_len;
+            } else {
+                prepare_response(&c->parser, &c->body, -1, &c->res);
+            }
+            request_body_free(&c->body);
+            c->cur_req_len = req_len;
+            c->header_sent = 0;
+            c->state = c->res.cached ? CONN_SEND_CACHED : CONN_SEND_HEADER;
 
-    // * [보안 중요!] Directory Traversal 공격 방지 로직 *
-    // 해커가 "GET /../../etc/passwd" 같은 요청을 보낼 수 있음.
-    // realpath 함수는 상대 경로(..)를 모두 해석해서 절대 경로로 변환해줌.
-    char resolved_path[PATH_MAX];
-    char www_root[PATH_MAX];
-    
-    realpath("./www", www_root); // 웹 루트의 절대 경로 구하기
-
-    // 요청한 파일의 절대 경로를 구하고, 그게 웹 루트(www_root)로 시작하는지 검사
-    if (realpath(full_path, resolved_path) != NULL) {
-        if (strncmp(resolved_path, www_root, strlen(www_root)) != 0) {
-            // 웹 루트 밖의 파일(예: 시스템 파일)을 요청했다면 403 Forbidden
-            const char* forbidden = "HTTP/1.1 403 Forbidden\r\n\r\n<h1>403 Forbidden</h1>\n";
-            write(client_fd, forbidden, strlen(forbidden));
-            close(client_fd);
+            if (c->res.file_fd >= 0) {
+                if (!c->res.file_regular) c->res.body_remain = (off_t)1 << 62; // 길이 모름 -> EOF까지
+                if (c->pipe_fds[0] < 0) {
+                    if (pipe2(c->pipe_fds, O_CLOEXEC) < 0) {
+                        uring_conn_free(l, uc);
+                        return;
+                    }
+                    fcntl(c->pipe_fds[1], F_SETPIPE_SZ, URING_PIPE_SIZE); // 실패하면 기본 크기(64KB) 그대로
+                    uc->pipe_size = fcntl(c->pipe_fds[1], F_GETPIPE_SZ);
+                }
+            }
+            break;
+        }
+        case CONN_SEND_HEADER:
+            if (c->header_sent == c->res.header_len) {
+                if (c->res.file_fd < 0) { // 본문 없는 응답
+                    if (conn_finish_response(c) < 0) {
+                        uring_conn_free(l, uc);
+                        return;
+                    }
+                    break;
+                }
+                c->state = CONN_SEND_BODY;
+                break;
+            }
+            // 헤더와 본문 첫 조각을 한 체인으로 제출 (파일이 파이프 크기 이하면 응답 전체가 제출 한 번)
+            uring_reserve(&l->ring, 4);
+            sqe = uring_sqe(&l->ring, UOP_SEND, uc);
+            uring_prep_send(sqe, c->fd, c->res.header + c->header_sent, c->res.header_len - c->header_sent,
+                            c->res.file_fd >= 0 ? MSG_MORE : 0);
+            if (c->res.file_fd >= 0) {
+                sqe->flags |= IOSQE_IO_LINK;
+                uring_queue_body(l, uc);
+            }
+            return;
+        case CONN_SEND_BODY:
+            if (uring_body_done(uc)) {
+                if (conn_finish_response(c) < 0) {
+                    uring_conn_free(l, uc);
+                    return;
+                }
+                break;
+            }
+            uring_queue_body(l, uc);
             return;
+        case CONN_SEND_CACHED: {
+            int cnt = cached_iov(&c->res, uc->iov);
+            if (cnt == 0) {
+                if (conn_finish_response(c) < 0) {
+                    uring_conn_free(l, uc);
+                    return;
+                }
+                break;
+            }
+            memset(&uc->msg, 0, sizeof(uc->msg));
+            uc->msg.msg_iov = uc->iov;
+            uc->msg.msg_iovlen = cnt;
+            uring_reserve(&l->ring, 1);
+            sqe = uring_sqe(&l->ring, UOP_SEND_CACHED, uc);
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = c->fd;
+            sqe->addr = (unsigned long)&uc->msg;
+            sqe->len = 1;
+            sqe->msg_flags = MSG_WAITALL;
+            return;
+        }
         }
     }
+}
 
-    // 6. 파일 열기
-    int file_fd = open(full_path, O_RDONLY);
-    if (file_fd < 0) {
-        // 파일이 없으면 404 Not Found 전송
-        const char* not_found = "HTTP/1.1 404 Not Found\r\n\r\n<h1>404 Not Found</h1>\n";
-        write(client_fd, not_found, strlen(not_found));
-        close(client_fd);
+/* * [함수: 완료 하나 처리]
+ * 결과(res)만큼 진행 위치를 옮겨 두고, 이 연결의 SQE가 전부 돌아왔으면 다음 단계를 제출합니다.
+ * 링크 체인에서 앞 단계가 실패/부분 완료되면 뒤 단계는 -ECANCELED로 오는데, 이건 에러가 아니라
+ * "여기서부터 다시 제출하라"는 뜻이므로 연결을 닫지 않음
+ */
+static void uring_complete(UringLoop* l, struct io_uring_cqe* cqe) {
+    UringConn* uc = (UringConn*)(unsigned long)(cqe->user_data & ~(unsigned long long)UOP_MASK);
+    int op = cqe->user_data & UOP_MASK;
+    int res = cqe->res;
+
+    if (op == UOP_ACCEPT) {
+        if (uc) return; // 드레인 때 낸 accept 취소 요청 자체의 완료 (포인터 자리에 루프를 담아 구분)
+        if (res >= 0) {
+            STAT_ADD(connections, 1);
+            STAT_ADD(accepted, 1);
+            int ip_slot = ip_admit_fd(res); // multishot accept는 주소를 안 돌려주므로 한도가 켜져 있을 때만 물어봄
+            UringConn* n = ip_slot == IP_REJECT ? NULL : slab_alloc(&l->base.conns);
+            if (ip_slot == IP_REJECT) {
+                send_overload_response(res, 429);
+                STAT_ADD(ip_limited, 1);
+                STAT_ADD(closed, 1);
+            } else if (!n) {
+                close(res);
+                STAT_ADD(closed, 1);
+                ip_release(ip_slot);
+            } else {
+                n->c.fd = res;
+                n->c.ip_slot = ip_slot;
+                n->c.state = CONN_READ_REQUEST;
+                http_parser_init(&n->c.parser);
+                memset(&n->c.body, 0, sizeof(n->c.body));
+                n->c.res.file_fd = -1;
+                n->c.pipe_fds[0] = n->c.pipe_fds[1] = -1;
+                idle_touch(&l->base, &n->c);
+                uring_advance(l, n);
+            }
+        } else if (res != -EINTR && res != -ECONNABORTED && res != -ECANCELED) { // ECANCELED: 드레인
+            fprintf(stderr, "accept: %s\n", strerror(-res));
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) { // multishot이 멈춤
+            if (l->draining)
+                __atomic_sub_fetch(&accepting_threads, 1, __ATOMIC_RELEASE); // 취소됨 -> 이 루프는 accept 끝
+            else
+                uring_arm_accept(l); // 다시 걸기
+        }
+        return;
+    }
+    if (op == UOP_TIMEOUT) {
+        // 유휴 연결 정리: 걸려 있는 recv/send를 shutdown으로 깨워서 완료 경로로 닫히게 함
+        time_t now = monotonic_sec();
+        while (l->base.head && now - l->base.head->last_active >= KEEPALIVE_TIMEOUT) {
+            UringConn* idle = (UringConn*)l->base.head;
+            idle_unlink(&l->base, &idle->c);
+            idle->closing = 1;
+            shutdown(idle->c.fd, SHUT_RDWR);
+        }
+        if (__atomic_load_n(&server_draining, __ATOMIC_ACQUIRE)) {
+            if (!l->draining) {
+                // multishot accept 취소. 마지막 accept 완료(F_MORE 없음, -ECANCELED)가 오면 accept 끝으로 셈
+                l->draining = 1;
+                uring_reserve(&l->ring, 1);
+                struct io_uring_sqe* sqe = uring_sqe(&l->ring, UOP_ACCEPT, NULL);
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->addr = UOP_ACCEPT; // 취소할 SQE의 user_data (uring_arm_accept 참고)
+                sqe->user_data = (unsigned long)l | UOP_ACCEPT;
+            }
+            // 다음 요청을 기다리기만 하는 Keep-Alive 연결은 바로 닫음 (epoll 모드의 close_quiet_connections)
+            for (Connection* c = l->base.head, *next; c; c = next) {
+                next = c->next;
+                if (c->state != CONN_READ_REQUEST || c->req_len > 0) continue;
+                idle_unlink(&l->base, c);
+                ((UringConn*)c)->closing = 1;
+                shutdown(c->fd, SHUT_RDWR);
+            }
+        }
+        uring_arm_timeout(l);
         return;
     }
 
-    // 7. 정상 응답 헤더 전송 (200 OK)
-    const char* header = "HTTP/1.1 200 OK\r\n\r\n";
-    write(client_fd, header, strlen(header));
+    Connection* c = &uc->c;
+    Response* r = &c->res;
+    uc->inflight--;
+    if (res < 0 && res != -ECANCELED && !(op == UOP_RECV && res == -ENOBUFS)) uc->closing = 1;
+    if (res > 0) {
+        switch (op) {
+        case UOP_RECV: {
+            // 풀에서 빌려 쓴 버퍼 내용을 연결 버퍼로 옮기고 바로 돌려줌
+            int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            memcpy(c->req + c->req_len, l->ring.bufs + (size_t)bid * BUF_SIZE, res);
+            c->req_len += res;
+            break;
+        }
+        case UOP_SEND: c->header_sent += res; break;
+        case UOP_SEND_PART: r->part_hdr_sent += res; break;
+        case UOP_SEND_CACHED: r->cached_sent += res; break;
+        case UOP_SPLICE_IN:
+            c->pipe_pending += res;
+            r->body_offset += res;
+            r->body_remain -= res;
+            break;
+        case UOP_SPLICE_OUT: c->pipe_pending -= res; break;
+        }
+    } else if (res == 0 && op == UOP_RECV) {
+        uc->closing = 1; // 클라이언트가 연결을 끊음
+    } else if (res == 0 && op == UOP_SPLICE_IN) {
+        r->body_remain = 0; // 파일 끝 (FIFO의 EOF 또는 전송 도중 파일이 잘림)
+    }
+    if (cqe->flags & IORING_CQE_F_BUFFER) uring_buf_recycle(&l->ring, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+
+    if (uc->inflight > 0) return; // 체인의 나머지 완료를 기다림
+    if (!uc->closing) idle_touch(&l->base, c);
+    uring_advance(l, uc);
+}
+
+/* * [함수: io_uring 워커]
+ * 루프마다 링 하나. "제출 + 완료 대기"가 io_uring_enter 한 번이고, 완료 처리 중에 생긴 SQE는
+ * 다음 바퀴의 io_uring_enter에 함께 실려 나갑니다.
+ */
+void* uring_loop_thread(void* arg) {
+    AcceptorArg* a = arg;
+    UringLoop* l = calloc(1, sizeof(UringLoop));
+    pin_to_cpu(a->cpu);
+    stats_register("uring");
+    slab_init(&l->base.conns, sizeof(UringConn));
+    l->base.epfd = -1;
+    l->base.server_fd = a->server_fd;
+    l->tick.tv_sec = 1;
 
-    // 8. 파일 내용 전송 (반복문으로 끝까지 읽어서 씀)
-    char file_buf[BUF_SIZE];
-    int n;
-    while ((n = read(file_fd, file_buf, BUF_SIZE)) > 0) {
-        write(client_fd, file_buf, n);
+    // SINGLE_ISSUER 링은 만든 스레드에서만 제출할 수 있으므로 루프 스레드 안에서 만듦
+    if (uring_init(&l->ring) < 0) {
+        perror("io_uring (kernel 5.19+ required)");
+        exit(1);
     }
+    uring_arm_accept(l);
+    uring_arm_timeout(l);
 
-    // 9. 리소스 정리 (파일 닫기, 소켓 닫기)
-    close(file_fd);
-    close(client_fd);
+    while (1) {
+        if (uring_submit(&l->ring, 1) < 0 && errno != EINTR && errno != EBUSY) {
+            perror("io_uring_enter");
+            break;
+        }
+        long long t0 = monotonic_ns();
+        unsigned head = *l->ring.cq_head;
+        unsigned tail = __atomic_load_n(l->ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            uring_complete(l, &l->ring.cqes[head & *l->ring.cq_mask]);
+            // 처리하는 동안 CQ 자리를 바로바로 돌려줌 (uring_reserve의 제출이 CQ 넘침을 만들지 않도록)
+            __atomic_store_n(l->ring.cq_head, head + 1, __ATOMIC_RELEASE);
+        }
+        STAT_ADD(busy_ns, monotonic_ns() - t0);
+    }
+    return NULL;
 }
 
 /* * ======================================================================================
- * [함수: 생산자 (Producer)]
- * 메인 스레드가 accept()로 받은 클라이언트 소켓을 큐에 넣습니다.
+ * [코루틴 모드 (coro)]
+ * 스레드 풀 모드의 handle_request는 "읽고 -> 해석하고 -> 보낸다"가 위에서 아래로 읽히는 평범한 코드지만,
+ * 느린 클라이언트 하나가 워커 스레드 하나를 통째로 붙잡습니다. (10만 연결 = 스레드 10만 개)
+ * epoll 모드는 스레드 몇 개로 연결 수만 개를 다루지만, 같은 일을 상태 머신(conn_drive)으로 쪼개 써야 합니다.
+ *
+ * 코루틴 모드는 둘을 합칩니다. 연결마다 자기 스택을 가진 코루틴(stackful coroutine)을 하나 만들고
+ * 그 안에서 handle_request를 그대로 돌립니다.
+ * - 소켓은 논블로킹. read/send가 EAGAIN이면 io_retry가 epoll에 관심을 걸어 두고 스케줄러로 전환(양보)
+ *   -> 스레드는 준비된 다른 코루틴을 돌리고, 소켓이 준비되면 멈췄던 자리(함수 한가운데)에서 이어서 감
+ * - 스케줄러 = 루프 스레드 하나(-w개)마다 epoll 하나 + 실행 대기열. 코루틴은 만든 스레드에서만 돌므로
+ *   스레드별 통계(my_stats)나 접근 로그 링도 락 없이 그대로 씀
+ * - 기다리는 코루틴은 "기다리기 시작한 순서" 목록에 매달림. 제한 시간이 모두 KEEPALIVE_TIMEOUT으로 같아서
+ *   이 순서가 곧 마감 순서 -> 시간 초과 검사는 목록 앞에서 안 끝난 것을 만날 때까지만 봄
+ *   (epoll 모드와 같이 읽기든 쓰기든 그 시간 동안 진척이 없으면 닫음)
+ * - 드레인: 다음 요청을 기다리기만 하는 코루틴(받은 바이트 없음)은 바로 깨워서 닫게 함
+ *
+ * [문맥 전환] x86-64에서는 callee-saved 레지스터 6개 + MXCSR/x87 제어 워드만 스택에 쌓고 rsp를 바꾸는
+ * 손으로 쓴 어셈블리 몇 줄 (함수 호출 한 번 정도의 비용). 다른 아키텍처나 -DCORO_UCONTEXT면
+ * swapcontext를 쓰는데, 이건 전환마다 신호 마스크를 저장/복원하느라 시스템 콜(rt_sigprocmask)이 들어감
+ *
+ * [스택] 코루틴마다 CORO_STACK_SIZE. 2MB 덩어리를 mmap(MAP_NORESERVE)해서 나눠 쓰므로 실제로 드는
+ * 메모리는 코루틴이 건드린 페이지뿐. 요청 사이에 쉬는 연결은 대개 몇 페이지만 씀
+ * - 가드 페이지(PROT_NONE)를 스택마다 두면 VMA가 스택마다 하나씩 생겨 vm.max_map_count(기본 65530)에
+ *   연결 3만 개쯤에서 막힘. 그래서 가드 대신 스택 맨 밑에 카나리 값을 두고, 양보할 때마다 확인해서
+ *   넘쳤으면 바로 abort (조용히 옆 메모리를 망가뜨리고 계속 도는 것보다 나음)
+ * - Coro 구조체는 스택 영역의 맨 밑에 함께 둠 (넘치면 남의 것이 아니라 자기 것부터 밟음)
+ * - 끝난 코루틴의 영역은 루프의 free list로 가서 다음 연결이 다시 씀 (OS에 돌려주지 않음)
+ *
+ * 주의: 플러그인 handle이나 큰 파일 압축처럼 CPU를 오래 쓰는 일은 양보 없이 끝까지 도므로,
+ *       그동안 같은 루프의 다른 연결은 기다림 (epoll 모드와 같은 제약)
  * ======================================================================================
  */
-void enqueue(int client_fd) {
-    pthread_mutex_lock(&mutex); // 자물쇠 잠금 (임계 영역 시작)
+#define CORO_STACK_SIZE (64 * 1024)              // 코루틴 하나의 영역 (Coro 구조체 + 스택)
+#define CORO_CHUNK (2 * 1024 * 1024)             // 한 번에 mmap하는 크기 (영역 32개)
+#define CORO_CANARY 0x6c61623863616e61ULL        // 스택 맨 밑 표시 ("lab8cana")
+
+#if defined(__x86_64__) && !defined(CORO_UCONTEXT)
+#define CORO_ASM 1
+#else
+#include <ucontext.h>
+#endif
+
+typedef struct Coro {
+#ifdef CORO_ASM
+    void* sp;                 // 멈춰 있는 동안의 스택 포인터 (레지스터는 그 스택 위에 쌓여 있음)
+#else
+    ucontext_t ctx;
+#endif
+    struct CoroLoop* loop;
+    int fd;                   // 맡은 클라이언트 소켓 (-1이면 빈 영역)
+    int ip_slot;
+    int waiting;              // 소켓 이벤트를 기다리는 중
+    int idle;                 // 다음 요청을 기다리는 중 (받은 바이트 없음, 드레인 때 바로 닫아도 됨)
+    int timed_out;            // 기다리다 시간 초과 / 드레인으로 깨워짐
+    int done;                 // handle_request가 끝남 -> 스케줄러가 영역을 회수
+    long long deadline;       // 기다리기를 포기할 시각 (monotonic_ns)
+    struct Coro* prev;        // 대기 목록 (기다리기 시작한 순서 = 마감 순서)
+    struct Coro* next;        // 대기 목록 / 실행 대기열 / free list 공용
+    unsigned long long canary; // 스택의 맨 밑 바로 아래 (스택이 여기까지 내려와 덮으면 넘친 것)
+} Coro;
+
+typedef struct CoroLoop {
+    int epfd;
+    int server_fd;
+#ifdef CORO_ASM
+    void* sched_sp;           // 스케줄러(루프 스레드 원래 스택)로 돌아갈 자리
+#else
+    ucontext_t sched_ctx;
+#endif
+    Coro* run_head;           // 실행할 코루틴 (FIFO)
+    Coro* run_tail;
+    Coro* wait_head;          // 기다리는 코루틴 (앞쪽이 마감이 빠름)
+    Coro* wait_tail;
+    Coro* free_list;          // 다 끝난 영역
+    char* cur;                // 지금 덩어리에서 아직 안 나눠 준 부분
+    char* end;
+    int stopped;              // 드레인으로 accept를 멈춤
+} CoroLoop;
+
+static __thread Coro* coro_current; // 이 스레드에서 지금 돌고 있는 코루틴 (NULL = 코루틴 밖)
+
+#ifdef CORO_ASM
+/* * [함수: 문맥 전환] lab8_coro_switch(&저장할_sp, 갈_sp)
+ * System V ABI에서 함수가 보존해야 하는 것(rbx, rbp, r12~r15, MXCSR, x87 제어 워드)만 지금 스택에 쌓고
+ * rsp를 저장한 뒤, 상대 스택으로 옮겨 같은 순서로 꺼내고 ret. 나머지 레지스터는 호출한 쪽이 이미 버린 것으로 봄
+ */
+void lab8_coro_switch(void** save_sp, void* next_sp);
+__asm__(".text\n"
+        ".globl lab8_coro_switch\n"
+        ".hidden lab8_coro_switch\n"
+        ".type lab8_coro_switch, @function\n"
+        "lab8_coro_switch:\n"
+        "    pushq %rbp\n"
+        "    pushq %rbx\n"
+        "    pushq %r12\n"
+        "    pushq %r13\n"
+        "    pushq %r14\n"
+        "    pushq %r15\n"
+        "    subq $8, %rsp\n"
+        "    stmxcsr (%rsp)\n"
+        "    fnstcw 4(%rsp)\n"
+        "    movq %rsp, (%rdi)\n"
+        "    movq %rsi, %rsp\n"
+        "    ldmxcsr (%rsp)\n"
+        "    fldcw 4(%rsp)\n"
+        "    addq $8, %rsp\n"
+        "    popq %r15\n"
+        "    popq %r14\n"
+        "    popq %r13\n"
+        "    popq %r12\n"
+        "    popq %rbx\n"
+        "    popq %rbp\n"
+        "    ret\n"
+        ".size lab8_coro_switch, .-lab8_coro_switch\n");
+#endif
+
+/* [함수: 코루틴 -> 스케줄러] 돌아올 때는 스케줄러가 다시 이 코루틴을 고른 것 */
+static void coro_yield(Coro* c) {
+    if (c->canary != CORO_CANARY) {
+        fprintf(stderr, "coroutine stack overflow (fd %d), raise CORO_STACK_SIZE\n", c->fd);
+        abort();
+    }
+#ifdef CORO_ASM
+    lab8_coro_switch(&c->sp, c->loop->sched_sp);
+#else
+    swapcontext(&c->ctx, &c->loop->sched_ctx);
+#endif
+}
+
+/* [함수: 코루틴 본체] 연결 하나를 끝까지 처리하고 스케줄러로 돌아감 (다시 불리지 않음) */
+static void coro_main(void) {
+    Coro* c = coro_current;
+    handle_request(c->fd); // 소켓도 여기서 닫힘 (epoll 등록도 함께 빠짐)
+    STAT_ADD(closed, 1);
+    ip_release(c->ip_slot);
+    c->done = 1;
+    coro_yield(c);
+    abort(); // 끝난 코루틴으로는 돌아오지 않음
+}
 
-    // 큐가 꽉 찼다면? 빈 자리가 생길 때까지 대기(Wait)
-    // cond_nonfull 신호가 올 때까지 mutex를 풀고 잠듦 -> 신호 오면 깨서 다시 mutex 잡음
-    while (count == MAX_QUEUE) {
-        pthread_cond_wait(&cond_nonfull, &mutex);
+/* [함수: 영역 하나 받기] free list에 있으면 그것을, 없으면 덩어리에서 잘라 씀. 메모리가 없으면 NULL */
+static Coro* coro_alloc(CoroLoop* l) {
+    Coro* c = l->free_list;
+    if (c) {
+        l->free_list = c->next;
+    } else {
+        if (!l->cur || l->cur + CORO_STACK_SIZE > l->end) {
+            // 스택은 건드린 페이지만 쓰도록 huge page는 끔 (2MB 단위로 채워지면 연결마다 메모리가 크게 늚)
+            char* p = mmap(NULL, CORO_CHUNK, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (p == MAP_FAILED) return NULL;
+            madvise(p, CORO_CHUNK, MADV_NOHUGEPAGE);
+            l->cur = p;
+            l->end = p + CORO_CHUNK;
+        }
+        c = (Coro*)l->cur;
+        l->cur += CORO_STACK_SIZE;
+    }
+    memset(c, 0, sizeof(Coro));
+    c->loop = l;
+    c->canary = CORO_CANARY;
+    return c;
+}
+
+/* [함수: 새 코루틴 준비] 처음 전환하면 coro_main의 첫 줄부터 돌도록 스택을 꾸밈 */
+static void coro_prepare(Coro* c) {
+    char* top = (char*)c + CORO_STACK_SIZE;
+#ifdef CORO_ASM
+    // lab8_coro_switch가 꺼내 갈 모양 그대로: [제어 워드][r15..rbp 6개][ret 주소 = coro_main][가짜 복귀 주소]
+    // ret 뒤 rsp가 16바이트 경계 - 8 이 되어야 보통 call로 들어온 함수와 같은 정렬 (top은 64KB 경계)
+    unsigned long long* sp = (unsigned long long*)top;
+    *--sp = 0;                                 // coro_main의 복귀 주소 (돌아오지 않음)
+    *--sp = (unsigned long long)coro_main;
+    for (int i = 0; i < 6; i++) *--sp = 0;     // rbp, rbx, r12~r15
+    *--sp = 0x1F80ULL | (0x037FULL << 32);     // MXCSR / x87 제어 워드 기본값
+    c->sp = sp;
+#else
+    getcontext(&c->ctx);
+    c->ctx.uc_stack.ss_sp = (char*)(c + 1);
+    c->ctx.uc_stack.ss_size = top - (char*)(c + 1);
+    c->ctx.uc_link = NULL;
+    makecontext(&c->ctx, coro_main, 0);
+#endif
+}
+
+/* [함수: 스케줄러 -> 코루틴] 코루틴이 양보하거나 끝나면 돌아옴. 끝났으면 영역을 회수 */
+static void coro_resume(CoroLoop* l, Coro* c) {
+    coro_current = c;
+#ifdef CORO_ASM
+    lab8_coro_switch(&l->sched_sp, c->sp);
+#else
+    swapcontext(&l->sched_ctx, &c->ctx);
+#endif
+    coro_current = NULL;
+    if (c->done) {
+        c->fd = -1;
+        c->next = l->free_list;
+        l->free_list = c;
     }
+}
+
+static void coro_run_push(CoroLoop* l, Coro* c) {
+    c->next = NULL;
+    if (l->run_tail) l->run_tail->next = c;
+    else l->run_head = c;
+    l->run_tail = c;
+}
 
-    // 데이터 넣기 (원형 큐 알고리즘)
-    queue[rear] = client_fd;
-    rear = (rear + 1) % MAX_QUEUE; // 뱅글뱅글 돌게 만듦
-    count++;
+static void coro_wait_unlink(CoroLoop* l, Coro* c) {
+    if (c->prev) c->prev->next = c->next;
+    else l->wait_head = c->next;
+    if (c->next) c->next->prev = c->prev;
+    else l->wait_tail = c->prev;
+}
 
-    // "자, 일감 들어왔다!" 하고 자고 있는 워커 스레드 하나를 깨움
-    pthread_cond_signal(&cond_nonempty);
-    
-    pthread_mutex_unlock(&mutex); // 자물쇠 해제 (임계 영역 끝)
+/* [함수: 기다리던 코루틴 깨우기] 대기 목록에서 빼서 실행 대기열로 (timed_out이면 io_retry가 실패를 돌려줌) */
+static void coro_wake(CoroLoop* l, Coro* c, int timed_out) {
+    coro_wait_unlink(l, c);
+    c->waiting = 0;
+    c->timed_out = timed_out;
+    coro_run_push(l, c);
 }
 
-/* * [함수: 큐에서 꺼내기 (내부용)]
- * 워커 스레드가 호출합니다. (이미 lock이 걸린 상태에서 호출됨을 가정)
+/* * [함수: 소켓이 준비될 때까지 양보]
+ * 코루틴 밖(스레드 풀 워커의 블로킹 소켓)이면 기다릴 방법이 없으므로 바로 -1
+ * (블로킹 소켓의 EAGAIN은 SO_RCVTIMEO 시간 초과라서 연결을 닫는 게 원래 동작)
+ * 소켓은 accept 때 EPOLLIN|EPOLLOUT 엣지 트리거로 한 번 등록해 두었으므로 여기서는 목록에만 매달고 양보함.
+ * 어떤 이벤트로 깨어나든 호출한 쪽이 시스템 콜을 다시 해 보므로, 원하던 방향이 아니어도 문제없음
  */
-int dequeue() {
-    int client_fd = queue[front];
-    front = (front + 1) % MAX_QUEUE;
-    count--;
-    return client_fd;
+static int coro_wait(int fd, int idle) {
+    Coro* c = coro_current;
+    if (!c || fd != c->fd) return -1;
+    CoroLoop* l = c->loop;
+    if (idle && l->stopped) return -1; // 드레인 중: 다음 요청을 기다리지 않고 닫음
+    c->waiting = 1;
+    c->idle = idle;
+    c->deadline = monotonic_ns() + KEEPALIVE_TIMEOUT * 1000000000LL;
+    c->next = NULL;
+    c->prev = l->wait_tail;
+    if (l->wait_tail) l->wait_tail->next = c;
+    else l->wait_head = c;
+    l->wait_tail = c;
+    coro_yield(c);
+    return c->timed_out ? -1 : 0;
 }
 
-/* * ======================================================================================
- * [함수: 소비자 (Consumer / Worker Thread)]
- * 스레드 풀의 각 스레드가 실행할 함수입니다. 무한 루프를 돌며 일감을 기다립니다.
- * ======================================================================================
+/* * [함수: 실패한 I/O를 다시 해 볼지]
+ * 방금 read/send/writev가 -1로 실패했을 때 부름. EINTR이면 바로 다시, EAGAIN이면 코루틴 안에서만
+ * 소켓이 준비될 때까지 기다렸다가 다시 (events는 기다리는 방향, 지금은 등록이 양방향이라 설명용)
+ * 반환값: 1 = 다시 시도, 0 = 진짜 에러 / 시간 초과 (errno는 원래 값 그대로)
  */
-void* worker_thread(void* arg) {
+static int io_retry(int fd, int events, int idle) {
+    (void)events;
+    if (errno == EINTR) return 1;
+    if (errno != EAGAIN && errno != EWOULDBLOCK) return 0;
+    int saved = errno;
+    if (coro_wait(fd, idle) == 0) return 1;
+    errno = saved;
+    return 0;
+}
+
+/* [함수: 새 연결마다 코루틴 하나] epoll 모드의 accept_connections와 같은 순서 (IP 한도 -> 등록) */
+static void coro_accept(CoroLoop* l) {
+    for (;;) {
+        struct sockaddr_in peer;
+        socklen_t peer_len = sizeof(peer);
+        int client_fd = accept4(l->server_fd, (struct sockaddr*)&peer, &peer_len,
+                                use_accept4 ? SOCK_NONBLOCK | SOCK_CLOEXEC : SOCK_CLOEXEC); // accept_connections와 같음
+        if (client_fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                perror("accept");
+            return;
+        }
+        STAT_ADD(accepted, 1);
+        if (!use_accept4) set_nonblocking(client_fd);
+
+        int ip_slot = ip_admit(&peer);
+        if (ip_slot == IP_REJECT) {
+            send_overload_response(client_fd, 429);
+            STAT_ADD(ip_limited, 1);
+            STAT_ADD(closed, 1);
+            continue;
+        }
+        Coro* c = coro_alloc(l);
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = c };
+        if (!c || epoll_ctl(l->epfd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+            if (c) {
+                c->next = l->free_list;
+                l->free_list = c;
+            }
+            close(client_fd);
+            STAT_ADD(closed, 1);
+            ip_release(ip_slot);
+            continue;
+        }
+        STAT_ADD(connections, 1);
+        c->fd = client_fd;
+        c->ip_slot = ip_slot;
+        coro_prepare(c);
+        coro_run_push(l, c); // 요청이 이미 와 있을 수 있으니 이번 차례에 바로 한 번 돌려봄
+    }
+}
+
+/* * [스레드 함수: 코루틴 스케줄러]
+ * epoll_wait -> 이벤트가 온 코루틴 / 시간이 다 된 코루틴을 실행 대기열로 -> 대기열이 빌 때까지 차례로 실행
+ * 코루틴이 돌다가 다시 양보하면 대기 목록에, 끝나면 free list에 들어감
+ */
+void* coro_loop_thread(void* arg) {
+    AcceptorArg* a = arg;
+    CoroLoop loop = { .server_fd = a->server_fd };
+    pin_to_cpu(a->cpu);
+    stats_register("coro");
+
+    loop.epfd = epoll_create1(0);
+    if (loop.epfd < 0) {
+        perror("epoll_create1");
+        return NULL;
+    }
+    // 리슨 소켓은 epoll 모드와 같이 EPOLLEXCLUSIVE, data.ptr = NULL로 구분
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL };
+    if (epoll_ctl(loop.epfd, EPOLL_CTL_ADD, loop.server_fd, &ev) < 0) {
+        perror("epoll_ctl");
+        close(loop.epfd);
+        return NULL;
+    }
+
+    struct epoll_event events[MAX_EVENTS];
     while (1) {
-        // 1. 일감 가지러 가기 (임계 영역)
-        pthread_mutex_lock(&mutex);
-
-        // 큐가 비어있다면? 일감이 들어올 때까지 대기(Wait)
-        // cond_nonempty 신호를 기다림
-        while (count == 0) {
-            pthread_cond_wait(&cond_nonempty, &mutex);
-        }
-
-        // 2. 일감 꺼내기
-        int client_fd = dequeue();
-        
-        // "빈 자리 생겼어!" 하고 메인 스레드에게 알려줌
-        pthread_cond_signal(&cond_nonfull);
-        
-        pthread_mutex_unlock(&mutex); // 자물쇠 해제 (중요: 빨리 놔줘야 다른 스레드가 큐에 접근함)
-
-        // 3. 실제 업무 처리 (병렬 처리 구간)
-        // *매우 중요*: handle_request는 자물쇠 밖에서 실행해야 합니다.
-        // 안 그러면 한 번에 한 명만 일을 하게 되어 멀티스레드 쓰는 의미가 없어짐.
-        handle_request(client_fd);
+        // 가장 먼저 마감되는 코루틴까지만 잠 (최대 1초: 드레인 시작도 이때 알아챔)
+        int timeout = 1000;
+        if (loop.wait_head) {
+            long long ms = (loop.wait_head->deadline - monotonic_ns()) / 1000000 + 1;
+            if (ms < timeout) timeout = ms < 0 ? 0 : (int)ms;
+        }
+        int n = epoll_wait(loop.epfd, events, MAX_EVENTS, timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        long long t0 = monotonic_ns();
+        for (int i = 0; i < n; i++) {
+            Coro* c = events[i].data.ptr;
+            if (c == NULL) {
+                if (!loop.stopped) coro_accept(&loop);
+                continue;
+            }
+            // 같은 묶음 안에서 먼저 끝나 free list로 간 코루틴의 이벤트일 수도 있음 (waiting = 0이라 무시됨.
+            // 영역은 해제하지 않으므로 포인터는 여전히 유효)
+            if (c->waiting) coro_wake(&loop, c, 0);
+        }
+        while (loop.wait_head && loop.wait_head->deadline <= t0) coro_wake(&loop, loop.wait_head, 1);
+
+        if (!loop.stopped && __atomic_load_n(&server_draining, __ATOMIC_ACQUIRE)) {
+            epoll_ctl(loop.epfd, EPOLL_CTL_DEL, loop.server_fd, NULL);
+            loop.stopped = 1;
+            __atomic_sub_fetch(&accepting_threads, 1, __ATOMIC_RELEASE);
+        }
+        if (loop.stopped) { // 다음 요청만 기다리던 연결은 깨워서 닫게 함
+            for (Coro *c = loop.wait_head, *next; c; c = next) {
+                next = c->next;
+                if (c->idle) coro_wake(&loop, c, 1);
+            }
+        }
+
+        int ran = loop.run_head != NULL;
+        while (loop.run_head) {
+            Coro* c = loop.run_head;
+            loop.run_head = c->next;
+            if (!loop.run_head) loop.run_tail = NULL;
+            coro_resume(&loop, c);
+        }
+        if (n > 0 || ran) STAT_ADD(busy_ns, monotonic_ns() - t0);
     }
+    close(loop.epfd);
     return NULL;
 }
 
 /* * ======================================================================================
- * [메인 함수]
- * 서버 초기화 및 스레드 풀 생성, 연결 수락 루프
+ * [함수: 리슨 소켓 만들기]
+ * socket -> SO_REUSEADDR (-> SO_REUSEPORT) -> bind -> listen 을 한 번에 처리합니다.
+ * reuseport가 1이면 같은 포트에 소켓을 여러 개 bind할 수 있고,
+ * 커널이 들어오는 연결을 (출발지 주소/포트 해시로) 소켓들에 골고루 나눠 줍니다.
+ * 그러면 accept가 소켓마다 따로 돌아서 연결 수립 속도가 코어 수만큼 늘어납니다.
  * ======================================================================================
  */
-int main() {
-    int server_fd, client_fd;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t client_len = sizeof(client_addr);
+static int create_listener(int reuseport, int backlog) {
+    // 1. 소켓 생성 (IPv4, TCP). 교체 때는 SCM_RIGHTS로 따로 넘기므로 exec에는 물려주지 않음
+    int server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server_fd < 0) {
+        perror("socket");
+        return -1;
+    }
 
-    // 1. 소켓 생성 (IPv4, TCP)
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    
     // [중요] SO_REUSEADDR 옵션 설정
     // 서버를 껐다 켰을 때 "Address already in use" 에러가 나지 않도록,
     // TIME_WAIT 상태의 포트를 재사용하게 해주는 필수 옵션.
     int opt = 1;
     setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (reuseport && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt(SO_REUSEPORT)");
+        close(server_fd);
+        return -1;
+    }
 
     // 2. 주소 구조체 설정
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_port = htons(PORT);       // Host to Network Short (엔디안 변환)
     server_addr.sin_addr.s_addr = INADDR_ANY; // 내 컴퓨터의 모든 IP로 들어오는 요청 수락
 
     // 3. 바인딩 (소켓에 주소표 붙이기)
-    bind(server_fd, (struct sockaddr*)&server_addr, sizeof(server_addr));
-
-    // 4. 리슨 (연결 대기열 생성, 10은 OS backlog 크기)
-    listen(server_fd, 10);
-    printf("Thread-Pool Web Server running at http://localhost:%d\n", PORT);
+    if (bind(server_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        perror("bind");
+        close(server_fd);
+        return -1;
+    }
 
-    // 5. 스레드 풀 생성 (일꾼 4명 고용)
-    pthread_t threads[THREAD_POOL_SIZE];
-    for (int i = 0; i < THREAD_POOL_SIZE; i++) {
-        // worker_thread 함수를 실행하는 스레드를 만듦
-        pthread_create(&threads[i], NULL, worker_thread, NULL);
+    // 4. 리슨 (연결 대기열 생성, backlog는 OS가 accept 전까지 쌓아둘 연결 수)
+    if (listen(server_fd, backlog) < 0) {
+        perror("listen");
+        close(server_fd);
+        return -1;
     }
+    return server_fd;
+}
 
-    // 6. 무한 루프: 클라이언트 연결 수락 (생산자 역할)
-    while (1) {
+/* * ======================================================================================
+ * [스레드 함수: accept 루프 (스레드 풀 모드)]
+ * 리슨 소켓 하나를 맡아 연결을 받아서 작업 큐에 넣습니다. (생산자 역할)
+ * SO_REUSEPORT 모드에서는 이런 스레드가 리슨 소켓마다 하나씩 각자의 코어에서 돕니다.
+ * 작업 큐가 락 없는 MPMC 큐라서 생산자가 여러 명이어도 서로 막지 않습니다.
+ * ======================================================================================
+ */
+void* acceptor_thread(void* arg) {
+    AcceptorArg* a = arg;
+    pin_to_cpu(a->cpu);
+    stats_register("acceptor");
+    CoDel codel = { 0 };
+
+    while (!__atomic_load_n(&server_draining, __ATOMIC_ACQUIRE)) {
         // accept: 클라이언트가 올 때까지 여기서 '블락(대기)' 됩니다.
-        client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
-        
+        struct sockaddr_in peer;
+        socklen_t peer_len = sizeof(peer);
+        // CLOEXEC: 교체 때 새 프로세스가 이 연결을 물려받지 않게 (accept_connections 참고)
+        int client_fd = accept4(a->server_fd, (struct sockaddr*)&peer, &peer_len, SOCK_CLOEXEC);
+
         if (client_fd < 0) {
-            perror("accept");
+            // EAGAIN: 리슨 소켓의 SO_RCVTIMEO(1초)가 지남 -> 드레인이 시작됐는지 다시 확인
+            if (errno != EINTR && errno != EAGAIN) perror("accept");
+            continue;
+        }
+        STAT_ADD(accepted, 1);
+
+        // 입장 제어: 이 IP가 한도를 넘었으면 429, 큐가 계속 밀려 있으면 503 (큐에 넣지 않고 바로 응답)
+        int ip_slot = ip_admit(&peer);
+        if (ip_slot == IP_REJECT) {
+            send_overload_response(client_fd, 429);
+            STAT_ADD(ip_limited, 1);
+            STAT_ADD(closed, 1);
+            continue;
+        }
+        if (!codel_admit(&codel)) {
+            send_overload_response(client_fd, 503);
+            STAT_ADD(shed, 1);
+            STAT_ADD(closed, 1);
+            ip_release(ip_slot);
             continue;
         }
 
         // 연결된 소켓(일감)을 큐에 등록
-        // 이 함수 안에서 큐가 꽉 차있으면 빌 때까지 대기함
-        enqueue(client_fd);
+        // 큐가 꽉 차있으면 block 정책은 빌 때까지 대기, shed 정책은 503으로 바로 돌려보냄
+        if (!enqueue(client_fd, ip_slot)) {
+            send_overload_response(client_fd, 503);
+            STAT_ADD(rejected, 1);
+            STAT_ADD(closed, 1);
+            ip_release(ip_slot);
+        }
+    }
+    // 드레인: 더 받지 않음 (남은 연결은 리슨 소켓을 넘겨받은 새 프로세스가 accept함)
+    __atomic_sub_fetch(&accepting_threads, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* * ======================================================================================
+ * [운영 신호 (재설정 / 무중단 교체 / 드레인)]
+ * 예전에는 main이 신호 처리 없이 영원히 돌아서, 새 바이너리를 배포하려면 프로세스를 죽여야 했고
+ * 그 순간 처리 중이던 연결과 리슨 큐에 쌓여 있던 연결이 모두 끊겼습니다.
+ * 신호는 모든 스레드에서 막아 두고(pthread_sigmask) 전용 스레드가 sigwait로 하나씩 받아 처리합니다.
+ * (핸들러 안에서는 할 수 있는 일이 거의 없고, 워커의 시스템 콜이 EINTR로 끊기지도 않음)
+ *
+ * - SIGHUP: 설정 파일(-f)을 다시 읽어서 적용. 연결은 하나도 끊지 않음
+ *   docroot: 같은 이름이어도 다시 찾음 (www -> releases/v2 처럼 심볼릭 링크를 바꿔 배포하는 경우)
+ *            실제 디렉토리가 바뀌었으면 콘텐츠/경로 캐시를 비움
+ *   workers: 스레드 풀 모드면 워커를 늘리거나 줄임 (epoll/uring의 루프 수는 링/리슨 소켓 배치가 걸려
+ *            있어서 SIGUSR2 교체로 바꿈)
+ *   cache_max_bytes / cache_max_file: 캐시 한도 (줄었으면 바로 오래된 것부터 버림)
+ *   접근 로그(-l): 같은 경로로 다시 엶 (logrotate가 옮긴 파일 대신 새 파일에 이어 씀)
+ * - SIGUSR2: 무중단 교체
+ *   1. socketpair를 만들고 fork + exec로 같은 명령줄의 새 프로세스를 띄움 (바이너리를 교체해 두었다면 새 것)
+ *   2. 리슨 소켓들을 SCM_RIGHTS로 넘김 -> 새 프로세스에도 "같은" 소켓이 생김 (리슨 큐도 공유)
+ *      소켓을 닫았다 다시 bind하지 않으므로 연결이 거절(RST)되는 순간이 아예 없음
+ *   3. 새 프로세스가 스레드를 다 띄우고 "준비됨" 1바이트를 보내면, 옛 프로세스는 드레인 시작
+ *      (준비 신호가 안 오면 새 프로세스를 죽이고 옛 프로세스가 계속 서비스함)
+ * - SIGTERM / SIGINT: 넘길 곳 없이 드레인만 하고 끝냄 (한 번 더 보내면 즉시 종료)
+ *
+ * [드레인] accept를 멈추고 -> 열려 있는 연결이 다 닫힐 때까지 기다렸다가 -> 종료
+ * - 응답 중인 연결: 지금 응답에 Connection: close를 붙여 끝까지 보낸 뒤 닫음
+ * - 다음 요청을 기다리는 Keep-Alive 연결: epoll/uring은 바로 닫음. 스레드 풀은 워커가 read에서 기다리는
+ *   중이라 다음 요청을 처리하거나 유휴 타임아웃(KEEPALIVE_TIMEOUT)이 지나야 닫힘
+ * - 열려 있는 연결 수 = 스레드별 accepted 합 - closed 합 (공유 카운터 없이 통계 칸으로 셈)
+ * - DRAIN_TIMEOUT이 지나도 남은 연결(아주 느린 다운로드 등)은 끊고 끝냄
+ * ======================================================================================
+ */
+#define DRAIN_TIMEOUT 30            // 드레인 최대 대기 (초)
+#define HANDOFF_READY_TIMEOUT 10    // 새 프로세스가 준비될 때까지 기다리는 시간 (초)
+#define HANDOFF_ENV "LAB8_HANDOFF_FD" // 새 프로세스에게 앞 프로세스와 이어진 소켓 번호를 알려주는 환경 변수
+#define HANDOFF_BATCH 250           // SCM_RIGHTS 메시지 하나에 담는 fd 수 (커널 한도 SCM_MAX_FD = 253)
+
+enum { MODE_POOL = 0, MODE_EPOLL, MODE_URING, MODE_CORO };
+
+/* [구조체: 다시 읽을 수 있는 설정] 명령줄 값이 기본값, 설정 파일(-f)이 있으면 그 값이 우선 */
+typedef struct {
+    char docroot[PATH_MAX];
+    int workers;
+    size_t cache_max_bytes;
+    off_t cache_max_file;
+    int admission_target_ms;
+    int max_conns_per_ip;
+} Config;
+
+static Config cfg = { .docroot = "./www" };
+static Config cfg_cmdline;             // 명령줄로 정한 값 (재설정 때 파일에서 빠진 키는 이 값으로 돌아감)
+static const char* config_path = NULL; // -f
+static int server_mode = MODE_POOL;
+static char** saved_argv;              // 교체 때 같은 명령줄로 exec
+static int* listen_fds;                // 교체 때 넘길 리슨 소켓들
+static int num_listen_fds;
+static int handoff_fd = -1;            // 교체로 시작했으면 앞 프로세스와 이어진 소켓 (준비되면 알리고 닫음)
+
+/* * [함수: 설정 파일 읽기]
+ * 한 줄에 "key = value" 하나, '#'으로 시작하면 주석. 모르는 키나 잘못된 값이 하나라도 있으면 -1
+ * (그러면 재설정은 통째로 취소. 반쯤 적용된 설정으로 도는 것보다 지금 설정을 유지하는 게 안전)
+ */
+static int config_load(const char* path, Config* c) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char line[PATH_MAX + 64], key[32], val[PATH_MAX];
+    int lineno = 0, bad = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char* p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0') continue;
+        if (sscanf(p, "%31[a-z_] = %4095s", key, val) != 2) {
+            fprintf(stderr, "%s:%d: expected 'key = value'\n", path, lineno);
+            bad = 1;
+            continue;
+        }
+        if (strcmp(key, "docroot") == 0) {
+            snprintf(c->docroot, sizeof(c->docroot), "%s", val);
+            continue;
+        }
+        char* end;
+        long long v = strtoll(val, &end, 10);
+        int ok = *end == '\0' && v >= 0;
+        if (strcmp(key, "workers") == 0 && ok && v >= 1 && v <= POOL_MAX_WORKERS) {
+            c->workers = v;
+        } else if (strcmp(key, "cache_max_bytes") == 0 && ok) {
+            c->cache_max_bytes = v;
+        } else if (strcmp(key, "cache_max_file") == 0 && ok) {
+            c->cache_max_file = v;
+        } else if (strcmp(key, "admission_target_ms") == 0 && ok && v <= INT_MAX) {
+            c->admission_target_ms = v;
+        } else if (strcmp(key, "max_conns_per_ip") == 0 && ok && v <= INT_MAX) {
+            c->max_conns_per_ip = v;
+        } else {
+            fprintf(stderr, "%s:%d: unknown key or bad value '%s = %s'\n", path, lineno, key, val);
+            bad = 1;
+        }
+    }
+    fclose(f);
+    return bad ? -1 : 0;
+}
+
+/* [함수: 캐시 한도 / 입장 제어 적용] */
+static void config_apply_limits(const Config* c) {
+    __atomic_store_n(&cache_max_bytes, c->cache_max_bytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&cache_max_file, c->cache_max_file, __ATOMIC_RELAXED);
+    __atomic_store_n(&admission_target_ms, c->admission_target_ms, __ATOMIC_RELAXED);
+    __atomic_store_n(&max_conns_per_ip, c->max_conns_per_ip, __ATOMIC_RELAXED);
+}
+
+/* [함수: SIGHUP 재설정] 신호 스레드에서만 부르므로 cfg를 락 없이 고침 */
+static void config_reload(void) {
+    Config next = cfg_cmdline;
+    if (config_path && config_load(config_path, &next) < 0) {
+        fprintf(stderr, "reload: %s has errors, keeping the current config\n", config_path);
+        return;
+    }
+
+    // 1. 웹 루트. 새 것을 먼저 공개하고 나서 캐시를 비워야 옛 웹 루트의 파일이 다시 들어오지 않음 (cache_insert 참고)
+    char old_root[PATH_MAX];
+    snprintf(old_root, sizeof(old_root), "%s", docroot->path);
+    if (docroot_set(next.docroot) < 0) {
+        perror(next.docroot);
+        snprintf(next.docroot, sizeof(next.docroot), "%s", cfg.docroot);
+    }
+
+    // 2. 캐시 한도 + 입장 제어. 웹 루트가 실제로 바뀌었으면 통째로 비우고, 아니면 줄어든 한도에 맞춰 덜어냄
+    config_apply_limits(&next);
+    if (strcmp(old_root, docroot->path) != 0)
+        cache_invalidate(NULL, 0);
+    else
+        cache_trim();
+
+    // 3. 워커 수
+    if (server_mode == MODE_POOL) {
+        pool_resize(next.workers);
+    } else if (next.workers != cfg.workers) {
+        fprintf(stderr, "reload: the loop count only changes on restart (SIGUSR2)\n");
+        next.workers = cfg.workers;
+    }
+
+    cfg = next;
+    printf("Config reloaded: docroot %s, %d workers, cache %zu bytes (files up to %lld), "
+           "admission %d ms, %d conns per IP\n",
+           docroot->path, cfg.workers, cfg.cache_max_bytes, (long long)cfg.cache_max_file,
+           cfg.admission_target_ms, cfg.max_conns_per_ip);
+    fflush(stdout);
+}
+
+/* [함수: fd 보내기] 메시지마다 "전체 개수"(int)를 본문으로, fd를 최대 HANDOFF_BATCH개씩 SCM_RIGHTS로 */
+static int handoff_send_fds(int sock, const int* fds, int n) {
+    for (int sent = 0; sent < n; sent += HANDOFF_BATCH) {
+        int k = n - sent < HANDOFF_BATCH ? n - sent : HANDOFF_BATCH;
+        char ctrl[CMSG_SPACE(sizeof(int) * HANDOFF_BATCH)];
+        struct iovec iov = { .iov_base = &n, .iov_len = sizeof(n) };
+        struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1,
+                              .msg_control = ctrl, .msg_controllen = CMSG_SPACE(sizeof(int) * k) };
+        struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(sizeof(int) * k);
+        memcpy(CMSG_DATA(cm), fds + sent, sizeof(int) * k);
+        if (sendmsg(sock, &msg, 0) < 0) return -1;
+    }
+    return 0;
+}
+
+/* [함수: fd 받기] 받은 개수를 돌려줌 (max보다 많이 오면 나머지는 닫음). 실패하면 -1 */
+static int handoff_recv_fds(int sock, int* fds, int max) {
+    int got = 0, total = -1;
+    while (total < 0 || got < total) {
+        char ctrl[CMSG_SPACE(sizeof(int) * HANDOFF_BATCH)];
+        int n;
+        struct iovec iov = { .iov_base = &n, .iov_len = sizeof(n) };
+        struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctrl, .msg_controllen = sizeof(ctrl) };
+        if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != sizeof(n)) return -1;
+        total = n;
+        struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+        if (!cm || cm->cmsg_type != SCM_RIGHTS) return -1;
+        int k = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (int i = 0; i < k; i++, got++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cm) + i * sizeof(int), sizeof(int));
+            if (got < max) fds[got] = fd;
+            else close(fd);
+        }
+    }
+    return got < max ? got : max;
+}
+
+/* [함수: 새 프로세스 준비 완료 알리기] 교체로 시작한 프로세스가 모든 스레드를 띄운 뒤에 부름 */
+static void handoff_ready(void) {
+    if (handoff_fd < 0) return;
+    if (write(handoff_fd, "R", 1) != 1) perror("handoff");
+    close(handoff_fd);
+    handoff_fd = -1;
+}
+
+/* * [함수: 새 프로세스로 교체 시작]
+ * 성공하면 새 프로세스의 pid, 실패하면 -1 (그때는 이 프로세스가 계속 서비스함)
+ */
+static pid_t handoff_start(void) {
+    int sv[2];
+    // SEQPACKET: 메시지 경계가 지켜져서 fd 묶음이 섞이지 않음
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+        perror("socketpair");
+        return -1;
+    }
+
+    // 새 프로세스의 환경 변수 = 지금 환경 + 소켓 번호. fork 뒤 자식에서는 malloc을 못 쓰므로 미리 만듦
+    extern char** environ;
+    size_t n = 0;
+    while (environ[n]) n++;
+    char** envp = malloc((n + 2) * sizeof(char*));
+    char env_fd[64];
+    snprintf(env_fd, sizeof(env_fd), HANDOFF_ENV "=%d", sv[1]);
+    size_t k = 0;
+    for (size_t i = 0; envp && i < n; i++)
+        if (strncmp(environ[i], HANDOFF_ENV "=", sizeof(HANDOFF_ENV)) != 0) envp[k++] = environ[i];
+    pid_t pid = -1;
+    if (envp) {
+        envp[k++] = env_fd;
+        envp[k] = NULL;
+        pid = fork();
+    }
+    if (pid == 0) {
+        // 자식: exec해도 신호 마스크는 그대로 물려받으므로 풀어 주고, 교체용 소켓 하나만 열린 채로 exec
+        // argv[0] 경로로 찾으므로 바이너리를 새 것으로 바꿔 두었다면 새 것이 뜸 (/proc/self/exe는 옛 파일)
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        // 혹시 CLOEXEC 없이 열린 fd(파일, epoll 등)가 있어도 새 프로세스로 새지 않게 전부 CLOEXEC로 돌림
+        close_range(3, ~0U, CLOSE_RANGE_CLOEXEC);
+        fcntl(sv[1], F_SETFD, 0);
+        execvpe(saved_argv[0], saved_argv, envp);
+        _exit(127);
+    }
+    free(envp);
+    close(sv[1]);
+    if (pid < 0) {
+        perror("fork");
+        close(sv[0]);
+        return -1;
+    }
+
+    // 리슨 소켓 넘기기 -> 준비 신호 기다리기
+    struct timeval tv = { .tv_sec = HANDOFF_READY_TIMEOUT, .tv_usec = 0 };
+    setsockopt(sv[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char ready = 0;
+    if (handoff_send_fds(sv[0], listen_fds, num_listen_fds) < 0 || read(sv[0], &ready, 1) != 1 || ready != 'R') {
+        fprintf(stderr, "handoff: new process %d did not come up, keeping this one\n", (int)pid);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        close(sv[0]);
+        return -1;
+    }
+    close(sv[0]);
+    return pid;
+}
+
+/* * [함수: 드레인 후 종료]
+ * 모든 accept 스레드/루프가 멈춘 것을 확인한 뒤(그 뒤로는 accepted가 늘지 않음)
+ * 열린 연결이 0이 될 때까지 기다림. 워커/루프 스레드는 멈추지 않고 남은 연결을 계속 처리함
+ */
+static void drain_and_exit(void) {
+    __atomic_store_n(&server_draining, 1, __ATOMIC_RELEASE);
+    long long deadline = monotonic_ns() + DRAIN_TIMEOUT * 1000000000LL;
+    for (;;) {
+        int accepting = __atomic_load_n(&accepting_threads, __ATOMIC_ACQUIRE);
+        long open = stats_open_connections();
+        if (accepting == 0 && open <= 0) {
+            routes_fini(); // 열린 연결이 없으면 플러그인 handle을 돌고 있는 스레드도 없음
+            break;
+        }
+        if (monotonic_ns() > deadline) {
+            fprintf(stderr, "drain: timed out with %ld connections open\n", open);
+            break;
+        }
+        usleep(50 * 1000);
+    }
+    access_log_stop(); // 남은 기록까지 다 쓰고 끝냄
+    printf("Drained, exiting\n");
+    fflush(stdout);
+    _exit(0);
+}
+
+/* [스레드 함수: 신호 처리] main이 막아 둔 신호를 sigwait로 하나씩 받음 */
+static void* signal_thread(void* arg) {
+    sigset_t* set = arg;
+    for (;;) {
+        int sig;
+        if (sigwait(set, &sig) != 0) continue;
+        int draining = __atomic_load_n(&server_draining, __ATOMIC_RELAXED);
+        if (sig == SIGHUP) {
+            __atomic_store_n(&access_log.reopen, 1, __ATOMIC_RELEASE);
+            if (!draining) config_reload();
+            continue;
+        }
+        if (draining) {
+            if (sig != SIGUSR2) _exit(1); // 드레인 중에 또 종료 신호 -> 기다리지 않고 바로 끝냄
+            continue;
+        }
+        if (sig == SIGUSR2) {
+            pid_t pid = handoff_start();
+            if (pid < 0) continue;
+            printf("Handed the listeners to pid %d, draining\n", (int)pid);
+        } else {
+            printf("Shutting down, draining\n");
+        }
+        fflush(stdout);
+        drain_and_exit();
+    }
+    return NULL;
+}
+
+/* * ======================================================================================
+ * [메인 함수]
+ * 서버 초기화 및 스레드 풀 생성, 연결 수락 루프
+ * 실행: ./webserver-mt          -> 스레드 풀 모드 (기본)
+ *       ./webserver-mt epoll    -> 이벤트 루프 모드
+ *       ./webserver-mt uring    -> io_uring 모드 (리눅스 5.19+)
+ *       ./webserver-mt coro     -> 코루틴 모드 (연결마다 코루틴, 스레드 풀 코드를 epoll 위에서)
+ *       ./webserver-mt -r 4 ... -> 같은 포트에 SO_REUSEPORT 리슨 소켓 4개 (코어마다 accept 루프)
+ *       kill -HUP <pid>         -> 설정 다시 읽기,  kill -USR2 <pid> -> 새 프로세스로 무중단 교체
+ * ======================================================================================
+ */
+int main(int argc, char* argv[]) {
+    // 0. 실행 옵션 해석
+    //    -q <depth>       : 작업 큐 크기 (스레드 풀 모드)
+    //    -o block|shed    : 큐가 가득 찼을 때 정책 (block = accept를 멈춤, shed = 503으로 즉시 거절)
+    //    -r <N>           : SO_REUSEPORT 리슨 소켓 N개, 각각 CPU에 고정된 자기 accept 루프를 가짐
+    //    -b <backlog>     : listen backlog 크기
+    //    -n               : accept4(SOCK_NONBLOCK) 사용 (epoll 모드)
+    //    -w <N>           : 워커 스레드 수 (풀 모드) / 루프 수 (epoll, uring). 기본은 쓸 수 있는 CPU 수
+    //    -P               : 워커/루프를 CPU에 하나씩 고정
+    //    -m               : 캐시 본문을 힙 복사 대신 파일 mmap으로 (페이지 캐시를 그대로 보냄)
+    //    -A <ms>          : 입장 제어 목표 대기 시간 (풀 모드, 기본 50ms, 0이면 끔)
+    //    -I <N>           : IP 하나당 동시 연결 한도 (기본 0 = 끔)
+    //    -L <pfx=lib.so>  : URL 접두어를 핸들러 플러그인에 맡김 (여러 번 가능, "pfx=lib.so:arg"로 인자 전달)
+    //    -l <file>        : 접근 로그를 file에 덧붙임 ("-"면 표준 출력, 기본은 끔)
+    //    -f <config>      : 설정 파일 (docroot, workers, cache_max_bytes, cache_max_file,
+    //                       admission_target_ms, max_conns_per_ip). SIGHUP으로 다시 읽음
+    //    pool|epoll|uring|coro : 실행 모드 (기본 pool)
+    int use_epoll = 0, use_uring = 0, use_coro = 0;
+    cpu_init();
+    int num_workers = num_cpus;
+    int pin = 0;
+    long queue_depth = MAX_QUEUE;
+    int shed_on_full = 0;
+    int reuseport = 0;
+    int target_ms = CODEL_TARGET_MS, per_ip = 0;
+    const char* log_path = NULL;
+    int bad = 0;
+    int c;
+    while ((c = getopt(argc, argv, "q:o:r:b:nw:PmA:I:L:l:f:")) != -1) {
+        switch (c) {
+        case 'q':
+            queue_depth = atol(optarg);
+            break;
+        case 'o':
+            if (strcmp(optarg, "shed") == 0) shed_on_full = 1;
+            else if (strcmp(optarg, "block") == 0) shed_on_full = 0;
+            else bad = 1;
+            break;
+        case 'r':
+            reuseport = atoi(optarg);
+            if (reuseport < 1 || reuseport > 1024) bad = 1;
+            break;
+        case 'b':
+            listen_backlog = atoi(optarg);
+            if (listen_backlog < 1) bad = 1;
+            break;
+        case 'n':
+            use_accept4 = 1;
+            break;
+        case 'w':
+            num_workers = atoi(optarg);
+            if (num_workers < 1 || num_workers > POOL_MAX_WORKERS) bad = 1;
+            break;
+        case 'P':
+            pin = 1;
+            break;
+        case 'm':
+            cache_use_mmap = 1;
+            break;
+        case 'A':
+            target_ms = atoi(optarg);
+            if (target_ms < 0) bad = 1;
+            break;
+        case 'I':
+            per_ip = atoi(optarg);
+            if (per_ip < 0) bad = 1;
+            break;
+        case 'L':
+            if (route_add(optarg) < 0) return 1;
+            break;
+        case 'l':
+            log_path = optarg;
+            break;
+        case 'f':
+            config_path = optarg;
+            break;
+        default:
+            bad = 1;
+        }
+    }
+    if (optind < argc && strcmp(argv[optind], "epoll") == 0) {
+        use_epoll = 1;
+        optind++;
+    } else if (optind < argc && strcmp(argv[optind], "uring") == 0) {
+        use_uring = 1;
+        optind++;
+    } else if (optind < argc && strcmp(argv[optind], "coro") == 0) {
+        use_coro = 1;
+        optind++;
+    } else if (optind < argc && strcmp(argv[optind], "pool") == 0) {
+        optind++;
+    }
+    if (bad || optind != argc || queue_depth < 1 || queue_depth > (1L << 20)) {
+        printf("Usage: %s [-q queue_depth] [-o block|shed] [-r listeners] [-b backlog] [-n] [-w workers] [-P] [-m]\n"
+               "       [-A admission_ms] [-I conns_per_ip] [-L /prefix=plugin.so[:arg]]... [-l access.log]\n"
+               "       [-f config] [pool|epoll|uring|coro]\n",
+               argv[0]);
+        return 1;
+    }
+    server_mode = use_uring ? MODE_URING : use_epoll ? MODE_EPOLL : use_coro ? MODE_CORO : MODE_POOL;
+    saved_argv = argv;
+    cfg.workers = num_workers;
+    cfg.cache_max_bytes = CACHE_MAX_BYTES;
+    cfg.cache_max_file = CACHE_MAX_FILE;
+    cfg.admission_target_ms = target_ms;
+    cfg.max_conns_per_ip = per_ip;
+    cfg_cmdline = cfg;
+    if (config_path && config_load(config_path, &cfg) < 0) return 1;
+    num_workers = cfg.workers;
+    config_apply_limits(&cfg);
+
+    // 신호: 이후에 만드는 모든 스레드가 이 마스크를 물려받으므로 스레드를 만들기 전에 막아 둠
+    // (신호 스레드가 sigwait로 받음). SIGPIPE는 무시: 응답 도중 클라이언트가 끊으면 send/sendfile이
+    // SIGPIPE를 받아 서버 전체가 죽던 문제 (EPIPE 에러로 받아서 그 연결만 닫음)
+    signal(SIGPIPE, SIG_IGN);
+    static sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGHUP);
+    sigaddset(&sigs, SIGUSR2);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+    // 기본 backlog: 스레드 풀은 원래대로 10, 이벤트 루프는 한 번에 많은 연결을 다루므로 SOMAXCONN
+    if (listen_backlog < 0) listen_backlog = use_epoll || use_uring || use_coro ? SOMAXCONN : 10;
+
+    // 1~4. 리슨 소켓 생성 (SO_REUSEPORT 모드면 같은 포트에 여러 개)
+    //      무중단 교체로 시작했으면 만들지 않고 앞 프로세스의 것을 넘겨받음 (같은 소켓, 같은 리슨 큐)
+    int num_listeners = reuseport ? reuseport : 1;
+    int* listeners = malloc(num_listeners * sizeof(int));
+    const char* handoff_env = getenv(HANDOFF_ENV);
+    if (handoff_env) {
+        handoff_fd = atoi(handoff_env);
+        unsetenv(HANDOFF_ENV);
+        fcntl(handoff_fd, F_SETFD, FD_CLOEXEC);
+        int got = handoff_recv_fds(handoff_fd, listeners, num_listeners);
+        if (got != num_listeners) {
+            fprintf(stderr, "handoff: expected %d listeners, got %d\n", num_listeners, got);
+            return 1;
+        }
+        printf("Took over %d listener(s) from pid %d\n", got, (int)getppid());
+    }
+    listen_fds = listeners;
+    num_listen_fds = num_listeners;
+    for (int i = 0; i < num_listeners; i++) {
+        if (!handoff_env) listeners[i] = create_listener(reuseport > 0, listen_backlog);
+        if (listeners[i] < 0) return 1;
+        // SO_INCOMING_CPU: 패킷을 받은 CPU와 같은 CPU를 지정한 리슨 소켓으로 연결을 보내 달라고 커널에 알림
+        // (리눅스 6.2+). i번째 리슨 소켓의 accept 루프는 i번째 CPU에 고정되므로, RSS/RPS로 그 CPU에
+        // 들어온 연결은 accept -> 파싱 -> 응답까지 처음 받은 코어에서 끝남
+        if (reuseport) {
+            int cpu = cpu_ids[i % num_cpus];
+            setsockopt(listeners[i], SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+        }
+    }
+
+    // 웹 루트는 시작할 때 한 번만 찾아서 열어 둠 (요청마다 realpath("./www")를 다시 하지 않음)
+    if (docroot_set(cfg.docroot) < 0) {
+        perror(cfg.docroot);
+        exit(1);
+    }
+
+    // 핫 파일 캐시 + inotify 감시 스레드 시작 (두 모드 공통)
+    cache_init();
+
+    // 접근 로그 쓰기 스레드 (워커보다 먼저 띄워서 첫 요청부터 남김)
+    if (log_path && access_log_start(strcmp(log_path, "-") == 0 ? NULL : log_path) < 0) return 1;
+
+    // 신호 처리 스레드 (웹 루트/캐시가 준비된 뒤에 띄워야 SIGHUP 재설정이 안전함)
+    pthread_t sig_tid;
+    pthread_create(&sig_tid, NULL, signal_thread, &sigs);
+
+    if (use_uring) {
+        // io_uring 모드: 루프 배치는 epoll 모드와 같음 (리슨 소켓 하나를 나눠 쓰거나, SO_REUSEPORT로 루프마다 하나)
+        // 리슨 소켓은 블로킹 그대로 둠 (accept를 커널이 대신 기다려 줌)
+        int num_loops = reuseport ? reuseport : num_workers;
+        accepting_threads = num_loops;
+        printf("io_uring Web Server running at http://localhost:%d (%d rings%s%s)\n",
+               PORT, num_loops, reuseport ? ", SO_REUSEPORT" : "", pin || reuseport ? ", pinned" : "");
+
+        pthread_t* loops = malloc(num_loops * sizeof(pthread_t));
+        AcceptorArg* args = malloc(num_loops * sizeof(AcceptorArg));
+        for (int i = 0; i < num_loops; i++) {
+            args[i].server_fd = listeners[reuseport ? i : 0];
+            args[i].cpu = reuseport || pin ? i : -1;
+            pthread_create(&loops[i], NULL, uring_loop_thread, &args[i]);
+        }
+        handoff_ready();
+        for (int i = 0; i < num_loops; i++) {
+            pthread_join(loops[i], NULL);
+        }
+        return 0;
+    }
+
+    if (use_epoll || use_coro) {
+        // 이벤트 루프 모드 / 코루틴 모드 (루프 배치는 같고, 루프 안에서 연결을 상태 머신으로 돌리느냐 코루틴으로 돌리느냐만 다름)
+        // - 기본: 리슨 소켓 하나를 num_workers개의 루프가 EPOLLEXCLUSIVE로 나눠 감시 (-P면 루프마다 CPU 고정)
+        // - SO_REUSEPORT: 루프마다 자기 리슨 소켓을 갖고 자기 CPU에 고정됨 (accept도 코어마다 따로)
+        int num_loops = reuseport ? reuseport : num_workers;
+        accepting_threads = num_loops;
+        for (int i = 0; i < num_listeners; i++) {
+            // 리슨 소켓도 논블로킹이어야 accept가 EAGAIN으로 빠져나옴
+            set_nonblocking(listeners[i]);
+        }
+        printf("%s Web Server running at http://localhost:%d (%d loops%s%s)\n",
+               use_coro ? "Coroutine" : "Event-Loop (epoll)", PORT, num_loops, reuseport ? ", SO_REUSEPORT" : "",
+               pin || reuseport ? ", pinned" : "");
+
+        pthread_t* loops = malloc(num_loops * sizeof(pthread_t));
+        AcceptorArg* args = malloc(num_loops * sizeof(AcceptorArg));
+        for (int i = 0; i < num_loops; i++) {
+            args[i].server_fd = listeners[reuseport ? i : 0];
+            args[i].cpu = reuseport || pin ? i : -1;
+            pthread_create(&loops[i], NULL, use_coro ? coro_loop_thread : event_loop_thread, &args[i]);
+        }
+        handoff_ready();
+        for (int i = 0; i < num_loops; i++) {
+            pthread_join(loops[i], NULL);
+        }
+        return 0;
+    }
+
+    if (queue_init(queue_depth, shed_on_full) < 0) {
+        perror("queue_init");
+        return 1;
     }
+    printf("Thread-Pool Web Server running at http://localhost:%d (%d workers, queue %zu, %s on full, "
+           "admission %d ms%s%s)\n",
+           PORT, num_workers, work_queue.mask + 1, shed_on_full ? "shed" : "block", cfg.admission_target_ms,
+           reuseport ? ", SO_REUSEPORT" : "", pin ? ", pinned" : "");
 
-    close(server_fd);
+    // 5. 스레드 풀 생성 (기본은 CPU마다 일꾼 한 명, 워커 번호 = 고정할 CPU 순번)
+    pool_pin = pin;
+    pool_resize(num_workers);
+
+    // 6. 클라이언트 연결 수락 (생산자 역할)
+    // 리슨 소켓이 하나면 메인 스레드가 직접, SO_REUSEPORT면 소켓마다 accept 스레드를 띄움
+    // 블로킹 accept는 드레인을 알아챌 수 없으므로 1초마다 깨어나게 함 (SO_RCVTIMEO는 accept에도 적용됨)
+    struct timeval accept_tick = { .tv_sec = 1, .tv_usec = 0 };
+    accepting_threads = num_listeners;
+    AcceptorArg* args = malloc(num_listeners * sizeof(AcceptorArg));
+    pthread_t* acceptors = malloc(num_listeners * sizeof(pthread_t));
+    for (int i = 0; i < num_listeners; i++) {
+        setsockopt(listeners[i], SOL_SOCKET, SO_RCVTIMEO, &accept_tick, sizeof(accept_tick));
+        args[i].server_fd = listeners[i];
+        args[i].cpu = reuseport ? i : -1;
+        if (reuseport) pthread_create(&acceptors[i], NULL, acceptor_thread, &args[i]);
+    }
+    handoff_ready();
+    if (!reuseport) acceptor_thread(&args[0]); // 드레인이 시작되어야 돌아옴
+    for (int i = 0; reuseport && i < num_listeners; i++) {
+        pthread_join(acceptors[i], NULL);
+    }
+    // accept는 멈췄고 워커들이 남은 연결을 마저 처리하는 중. 다 끝나면 신호 스레드가 프로세스를 끝냄
+    pthread_join(sig_tid, NULL);
     return 0;
-}
\ No newline at end of file
+}
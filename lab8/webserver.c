@@ -5,59 +5,479 @@
  * 리눅스 시스템 프로그래밍과 네트워크를 위한 필수 헤더들입니다.
  * ======================================================================================
  */
-#include <stdio.h>      // 표준 입출력 (printf, sscanf, snprintf)
+#define _GNU_SOURCE     // splice()는 GNU 확장이라 모든 헤더보다 먼저 정의해야 함
+#include <stdio.h>      // 표준 입출력 (printf, snprintf)
 #include <stdlib.h>     // 표준 라이브러리 (exit)
 #include <string.h>     // 문자열 처리 (strcmp, strcpy, strlen)
 #include <unistd.h>     // 유닉스 표준 시스템 콜 (read, write, close)
-#include <fcntl.h>      // 파일 제어 (open, O_RDONLY)
+#include <fcntl.h>      // 파일 제어 (open, O_RDONLY, splice)
+#include <errno.h>      // 에러 번호 (EINTR)
+#include <sys/time.h>   // struct timeval (소켓 타임아웃 설정용)
 #include <netinet/in.h> // 인터넷 주소 체계 (struct sockaddr_in, htons, INADDR_ANY)
 #include <sys/socket.h> // 소켓 핵심 함수 (socket, bind, listen, accept)
 #include <sys/types.h>  // 시스템 데이터 타입
-#include <sys/stat.h>   // 파일 상태 정보
+#include <sys/stat.h>   // 파일 상태 정보 (fstat: 파일 크기/종류)
+#include <sys/sendfile.h> // 커널 내부 복사 (sendfile: 파일 -> 소켓 Zero-Copy)
 #include <limits.h>     // 시스템 제한 상수 (PATH_MAX: 경로 최대 길이)
+#include <sys/syscall.h> // openat2는 glibc 래퍼가 없어서 syscall()로 직접 호출
+#include <linux/openat2.h> // openat2의 open_how 구조체와 RESOLVE_BENEATH
+#include <signal.h>     // 운영 신호 (sigaction, sigprocmask: HUP/USR2/TERM)
+#include <poll.h>       // ppoll (신호 마스크를 바꾸면서 기다리기)
+#include <sys/wait.h>   // waitpid (교체에 실패한 새 프로세스 정리)
+#include <sys/uio.h>    // struct iovec (교체 때 리슨 소켓을 넘기는 sendmsg/recvmsg)
+#include <pthread.h>    // 접근 로그 쓰기 스레드
+#include <time.h>       // clock_gettime, gmtime_r (접근 로그 시각/처리 시간)
+
+#include "http_parser.h" // 증분 HTTP 요청 파서 (같은 디렉토리의 헤더 전용 파일)
 
 /* * [상수 정의]
  * - PORT 8080: 1024번 이하 포트는 관리자(root) 권한이 필요하므로, 보통 연습용은 8080을 씁니다.
  * - BUF_SIZE 4096: 4KB. 보통 OS의 메모리 페이지 크기와 같아 I/O 효율이 좋습니다.
+ * - KEEPALIVE_TIMEOUT: Keep-Alive 연결에서 다음 요청을 기다려 주는 최대 시간(초)
  */
 #define PORT 8080
 #define BUF_SIZE 4096
+#define KEEPALIVE_TIMEOUT 5
+#define MAX_REQUEST_BODY (64 * 1024) // 읽어서 버릴 요청 본문 최대 (넘으면 413)
+#define BYTERANGES_BOUNDARY "LAB8_BYTERANGES_7d3f0a9c1e5b" // 여러 구간 Range 응답의 구분자
 #define PATH_MAX 4096
+#define HANDOFF_ENV "LAB8_HANDOFF_FD" // 무중단 교체: 새 프로세스가 리슨 소켓을 받을 소켓 번호 (webserver-mt.c와 같은 규약)
+#define HANDOFF_READY_TIMEOUT 10      // 새 프로세스가 준비 신호를 보내야 하는 시간(초)
 
 /* * ======================================================================================
- * [함수: HTTP 요청 처리]
- * 클라이언트(웹 브라우저)와 연결된 소켓(client_fd)을 통해 요청을 읽고 응답을 보냅니다.
+ * [함수: 파일 본문 전송 (Zero-Copy)]
+ * read -> write 루프는 4KB마다 시스템 콜 2번, 커널->유저->커널 복사 2번이 필요합니다.
+ * - 일반 파일: sendfile()로 페이지 캐시에서 소켓으로 커널 안에서 바로 보냅니다.
+ * - 파이프/장치 등: sendfile이 안 되므로 splice()로 "파일 -> 파이프 -> 소켓"을 이어 붙입니다.
+ *   (splice는 양쪽 중 하나가 반드시 파이프여야 해서 중간 파이프를 하나 만듭니다)
+ * 둘 다 요청한 것보다 적게 보낼 수 있으므로(부분 전송) 남은 양이 0이 될 때까지 반복합니다.
  * ======================================================================================
  */
-void handle_request(int client_fd) {
-    char buffer[BUF_SIZE];
-    
-    // 1. 요청 읽기 (Read Request)
-    // 클라이언트가 보낸 데이터(HTTP Request Packet)를 버퍼로 읽어옵니다.
-    // read는 블로킹 함수라 데이터가 올 때까지 대기할 수 있습니다.
-    int bytes = read(client_fd, buffer, BUF_SIZE - 1);
-
-    if (bytes <= 0) { // 읽은 바이트가 0이면 연결 종료(EOF), 음수면 에러
-        close(client_fd);
+int send_file_range(int client_fd, int file_fd, off_t offset, off_t remain) {
+    // sendfile은 offset을 보낸 만큼 알아서 전진시켜 줌 (파일 위치는 건드리지 않으므로 구간 전송에도 그대로 씀)
+    while (remain > 0) {
+        ssize_t n = sendfile(client_fd, file_fd, &offset, remain);
+        if (n < 0 && errno == EINTR) continue; // 시그널에 끊긴 것뿐 -> 재시도
+        if (n <= 0) return -1;                 // 에러(클라이언트 끊김) 또는 파일이 줄어듦
+        remain -= n;
+    }
+    return 0;
+}
+
+int send_file_body(int client_fd, int file_fd, const struct stat* st) {
+    if (S_ISREG(st->st_mode)) return send_file_range(client_fd, file_fd, 0, st->st_size);
+
+    int ret = 0;
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0) return -1;
+    for (;;) {
+        // 1단계: 파일 -> 파이프 (0이면 파일 끝)
+        ssize_t in = splice(file_fd, NULL, pipe_fds[1], NULL, 64 * 1024, SPLICE_F_MOVE);
+        if (in < 0 && errno == EINTR) continue;
+        if (in <= 0) break;
+
+        // 2단계: 파이프 -> 소켓 (부분 전송이면 파이프가 빌 때까지 반복)
+        while (in > 0) {
+            ssize_t out = splice(pipe_fds[0], NULL, client_fd, NULL, in, SPLICE_F_MOVE);
+            if (out < 0 && errno == EINTR) continue;
+            if (out <= 0) {
+                ret = -1;
+                goto done;
+            }
+            in -= out;
+        }
+    }
+done:
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    return ret;
+}
+
+/* * ======================================================================================
+ * [HTTP/1.1 Keep-Alive 도우미 함수들]
+ * 연결을 재사용하려면 클라이언트가 "응답이 어디서 끝나는지" 알아야 합니다.
+ * 그래서 모든 응답에 Content-Length(본문 길이)와 Connection(유지/종료)을 붙입니다.
+ * ======================================================================================
+ */
+
+/* [함수: 짧은 응답 전송] 에러 페이지처럼 본문이 문자열 하나인 응답. 보낸 바이트 수를 돌려줌 (접근 로그용) */
+int send_simple_response(int client_fd, const char* status, const char* body, int keep_alive) {
+    char response[512];
+    int len = snprintf(response, sizeof(response),
+                       "HTTP/1.1 %s\r\nContent-Length: %zu\r\nConnection: %s\r\n\r\n%s",
+                       status, strlen(body), keep_alive ? "keep-alive" : "close", body);
+    return write(client_fd, response, len);
+}
+
+/* * [함수: 압축할 만한 파일인지]
+ * 텍스트 파일만 압축본(.gz / .br)을 찾아봅니다. 이미 압축된 형식(png, jpg, zip...)은 의미가 없음.
+ */
+int is_compressible(const char* path) {
+    static const char* const exts[] = { ".html", ".htm", ".css", ".js", ".mjs", ".json", ".txt",
+                                        ".svg", ".xml", ".md", ".csv", NULL };
+    const char* dot = strrchr(path, '.');
+    if (!dot || strchr(dot, '/')) return 0;
+    for (int i = 0; exts[i]; i++) {
+        if (strcasecmp(dot, exts[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+/* * ======================================================================================
+ * [웹 루트 안의 파일 열기 (Directory Traversal 방지)]
+ * 해커가 "GET /../../etc/passwd" 같은 요청을 보내 서버의 중요 파일을 훔치려 할 수 있습니다.
+ * - 웹 루트("./www")는 main에서 한 번만 절대 경로를 구하고 디렉토리 fd로 열어 둡니다.
+ * - openat2(웹 루트 fd, "sub/a.txt", RESOLVE_BENEATH): 커널이 경로를 따라가다가 ".."이나
+ *   심볼릭 링크로 웹 루트 밖으로 나가려 하면 EXDEV로 거부합니다. 검사와 open이 한 번에 일어나므로
+ *   요청마다 realpath로 경로를 두 번 걷지 않아도 되고, 검사와 open 사이에 링크를 바꿔치는 공격도 막힘
+ * - 리눅스 5.6 미만이라 openat2가 없으면(ENOSYS) 예전처럼 realpath 결과가 웹 루트로 시작하는지 검사
+ * ======================================================================================
+ */
+static char www_root[PATH_MAX]; // 웹 서버 루트 폴더("./www")의 절대 경로
+static size_t www_root_len;
+static int www_fd = -1;         // 웹 루트 디렉토리 fd (openat2의 기준)
+static int use_openat2 = 1;
+
+/* [함수: 파일 열기] 성공하면 fd, 실패하면 -1 (errno가 EXDEV면 웹 루트 밖 -> 403, 그 외는 404) */
+int docroot_open(const char* url_path) {
+    while (*url_path == '/') url_path++; // 상대 경로로 (절대 경로는 RESOLVE_BENEATH가 거부함)
+    if (use_openat2) {
+        struct open_how how = { .flags = O_RDONLY, .resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS };
+        int fd = syscall(SYS_openat2, www_fd, *url_path ? url_path : ".", &how, sizeof(how));
+        if (fd >= 0 || errno != ENOSYS) return fd;
+        use_openat2 = 0;
+    }
+    char full_path[PATH_MAX + 300], resolved_path[PATH_MAX];
+    snprintf(full_path, sizeof(full_path), "%s/%s", www_root, url_path);
+    // realpath는 상대 경로(..)와 심볼릭 링크를 모두 해석함 (파일이 없으면 NULL -> 아래 open에서 404)
+    // "/www2"처럼 이름만 겹치는 이웃 디렉토리를 통과시키지 않도록 바로 뒤가 '/'인지도 확인
+    if (realpath(full_path, resolved_path) != NULL &&
+        (strncmp(resolved_path, www_root, www_root_len) != 0 ||
+         (resolved_path[www_root_len] != '/' && resolved_path[www_root_len] != '\0'))) {
+        errno = EXDEV;
+        return -1;
+    }
+    return open(full_path, O_RDONLY);
+}
+
+/* * ======================================================================================
+ * [운영 신호 (재설정 / 무중단 교체 / 종료)]
+ * - SIGHUP : 웹 루트("./www")를 다시 찾아 엽니다. (./www가 심볼릭 링크라면 새 배포본으로 바뀜)
+ * - SIGUSR2: 자기 자신을 다시 exec하고 리슨 소켓을 넘긴 뒤 종료합니다. (연결 거부 없이 바이너리 교체)
+ * - SIGTERM/SIGINT: 지금 처리 중인 연결을 마치고 종료합니다.
+ * 싱글 스레드라 신호 처리기에서는 플래그만 세우고, 실제 작업은 accept 루프가 합니다.
+ * 신호는 평소에 막아(block) 두고 ppoll로 기다리는 동안에만 풉니다. 그래서 요청을 처리하던
+ * read/write/sendfile이 신호에 끊기지 않고, 기다리는 중에 온 신호는 ppoll이 EINTR로 바로 알려 줍니다.
+ * ======================================================================================
+ */
+static volatile sig_atomic_t got_sighup, got_sigusr2, got_sigterm;
+static sigset_t ops_signals; // 위 신호 묶음 (평소에는 막혀 있음)
+
+static void on_signal(int sig) {
+    if (sig == SIGHUP) got_sighup = 1;
+    else if (sig == SIGUSR2) got_sigusr2 = 1;
+    else got_sigterm = 1;
+}
+
+/* [함수: 처리할 신호가 와 있는지] Keep-Alive 연결이 신호 처리를 무한정 미루지 않도록 요청마다 확인 */
+static int ops_signal_pending(void) {
+    sigset_t pending;
+    if (sigpending(&pending) < 0) return 0;
+    return sigismember(&pending, SIGHUP) || sigismember(&pending, SIGUSR2) ||
+           sigismember(&pending, SIGTERM) || sigismember(&pending, SIGINT);
+}
+
+/* [함수: 웹 루트 열기] 실패하면 -1 (그때는 기존 웹 루트를 그대로 씀) */
+static int docroot_load(void) {
+    char path[PATH_MAX];
+    int fd;
+    if (!realpath("./www", path) || (fd = open(path, O_PATH | O_DIRECTORY)) < 0) {
+        perror("./www");
+        return -1;
+    }
+    if (www_fd >= 0) close(www_fd);
+    www_fd = fd;
+    strcpy(www_root, path);
+    www_root_len = strlen(www_root);
+    return 0;
+}
+
+/* * [함수: 새 프로세스로 교체]
+ * 리슨 소켓 fd를 SCM_RIGHTS로 넘기고, 새 프로세스가 "R"을 보낼 때까지 기다립니다.
+ * 성공하면 0 (이 프로세스는 종료하면 됨), 실패하면 -1 (새 프로세스를 죽이고 계속 서비스)
+ * 넘기는 동안에도 리슨 소켓은 열려 있으므로 새 연결은 백로그에 쌓여 있다가 새 프로세스가 받습니다.
+ */
+static int handoff_start(char* argv[], int server_fd) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+        perror("socketpair");
+        return -1;
+    }
+
+    // 새 프로세스의 환경 변수 = 지금 환경 + 소켓 번호 (webserver-mt.c와 같은 방식)
+    // 접근 로그 스레드가 있으므로 fork 뒤 자식에서는 malloc(setenv)을 못 씀 -> 미리 만들어 두고 execvpe
+    // (fork 순간 다른 스레드가 malloc 락을 잡고 있었다면 자식에서는 영원히 안 풀림)
+    extern char** environ;
+    size_t n_env = 0;
+    while (environ[n_env]) n_env++;
+    char** envp = malloc((n_env + 2) * sizeof(char*));
+    char env_fd[64];
+    snprintf(env_fd, sizeof(env_fd), HANDOFF_ENV "=%d", sv[1]);
+    size_t k = 0;
+    for (size_t i = 0; envp && i < n_env; i++)
+        if (strncmp(environ[i], HANDOFF_ENV "=", sizeof(HANDOFF_ENV)) != 0) envp[k++] = environ[i];
+    pid_t pid = -1;
+    if (envp) {
+        envp[k++] = env_fd;
+        envp[k] = NULL;
+        pid = fork();
+    }
+    if (pid == 0) {
+        // 자식: 막아 둔 신호 마스크는 exec 뒤에도 남으므로 풀고, 교체용 소켓만 열린 채로 exec
+        sigprocmask(SIG_UNBLOCK, &ops_signals, NULL);
+        fcntl(sv[1], F_SETFD, 0);
+        execvpe(argv[0], argv, envp);
+        _exit(127);
+    }
+    free(envp);
+    close(sv[1]);
+    if (pid < 0) {
+        perror("fork");
+        close(sv[0]);
+        return -1;
+    }
+
+    // 메시지 = fd 개수(int) + 제어 메시지에 실린 fd
+    int n = 1;
+    char ctrl[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { .iov_base = &n, .iov_len = sizeof(n) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctrl, .msg_controllen = sizeof(ctrl) };
+    struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cm), &server_fd, sizeof(int));
+
+    struct timeval tv = { .tv_sec = HANDOFF_READY_TIMEOUT, .tv_usec = 0 };
+    setsockopt(sv[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char ready = 0;
+    if (sendmsg(sv[0], &msg, 0) < 0 || read(sv[0], &ready, 1) != 1 || ready != 'R') {
+        fprintf(stderr, "handoff: new process %d did not come up, keeping this one\n", (int)pid);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        close(sv[0]);
+        return -1;
+    }
+    close(sv[0]);
+    printf("Handed off to pid %d\n", (int)pid);
+    return 0;
+}
+
+/* [함수: 넘겨받은 리슨 소켓] 교체로 시작한 게 아니면 -1. 받은 뒤 *ready_fd로 준비 신호를 보냄 */
+static int handoff_take(int* ready_fd) {
+    const char* env = getenv(HANDOFF_ENV);
+    *ready_fd = -1;
+    if (!env) return -1;
+    int sock = atoi(env), n, fd = -1;
+    unsetenv(HANDOFF_ENV); // 다음 교체 때 새로 정함
+    char ctrl[CMSG_SPACE(sizeof(int) * 8)];
+    struct iovec iov = { .iov_base = &n, .iov_len = sizeof(n) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctrl, .msg_controllen = sizeof(ctrl) };
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) == sizeof(n)) {
+        struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+        int k = cm && cm->cmsg_type == SCM_RIGHTS ? (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int) : 0;
+        for (int i = 0; i < k; i++) { // 리슨 소켓이 여러 개 오면(webserver-mt.c -R) 첫 번째만 씀
+            int got;
+            memcpy(&got, CMSG_DATA(cm) + i * sizeof(int), sizeof(int));
+            if (fd < 0) fd = got;
+            else close(got);
+        }
+    }
+    if (fd < 0) {
+        fprintf(stderr, "handoff: no listener received\n");
+        close(sock);
+        return -1;
+    }
+    *ready_fd = sock;
+    return fd;
+}
+
+/* * ======================================================================================
+ * [접근 로그 (Access Log)]
+ * 예전에는 요청마다 받은 원문을 통째로 printf했습니다. 사람이 읽기도 어렵고, 표준 출력이 느린 터미널이나
+ * 파이프면 그 printf가 끝날 때까지 다음 요청이 기다렸습니다. (싱글 스레드라 서버 전체가 멈춤)
+ * 지금은 요청마다 한 줄짜리 구조화된 기록을 남깁니다.
+ *   time=2026-10-16T09:30:00.123Z method=GET path="/index.html" status=200 bytes=1234 duration_us=87
+ * - 요청을 처리한 스레드는 고정 크기 기록을 원형 버퍼(링)에 복사만 하고 바로 다음 일로 넘어감
+ *   (쓰는 쪽 하나, 읽는 쪽 하나라서 락 없이 head/tail 원자적 store만으로 충분)
+ * - 로그 스레드가 ACCESS_LOG_FLUSH_MS마다 링을 비우며 줄을 만들고, 모은 만큼을 write 한 번으로 표준 출력에 씀
+ * - 링이 가득 차면(출력이 못 따라감) 기다리지 않고 그 기록을 버림. 버린 수는 종료할 때 알려줌
+ * 그래서 이 파일만 스레드를 씀: gcc -O2 -o webserver webserver.c -pthread
+ * ======================================================================================
+ */
+#define ACCESS_LOG_RING 4096         // 담아 둘 수 있는 기록 수 (2의 거듭제곱)
+#define ACCESS_LOG_FLUSH_MS 100      // 로그 스레드가 링을 비우는 주기
+#define ACCESS_LOG_BATCH (64 * 1024) // write 한 번에 모으는 최대 바이트
+#define ACCESS_LOG_LINE_MAX 512      // 한 줄의 최대 길이 (경로를 이스케이프해도 넘지 않음)
+
+/* [구조체: 응답 요약] serve_request가 채움 (bytes = 헤더 + 본문, 모르면 -1) */
+typedef struct {
+    int status;
+    long long bytes;
+} ResponseLog;
+
+/* [구조체: 기록 하나] 캐시 라인 2개에 딱 맞게 (경로는 잘라서 담음) */
+typedef struct {
+    long long time_ns;     // 응답을 끝낸 시각 (CLOCK_REALTIME)
+    long long duration_ns; // 요청 해석 -> 응답 전송 완료
+    long long bytes;
+    int status;
+    char method[8];        // 없으면 "" (요청 줄을 못 읽은 400 등)
+    char path[92];
+} AccessLogRecord;
+
+static struct {
+    size_t head;          // 다음에 쓸 위치 (요청 처리 스레드만 씀)
+    char pad0[64 - sizeof(size_t)]; // head와 tail을 다른 캐시 라인에 (두 스레드가 라인을 뺏고 뺏기지 않게)
+    size_t tail;          // 다음에 읽을 위치 (로그 스레드만 씀)
+    char pad1[64 - sizeof(size_t)];
+    AccessLogRecord recs[ACCESS_LOG_RING];
+    unsigned long dropped; // 링이 가득 차서 버린 기록 수
+    int stop;              // 종료: 남은 기록을 다 쓰고 끝냄
+    pthread_t tid;
+} access_log;
+
+/* [함수: 단조 증가 시계(나노초)] 처리 시간 측정용 */
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* [함수: 기록 하나 남기기] 절대 기다리지 않음 (가득 찼으면 버리고 세기만 함). req가 NULL이면 요청 줄을 못 읽음 */
+static void access_log_add(const HttpRequest* req, const ResponseLog* res, long long start_ns) {
+    size_t head = access_log.head;
+    if (head - __atomic_load_n(&access_log.tail, __ATOMIC_ACQUIRE) >= ACCESS_LOG_RING) {
+        __atomic_store_n(&access_log.dropped, access_log.dropped + 1, __ATOMIC_RELAXED);
         return;
     }
+    AccessLogRecord* rec = &access_log.recs[head & (ACCESS_LOG_RING - 1)];
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts); // 밀리초 단위로만 남기므로 거친 시계로 충분
+    rec->time_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    rec->duration_ns = monotonic_ns() - start_ns;
+    rec->status = res->status;
+    rec->bytes = res->bytes;
+    size_t mlen = req && req->method_len < sizeof(rec->method) ? req->method_len : 0;
+    size_t plen = req ? req->target_len : 0;
+    if (plen >= sizeof(rec->path)) plen = sizeof(rec->path) - 1;
+    memcpy(rec->method, req ? req->method : "", mlen);
+    rec->method[mlen] = '\0';
+    memcpy(rec->path, req ? req->target : "", plen);
+    rec->path[plen] = '\0';
+    __atomic_store_n(&access_log.head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* [함수: 기록 -> 한 줄] 경로의 따옴표/역슬래시/제어 문자는 이스케이프 (로그 줄을 위조하지 못하게) */
+static size_t access_log_format(char* out, const AccessLogRecord* rec) {
+    time_t sec = rec->time_ns / 1000000000LL;
+    struct tm tm;
+    char stamp[32];
+    gmtime_r(&sec, &tm);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+    char* p = out;
+    p += sprintf(p, "time=%s.%03dZ method=%s path=\"", stamp, (int)(rec->time_ns / 1000000 % 1000),
+                 rec->method[0] ? rec->method : "-");
+    for (const unsigned char* s = (const unsigned char*)rec->path; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            *p++ = '\\';
+            *p++ = *s;
+        } else if (*s < 0x20 || *s >= 0x7f) {
+            p += sprintf(p, "\\x%02x", *s);
+        } else {
+            *p++ = *s;
+        }
+    }
+    p += sprintf(p, "\" status=%d bytes=", rec->status);
+    p += rec->bytes < 0 ? sprintf(p, "-") : sprintf(p, "%lld", rec->bytes);
+    p += sprintf(p, " duration_us=%lld\n", rec->duration_ns / 1000);
+    return p - out;
+}
 
-    buffer[bytes] = '\0'; // C언어 문자열의 끝을 알리는 Null Terminator 추가
-    printf("Received request:\n%s\n", buffer); // 디버깅용 출력
+/* * [함수: 링 비우기]
+ * 기록을 줄로 바꿔 batch에 이어 붙이고, batch가 차거나 링이 비면 write 한 번으로 보냄
+ * 줄로 옮긴 칸은 write가 끝나기 전에 바로 돌려줌
+ */
+static void access_log_drain(char* batch) {
+    size_t head = __atomic_load_n(&access_log.head, __ATOMIC_ACQUIRE);
+    size_t tail = access_log.tail;
+    while (tail != head) {
+        size_t used = 0;
+        while (tail != head && used + ACCESS_LOG_LINE_MAX <= ACCESS_LOG_BATCH) {
+            used += access_log_format(batch + used, &access_log.recs[tail & (ACCESS_LOG_RING - 1)]);
+            tail++;
+        }
+        __atomic_store_n(&access_log.tail, tail, __ATOMIC_RELEASE);
+        // 부분 쓰기면 남은 부분부터 이어서 (실패하면 그 줄들만 잃음)
+        for (size_t off = 0; off < used;) {
+            ssize_t w = write(STDOUT_FILENO, batch + off, used - off);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) break;
+            off += w;
+        }
+    }
+}
 
-    // 2. HTTP 파싱 (Parsing)
+/* [스레드 함수: 로그 쓰기] 주기마다 링을 비움. stop이면 마지막으로 한 번 더 비우고 끝냄 */
+static void* access_log_thread(void* arg) {
+    (void)arg;
+    char* batch = malloc(ACCESS_LOG_BATCH);
+    for (;;) {
+        int stop = __atomic_load_n(&access_log.stop, __ATOMIC_ACQUIRE);
+        access_log_drain(batch);
+        if (stop) break;
+        struct timespec tick = { .tv_sec = 0, .tv_nsec = ACCESS_LOG_FLUSH_MS * 1000000L };
+        nanosleep(&tick, NULL);
+    }
+    free(batch);
+    return NULL;
+}
+
+/* [함수: 로그 스레드 끝내기] 남은 기록까지 쓰고 돌아옴 */
+static void access_log_stop(void) {
+    __atomic_store_n(&access_log.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(access_log.tid, NULL);
+    if (access_log.dropped) fprintf(stderr, "access log: dropped %lu records\n", access_log.dropped);
+}
+
+/* * ======================================================================================
+ * [함수: 요청 하나 처리]
+ * 파서가 나눠 둔 요청 하나(req)를 보고 응답을 보냅니다.
+ * 보낸 응답의 상태 코드와 바이트 수는 *log에 적어 둠 (접근 로그용, 바이트 수를 모르면 -1)
+ * 반환값: 1 = 연결을 유지해도 됨, 0 = 연결을 닫아야 함
+ * ======================================================================================
+ */
+int serve_request(int client_fd, const HttpRequest* req, ResponseLog* log) {
+    // 1. 연결 유지 여부 (요청 헤더의 HTTP 버전과 Connection 헤더로 결정)
+    int keep_alive = http_keep_alive(req);
+
+    // 2. 요청 경로 꺼내기
     // HTTP 요청의 첫 줄은 보통 "GET /index.html HTTP/1.1" 형태입니다.
-    char method[8], path[256];
-    // sscanf: 문자열에서 형식을 지정해 데이터를 추출. 첫 번째 단어(Method)와 두 번째 단어(Path)만 가져옴.
-    sscanf(buffer, "%s %s", method, path);
+    // 파서는 버퍼 안의 위치와 길이만 알려주므로 '\0'으로 끝나는 사본을 만들어 파일 경로로 씀
+    char path[256];
+    if (req->target_len >= sizeof(path)) {
+        *log = (ResponseLog){ 414, send_simple_response(client_fd, "414 URI Too Long", "", 0) };
+        return 0;
+    }
+    memcpy(path, req->target, req->target_len);
+    path[req->target_len] = '\0';
 
     // 3. 메소드 검사 (GET 방식만 허용)
-    if (strcmp(method, "GET") != 0) {
+    if (!http_method_is(req, "GET")) {
         // 405 Method Not Allowed: GET 이외의 요청(POST, PUT 등)은 거절
-        const char* error = "HTTP/1.1 405 Method Not Allowed\r\n\r\n";
-        write(client_fd, error, strlen(error));
-        close(client_fd);
-        return;
+        // 뒤따라오는 본문을 읽지 않으므로 연결을 끊어서 다음 요청과 섞이지 않게 함
+        *log = (ResponseLog){ 405, send_simple_response(client_fd, "405 Method Not Allowed", "", 0) };
+        return 0;
     }
 
     // 4. 기본 경로 처리
@@ -66,70 +486,275 @@ void handle_request(int client_fd) {
         strcpy(path, "/index.html");
     }
 
-    // 5. 로컬 파일 경로 완성
-    // 웹 루트 디렉토리("./www")와 요청 경로(path)를 합침
-    char full_path[512];
-    snprintf(full_path, sizeof(full_path), "./www%s", path);
+    // 5. 파일 열기 (File Open) - 웹 루트 밖을 가리키면 403 Forbidden
+    int file_fd = docroot_open(path);
+    if (file_fd < 0 && errno == EXDEV) {
+        *log = (ResponseLog){ 403, send_simple_response(client_fd, "403 Forbidden", "<h1>403 Forbidden</h1>\n",
+                                                        keep_alive) };
+        return keep_alive;
+    }
+    struct stat st;
+    if (file_fd >= 0 && (fstat(file_fd, &st) < 0 || S_ISDIR(st.st_mode))) {
+        close(file_fd); // 디렉토리는 보낼 수 없으므로 없는 파일 취급
+        file_fd = -1;
+    }
+    if (file_fd < 0) {
+        // 파일 열기 실패 -> 404 Not Found
+        *log = (ResponseLog){ 404, send_simple_response(client_fd, "404 Not Found", "<h1>404 Not Found</h1>\n",
+                                                        keep_alive) };
+        return keep_alive;
+    }
+
+    // 6-1. 미리 압축된 형제 파일 (Content Negotiation)
+    // 클라이언트가 Accept-Encoding으로 br/gzip을 받겠다고 하고, index.html.br / index.html.gz 가
+    // 원본보다 새것으로 있으면 원본 대신 그걸 보냅니다. (br이 gzip보다 작으므로 먼저 찾음)
+    // 이 서버는 압축본을 담아 둘 캐시가 없으므로 요청마다 직접 압축하지는 않습니다.
+    // Range 요청은 원본 바이트 기준으로만 처리 (압축본의 일부를 잘라 주면 클라이언트가 풀 수 없음)
+    char extra[96] = "";
+    const char* enc = NULL; // 보낼 압축 방식 (NULL = 원본)
+    if (S_ISREG(st.st_mode) && is_compressible(path)) {
+        strcpy(extra, "Vary: Accept-Encoding\r\n"); // 프록시가 압축본/원본을 섞어서 주지 않도록
+        int accepted = http_find_header(req, "Range") ? 0 : http_accept_encoding(req);
+        static const struct { int bit; const char* name; const char* suffix; } encs[] = {
+            { HTTP_ENC_BR, "br", ".br" }, { HTTP_ENC_GZIP, "gzip", ".gz" },
+        };
+        for (int i = 0; i < 2; i++) {
+            if (!(accepted & encs[i].bit)) continue;
+            char sib_path[sizeof(path) + 4];
+            snprintf(sib_path, sizeof(sib_path), "%s%s", path, encs[i].suffix);
+            // 형제 파일도 웹 루트 밖을 가리키는 심볼릭 링크일 수 있으므로 같은 검사를 거침
+            int sib_fd = docroot_open(sib_path);
+            struct stat sib_st;
+            if (sib_fd < 0) continue;
+            if (fstat(sib_fd, &sib_st) < 0 || !S_ISREG(sib_st.st_mode) ||
+                sib_st.st_mtim.tv_sec < st.st_mtim.tv_sec) { // 원본보다 오래된 압축본은 무시
+                close(sib_fd);
+                continue;
+            }
+            close(file_fd);
+            file_fd = sib_fd;
+            st = sib_st;
+            snprintf(extra, sizeof(extra), "Content-Encoding: %s\r\nVary: Accept-Encoding\r\n", encs[i].name);
+            enc = encs[i].name;
+            break;
+        }
+    }
+
+    // 파이프 등은 길이도 수정 시각도 의미가 없으므로 검증자/Range 없이 그대로 흘려보냄
+    // "연결 종료 = 본문 끝"으로 알려줄 수밖에 없음
+    if (!S_ISREG(st.st_mode)) {
+        const char* header = "HTTP/1.1 200 OK\r\nConnection: close\r\n\r\n";
+        send(client_fd, header, strlen(header), MSG_MORE);
+        send_file_body(client_fd, file_fd, &st);
+        close(file_fd);
+        *log = (ResponseLog){ 200, -1 }; // 길이를 미리 모름
+        return 0;
+    }
 
     /* * ==================================================================================
-     * [보안 핵심: Directory Traversal 방지]
-     * 해커가 "GET /../../etc/passwd" 같은 요청을 보내 서버의 중요 파일을 훔치려 할 수 있습니다.
-     * realpath() 함수를 사용하여 상대 경로(..)를 모두 절대 경로로 변환한 뒤 검사해야 합니다.
+     * [조건부 요청 (304)]
+     * ETag: fstat 결과(inode, 크기, 나노초 수정 시각)로 만든 버전 표시. 압축본이면 인코딩 이름을 붙여 구분.
+     * 클라이언트가 가진 버전(If-None-Match / If-Modified-Since)과 같으면 본문 없이 304만 보냅니다.
      * ==================================================================================
      */
-    char resolved_path[PATH_MAX]; // 요청한 파일의 실제 절대 경로
-    char www_root[PATH_MAX];      // 웹 서버 루트 폴더("./www")의 절대 경로
-    
-    // 1. 우리 서버의 루트 폴더("./www")가 실제 디스크 어디에 있는지 절대 경로를 구함
-    realpath("./www", www_root);
-    
-    // 2. 요청한 파일의 절대 경로를 구함 (파일이 존재하지 않으면 NULL 반환)
-    if (realpath(full_path, resolved_path) != NULL) {
-        
-        // 3. 요청한 파일의 경로가 웹 루트 경로로 시작하는지 확인 (Prefix Check)
-        // 만약 resolved_path가 /etc/passwd 라면 www_root(/home/user/project/www)와 다르므로 차단됨.
-        if (strncmp(resolved_path, www_root, strlen(www_root)) != 0) {
-            // 403 Forbidden: 접근 권한 없음
-            const char* forbidden = 
-                "HTTP/1.1 403 Forbidden\r\n\r\n"
-                "<h1>403 Forbidden</h1>\n";
-            write(client_fd, forbidden, strlen(forbidden));
-            close(client_fd);
-            return;
-        }
-    } 
-    // realpath가 NULL이면 파일이 없다는 뜻이므로 아래 open에서 처리됨
-
-    
+    char etag[64], last_modified[HTTP_DATE_LEN], header[512];
+    int header_len;
+    snprintf(etag, sizeof(etag), "\"%llx-%llx-%llx%s%s\"", (unsigned long long)st.st_ino,
+             (unsigned long long)st.st_size,
+             (unsigned long long)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec,
+             enc ? "-" : "", enc ? enc : "");
+    http_format_date(st.st_mtime, last_modified);
+    if (http_not_modified(req, etag, st.st_mtime)) {
+        header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.1 304 Not Modified\r\nETag: %s\r\nLast-Modified: %s\r\n%sConnection: %s\r\n\r\n",
+                              etag, last_modified, enc ? "Vary: Accept-Encoding\r\n" : extra,
+                              keep_alive ? "keep-alive" : "close");
+        send(client_fd, header, header_len, 0);
+        close(file_fd);
+        *log = (ResponseLog){ 304, header_len };
+        return keep_alive;
+    }
 
-    // 6. 파일 열기 (File Open)
-    int file_fd = open(full_path, O_RDONLY);
-    if (file_fd < 0) {
-        // 파일 열기 실패 -> 404 Not Found
-        const char* not_found =
-            "HTTP/1.1 404 Not Found\r\n\r\n"
-            "<h1>404 Not Found</h1>\n";
-        write(client_fd, not_found, strlen(not_found));
-        close(client_fd);
-        return;
+    /* * ==================================================================================
+     * [Range 요청 (206)]
+     * 이어받기나 동영상 탐색은 파일의 일부만 요청합니다. sendfile에 시작 위치만 바꿔 주면 되므로
+     * 구간 전송도 그대로 Zero-Copy입니다. 구간이 여러 개면 multipart/byteranges로 구간마다
+     * 구분자와 Content-Range를 끼워 넣습니다.
+     * ==================================================================================
+     */
+    HttpRange ranges[HTTP_MAX_RANGES];
+    int nranges = enc ? 0 : http_parse_range(req, st.st_size, etag, st.st_mtime, ranges);
+    if (nranges < 0) { // 파일 밖의 구간만 요청함
+        header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%lld\r\n"
+                              "Content-Length: 0\r\nConnection: %s\r\n\r\n",
+                              (long long)st.st_size, keep_alive ? "keep-alive" : "close");
+        send(client_fd, header, header_len, 0);
+        close(file_fd);
+        *log = (ResponseLog){ 416, header_len };
+        return keep_alive;
+    }
+    if (nranges > 1) {
+        // 구간 헤더들을 미리 만들어 전체 길이(Content-Length)를 계산
+        char parts[HTTP_MAX_RANGES + 1][128];
+        int part_len[HTTP_MAX_RANGES + 1];
+        long long total = 0;
+        for (int i = 0; i <= nranges; i++) {
+            if (i == nranges)
+                part_len[i] = snprintf(parts[i], sizeof(parts[i]), "\r\n--" BYTERANGES_BOUNDARY "--\r\n");
+            else
+                part_len[i] = snprintf(parts[i], sizeof(parts[i]),
+                                       "%s--" BYTERANGES_BOUNDARY "\r\nContent-Range: bytes %lld-%lld/%lld\r\n\r\n",
+                                       i ? "\r\n" : "", ranges[i].start, ranges[i].end, (long long)st.st_size);
+            total += part_len[i] + (i < nranges ? ranges[i].end - ranges[i].start + 1 : 0);
+        }
+        header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.1 206 Partial Content\r\nContent-Type: multipart/byteranges; boundary="
+                              BYTERANGES_BOUNDARY "\r\nContent-Length: %lld\r\nETag: %s\r\nLast-Modified: %s\r\n"
+                              "%sConnection: %s\r\n\r\n",
+                              total, etag, last_modified, extra, keep_alive ? "keep-alive" : "close");
+        send(client_fd, header, header_len, MSG_MORE);
+        int ok = 1;
+        for (int i = 0; i < nranges && ok; i++) {
+            send(client_fd, parts[i], part_len[i], MSG_MORE);
+            ok = send_file_range(client_fd, file_fd, ranges[i].start, ranges[i].end - ranges[i].start + 1) == 0;
+        }
+        if (ok) send(client_fd, parts[nranges], part_len[nranges], 0); // 마지막 조각은 바로 내보냄
+        close(file_fd);
+        *log = (ResponseLog){ 206, ok ? header_len + total : -1 };
+        return ok && keep_alive;
     }
 
-    // 7. HTTP 헤더 전송 (200 OK)
+    // 7. HTTP 헤더 전송 (200 OK, 구간 1개면 206)
     // "\r\n\r\n"은 헤더의 끝을 알리는 필수 마커입니다.
-    const char* header = "HTTP/1.1 200 OK\r\n\r\n";
-    write(client_fd, header, strlen(header));
+    // 크기를 알고 있으니 Content-Length를 붙여서 연결을 재사용할 수 있게 함.
+    off_t offset = nranges ? ranges[0].start : 0;
+    off_t length = nranges ? ranges[0].end - ranges[0].start + 1 : st.st_size;
+    char range_line[96] = "";
+    if (nranges)
+        snprintf(range_line, sizeof(range_line), "Content-Range: bytes %lld-%lld/%lld\r\n", ranges[0].start,
+                 ranges[0].end, (long long)st.st_size);
+    header_len = snprintf(header, sizeof(header),
+                          "HTTP/1.1 %s\r\nContent-Length: %lld\r\n%sETag: %s\r\nLast-Modified: %s\r\n%s%s"
+                          "Connection: %s\r\n\r\n",
+                          nranges ? "206 Partial Content" : "200 OK", (long long)length, range_line, etag,
+                          last_modified, enc ? "" : "Accept-Ranges: bytes\r\n", extra,
+                          keep_alive ? "keep-alive" : "close");
+    // MSG_MORE: "곧 본문이 이어진다"고 커널에 알려 헤더만 담긴 작은 패킷이 따로 나가지 않게 함
+    // (작은 패킷 + Nagle + Delayed ACK가 겹치면 Keep-Alive 요청마다 40ms씩 멈출 수 있음)
+    send(client_fd, header, header_len, length > 0 ? MSG_MORE : 0); // 빈 파일이면 뒤따를 데이터가 없음
 
     // 8. 파일 내용 전송 (File Transfer)
-    // 파일을 조금씩 읽어서(read) 소켓에 씁니다(write).
-    char file_buf[BUF_SIZE];
-    int n;
-    while ((n = read(file_fd, file_buf, BUF_SIZE)) > 0) {
-        write(client_fd, file_buf, n); // 소켓으로 데이터 발사
-    }
+    // 유저 공간 버퍼를 거치지 않고 커널이 파일 -> 소켓으로 바로 보냅니다(sendfile).
+    // 본문을 끝까지 못 보냈다면 응답 경계가 깨졌으므로 연결을 재사용할 수 없음.
+    int sent = send_file_range(client_fd, file_fd, offset, length) == 0;
+    if (!sent) keep_alive = 0;
+    *log = (ResponseLog){ nranges ? 206 : 200, sent ? header_len + length : -1 };
 
     // 9. 정리 (Clean up)
     close(file_fd);   // 파일 닫기
-    close(client_fd); // 클라이언트 연결 끊기 (HTTP/1.0 스타일 - 비지속 연결)
+    return keep_alive;
+}
+
+/* * [함수: 요청 본문 읽어서 버리기]
+ * 정적 파일 서버라 본문은 쓰지 않지만, 끝까지 읽어서 버리지 않으면 본문 안에 숨긴 요청이
+ * 파이프라이닝된 다음 요청으로 실행됨 (Request Smuggling)
+ * 본문은 buffer[hdr_len, *len) 부터 도착함. 헤더(req가 가리키는 곳)는 그대로 두고 본문 바이트만 빼냄
+ * 반환값: 0 = 다 버림, HTTP_PARSE_ERROR = 잘못된 본문(400), BODY_TOO_LARGE(413), BODY_EOF = 연결 끊김/시간 초과
+ */
+#define BODY_TOO_LARGE -3
+#define BODY_EOF -4
+static int discard_body(int client_fd, HttpBody* b, char* buffer, size_t size, size_t hdr_len, size_t* len) {
+    if (!b->chunked && b->remain > MAX_REQUEST_BODY) return BODY_TOO_LARGE; // 받기 전에 거절
+    size_t total = 0;
+    for (;;) {
+        size_t out;
+        long used = http_body_decode(b, buffer + hdr_len, *len - hdr_len, &out);
+        if (used < 0) return HTTP_PARSE_ERROR;
+        memmove(buffer + hdr_len, buffer + hdr_len + used, *len - hdr_len - used);
+        *len -= used;
+        total += out;
+        if (total > MAX_REQUEST_BODY) return BODY_TOO_LARGE;
+        if (http_body_done(b)) return 0;
+        if (*len == size) return HTTP_PARSE_ERROR; // chunk 길이 줄이 버퍼에 안 들어감
+        ssize_t bytes = read(client_fd, buffer + *len, size - *len);
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) return BODY_EOF;
+        *len += bytes;
+    }
+}
+
+/* * ======================================================================================
+ * [함수: HTTP 연결 처리]
+ * 클라이언트(웹 브라우저)와 연결된 소켓(client_fd)을 통해 요청을 읽고 응답을 보냅니다.
+ * HTTP/1.1 Keep-Alive: 응답 후에도 연결을 닫지 않고 다음 요청을 기다립니다.
+ * 파이프라이닝: 클라이언트가 여러 요청을 한꺼번에 보내면 버퍼에 남겨뒀다가 도착 순서대로 처리합니다.
+ * 주의: 싱글 스레드 서버라 연결 하나를 붙잡고 있는 동안 다른 연결은 accept되지 못합니다.
+ *       그래서 유휴 타임아웃(KEEPALIVE_TIMEOUT)을 짧게 둡니다.
+ * ======================================================================================
+ */
+void handle_request(int client_fd) {
+    char buffer[BUF_SIZE];
+    size_t len = 0; // 버퍼에 쌓여 있는 바이트 수
+
+    // 유휴 타임아웃: SO_RCVTIMEO를 걸어두면 그 시간 동안 데이터가 안 올 때 read가 실패(EAGAIN)함
+    struct timeval tv = { .tv_sec = KEEPALIVE_TIMEOUT, .tv_usec = 0 };
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    int keep_alive = 1;
+    while (keep_alive) {
+        // 1. 요청 읽기 (Read Request)
+        // 빈 줄까지 온전히 도착할 때까지 읽습니다. (TCP는 요청을 여러 조각으로 나눠 보낼 수 있음)
+        // read는 블로킹 함수라 데이터가 올 때까지 대기할 수 있습니다.
+        // 파서는 증분 방식이라 더 읽은 뒤 다시 불러도 이미 검사한 바이트는 건너뜁니다.
+        HttpRequest req;
+        http_parser_init(&req);
+        int req_len;
+        while ((req_len = http_parse(&req, buffer, len)) == HTTP_PARSE_INCOMPLETE) {
+            if (len == sizeof(buffer)) { // 헤더가 버퍼보다 큼
+                ResponseLog log = { 431, send_simple_response(client_fd, "431 Request Header Fields Too Large", "", 0) };
+                access_log_add(NULL, &log, monotonic_ns());
+                goto out;
+            }
+            ssize_t bytes = read(client_fd, buffer + len, sizeof(buffer) - len);
+            if (bytes < 0 && errno == EINTR) continue;
+            if (bytes <= 0) goto out; // 0이면 연결 종료(EOF), 음수면 에러 또는 유휴 시간 초과
+            len += bytes;
+        }
+        long long start = monotonic_ns();
+        if (req_len == HTTP_PARSE_ERROR) { // 문법이 틀린 요청
+            ResponseLog log = { 400, send_simple_response(client_fd, "400 Bad Request", "", 0) };
+            access_log_add(NULL, &log, start);
+            goto out;
+        }
+
+        // 본문이 딸려 왔으면(Content-Length / chunked) 다음 요청으로 착각하지 않게 먼저 읽어서 버림
+        // 길이 정보가 이상하면(둘 다 있음, 숫자가 아님 등) 본문 끝을 알 수 없으므로 400 후 연결 종료
+        HttpBody body;
+        int has_body = http_body_init(&body, &req);
+        if (has_body > 0) has_body = discard_body(client_fd, &body, buffer, sizeof(buffer), req_len, &len);
+        if (has_body == BODY_EOF) goto out;
+        if (has_body == HTTP_PARSE_ERROR || has_body == BODY_TOO_LARGE) {
+            const char* status = has_body == BODY_TOO_LARGE ? "413 Content Too Large" : "400 Bad Request";
+            ResponseLog log = { has_body == BODY_TOO_LARGE ? 413 : 400, send_simple_response(client_fd, status, "", 0) };
+            access_log_add(&req, &log, start);
+            goto out;
+        }
+
+        // 2. 요청 하나 처리
+        // 파서가 돌려준 길이(req_len)까지가 이번 요청(본문은 이미 빠짐), 그 뒤는 파이프라이닝된 다음 요청입니다.
+        ResponseLog log;
+        keep_alive = serve_request(client_fd, &req, &log);
+        access_log_add(&req, &log, start);
+        if (ops_signal_pending()) keep_alive = 0; // 재설정/교체/종료를 기다리는 중이면 이 응답까지만
+
+        // 3. 처리한 요청을 버퍼에서 제거 (남은 파이프라이닝 요청을 앞으로 당김)
+        memmove(buffer, buffer + req_len, len - req_len);
+        len -= req_len;
+    }
+
+out:
+    close(client_fd); // 클라이언트 연결 끊기
 }
 
 /* * ======================================================================================
@@ -137,54 +762,114 @@ void handle_request(int client_fd) {
  * 서버 소켓을 생성하고, 연결을 기다리는(Listen) 무한 루프를 돕니다.
  * ======================================================================================
  */
-int main() {
+int main(int argc, char* argv[]) {
+    (void)argc;
     int server_fd, client_fd;
     struct sockaddr_in server_addr, client_addr; // IPv4 주소 구조체
     socklen_t client_len = sizeof(client_addr);
 
+    // 접근 로그는 로그 스레드가 표준 출력(fd 1)에 직접 write로 씀
+    // printf의 줄과 순서가 뒤섞이지 않도록 stdio 버퍼는 줄 단위로 바로 내보냄 (출력하기 전에 정해야 함)
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
     /* 1. 소켓 생성 (Socket Creation)
      * - AF_INET: IPv4 인터넷 프로토콜 사용
      * - SOCK_STREAM: TCP 프로토콜 사용 (연결 지향형, 신뢰성 보장)
      */
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    
-    /* 2. 소켓 옵션 설정 (SO_REUSEADDR) - ★면접 단골 질문★
-     * 서버를 껐다 바로 다시 킬 때, "Address already in use" 에러를 방지합니다.
-     * TCP는 연결 종료 후 잠시 'TIME_WAIT' 상태로 포트를 점유하는데, 이를 무시하고 재사용하게 해줍니다.
-     */
-    int opt = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-    /* 3. 주소 구조체 초기화 */
-    server_addr.sin_family = AF_INET;
-    // htons (Host TO Network Short): 내 컴퓨터의 바이트 순서(Little Endian)를 네트워크 표준(Big Endian)으로 변환
-    server_addr.sin_port = htons(PORT); 
-    // INADDR_ANY: 내 컴퓨터에 랜카드가 여러 개일 때, 어느 IP로 들어오든 다 처리하겠다 (0.0.0.0)
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-
-    /* 4. 바인딩 (Binding)
-     * 소켓(전화기)에 전화번호(IP, Port)를 할당하는 과정입니다.
-     */
-    bind(server_fd, (struct sockaddr*)&server_addr, sizeof(server_addr));
+    // 무중단 교체(SIGUSR2)로 시작했다면 이전 프로세스의 리슨 소켓을 그대로 받아 씀 (2~5단계 생략)
+    int ready_fd;
+    server_fd = handoff_take(&ready_fd);
+    if (server_fd < 0) {
+        // SOCK_CLOEXEC: 교체 때는 SCM_RIGHTS로 따로 넘기므로 exec되는 새 프로세스에 물려주지 않음
+        server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        
+        /* 2. 소켓 옵션 설정 (SO_REUSEADDR) - ★면접 단골 질문★
+         * 서버를 껐다 바로 다시 킬 때, "Address already in use" 에러를 방지합니다.
+         * TCP는 연결 종료 후 잠시 'TIME_WAIT' 상태로 포트를 점유하는데, 이를 무시하고 재사용하게 해줍니다.
+         */
+        int opt = 1;
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 
-    
+        /* 3. 주소 구조체 초기화 */
+        server_addr.sin_family = AF_INET;
+        // htons (Host TO Network Short): 내 컴퓨터의 바이트 순서(Little Endian)를 네트워크 표준(Big Endian)으로 변환
+        server_addr.sin_port = htons(PORT); 
+        // INADDR_ANY: 내 컴퓨터에 랜카드가 여러 개일 때, 어느 IP로 들어오든 다 처리하겠다 (0.0.0.0)
+        server_addr.sin_addr.s_addr = INADDR_ANY;
 
-    /* 5. 리슨 (Listening)
-     * 연결 요청을 받을 준비를 합니다. 
-     * 5는 'Backlog Queue' 크기로, 동시에 연결 요청이 몰릴 때 대기시킬 수 있는 최대 수입니다.
-     */
-    listen(server_fd, 5);
+        /* 4. 바인딩 (Binding)
+         * 소켓(전화기)에 전화번호(IP, Port)를 할당하는 과정입니다.
+         */
+        bind(server_fd, (struct sockaddr*)&server_addr, sizeof(server_addr));
+
+        
+
+        /* 5. 리슨 (Listening)
+         * 연결 요청을 받을 준비를 합니다. 
+         * 5는 'Backlog Queue' 크기로, 동시에 연결 요청이 몰릴 때 대기시킬 수 있는 최대 수입니다.
+         */
+        listen(server_fd, 5);
+    }
+
+    // 웹 루트는 한 번만 찾아서 열어 둠 (요청마다 realpath("./www")를 다시 하지 않음, SIGHUP 때만 다시)
+    if (docroot_load() < 0) exit(1);
+
+    // 운영 신호: 처리기는 플래그만 세우고, 신호는 ppoll로 기다릴 때만 받음
+    // SIGPIPE: 응답 도중 클라이언트가 끊으면 write가 프로세스를 죽이지 않고 EPIPE로 실패하게 함
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigemptyset(&sa.sa_mask);
+    sigemptyset(&ops_signals);
+    int ops[] = { SIGHUP, SIGUSR2, SIGTERM, SIGINT };
+    for (int i = 0; i < 4; i++) {
+        sigaction(ops[i], &sa, NULL);
+        sigaddset(&ops_signals, ops[i]);
+    }
+    sigset_t wait_mask; // ppoll 동안만 쓰는 마스크 = 원래 마스크 (막아 둔 신호가 풀림)
+    sigprocmask(SIG_BLOCK, &ops_signals, &wait_mask);
+
+    // 리슨 소켓은 논블로킹: ppoll이 "연결 있음"이라 해도 교체 중인 다른 프로세스가 먼저 가져갈 수 있음
+    // (accept로 받은 소켓은 이 플래그를 물려받지 않으므로 요청 처리는 그대로 블로킹)
+    fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL) | O_NONBLOCK);
+
+    if (ready_fd >= 0) {
+        printf("Took over listener from pid %d\n", (int)getppid());
+        if (write(ready_fd, "R", 1) != 1) perror("handoff");
+        close(ready_fd);
+    }
     printf("Simple Web Server running at http://localhost:%d\n", PORT);
 
+    // 접근 로그 쓰기 스레드 (운영 신호를 막아 둔 마스크를 물려받으므로 신호는 계속 이 스레드의 ppoll이 받음)
+    pthread_create(&access_log.tid, NULL, access_log_thread, NULL);
+
     /* 6. 연결 수락 루프 (Accept Loop) */
     while (1) {
-        // accept: 클라이언트가 연결할 때까지 여기서 프로그램이 멈춰있습니다(Blocking).
-        // 연결되면 새로운 소켓 파일 디스크립터(client_fd)를 반환합니다.
+        // 연결이나 신호가 올 때까지 여기서 멈춰 있습니다(Blocking).
+        // ppoll은 기다리는 동안만 신호 마스크를 wait_mask로 바꿔 주므로, "신호 확인 -> 대기" 사이에
+        // 신호가 와서 놓치는 일이 없습니다. (sigprocmask + poll로 나눠 부르면 그 틈에 놓칠 수 있음)
+        struct pollfd pfd = { .fd = server_fd, .events = POLLIN };
+        if (ppoll(&pfd, 1, NULL, &wait_mask) < 0 && errno != EINTR) {
+            perror("ppoll");
+            continue;
+        }
+
+        if (got_sighup) {
+            got_sighup = 0;
+            if (docroot_load() == 0) printf("Reloaded web root: %s\n", www_root);
+        }
+        if (got_sigusr2) {
+            got_sigusr2 = 0;
+            if (handoff_start(argv, server_fd) == 0) break;
+        }
+        if (got_sigterm) break; // 싱글 스레드라 여기 왔다면 처리 중인 연결이 없음 -> 드레인할 것이 없음
+
+        // accept: 대기열에서 연결 하나를 꺼내고, 새로운 소켓 파일 디스크립터(client_fd)를 반환합니다.
         // server_fd는 '연결 대기용', client_fd는 '실제 통신용'입니다.
-        client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
+        // accept4(SOCK_CLOEXEC): 교체로 exec되는 새 프로세스가 클라이언트 소켓을 물려받지 않게
+        client_fd = accept4(server_fd, (struct sockaddr*)&client_addr, &client_len, SOCK_CLOEXEC);
         
         if (client_fd < 0) {
-            perror("accept");
+            if (errno != EAGAIN && errno != EINTR) perror("accept");
             continue;
         }
         
@@ -192,6 +877,8 @@ int main() {
         handle_request(client_fd);
     }
 
-    close(server_fd); // 서버 소켓 닫기 (사실 무한루프라 여기까지 안 옴)
+    close(server_fd); // 서버 소켓 닫기 (교체했다면 새 프로세스가 같은 소켓을 계속 열어 두고 있음)
+    access_log_stop();
+    printf("Exiting\n");
     return 0;
-}
\ No newline at end of file
+}